@@ -7,6 +7,14 @@ if size(y,2)~=1
     y = transpose(y);
 end
 
-ll = -1/2*transpose(y)*inv(K)*y +...
-     -1/2*log(det(K)) +...
+% The Cholesky factor gives both the quadratic form and the log-determinant
+% (det(K) under/overflows for long series)
+[L,notPd] = chol(K,'lower');
+if notPd
+    ll = -Inf;
+    return
+end
+alpha = L\y;
+ll = -1/2*transpose(alpha)*alpha +...
+     -sum(log(diag(L))) +...
      -N/2*log(2*pi);
\ No newline at end of file
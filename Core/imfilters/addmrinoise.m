@@ -1,9 +1,26 @@
-function im = addmrinoise(im,sig)
+function im = addmrinoise(im,sig,seed)
 %addmrinoise  Adds uniform noise to an image
 %
 %   I = addmrinoise(I,SIG) adds zero-mean Gaussian noise with standard deviation
 %   SIG to the image I. Two random variables are generated for each "channel"
 %   and added in quadrature
+%
+%   I = addmrinoise(I,SIG,SEED) uses the seed SEED of the mr_noise MEX file's
+%   counter-based generator, which reproduces the same noise for the same seed
+%   regardless of the number of threads. Without a seed, the seed is drawn from
+%   MATLAB's global random number stream
+
+    % The native generator adds the noise to all voxels on all cores
+    if (exist('mr_noise','file')==3)
+        if (nargin<3)
+            seed = randi(intmax('int32'));
+        end
+        if ~isa(im,'single')
+            im = double(im);
+        end
+        im = mr_noise(im,sig,'Seed',seed);
+        return
+    end
 
     % Determine the image size and create a function handle for generating a
     % random variable
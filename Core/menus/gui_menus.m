@@ -636,8 +636,15 @@ function export_rois_Callback(hObj,eventdata)
         return
     end
 
-    % Export ROIs
-    obj.export(exType,sDir,sel);
+    % Export ROIs. Only NordicICE files are currently supported
+    names = obj.regions('names');
+    switch exType
+        case 'nordicice'
+            obj.export('rois',sDir,'nordicice',names(sel));
+        otherwise
+            errordlg(sprintf('Exporting ROIs as "%s" is not supported.',...
+                                              get(hObj,'Label')),'ROI Export');
+    end
 
 end %export_rois_Callback
 
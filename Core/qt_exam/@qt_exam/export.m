@@ -14,15 +14,20 @@ function export(obj,varargin)
 %       'maps'      Exports all loaded maps as DICOMs. Any filters stored in the
 %                   qt_image object pipeline are applied before writing data.
 %
-%       'rois'      Exports all loaded ROIs
+%       'rois'      Exports all loaded ROIs as NordicICE files (one file per
+%                   ROI and slice). When available, the roi_batch MEX file
+%                   writes all files in a single parallel call
 %
 %
 %   export(...,FORMAT) exports the specified qt_exam object data using the
 %   output FORMAT, which must be a supported format of the specified data type
 %   (i.e. qt_image or qt_roi).
+%
+%   export(OBJ,'rois',DIR,'nordicice',NAMES) exports only the ROIs with a name
+%   in the cell array NAMES.
 
     % Validate and parse the inputs
-    [dataType,dataFormat,outDir] = parse_inputs(varargin{:});
+    [dataType,dataFormat,names,outDir] = parse_inputs(varargin{:});
 
     % Create a unique directory name within the user-specified directory
     outDir = tempname(outDir);
@@ -70,17 +75,71 @@ function export(obj,varargin)
             end
 
         case 'rois'
+            export_rois(obj,outDir,names);
     end
 
 end %qt_exam.export
 
 
+%-----------------------------------------
+function export_rois(obj,outDir,names)
+
+    % Gather the valid ROIs of all tags and their slice locations
+    [rois,slices] = deal(cell(0,1));
+    for tag = fieldnames(obj.rois)'
+        rs      = obj.rois.(tag{1});
+        isValid = reshape(rs(:).validaterois,[],1);
+        if ~isempty(names)
+            isValid(isValid) = ismember({rs(isValid).name},names);
+        end
+        [~,slIdx,~,~]   = ind2sub(size(rs),find(isValid));
+        rois{end+1,1}   = reshape(rs(isValid),[],1); %#ok<*AGROW>
+        slices{end+1,1} = slIdx(:);
+    end
+    rois   = vertcat(rois{:});
+    slices = vertcat(slices{:});
+    if isempty(rois)
+        return
+    end
+
+    % Rectangles and ellipses are written from their corners and other ROIs
+    % from their vertices (pixel coordinates)
+    pos = {rois.scaledPosition}';
+    isBox = ismember({rois.type}',{'rect','ellipse'});
+    if (exist('roi_batch','file')==3)
+        pos(isBox) = cellfun(@(p) [p(1:2); p(1:2)+p(3:4)],pos(isBox),...
+                                                         'UniformOutput',false);
+        b = struct('Size',round(rois(1).scale([2 1])),...
+                   'Files',{cell(0,1)},...
+                   'Software',{cell(0,1)},...
+                   'FileIndex',zeros(numel(rois),1),...
+                   'Names',{{rois.name}'},...
+                   'Types',{strcat('im',{rois.type}')},...
+                   'Slices',slices,...
+                   'Vertices',{pos},...
+                   'Runs',{cell(numel(rois),1)});
+        roi_batch('export',b,outDir);
+        return
+    end
+    for rIdx = 1:numel(rois)
+        name = rois(rIdx).name;
+        if isempty(name)
+            name = 'roi';
+        end
+        fName = fullfile(outDir,sprintf('%s_%05d.roi',...
+                                   regexprep(name,'[^\w-]','_'),rIdx));
+        nordicicewrite(fName,pos{rIdx},'medium',['im' rois(rIdx).type]);
+    end
+
+end %export_rois
+
+
 %----------------------------------------------
 function varargout = parse_inputs(varargin)
 
     % Validate the number of inputs
     try
-        narginchk(2,3);
+        narginchk(2,4);
     catch ME
         throwAsCaller(ME);
     end
@@ -90,17 +149,25 @@ function varargout = parse_inputs(varargin)
     parser.KeepUnmatched = true;
     parser.addRequired('dataType',@ischar);
     parser.addRequired('outDir',@(x) (exist(x,'dir')==7));
-    parser.addOptional('format','dicom',@ischar);
+    parser.addOptional('format','',@ischar);
+    parser.addOptional('names',{},@iscellstr);
 
     % Parse the inputs
     parser.parse(varargin{:});
     results = parser.Results;
 
-    % Perform some additional validation
-    %FIXME: the "format" input is only supported for images. This should be
-    %modified to support ROIs as well.
+    % Perform some additional validation. ROIs are only exported as NordicICE
+    % files
     results.dataType = validatestring(results.dataType,{'images','maps','rois'});
-    results.format   = validatestring(results.format,{'dicom','raw'});
+    if strcmpi(results.dataType,'rois')
+        formats = {'nordicice'};
+    else
+        formats = {'dicom','raw'};
+    end
+    if isempty(results.format)
+        results.format = formats{1};
+    end
+    results.format = validatestring(results.format,formats);
 
     % Deal the outpus
     varargout = struct2cell(results);
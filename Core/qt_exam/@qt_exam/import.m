@@ -58,8 +58,13 @@ function varargout = import(varargin)
     % Data import and initial validation
     %------------------------------------
 
-    % Import exam data
-    img = qt_image(pathName,'guiDialogs',guiDlgs);
+    % Import exam data. The native DICOM series loader (dicom_series MEX) reads
+    % and sorts all headers and images on all cores; directories it cannot
+    % fully handle are read by qt_image
+    img = import_dicom_series(pathName);
+    if isempty(img)
+        img = qt_image(pathName,'guiDialogs',guiDlgs);
+    end
     if isempty(img)
         return
     elseif (numel(img)==1) && isempty(img.fileName)
@@ -236,6 +241,41 @@ function varargout = parse_inputs(varargin)
 
 end %parse_inputs
 
+%-------------------------------------------
+function img = import_dicom_series(pathName)
+%import_dicom_series  Imports a single DICOM series using the dicom_series MEX
+
+    % Initialize the output. An empty output signals the caller to use the
+    % qt_image file reader
+    img = qt_image.empty(0,1);
+    if (exist('dicom_series','file')~=3)
+        return
+    end
+
+    % Only the specified directories are searched (see "SEARCHING DIRECTORIES
+    % FOR IMAGES" above). Directories containing multiple series or files that
+    % cannot be decoded (e.g., compressed transfer syntaxes) are left to the
+    % MATLAB reader
+    [s,unsupported] = dicom_series(pathName,'MaxDepth',0);
+    if (numel(s)~=1) || ~isempty(unsupported) || any( cellfun(@isempty,s.FileNames(:)) )
+        return
+    end
+
+    % Convert the "Private" fields to the current DICOM dictionary and create
+    % the qt_image objects in slice-major order (i.e., the order expected by
+    % get_exam_type)
+    hdrs = convert_private_dicom_fields(s.Headers);
+    nImg = numel(s.FileNames);
+    img  = qt_image.empty(0,1);
+    for imIdx = nImg:-1:1
+        [sIdx,fIdx] = ind2sub(size(s.FileNames),imIdx);
+        img(imIdx,1) = qt_image(s.Image(:,:,sIdx,fIdx),...
+                                'metaData',hdrs(imIdx),...
+                                'fileName',s.FileNames{imIdx});
+    end
+
+end %import_dicom_series
+
 %----------------------------------
 function eType = get_exam_type(img)
 %get_exam_type  Attempts to determine exam type
@@ -55,7 +55,9 @@ function varargout = load(varargin)
             fPath          = pwd;
         end
     else
-        [fName,fPath] = uigetfile('*.mat','MAT-files (*.mat)',loadDir);
+        [fName,fPath] = uigetfile({'*.mat;*.qtx',...
+                                   'QUATTRO save files (*.mat, *.qtx)'},...
+                                   'QUATTRO save files',loadDir);
         fExt          = '';
     end
     fName = [fName fExt];
@@ -64,17 +66,24 @@ function varargout = load(varargin)
         return
     end
 
-    % Determines variables in MAT file and loads data
-    [tf,evalStr] = validate_vars( who('-file',fullfile(fPath,fName)) );
-    if any(tf)
+    % Determines variables in MAT file and loads data. Exam containers are read
+    % dataset by dataset, so only the data of the requested type are
+    % decompressed
+    [~,~,fExt] = fileparts(fName);
+    if strcmpi(fExt,'.qtx')
+        s     = read_container(fullfile(fPath,fName),dataType);
+        qtVer = s.version;
+    else
+        [tf,evalStr] = validate_vars( who('-file',fullfile(fPath,fName)) );
+        if ~any(tf)
+            return
+        end
         load(fullfile(fPath,fName));
         eval(evalStr);
         qtVer = 0;
         if isfield(s,'version') %#ok-s is defined by eval(evalStr)
             qtVer = s.version;
         end
-    else
-        return
     end
 
     % Validate data
@@ -510,4 +519,95 @@ function [tf,s] = validate_vars(vars)
         s   = sprintf('s=%s; clear %s',str,str);
     end
 
-end %validate_vars
\ No newline at end of file
+end %validate_vars
+
+
+%------------------------------------------
+function s = read_container(fName,dataType)
+%read_container  Reads a QUATTRO exam container into a save structure
+
+    if (exist('qtx_read','file')~=3)
+        error(['qt_exam:' mfilename ':missingMex'],...
+              'QUATTRO exam containers (*.qtx) require the qtx_read MEX file.');
+    end
+    if ~any( exist('getArrayFromByteStream')==[2 5] ) %#ok
+        error(['qt_exam:' mfilename ':noByteStreams'],...
+              ['QUATTRO exam containers (*.qtx) require the ',...
+               'getArrayFromByteStream built-in of MATLAB.']);
+    end
+
+    % Determine the stored exams
+    info   = qtx_read(fName);
+    names  = {info.Name};
+    exams  = regexp(names,'^exam(\d+)/','tokens','once');
+    exams  = cellfun(@(t) str2double(t{1}),exams(~cellfun(@isempty,exams)));
+    nExams = max([exams 0]);
+    s      = struct('version',double(qtx_read(fName,'version')));
+
+    % Images, headers, exam names and types
+    if any( strcmpi(dataType,{'images','any'}) )
+        [s.imgs,s.hdrs,s.type,s.name] = deal(cell(1,nExams));
+        for exIdx = 1:nExams
+            pre = sprintf('exam%u/',exIdx);
+            if any( strcmp([pre 'hdrs'],names) )
+                hdrs            = getArrayFromByteStream(qtx_read(fName,[pre 'hdrs']));
+                s.imgs{exIdx}   = read_planes(fName,[pre 'imgs'],hdrs.layout);
+                s.hdrs{exIdx}   = hdrs.hdrs;
+            end
+            if any( strcmp([pre 'meta'],names) )
+                meta            = getArrayFromByteStream(qtx_read(fName,[pre 'meta']));
+                s.type{exIdx}   = meta.type;
+                s.name{exIdx}   = meta.name;
+            end
+        end
+    end
+
+    % Parametric maps
+    if any( strcmpi(dataType,{'maps','any'}) )
+        s.maps = cell(1,nExams);
+        for exIdx = 1:nExams
+            mapIdx  = 1;
+            mapName = sprintf('exam%u/maps/%u',exIdx,mapIdx);
+            while any( strcmp([mapName '/hdrs'],names) )
+                hdrs   = getArrayFromByteStream(qtx_read(fName,[mapName '/hdrs']));
+                planes = read_planes(fName,mapName,hdrs.layout);
+                s.maps{exIdx} = [s.maps{exIdx};...
+                               struct('imgs',planes(:)','hdrs',hdrs.hdrs(:)')];
+                mapIdx  = mapIdx+1;
+                mapName = sprintf('exam%u/maps/%u',exIdx,mapIdx);
+            end
+        end
+    end
+
+    % ROIs
+    if any( strcmpi(dataType,{'rois','any'}) )
+        s.rois = cell(1,nExams);
+        for exIdx = 1:nExams
+            pre = sprintf('exam%u/rois/',exIdx);
+            for roiName = names( strncmp(pre,names,numel(pre)) )
+                rois          = getArrayFromByteStream(qtx_read(fName,roiName{1}));
+                s.rois{exIdx} = [s.rois{exIdx} rois];
+            end
+        end
+    end
+
+end %read_container
+
+%----------------------------------------------
+function planes = read_planes(fName,name,layout)
+%read_planes  Converts datasets written by pack_planes (see save) to a cell
+%array of planes
+
+    planes = cell(layout.size);
+    if layout.isStacked && ~all(layout.isEmpty(:))
+        stack = qtx_read(fName,name);
+        for k = reshape(find(~layout.isEmpty),1,[])
+            planes{k} = stack(:,:,k);
+        end
+    elseif ~layout.isStacked
+        for k = reshape(find(~layout.isEmpty),1,[])
+            planes{k} = qtx_read(fName,sprintf('%s/%u',name,k));
+        end
+    end
+
+end %read_planes
@@ -24,6 +24,15 @@ function save(obj,varargin)
 %   save(OBJ,TYPE,FILE) performs the save operation, as defined previously, in
 %   the file specified by the full file name, FILE.
 %
+%   When FILE is a QUATTRO exam container (*.qtx), each image plane, map and
+%   ROI set is stored as an independently compressed dataset (see qtx_write).
+%   Data that did not change since the previous save are not written again,
+%   so saving only the maps or ROIs of an exam rewrites only those that
+%   changed. Containers require the qtx_write MEX file and the (undocumented)
+%   getByteStreamFromArray built-in of MATLAB to serialize the headers and
+%   ROIs; without the latter, the data are saved to a MAT-file of the same
+%   name.
+%
 %   **WARNING** the functionality and output format of this method will change
 %   in the future
 
@@ -34,7 +43,11 @@ function save(obj,varargin)
     % default file name (defined in parse_inputs by the qt_options properties)
     % did not exist or (2) the user selected a save type other than 'save'
     if (exist(fName,'file')~=2) || ~strcmpi(svType,'save')
-        [fName,ok] = qt_uiputfile('*.mat','Save QUATTRO workspace...',fName);
+        filterSpec = {'*.mat','MAT-files (*.mat)'};
+        if (exist('qtx_write','file')==3) && has_byte_streams
+            filterSpec = [{'*.qtx','QUATTRO exam containers (*.qtx)'};filterSpec];
+        end
+        [fName,ok] = qt_uiputfile(filterSpec,'Save QUATTRO workspace...',fName);
         if ~ok
             errordlg('No data were saved.','Save Error','modal');
             return
@@ -75,7 +88,19 @@ function save(obj,varargin)
     end
 
     % Write the final save structure
-    save(fName,'save_data');
+    [fPath,fFile,fExt] = fileparts(fName);
+    if strcmpi(fExt,'.qtx') && ~has_byte_streams
+        fName = fullfile(fPath,[fFile '.mat']);
+        fExt  = '.mat';
+        warning(['qt_exam:' mfilename ':noByteStreams'],...
+                ['QUATTRO exam containers (*.qtx) are not supported by this ',...
+                 'version of MATLAB. The data were saved to %s.'],fName);
+    end
+    if strcmpi(fExt,'.qtx')
+        write_container(fName,save_data);
+    else
+        save(fName,'save_data');
+    end
     delete(h);
     pause(0.25);
 
@@ -248,4 +273,121 @@ function sv = write_map_data(sv,obj)
     % Append the image and meta-data to the save structure
     sv.maps{idx} = struct('imgs',maps,'hdrs',mapHdrs);
 
-end %write_map_data
\ No newline at end of file
+end %write_map_data
+
+
+%------------------------------Exam Container Fcns------------------------------
+
+%-------------------------------------
+function write_container(fName,sv)
+
+    if (exist('qtx_write','file')~=3)
+        error(['qt_exam:' mfilename ':missingMex'],...
+              'QUATTRO exam containers (*.qtx) require the qtx_write MEX file.');
+    end
+
+    % Convert the save structure to dataset name/value pairs. Headers and ROIs
+    % are serialized to byte streams
+    data = {'version',sv.version};
+    for exIdx = 1:max(structfun(@numel,rmfield(sv,'version')))
+        pre = sprintf('exam%u/',exIdx);
+
+        if isfield(sv,'imgs') && ~isempty(sv.imgs{exIdx})
+            [names,vals,layout] = pack_planes([pre 'imgs'],sv.imgs{exIdx});
+            hdrs                = struct('hdrs',sv.hdrs{exIdx},'layout',layout);
+            data = [data reshape([names;vals],1,[]),...
+                    {[pre 'hdrs'],getByteStreamFromArray(hdrs)}]; %#ok
+        end
+        if isfield(sv,'type')
+            meta = struct('type',sv.type{exIdx},'name',sv.name{exIdx});
+            data = [data {[pre 'meta'],getByteStreamFromArray(meta)}]; %#ok
+        end
+        if isfield(sv,'maps') && ~isempty(sv.maps{exIdx})
+            for mapIdx = 1:size(sv.maps{exIdx},1)
+                mapName             = sprintf('%smaps/%u',pre,mapIdx);
+                [names,vals,layout] = pack_planes(mapName,...
+                                                 {sv.maps{exIdx}(mapIdx,:).imgs}');
+                hdrs                = struct('hdrs',...
+                                            {{sv.maps{exIdx}(mapIdx,:).hdrs}},...
+                                            'layout',layout);
+                data = [data reshape([names;vals],1,[]),...
+                        {[mapName '/hdrs'],getByteStreamFromArray(hdrs)}]; %#ok
+            end
+        end
+        if isfield(sv,'rois') && ~isempty(sv.rois{exIdx})
+            tags = {sv.rois{exIdx}.tags};
+            for tag = unique(tags,'stable')
+                rois = sv.rois{exIdx}( strcmp(tags,tag{1}) );
+                data = [data {[pre 'rois/' tag{1}],getByteStreamFromArray(rois)}]; %#ok
+            end
+        end
+    end
+
+    % Remove the stored datasets of the saved data types that are no longer
+    % present (e.g., deleted maps)
+    if (exist(fName,'file')==2)
+        fldPatterns = struct('imgs','imgs|hdrs','type','meta',...
+                             'maps','maps/','rois','rois/');
+        patterns    = {};
+        for fld = fieldnames(fldPatterns)'
+            if isfield(sv,fld{1})
+                patterns{end+1} = fldPatterns.(fld{1}); %#ok
+            end
+        end
+        patterns = sprintf('%s|',patterns{:});
+        info     = qtx_read(fName);
+        names    = {info.Name};
+        isOld    = ~cellfun(@isempty,regexp(names,...
+                            ['^exam\d+/(' patterns(1:end-1) ')'],'once'));
+        isOld    = isOld & ~ismember(names,data(1:2:end));
+        data     = [data reshape([names(isOld);cell(1,sum(isOld))],1,[])];
+    end
+
+    qtx_write(fName,data{:});
+
+end %write_container
+
+%----------------------------------
+function tf = has_byte_streams
+
+    % The headers and ROIs of exam containers are serialized with the
+    % undocumented built-in getByteStreamFromArray, which older versions of
+    % MATLAB do not provide
+    tf = any( exist('getByteStreamFromArray')==[2 5] ); %#ok
+
+end %has_byte_streams
+
+%------------------------------------------------------
+function [names,vals,layout] = pack_planes(name,planes)
+%pack_planes  Converts a cell array of planes to datasets
+%
+%   Equally sized planes of the same class are stored as a single dataset of
+%   size [M N size(PLANES)] (empty planes are zero-filled) so that individual
+%   slices or frames can be read with qtx_read. Otherwise, each plane is stored
+%   in the dataset NAME/K, where K is the linear index of the plane.
+
+    isEmpty = cellfun(@isempty,planes);
+    full    = planes(~isEmpty);
+    layout  = struct('size',size(planes),'isEmpty',isEmpty,'isStacked',true);
+    [names,vals] = deal({});
+    if isempty(full)
+        return
+    end
+
+    sizes   = cellfun(@size,full,'UniformOutput',false);
+    classes = cellfun(@class,full,'UniformOutput',false);
+    if all( cellfun(@(sz) isequal(sz,sizes{1}),sizes) ) &&...
+                         all( strcmp(classes,classes{1}) ) && (numel(sizes{1})==2)
+        stack = full{1}([]); %preserves the class
+        stack(sizes{1}(1),sizes{1}(2),numel(planes)) = 0;
+        stack(:,:,find(~isEmpty)) = cat(3,full{:}); %#ok
+        names = {name};
+        vals  = {reshape(stack,[sizes{1} size(planes)])};
+    else
+        layout.isStacked = false;
+        names            = arrayfun(@(k) sprintf('%s/%u',name,k),...
+                                    reshape(find(~isEmpty),1,[]),'UniformOutput',false);
+        vals             = reshape(full,1,[]);
+    end
+
+end %pack_planes
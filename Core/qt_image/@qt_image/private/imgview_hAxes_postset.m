@@ -36,17 +36,27 @@ function imgview_hAxes_postset(obj,src,eventdata)
     % in true color format
     if viewObj.isRgb && ~isRGB
         nColors = 256;
+        imMap   = eval([obj.color, '(nColors)']);
 
-        % Update the WW/WL by resetting all values above the color limit max to
-        % the max and all values below the minimum to the min
-        img               = double(img);
-        img(img<clims(1)) = clims(1);
-        img(img>clims(2)) = clims(2);
+        % When available, the display engine applies the WW/WL and color map
+        % through a look-up table and provides the alpha data (NaN voxels are
+        % transparent)
+        if (exist('display_cache','file')==3) && ismatrix(img)
+            [img,imAlpha] = display_cache('renderimage',img,double(clims),...
+                                          imMap,'Transparency',obj.transparency);
+        else
 
-        % Normalize the image according to the color limits
-        img   = uint16( nColors*(img-clims(1))/diff(clims) );
-        imMap = eval([obj.color, '(nColors)']);
-        img   = ind2rgb(img,imMap);
+            % Update the WW/WL by resetting all values above the color limit
+            % max to the max and all values below the minimum to the min
+            img               = double(img);
+            img(img<clims(1)) = clims(1);
+            img(img>clims(2)) = clims(2);
+
+            % Normalize the image according to the color limits
+            img   = uint16( nColors*(img-clims(1))/diff(clims) );
+            img   = ind2rgb(img,imMap);
+
+        end
 
     end
 
@@ -101,6 +111,8 @@ function imgview_hAxes_postset(obj,src,eventdata)
     alpha = any( ~isnan(img), 3 );
     if obj.transparency && ~viewObj.isRgb && any(~alpha(:))
         set(viewObj.hImg,'AlphaData',obj.transparency*alpha);
+    elseif exist('imAlpha','var') && obj.transparency && any(imAlpha(:)~=1)
+        set(viewObj.hImg,'AlphaData',double(imAlpha));
     end
 
     % Determine the zoom state
@@ -0,0 +1,167 @@
+/*
+ *	ContentHash.h
+ *
+ *	Fast, non-cryptographic 64-bit hash used to key caches by content
+ *	(e.g., image pixel data, spacing and processing settings). The data
+ *	are consumed in 32 byte stripes by four independent lanes so that
+ *	hashing a volume runs at close to memory bandwidth.
+ */
+
+
+#ifndef CONTENTHASH_H
+#define CONTENTHASH_H
+
+
+/*	C++ headers	*/
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#ifdef _MSC_VER
+typedef unsigned __int64	QtHashType;
+#else
+#include <stdint.h>
+typedef uint64_t			QtHashType;
+#endif
+
+
+class ContentHash{
+
+ public:
+
+	ContentHash(QtHashType seed=0) : nBytes(0), nPending(0)
+	{
+		lane[0] = seed + prime1 + prime2;
+		lane[1] = seed + prime2;
+		lane[2] = seed;
+		lane[3] = seed - prime1;
+	};
+
+	/*
+	 *	Append()
+	 *
+	 *	Adds an arbitrary number of bytes to the hash
+	 */
+	void Append(const void* data, size_t n)
+	{
+		const unsigned char* ptr = static_cast<const unsigned char*>(data);
+		nBytes += n;
+
+		/*	Complete a pending stripe	*/
+		if( nPending ) {
+			const size_t nCopy = (n<32-nPending) ? n : 32-nPending;
+			std::memcpy(pending+nPending, ptr, nCopy);
+			nPending += nCopy;
+			ptr		 += nCopy;
+			n		 -= nCopy;
+			if( nPending<32 ) {
+				return;
+			};
+			Stripe(pending);
+			nPending = 0;
+		};
+
+		/*	Full stripes	*/
+		for(; n>=32; n-=32, ptr+=32) {
+			Stripe(ptr);
+		};
+
+		/*	Remainder	*/
+		if( n ) {
+			std::memcpy(pending, ptr, n);
+			nPending = n;
+		};
+	};
+
+	/*	Convenience overloads for scalar values and strings	*/
+	template <class T>
+	void AppendValue(const T &value) { Append(&value, sizeof(T)); };
+	void AppendString(const std::string &str) { Append(str.data(), str.size()); };
+
+	/*
+	 *	GetValue()
+	 *
+	 *	Returns the hash of all data appended so far
+	 */
+	QtHashType GetValue() const
+	{
+		QtHashType h = Rotate(lane[0],1) + Rotate(lane[1],7) + Rotate(lane[2],12) + Rotate(lane[3],18);
+		for(unsigned int idx=0; idx<4; idx++) {
+			h = (h ^ Round(0,lane[idx]))*prime1 + prime4;
+		};
+		h += static_cast<QtHashType>(nBytes);
+
+		/*	Tail bytes	*/
+		size_t idx = 0;
+		for(; idx+8<=nPending; idx+=8) {
+			QtHashType k;
+			std::memcpy(&k, pending+idx, 8);
+			h = Rotate(h ^ Round(0,k),27)*prime1 + prime4;
+		};
+		for(; idx<nPending; idx++) {
+			h = Rotate(h ^ (pending[idx]*prime5),11)*prime1;
+		};
+
+		/*	Avalanche	*/
+		h ^= h >> 33;
+		h *= prime2;
+		h ^= h >> 29;
+		h *= prime3;
+		h ^= h >> 32;
+		return h;
+	};
+
+	/*
+	 *	GetHexValue()
+	 *
+	 *	Returns the hash as a 16 character hexadecimal string (e.g., for
+	 *	use in file names)
+	 */
+	std::string GetHexValue() const
+	{
+		char str[17];
+		const QtHashType h = GetValue();
+		std::snprintf(str, sizeof(str), "%08x%08x",
+					  static_cast<unsigned int>(h>>32), static_cast<unsigned int>(h & 0xFFFFFFFF));
+		return std::string(str);
+	};
+
+
+ private:
+
+	QtHashType		lane[4];
+	unsigned char	pending[32];
+	size_t			nBytes;
+	size_t			nPending;
+
+	static const QtHashType prime1 = 11400714785074694791ULL;
+	static const QtHashType prime2 = 14029467366897019727ULL;
+	static const QtHashType prime3 =  1609587929392839161ULL;
+	static const QtHashType prime4 =  9650029242287828579ULL;
+	static const QtHashType prime5 =  2870177450012600261ULL;
+
+	static inline QtHashType Rotate(QtHashType x, unsigned int r)
+	{
+		return (x << r) | (x >> (64-r));
+	};
+
+	static inline QtHashType Round(QtHashType acc, QtHashType input)
+	{
+		acc += input*prime2;
+		acc  = Rotate(acc,31);
+		return acc*prime1;
+	};
+
+	void Stripe(const unsigned char* ptr)
+	{
+		for(unsigned int idx=0; idx<4; idx++) {
+			QtHashType k;
+			std::memcpy(&k, ptr+8*idx, 8);
+			lane[idx] = Round(lane[idx], k);
+		};
+	};
+};
+
+
+#endif
@@ -0,0 +1,111 @@
+/*
+ *	CounterRng.h
+ *
+ *	Counter-based random number generator (Philox4x32-10, Salmon et al.,
+ *	SC11) used to add noise to images and simulated signals. Each draw is
+ *	a pure function of the seed and of a 64-bit counter (e.g., the index of
+ *	the sample), so any element can be generated independently: parallel
+ *	loops need no per-thread state and produce the same values for any
+ *	number of threads or chunk size.
+ */
+
+
+#ifndef COUNTERRNG_H
+#define COUNTERRNG_H
+
+
+/*	C++ headers	*/
+#include <cmath>
+#include <cstddef>
+#include <stdint.h>
+
+
+class CounterRng{
+
+ public:
+
+	CounterRng(uint64_t seed=0)
+	{
+		key[0] = static_cast<uint32_t>(seed);
+		key[1] = static_cast<uint32_t>(seed>>32);
+	};
+
+	/*
+	 *	Generate()
+	 *
+	 *	Returns the four 32-bit random words of the counter (stream is an
+	 *	optional second counter word, e.g., a replicate index)
+	 */
+	void Generate(uint64_t counter, uint32_t stream, uint32_t* out) const
+	{
+		uint32_t c[4] = {static_cast<uint32_t>(counter), static_cast<uint32_t>(counter>>32), stream, 0};
+		uint32_t k[2] = {key[0], key[1]};
+		for(int round=0; round<10; round++) {
+			const uint64_t p0 = static_cast<uint64_t>(0xD2511F53u)*c[0];
+			const uint64_t p1 = static_cast<uint64_t>(0xCD9E8D57u)*c[2];
+			const uint32_t d[4] = {static_cast<uint32_t>(p1>>32)^c[1]^k[0], static_cast<uint32_t>(p1),
+								   static_cast<uint32_t>(p0>>32)^c[3]^k[1], static_cast<uint32_t>(p0)};
+			c[0] = d[0];
+			c[1] = d[1];
+			c[2] = d[2];
+			c[3] = d[3];
+			k[0] += 0x9E3779B9u;
+			k[1] += 0xBB67AE85u;
+		};
+		out[0] = c[0];
+		out[1] = c[1];
+		out[2] = c[2];
+		out[3] = c[3];
+	};
+
+	/*
+	 *	GetNormalPair()
+	 *
+	 *	Two independent standard normal variates of the counter (Box-Muller
+	 *	transform of two 53-bit uniform variates)
+	 */
+	void GetNormalPair(uint64_t counter, uint32_t stream, double &n1, double &n2) const
+	{
+		uint32_t w[4];
+		Generate(counter, stream, w);
+		const double u1 = ToUniform(w[0], w[1]), u2 = ToUniform(w[2], w[3]);
+		const double r	= std::sqrt(-2*std::log(1-u1));		/*	1-u1 is in (0,1]	*/
+		const double a	= 8*std::atan(1.0)*u2;
+		n1 = r*std::cos(a);
+		n2 = r*std::sin(a);
+	};
+
+	/*
+	 *	AddNoise()
+	 *
+	 *	Adds zero-mean noise of standard deviation sigma to the n values of
+	 *	s, which are the samples firstCounter to firstCounter+n-1 of the
+	 *	stream. Rician noise is the magnitude of the signal with Gaussian
+	 *	noise added to the real and imaginary channels (see addmrinoise.m)
+	 */
+	template <class TIn, class TOut>
+	void AddNoise(const TIn* s, size_t n, double sigma, bool isRician, uint64_t firstCounter, uint32_t stream,
+				  TOut* out) const
+	{
+		for(size_t k=0; k<n; k++) {
+			double n1, n2;
+			GetNormalPair(firstCounter+k, stream, n1, n2);
+			const double re = static_cast<double>(s[k])+sigma*n1;
+			out[k] = static_cast<TOut>( isRician ? std::sqrt(re*re+sigma*sigma*n2*n2) : re );
+		};
+	};
+
+
+ private:
+
+	uint32_t key[2];
+
+	/*	Uniform variate in [0,1) from the 53 high bits of two words	*/
+	static double ToUniform(uint32_t hi, uint32_t lo)
+	{
+		return ((hi>>5)*67108864.0+(lo>>6))*(1.0/9007199254740992.0);
+	};
+};
+
+
+#endif
@@ -0,0 +1,133 @@
+/*
+ *	DirectoryScan.h
+ *
+ *	Minimal cross-platform (Windows/POSIX) directory listing. Directory
+ *	trees are walked one level at a time with the directories of each
+ *	level listed in parallel, which hides the latency of network shares
+ *	and of directories holding thousands of files (e.g., DICOM exams).
+ */
+
+
+#ifndef DIRECTORYSCAN_H
+#define DIRECTORYSCAN_H
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/*	OS headers	*/
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+/*	QUATTRO headers	*/
+#include "ParallelFor.h"
+
+
+/*
+ *	ListDirectory()
+ *
+ *	Appends the full names of the files and sub-directories of a directory
+ *	(excluding "." and ".."). Returns false if the directory cannot be read
+ */
+inline bool ListDirectory(const std::string &dir, std::vector<std::string> &files,
+						  std::vector<std::string> &subDirs)
+{
+	std::string prefix = dir;
+	if( !prefix.empty() && (prefix[prefix.size()-1]!='/') && (prefix[prefix.size()-1]!='\\') ) {
+		prefix += '/';
+	};
+#ifdef _WIN32
+	WIN32_FIND_DATAA info;
+	HANDLE			 handle = FindFirstFileA( (prefix + "*").c_str(), &info );
+	if( handle==INVALID_HANDLE_VALUE ) {
+		return false;
+	};
+	do {
+		const std::string name(info.cFileName);
+		if( (name==".") || (name=="..") ) {
+			continue;
+		};
+		if( info.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY ) {
+			subDirs.push_back(prefix + name);
+		}
+		else {
+			files.push_back(prefix + name);
+		};
+	} while( FindNextFileA(handle, &info) );
+	FindClose(handle);
+#else
+	DIR* handle = opendir( dir.c_str() );
+	if( !handle ) {
+		return false;
+	};
+	for(struct dirent* entry=readdir(handle); entry; entry=readdir(handle)) {
+		const std::string name(entry->d_name);
+		if( (name==".") || (name=="..") ) {
+			continue;
+		};
+		const std::string fullName = prefix + name;
+		bool isDir = false;
+#ifdef _DIRENT_HAVE_D_TYPE
+		if( entry->d_type!=DT_UNKNOWN && entry->d_type!=DT_LNK ) {
+			isDir = (entry->d_type==DT_DIR);
+		}
+		else
+#endif
+		{
+			struct stat status;
+			isDir = (stat(fullName.c_str(), &status)==0) && S_ISDIR(status.st_mode);
+		};
+		if( isDir ) {
+			subDirs.push_back(fullName);
+		}
+		else {
+			files.push_back(fullName);
+		};
+	};
+	closedir(handle);
+#endif
+	return true;
+};
+
+
+/*
+ *	ScanDirectoryTree()
+ *
+ *	Returns the (sorted) full names of all files in the directories "dirs"
+ *	and their sub-directories up to a depth of maxDepth (0 lists only the
+ *	given directories, a negative value has no limit)
+ */
+inline std::vector<std::string> ScanDirectoryTree(const std::vector<std::string> &dirs, int maxDepth=-1,
+												  unsigned int nThreads=0)
+{
+	std::vector<std::string> files;
+	std::vector<std::string> level = dirs;
+	for(int depth=0; !level.empty() && ( (maxDepth<0) || (depth<=maxDepth) ); depth++) {
+		std::vector< std::vector<std::string> > levelFiles(level.size()), levelDirs(level.size());
+		ParallelFor(level.size(), 1, [&](size_t begin, size_t end, unsigned int) {
+			for(size_t idx=begin; idx<end; idx++) {
+				ListDirectory(level[idx], levelFiles[idx], levelDirs[idx]);
+			};
+		}, nThreads);
+
+		level.clear();
+		for(size_t idx=0; idx<levelFiles.size(); idx++) {
+			files.insert(files.end(), levelFiles[idx].begin(), levelFiles[idx].end());
+			level.insert(level.end(), levelDirs[idx].begin(), levelDirs[idx].end());
+		};
+	};
+	std::sort(files.begin(), files.end());
+	return files;
+};
+
+
+#endif
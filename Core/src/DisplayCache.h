@@ -0,0 +1,312 @@
+/*
+ *	DisplayCache.h
+ *
+ *	Rendering engine used by the QUATTRO image views. A DisplaySeries
+ *	stores the planes (slices/frames) of a series as single precision
+ *	values together with a pyramid of 2x2 downsampled levels, so a slice
+ *	can be drawn at the resolution of the axes without touching the
+ *	original data. Window/level and colormap lookup are applied through
+ *	a DisplayLut (one packed RGBA entry per colormap color), and map
+ *	overlays are alpha blended into the same RGB buffer. NaN voxels are
+ *	fully transparent, as on the indexed overlays of imgview.
+ */
+
+
+#ifndef DISPLAYCACHE_H
+#define DISPLAYCACHE_H
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define DISPLAYCACHE_SSE2
+#endif
+
+/*	QUATTRO headers	*/
+#include "ParallelFor.h"
+
+
+/*	Packed RGBA color (red in the least significant byte)	*/
+typedef unsigned int DisplayColor;
+
+
+class DisplayLut{
+
+ public:
+
+	DisplayLut() : lower(0), upper(1) {};
+
+	/*
+	 *	SetColormap()
+	 *
+	 *	Builds the table from an n-by-3 MATLAB colormap (column-major values
+	 *	in [0,1])
+	 */
+	void SetColormap(const double* map, size_t n)
+	{
+		colors.resize(n);
+		for(size_t idx=0; idx<n; idx++) {
+			DisplayColor color = 0xFF000000u;
+			for(size_t ch=0; ch<3; ch++) {
+				double value = std::min(std::max(map[idx+ch*n],0.0),1.0);
+				color |= static_cast<DisplayColor>(value*255.0+0.5) << (8*ch);
+			};
+			colors[idx] = color;
+		};
+	};
+
+	/*
+	 *	SetLimits()
+	 *
+	 *	Sets the color limits (i.e., WL-WW/2 and WL+WW/2). Values below and
+	 *	above the limits are mapped to the first and last color
+	 */
+	void SetLimits(double cMin, double cMax)
+	{
+		lower = cMin;
+		upper = cMax;
+	};
+
+	size_t GetNumberOfColors() const { return colors.size(); };
+
+	/*
+	 *	Apply()
+	 *
+	 *	Maps n values to colors. NaN values are mapped to transparent black
+	 */
+	void Apply(const float* values, size_t n, DisplayColor* out) const
+	{
+		if( colors.empty() ) {
+			std::fill(out, out+n, 0u);
+			return;
+		};
+
+		/*	A zero window width maps values to the first or last color	*/
+		const float	 scale = (upper>lower) ? static_cast<float>(colors.size()/(upper-lower))
+										   : std::numeric_limits<float>::max();
+		const float	 shift = static_cast<float>(lower);
+		const float	 last  = static_cast<float>(colors.size()-1);
+		const DisplayColor* table = colors.data();
+		size_t idx = 0;
+#ifdef DISPLAYCACHE_SSE2
+		const __m128 vLower = _mm_set1_ps(shift);
+		const __m128 vScale = _mm_set1_ps(scale);
+		const __m128 vZero	= _mm_setzero_ps();
+		const __m128 vLast	= _mm_set1_ps(last);
+		int			 lut[4];
+		for(; idx+4<=n; idx+=4) {
+			__m128 v	 = _mm_loadu_ps(values+idx);
+			__m128 isNaN = _mm_cmpunord_ps(v, v);
+			__m128 t	 = _mm_mul_ps(_mm_sub_ps(v, vLower), vScale);
+			t			 = _mm_min_ps(_mm_max_ps(t, vZero), vLast);	/*	NaN yields 0	*/
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(lut), _mm_cvttps_epi32(t));
+			const int nanMask = _mm_movemask_ps(isNaN);
+			for(int k=0; k<4; k++) {
+				out[idx+k] = (nanMask & (1<<k)) ? 0u : table[lut[k]];
+			};
+		};
+#endif
+		for(; idx<n; idx++) {
+			const float v = values[idx];
+			if( v!=v ) {
+				out[idx] = 0u;
+				continue;
+			};
+			const float t = std::min(std::max((v-shift)*scale, 0.0f), last);
+			out[idx] = table[static_cast<int>(t)];
+		};
+	};
+
+
+ private:
+
+	std::vector<DisplayColor> colors;
+	double	lower;
+	double	upper;
+};
+
+
+class DisplaySeries{
+
+ public:
+
+	DisplaySeries() : nPlanes(0) {};
+
+	/*
+	 *	Initialize()
+	 *
+	 *	Allocates the full resolution level for nPlanes planes of size
+	 *	rows-by-cols. Planes are written with GetPlane(0,idx) and the pyramid
+	 *	is built by BuildPyramid()
+	 */
+	void Initialize(size_t rows, size_t cols, size_t planes)
+	{
+		nPlanes = planes;
+		levels.assign(1, Level());
+		levels[0].rows = rows;
+		levels[0].cols = cols;
+		levels[0].data.assign(rows*cols*planes, 0.0f);
+	};
+
+	/*
+	 *	BuildPyramid()
+	 *
+	 *	Creates downsampled levels until a plane fits within minSize voxels
+	 *	along both dimensions. Each voxel is the mean of the non-NaN voxels
+	 *	of the corresponding 2x2 block of the previous level
+	 */
+	void BuildPyramid(size_t minSize=64, unsigned int nThreads=0)
+	{
+		levels.resize(1);
+		while( (levels.back().rows>minSize) || (levels.back().cols>minSize) ) {
+			const Level &src = levels.back();
+			Level dst;
+			dst.rows = (src.rows+1)/2;
+			dst.cols = (src.cols+1)/2;
+			dst.data.resize(dst.rows*dst.cols*nPlanes);
+			ParallelFor(nPlanes, 1, [&](size_t begin, size_t end, unsigned int) {
+				for(size_t plane=begin; plane<end; plane++) {
+					Downsample(src, dst, plane);
+				};
+			}, nThreads);
+			levels.push_back(std::move(dst));
+		};
+	};
+
+	size_t GetNumberOfLevels() const { return levels.size(); };
+	size_t GetNumberOfPlanes() const { return nPlanes; };
+	size_t GetRows(size_t level) const { return levels[level].rows; };
+	size_t GetCols(size_t level) const { return levels[level].cols; };
+
+	float* GetPlane(size_t level, size_t plane)
+	{
+		Level &lvl = levels[level];
+		return lvl.data.data()+plane*lvl.rows*lvl.cols;
+	};
+
+	const float* GetPlane(size_t level, size_t plane) const
+	{
+		const Level &lvl = levels[level];
+		return lvl.data.data()+plane*lvl.rows*lvl.cols;
+	};
+
+	/*
+	 *	GetLevel()
+	 *
+	 *	Returns the coarsest level that still provides at least the
+	 *	requested number of rows and columns (e.g., the axes size in pixels)
+	 */
+	size_t GetLevel(size_t rows, size_t cols) const
+	{
+		size_t level = 0;
+		while( (level+1<levels.size()) && (levels[level+1].rows>=rows) && (levels[level+1].cols>=cols) ) {
+			level++;
+		};
+		return level;
+	};
+
+	size_t GetMemorySize() const
+	{
+		size_t n = 0;
+		for(size_t idx=0; idx<levels.size(); idx++) {
+			n += levels[idx].data.size()*sizeof(float);
+		};
+		return n;
+	};
+
+
+ private:
+
+	struct Level{
+		size_t rows;
+		size_t cols;
+		std::vector<float> data;
+	};
+
+	std::vector<Level> levels;
+	size_t nPlanes;
+
+	static void Downsample(const Level &src, Level &dst, size_t plane)
+	{
+		const float* in	 = src.data.data()+plane*src.rows*src.cols;
+		float*		 out = dst.data.data()+plane*dst.rows*dst.cols;
+		for(size_t c=0; c<dst.cols; c++) {
+			for(size_t r=0; r<dst.rows; r++) {
+				float  sum = 0.0f;
+				int	   n   = 0;
+				for(size_t dc=0; dc<2; dc++) {
+					const size_t cIn = std::min(2*c+dc, src.cols-1);
+					for(size_t dr=0; dr<2; dr++) {
+						const float v = in[std::min(2*r+dr, src.rows-1)+cIn*src.rows];
+						if( v==v ) {
+							sum += v;
+							n++;
+						};
+					};
+				};
+				out[r+c*dst.rows] = n ? sum/n : std::numeric_limits<float>::quiet_NaN();
+			};
+		};
+	};
+};
+
+
+/*
+ *	BlendColors()
+ *
+ *	Composites the overlay colors onto the image colors in place. Overlay
+ *	voxels are blended with the opacity alpha (0-255), except for the
+ *	transparent (NaN) voxels, which leave the image unchanged
+ */
+inline void BlendColors(DisplayColor* image, const DisplayColor* overlay, size_t n, unsigned int alpha)
+{
+	const unsigned int beta = 255-alpha;
+	for(size_t idx=0; idx<n; idx++) {
+		const DisplayColor over = overlay[idx];
+		if( !(over>>24) ) {
+			continue;
+		};
+		const DisplayColor base = image[idx];
+		DisplayColor color = 0xFF000000u;
+		for(unsigned int shift=0; shift<24; shift+=8) {
+			const unsigned int value = ((over>>shift)&0xFFu)*alpha+((base>>shift)&0xFFu)*beta;
+			color |= ((value+127)/255) << shift;
+		};
+		image[idx] = color;
+	};
+};
+
+
+/*
+ *	SplitColors()
+ *
+ *	Writes packed colors to the planar (column-major m-by-n-by-3) layout of
+ *	a MATLAB true color image and, when requested, the alpha channel
+ */
+inline void SplitColors(const DisplayColor* colors, size_t n, unsigned char* rgb, unsigned char* alpha=0)
+{
+	unsigned char* red	 = rgb;
+	unsigned char* green = rgb+n;
+	unsigned char* blue	 = rgb+2*n;
+	for(size_t idx=0; idx<n; idx++) {
+		const DisplayColor color = colors[idx];
+		red[idx]   = static_cast<unsigned char>(color);
+		green[idx] = static_cast<unsigned char>(color>>8);
+		blue[idx]  = static_cast<unsigned char>(color>>16);
+	};
+	if( alpha ) {
+		for(size_t idx=0; idx<n; idx++) {
+			alpha[idx] = static_cast<unsigned char>(colors[idx]>>24);
+		};
+	};
+};
+
+
+#endif
@@ -0,0 +1,740 @@
+/*
+ *	ExamContainer.h
+ *
+ *	Chunked container for QUATTRO exam data (*.qtx). A container holds named
+ *	datasets (image series, parameter maps, ROI data, serialized headers)
+ *	of up to 8 dimensions. Every 2D plane of a dataset (i.e., one tile per
+ *	slice, time point, etc.) is deflated independently, so single slices or
+ *	frames are read without decompressing the remainder of the exam.
+ *
+ *	The file consists of a fixed header, the tiles and the index, which
+ *	lists the datasets and the location of their tiles. Saves only append
+ *	to the file: tiles whose content is unchanged are reused, new
+ *	tiles and a new index are written at the end of the file and, finally,
+ *	the header is updated to point to the new index. An interrupted save
+ *	therefore leaves the previous index (and data) intact. The file is
+ *	compacted when more than half of it is unreferenced.
+ *
+ *	All values are stored in little endian byte order:
+ *
+ *		Offset	Size	Description
+ *		---------------------------
+ *		0		8		Magic string ("QTXEXAM1")
+ *		8		8		Index offset
+ *		16		8		Index size
+ *		24		8		Index content hash
+ *		32		...		Tiles and index
+ *
+ *	Index: number of datasets (4 bytes), followed by the name length (4),
+ *	name, data type (4), number of dimensions (4), dimensions (8 each) and
+ *	the offset, compressed size and content hash (8 each) of every tile of
+ *	each dataset.
+ */
+
+
+#ifndef EXAMCONTAINER_H
+#define EXAMCONTAINER_H
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*	zlib headers	*/
+#include "zlib.h"
+
+/*	QUATTRO headers	*/
+#include "ContentHash.h"
+#include "MappedFile.h"
+#include "ParallelFor.h"
+
+
+//	Define common types
+enum examDataType{		//	Element types of the datasets
+	ExamUnknown,
+	ExamLogical,
+	ExamInt8,
+	ExamUInt8,
+	ExamInt16,
+	ExamUInt16,
+	ExamInt32,
+	ExamUInt32,
+	ExamInt64,
+	ExamUInt64,
+	ExamSingle,
+	ExamDouble,
+	ExamChar			//	UTF-16 code units (MATLAB char)
+};
+
+/*	Element sizes (bytes) in the order of examDataType	*/
+static const size_t examDataTypeSizes[] = { 0, 1, 1, 1, 2, 2, 4, 4, 8, 8, 4, 8, 2 };
+
+/*	File layout constants	*/
+static const char	examMagic[]			= "QTXEXAM1";
+static const size_t examHeaderSize		= 32;
+static const size_t examMaxDimensions	= 8;
+
+
+/*
+ *	ExamTile
+ *
+ *	Location and content hash (of the uncompressed data) of a tile
+ */
+struct ExamTile{
+	unsigned long long	offset;
+	unsigned long long	size;
+	QtHashType			hash;
+};
+
+
+/*
+ *	ExamDataset
+ *
+ *	Index entry of a dataset. Tiles are the planes spanned by the first two
+ *	dimensions, in column-major order of the remaining dimensions
+ */
+struct ExamDataset{
+	std::string				name;
+	examDataType			type;
+	std::vector<size_t>		dims;
+	std::vector<ExamTile>	tiles;
+
+	ExamDataset() : type(ExamUnknown) {};
+
+	size_t GetNumberOfElements() const
+	{
+		size_t n = 1;
+		for(size_t idx=0; idx<dims.size(); idx++) {
+			n *= dims[idx];
+		};
+		return n;
+	};
+
+	size_t GetElementSize() const { return examDataTypeSizes[type]; };
+
+	/*	Elements per tile (the first two dimensions)	*/
+	size_t GetTileElements() const
+	{
+		size_t n = 1;
+		for(size_t idx=0; (idx<2) && (idx<dims.size()); idx++) {
+			n *= dims[idx];
+		};
+		return n;
+	};
+
+	size_t GetTileSize() const { return GetTileElements()*GetElementSize(); };
+
+	size_t GetNumberOfTiles() const
+	{
+		const size_t nTile = GetTileElements();
+		return nTile ? GetNumberOfElements()/nTile : 0;
+	};
+};
+
+
+/*
+ *	ExamIndex
+ *
+ *	Serialization of the index
+ */
+class ExamIndex{
+
+ public:
+
+	/*	Encodes the datasets	*/
+	static std::string Encode(const std::vector<ExamDataset> &datasets)
+	{
+		std::string buffer;
+		PutValue(buffer, datasets.size(), 4);
+		for(size_t dIdx=0; dIdx<datasets.size(); dIdx++) {
+			const ExamDataset &dataset = datasets[dIdx];
+			PutValue(buffer, dataset.name.size(), 4);
+			buffer += dataset.name;
+			PutValue(buffer, dataset.type, 4);
+			PutValue(buffer, dataset.dims.size(), 4);
+			for(size_t idx=0; idx<dataset.dims.size(); idx++) {
+				PutValue(buffer, dataset.dims[idx], 8);
+			};
+			for(size_t idx=0; idx<dataset.tiles.size(); idx++) {
+				PutValue(buffer, dataset.tiles[idx].offset, 8);
+				PutValue(buffer, dataset.tiles[idx].size, 8);
+				PutValue(buffer, dataset.tiles[idx].hash, 8);
+			};
+		};
+		return buffer;
+	};
+
+	/*	Decodes the datasets. Returns false if the index is invalid	*/
+	static bool Decode(const unsigned char* data, size_t n, unsigned long long fileSize,
+					   std::vector<ExamDataset> &datasets)
+	{
+		size_t pos = 0;
+		unsigned long long nDatasets;
+		if( !GetValue(data, n, pos, nDatasets, 4) ) {
+			return false;
+		};
+		datasets.clear();
+		for(unsigned long long dIdx=0; dIdx<nDatasets; dIdx++) {
+			ExamDataset dataset;
+			unsigned long long nName, type, nDims;
+			if( !GetValue(data, n, pos, nName, 4) || (nName>n-pos) ) {
+				return false;
+			};
+			dataset.name.assign(reinterpret_cast<const char*>(data+pos), static_cast<size_t>(nName));
+			pos += static_cast<size_t>(nName);
+			if( !GetValue(data, n, pos, type, 4) || !GetValue(data, n, pos, nDims, 4) ||
+				(type<=ExamUnknown) || (type>ExamChar) || (nDims>examMaxDimensions) ) {
+				return false;
+			};
+			dataset.type = static_cast<examDataType>(type);
+			for(unsigned long long idx=0; idx<nDims; idx++) {
+				unsigned long long dim;
+				if( !GetValue(data, n, pos, dim, 8) ) {
+					return false;
+				};
+				dataset.dims.push_back(static_cast<size_t>(dim));
+			};
+			const size_t nTiles = dataset.GetNumberOfTiles();
+			if( nTiles>(n-pos)/24 ) {
+				return false;
+			};
+			dataset.tiles.resize(nTiles);
+			for(size_t idx=0; idx<nTiles; idx++) {
+				ExamTile &tile = dataset.tiles[idx];
+				unsigned long long hash;
+				GetValue(data, n, pos, tile.offset, 8);
+				GetValue(data, n, pos, tile.size, 8);
+				GetValue(data, n, pos, hash, 8);
+				tile.hash = static_cast<QtHashType>(hash);
+				if( (tile.offset<examHeaderSize) || (tile.size>fileSize) || (tile.offset>fileSize-tile.size) ) {
+					return false;
+				};
+			};
+			datasets.push_back(dataset);
+		};
+		return pos==n;
+	};
+
+	static void PutValue(std::string &buffer, unsigned long long value, size_t n)
+	{
+		for(size_t idx=0; idx<n; idx++) {
+			buffer += static_cast<char>( (value>>(8*idx)) & 0xFF );
+		};
+	};
+
+	static bool GetValue(const unsigned char* data, size_t n, size_t &pos, unsigned long long &value, size_t nBytes)
+	{
+		if( n-pos<nBytes ) {
+			return false;
+		};
+		value = 0;
+		for(size_t idx=0; idx<nBytes; idx++) {
+			value |= static_cast<unsigned long long>(data[pos+idx]) << (8*idx);
+		};
+		pos += nBytes;
+		return true;
+	};
+};
+
+
+class ExamContainer{
+
+ public:
+
+	ExamContainer() {};
+
+	/*
+	 *	Open()
+	 *
+	 *	Maps a container and reads the index. Returns false (see GetError())
+	 *	if the file cannot be read
+	 */
+	bool Open(const std::string &fName)
+	{
+		Close();
+		if( !file.Open(fName) ) {
+			return Fail("Unable to open " + fName);
+		};
+		const unsigned char* data = reinterpret_cast<const unsigned char*>(file.GetData());
+		const size_t		 n	  = file.GetSize();
+		if( (n<examHeaderSize) || std::memcmp(data, examMagic, 8) ) {
+			Close();
+			return Fail(fName + " is not a QUATTRO exam container");
+		};
+		unsigned long long offset, size, hash;
+		size_t pos = 8;
+		ExamIndex::GetValue(data, n, pos, offset, 8);
+		ExamIndex::GetValue(data, n, pos, size, 8);
+		ExamIndex::GetValue(data, n, pos, hash, 8);
+		if( (offset<examHeaderSize) || (size>n) || (offset>n-size) ) {
+			Close();
+			return Fail("Corrupt index in " + fName);
+		};
+		ContentHash indexHash;
+		indexHash.Append(data+offset, static_cast<size_t>(size));
+		if( (indexHash.GetValue()!=static_cast<QtHashType>(hash)) ||
+			!ExamIndex::Decode(data+offset, static_cast<size_t>(size), n, datasets) ) {
+			Close();
+			return Fail("Corrupt index in " + fName);
+		};
+		return true;
+	};
+
+	void Close()
+	{
+		file.Close();
+		datasets.clear();
+	};
+
+	/*	Returns the index of a dataset or -1 if the dataset does not exist	*/
+	long FindDataset(const std::string &name) const
+	{
+		for(size_t idx=0; idx<datasets.size(); idx++) {
+			if( datasets[idx].name==name ) {
+				return static_cast<long>(idx);
+			};
+		};
+		return -1;
+	};
+
+	/*
+	 *	ReadTiles()
+	 *
+	 *	Inflates the given tiles of a dataset (in parallel) and stores them
+	 *	consecutively in DST
+	 */
+	bool ReadTiles(size_t dsIdx, const std::vector<size_t> &tiles, void* dst, unsigned int nThreads=0)
+	{
+		if( !file.IsOpen() || (dsIdx>=datasets.size()) ) {
+			return Fail("Invalid dataset");
+		};
+		const ExamDataset	 &dataset  = datasets[dsIdx];
+		const size_t		  tileSize = dataset.GetTileSize();
+		const unsigned char*  data	   = reinterpret_cast<const unsigned char*>(file.GetData());
+		unsigned char*		  out	   = static_cast<unsigned char*>(dst);
+		for(size_t idx=0; idx<tiles.size(); idx++) {
+			if( tiles[idx]>=dataset.tiles.size() ) {
+				return Fail("Tile index exceeds the size of " + dataset.name);
+			};
+		};
+
+		std::atomic<bool> isValid(true);
+		ParallelFor(tiles.size(), 1, [&](size_t begin, size_t end, unsigned int) {
+			for(size_t idx=begin; idx<end; idx++) {
+				const ExamTile &tile = dataset.tiles[ tiles[idx] ];
+				uLongf nOut = static_cast<uLongf>(tileSize);
+				if( (uncompress(out+idx*tileSize, &nOut, data+tile.offset, static_cast<uLong>(tile.size))!=Z_OK) ||
+					(nOut!=tileSize) ) {
+					isValid = false;
+				};
+			};
+		}, nThreads);
+		if( !isValid ) {
+			return Fail("Corrupt data in " + dataset.name);
+		};
+		return true;
+	};
+
+	/*	Reads all tiles of a dataset	*/
+	bool ReadDataset(size_t dsIdx, void* dst, unsigned int nThreads=0)
+	{
+		std::vector<size_t> tiles( (dsIdx<datasets.size()) ? datasets[dsIdx].tiles.size() : 0 );
+		for(size_t idx=0; idx<tiles.size(); idx++) {
+			tiles[idx] = idx;
+		};
+		return ReadTiles(dsIdx, tiles, dst, nThreads);
+	};
+
+	const std::vector<ExamDataset>& GetDatasets() const { return datasets; };
+	const MappedFile&				GetFile() const		{ return file; };
+	const std::string&				GetError() const	{ return error; };
+
+
+ private:
+
+	MappedFile					file;
+	std::vector<ExamDataset>	datasets;
+	std::string					error;
+
+	ExamContainer(const ExamContainer&);
+	ExamContainer& operator=(const ExamContainer&);
+
+	bool Fail(const std::string &msg) { error = msg; return false; };
+};
+
+
+class ExamContainerWriter{
+
+ public:
+
+	ExamContainerWriter() : fid(0), nWritten(0), nReused(0), level(Z_BEST_SPEED) {};
+	~ExamContainerWriter() { Close(); };
+
+	/*
+	 *	Open()
+	 *
+	 *	Opens a container for writing, creating the file if it does not
+	 *	exist. The datasets of an existing container are kept unless they
+	 *	are replaced or removed
+	 */
+	bool Open(const std::string &fName)
+	{
+		Close();
+		fileName = fName;
+		FILE* test = std::fopen(fName.c_str(), "rb");
+		if( test ) {
+			std::fclose(test);
+			ExamContainer container;
+			if( !container.Open(fName) ) {
+				return Fail( container.GetError() );
+			};
+			datasets = container.GetDatasets();
+			fid		 = std::fopen(fName.c_str(), "r+b");
+		}
+		else {
+			fid = std::fopen(fName.c_str(), "w+b");
+			if( fid ) {
+				std::string header(examMagic, 8);
+				header.resize(examHeaderSize, '\0');
+				std::fwrite(header.data(), 1, header.size(), fid);
+			};
+		};
+		if( !fid ) {
+			return Fail("Unable to open " + fName + " for writing");
+		};
+		return true;
+	};
+
+	/*
+	 *	Write()
+	 *
+	 *	Adds or replaces a dataset. Tiles are hashed and only tiles that
+	 *	differ from the existing dataset are deflated (in parallel) and
+	 *	appended to the file
+	 */
+	bool Write(const std::string &name, examDataType type, const std::vector<size_t> &dims,
+			   const void* data, unsigned int nThreads=0)
+	{
+		if( !fid ) {
+			return Fail("No container is open");
+		}
+		else if( (type<=ExamUnknown) || (type>ExamChar) || (dims.size()>examMaxDimensions) ) {
+			return Fail("Invalid data type or size of " + name);
+		};
+		ExamDataset dataset;
+		dataset.name = name;
+		dataset.type = type;
+		dataset.dims = dims;
+		const size_t nTiles	  = dataset.GetNumberOfTiles();
+		const size_t tileSize = dataset.GetTileSize();
+		dataset.tiles.resize(nTiles);
+		const unsigned char* src = static_cast<const unsigned char*>(data);
+
+		/*	Existing tiles are reused if the type, size and content match.
+		 *	The tiles with a matching hash are compared byte by byte	*/
+		const long	 oldIdx	 = FindDataset(name);
+		const bool	 isMatch = (oldIdx>=0) && (datasets[oldIdx].type==type) && (datasets[oldIdx].dims==dims);
+		std::vector<unsigned char> isHashMatch(nTiles, 0);
+		ParallelFor(nTiles, 1, [&](size_t begin, size_t end, unsigned int) {
+			for(size_t idx=begin; idx<end; idx++) {
+				ContentHash hash;
+				hash.Append(src+idx*tileSize, tileSize);
+				dataset.tiles[idx].hash = hash.GetValue();
+				dataset.tiles[idx].size = 0;
+				isHashMatch[idx]		= isMatch && (datasets[oldIdx].tiles[idx].hash==dataset.tiles[idx].hash);
+			};
+		}, nThreads);
+		std::vector<size_t> hits;
+		for(size_t idx=0; idx<nTiles; idx++) {
+			if( isHashMatch[idx] ) {
+				hits.push_back(idx);
+			};
+		};
+		const size_t nBatch = std::max<size_t>(1, std::min<size_t>(64, (size_t(256)<<20)/std::max<size_t>(tileSize,1)));
+		std::vector< std::vector<unsigned char> > buffers(nBatch);
+		if( !hits.empty() && !ReuseTiles(datasets[oldIdx], src, hits, dataset, buffers, nThreads) ) {
+			return false;
+		};
+
+		/*	Deflate the changed tiles in batches (bounding the memory) and
+		 *	append them in order	*/
+		std::vector<size_t> changed;
+		for(size_t idx=0; idx<nTiles; idx++) {
+			if( !dataset.tiles[idx].size ) {
+				changed.push_back(idx);
+			}
+			else {
+				nReused++;
+			};
+		};
+		for(size_t first=0; first<changed.size(); first+=nBatch) {
+			const size_t	  n = std::min(nBatch, changed.size()-first);
+			std::atomic<bool> isValid(true);
+			ParallelFor(n, 1, [&](size_t begin, size_t end, unsigned int) {
+				for(size_t bIdx=begin; bIdx<end; bIdx++) {
+					std::vector<unsigned char> &buffer = buffers[bIdx];
+					uLongf nOut = compressBound( static_cast<uLong>(tileSize) );
+					buffer.resize(nOut);
+					if( compress2(buffer.data(), &nOut, src+changed[first+bIdx]*tileSize,
+								  static_cast<uLong>(tileSize), level)!=Z_OK ) {
+						isValid = false;
+					};
+					buffer.resize(nOut);
+				};
+			}, nThreads);
+			if( !isValid ) {
+				return Fail("Unable to compress " + name);
+			};
+			for(size_t bIdx=0; bIdx<n; bIdx++) {
+				ExamTile &tile = dataset.tiles[ changed[first+bIdx] ];
+				if( !Append(buffers[bIdx].data(), buffers[bIdx].size(), tile.offset) ) {
+					return false;
+				};
+				tile.size = buffers[bIdx].size();
+				nWritten++;
+			};
+		};
+
+		if( oldIdx>=0 ) {
+			datasets[oldIdx] = dataset;
+		}
+		else {
+			datasets.push_back(dataset);
+		};
+		return true;
+	};
+
+	/*	Removes a dataset. Returns false if the dataset does not exist	*/
+	bool Remove(const std::string &name)
+	{
+		const long idx = FindDataset(name);
+		if( idx<0 ) {
+			return false;
+		};
+		datasets.erase(datasets.begin()+idx);
+		return true;
+	};
+
+	/*
+	 *	Commit()
+	 *
+	 *	Writes the index and points the header to it, compacting the file
+	 *	first if more than half of it is unreferenced. The file is closed
+	 */
+	bool Commit()
+	{
+		if( !fid ) {
+			return Fail("No container is open");
+		};
+
+		/*	Referenced bytes	*/
+		const std::string index = ExamIndex::Encode(datasets);
+		unsigned long long nLive = examHeaderSize+index.size();
+		for(size_t dIdx=0; dIdx<datasets.size(); dIdx++) {
+			for(size_t idx=0; idx<datasets[dIdx].tiles.size(); idx++) {
+				nLive += datasets[dIdx].tiles[idx].size;
+			};
+		};
+		Seek(0, SEEK_END);
+		const unsigned long long nFile = Tell();
+		if( (nFile>2*nLive) && (nFile-nLive>(1u<<20)) ) {
+			return Compact();
+		};
+
+		unsigned long long indexOffset;
+		if( !Append(index.data(), index.size(), indexOffset) || !WriteHeader(fid, indexOffset, index) ) {
+			return false;
+		};
+		const bool isClosed = (std::fclose(fid)==0);
+		fid = 0;
+		return isClosed || Fail("Unable to write " + fileName);
+	};
+
+	/*	Closes the file without committing (the previous index is kept)	*/
+	void Close()
+	{
+		if( fid ) {
+			std::fclose(fid);
+			fid = 0;
+		};
+	};
+
+	long FindDataset(const std::string &name) const
+	{
+		for(size_t idx=0; idx<datasets.size(); idx++) {
+			if( datasets[idx].name==name ) {
+				return static_cast<long>(idx);
+			};
+		};
+		return -1;
+	};
+
+	/*	Compression level of new tiles (zlib levels)	*/
+	void SetCompressionLevel(int value) { level = value; };
+
+	const std::vector<ExamDataset>& GetDatasets() const { return datasets; };
+
+	/*	Number of tiles written and reused (unchanged) since Open()	*/
+	size_t GetNumberOfWrittenTiles() const	{ return nWritten; };
+	size_t GetNumberOfReusedTiles() const	{ return nReused; };
+
+	const std::string& GetError() const { return error; };
+
+
+ private:
+
+	FILE*						fid;
+	std::string					fileName;
+	std::vector<ExamDataset>	datasets;
+	size_t						nWritten;
+	size_t						nReused;
+	int							level;
+	std::string					error;
+
+	ExamContainerWriter(const ExamContainerWriter&);
+	ExamContainerWriter& operator=(const ExamContainerWriter&);
+
+	bool Fail(const std::string &msg) { error = msg; return false; };
+
+	/*	64-bit file positioning	*/
+	bool Seek(unsigned long long offset, int origin)
+	{
+#ifdef _WIN32
+		return _fseeki64(fid, static_cast<__int64>(offset), origin)==0;
+#else
+		return fseeko(fid, static_cast<off_t>(offset), origin)==0;
+#endif
+	};
+
+	unsigned long long Tell()
+	{
+#ifdef _WIN32
+		return static_cast<unsigned long long>( _ftelli64(fid) );
+#else
+		return static_cast<unsigned long long>( ftello(fid) );
+#endif
+	};
+
+	/*	Appends N bytes to the file, returning their offset	*/
+	bool Append(const void* data, size_t n, unsigned long long &offset)
+	{
+		if( !Seek(0, SEEK_END) ) {
+			return Fail("Unable to write " + fileName);
+		};
+		offset = Tell();
+		if( std::fwrite(data, 1, n, fid)!=n ) {
+			return Fail("Unable to write " + fileName);
+		};
+		return true;
+	};
+
+	/*	Writes the header of a file, pointing to the given index	*/
+	bool WriteHeader(FILE* file, unsigned long long indexOffset, const std::string &index)
+	{
+		ContentHash hash;
+		hash.Append(index.data(), index.size());
+		std::string header(examMagic, 8);
+		ExamIndex::PutValue(header, indexOffset, 8);
+		ExamIndex::PutValue(header, index.size(), 8);
+		ExamIndex::PutValue(header, hash.GetValue(), 8);
+		if( (std::fflush(file)!=0) || (std::fseek(file, 0, SEEK_SET)!=0) ||
+			(std::fwrite(header.data(), 1, header.size(), file)!=header.size()) || (std::fflush(file)!=0) ) {
+			return Fail("Unable to write " + fileName);
+		};
+		return true;
+	};
+
+	/*
+	 *	ReuseTiles()
+	 *
+	 *	Inflates the tiles of the previous version of a dataset whose hash
+	 *	matches the new data (in batches of the size of BUFFERS) and reuses
+	 *	those with identical content
+	 */
+	bool ReuseTiles(const ExamDataset &previous, const unsigned char* src, const std::vector<size_t> &hits,
+					ExamDataset &dataset, std::vector< std::vector<unsigned char> > &buffers, unsigned int nThreads)
+	{
+		const size_t tileSize = dataset.GetTileSize();
+		const size_t nBatch	  = buffers.size();
+		for(size_t first=0; first<hits.size(); first+=nBatch) {
+			const size_t n = std::min(nBatch, hits.size()-first);
+			for(size_t bIdx=0; bIdx<n; bIdx++) {
+				const ExamTile &tile = previous.tiles[ hits[first+bIdx] ];
+				buffers[bIdx].resize( static_cast<size_t>(tile.size) );
+				if( !Seek(tile.offset, SEEK_SET) ||
+					(std::fread(buffers[bIdx].data(), 1, buffers[bIdx].size(), fid)!=buffers[bIdx].size()) ) {
+					return Fail("Unable to read " + fileName);
+				};
+			};
+			ParallelFor(n, 1, [&](size_t begin, size_t end, unsigned int) {
+				std::vector<unsigned char> tileData(tileSize);
+				for(size_t bIdx=begin; bIdx<end; bIdx++) {
+					const size_t idx  = hits[first+bIdx];
+					uLongf		 nOut = static_cast<uLongf>(tileSize);
+					if( (uncompress(tileData.data(), &nOut, buffers[bIdx].data(), static_cast<uLong>(buffers[bIdx].size()))==Z_OK) &&
+						(nOut==tileSize) && !std::memcmp(tileData.data(), src+idx*tileSize, tileSize) ) {
+						dataset.tiles[idx] = previous.tiles[idx];
+					};
+				};
+			}, nThreads);
+		};
+		return true;
+	};
+
+	/*
+	 *	Compact()
+	 *
+	 *	Copies the referenced tiles to a new file that replaces the
+	 *	container. The replacement is atomic except on Windows, where the
+	 *	container must be removed first
+	 */
+	bool Compact()
+	{
+		std::fflush(fid);
+		std::fclose(fid);
+		fid = 0;
+		MappedFile source;
+		if( !source.Open(fileName) ) {
+			return Fail("Unable to open " + fileName);
+		};
+		const std::string tmpName = fileName + ".tmp";
+		FILE* out = std::fopen(tmpName.c_str(), "wb");
+		if( !out ) {
+			return Fail("Unable to open " + tmpName + " for writing");
+		};
+		std::string header(examHeaderSize, '\0');
+		bool isWritten = (std::fwrite(header.data(), 1, header.size(), out)==header.size());
+		unsigned long long offset = examHeaderSize;
+		for(size_t dIdx=0; isWritten && (dIdx<datasets.size()); dIdx++) {
+			for(size_t idx=0; isWritten && (idx<datasets[dIdx].tiles.size()); idx++) {
+				ExamTile &tile = datasets[dIdx].tiles[idx];
+				isWritten	= (std::fwrite(source.GetData()+tile.offset, 1, static_cast<size_t>(tile.size), out)==tile.size);
+				tile.offset = offset;
+				offset	   += tile.size;
+			};
+		};
+		source.Close();
+		const std::string index = ExamIndex::Encode(datasets);
+		isWritten = isWritten && (std::fwrite(index.data(), 1, index.size(), out)==index.size()) &&
+					WriteHeader(out, offset, index);
+		isWritten = (std::fclose(out)==0) && isWritten;
+		if( !isWritten ) {
+			std::remove(tmpName.c_str());
+			return Fail("Unable to write " + tmpName);
+		};
+#ifdef _WIN32
+		std::remove(fileName.c_str());
+#endif
+		if( std::rename(tmpName.c_str(), fileName.c_str())!=0 ) {
+			return Fail("Unable to replace " + fileName + " by " + tmpName);
+		};
+		return true;
+	};
+};
+
+
+#endif
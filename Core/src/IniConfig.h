@@ -0,0 +1,603 @@
+/*
+ *	IniConfig.h
+ *
+ *	Section-aware INI configuration reader. The file is memory-mapped and
+ *	parsed in a single pass into flat arrays of sections and entries whose
+ *	names and values point into the mapping (only multi-line values are
+ *	copied). Entries are found through a hash table keyed by the section
+ *	and the (case-insensitive) key, so "[Properties] metric" and
+ *	"[Job] metric" never collide and files with thousands of repeated
+ *	sections (e.g., one [Job] per frame) are loaded in microseconds.
+ *
+ *	Typed accessors cache the converted value of an entry, including
+ *	MATLAB style numeric arrays such as "[1 2 3]" or "[1 2;3 4]" (see
+ *	mat2str). The caches make the accessors unsafe to call concurrently
+ *	on the same object.
+ *
+ *	Supported syntax (compatible with inih/inifile.m files):
+ *		[Section]				section header (keys before the first header
+ *								belong to the unnamed section "")
+ *		key = value				"=" or ":" separated; leading white space
+ *								(e.g., inifile 'tabbed' style) is ignored
+ *		  continued value		indented lines without a separator are
+ *								appended to the previous value with "\n"
+ *		; comment or # comment	full line comments and inline comments
+ *								preceded by white space (outside brackets)
+ */
+
+
+#ifndef INICONFIG_H
+#define INICONFIG_H
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <string>
+#include <vector>
+
+/*	QUATTRO headers	*/
+#include "MappedFile.h"
+
+
+/*
+ *	IniStringView
+ *
+ *	Non-owning reference to a name or value
+ */
+struct IniStringView{
+	const char*	data;
+	size_t		size;
+
+	IniStringView() : data(0), size(0) {};
+	IniStringView(const char* str, size_t n) : data(str), size(n) {};
+
+	std::string str() const { return std::string(data, size); };
+
+	bool IsEqualNoCase(const char* other, size_t n) const
+	{
+		if( n!=size ) {
+			return false;
+		};
+		for(size_t idx=0; idx<n; idx++) {
+			if( std::tolower(static_cast<unsigned char>(data[idx]))!=std::tolower(static_cast<unsigned char>(other[idx])) ) {
+				return false;
+			};
+		};
+		return true;
+	};
+};
+
+
+class IniConfig{
+
+ public:
+
+	static const size_t npos = static_cast<size_t>(-1);
+
+	IniConfig() : parseError(0) {};
+
+	/*
+	 *	Read()
+	 *
+	 *	Maps and parses an INI file. Returns false if the file cannot be
+	 *	opened or a line cannot be parsed (see GetParseError)
+	 */
+	bool Read(const std::string &fName)
+	{
+		Clear();
+		if( !file.Open(fName, MapReadOnly) ) {
+			parseError = -1;
+			return false;
+		};
+		file.AdviseSequential();
+		return Parse(static_cast<const char*>(file.GetData()), file.GetSize());
+	};
+
+	/*
+	 *	Parse()
+	 *
+	 *	Parses INI text stored in memory. The buffer must remain valid for
+	 *	the lifetime of the object (or until the next Read/Parse)
+	 */
+	bool Parse(const char* text, size_t n);
+
+	/*
+	 *	GetParseError()
+	 *
+	 *	Returns 0 on success, the line number of the first error or -1 if
+	 *	the file could not be opened (as inih's ini_parse)
+	 */
+	int GetParseError() const { return parseError; };
+
+	/*	Sections	*/
+	size_t				GetNumberOfSections() const { return sections.size(); };
+	std::string			GetSectionName(size_t secIdx) const { return sections[secIdx].name.str(); };
+	size_t				FindSection(const std::string &name) const;
+	std::vector<size_t>	FindSections(const std::string &name) const;
+
+	/*	Entries of a section	*/
+	size_t				GetNumberOfEntries(size_t secIdx) const { return sections[secIdx].nEntries; };
+	std::string			GetEntryKey(size_t secIdx, size_t idx) const { return entries[sections[secIdx].firstEntry+idx].key.str(); };
+	size_t				FindEntry(size_t secIdx, const std::string &key) const;
+
+	/*
+	 *	Typed accessors
+	 *
+	 *	Return the value of a key in a section (by index, or the first
+	 *	section of the given name), or the default value if the key does
+	 *	not exist or cannot be converted
+	 */
+	bool		HasKey(size_t secIdx, const std::string &key) const { return FindEntry(secIdx, key)!=npos; };
+	std::string	GetString(size_t secIdx, const std::string &key, const std::string &defaultValue) const;
+	long		GetInteger(size_t secIdx, const std::string &key, long defaultValue) const;
+	double		GetReal(size_t secIdx, const std::string &key, double defaultValue) const;
+	bool		GetBoolean(size_t secIdx, const std::string &key, bool defaultValue) const;
+	bool		GetArray(size_t secIdx, const std::string &key, std::vector<double> &values) const;
+
+	bool		HasKey(const std::string &section, const std::string &key) const
+										{ return HasKey(FindSection(section), key); };
+	std::string	GetString(const std::string &section, const std::string &key, const std::string &defaultValue) const
+										{ return GetString(FindSection(section), key, defaultValue); };
+	long		GetInteger(const std::string &section, const std::string &key, long defaultValue) const
+										{ return GetInteger(FindSection(section), key, defaultValue); };
+	double		GetReal(const std::string &section, const std::string &key, double defaultValue) const
+										{ return GetReal(FindSection(section), key, defaultValue); };
+	bool		GetBoolean(const std::string &section, const std::string &key, bool defaultValue) const
+										{ return GetBoolean(FindSection(section), key, defaultValue); };
+	bool		GetArray(const std::string &section, const std::string &key, std::vector<double> &values) const
+										{ return GetArray(FindSection(section), key, values); };
+
+
+ private:
+
+	/*	Cache state flags of an entry	*/
+	enum { CachedReal = 1, ValidReal = 2, CachedArray = 4, ValidArray = 8 };
+
+	struct Section{
+		IniStringView	name;
+		size_t			firstEntry;
+		size_t			nEntries;
+		size_t			nextSameName;	/*	next section of the same name (npos: none)	*/
+	};
+
+	struct Entry{
+		size_t				section;
+		IniStringView		key;
+		IniStringView		value;
+		mutable unsigned char	cache;
+		mutable double			real;
+		mutable size_t			arrayOffset;
+		mutable size_t			arraySize;
+	};
+
+	MappedFile					file;
+	int							parseError;
+	std::vector<Section>		sections;
+	std::vector<Entry>			entries;
+	std::vector<size_t>			entrySlots;		/*	hash table of entry index+1 (0: empty)	*/
+	std::vector<size_t>			sectionSlots;	/*	hash table of the first section of a name	*/
+	std::deque<std::string>		joinedValues;	/*	storage of multi-line values	*/
+	mutable std::vector<double>	arrays;			/*	cached array values	*/
+
+	void Clear()
+	{
+		file.Close();
+		parseError = 0;
+		sections.clear();
+		entries.clear();
+		entrySlots.clear();
+		sectionSlots.clear();
+		joinedValues.clear();
+		arrays.clear();
+	};
+
+	/*	FNV-1a hash of a case-folded name, seeded with a section index	*/
+	static size_t HashName(const char* str, size_t n, size_t seed)
+	{
+		unsigned long long hash = 14695981039346656037ull ^ (seed*0x9E3779B97F4A7C15ull);
+		for(size_t idx=0; idx<n; idx++) {
+			hash ^= static_cast<unsigned char>( std::tolower(static_cast<unsigned char>(str[idx])) );
+			hash *= 1099511628211ull;
+		};
+		return static_cast<size_t>( hash ^ (hash>>32) );
+	};
+
+	void	BuildTables();
+	const Entry* GetEntry(size_t secIdx, const std::string &key) const
+	{
+		const size_t idx = FindEntry(secIdx, key);
+		return (idx==npos) ? 0 : &entries[idx];
+	};
+	static IniStringView Trim(const char* begin, const char* end);
+	static bool ParseNumber(const char* begin, const char* end, double &value, const char** next);
+};
+
+
+/*
+ *	Trim()
+ *
+ *	Removes leading and trailing white space
+ */
+inline IniStringView IniConfig::Trim(const char* begin, const char* end)
+{
+	while( (begin<end) && std::isspace(static_cast<unsigned char>(*begin)) ) {
+		begin++;
+	};
+	while( (end>begin) && std::isspace(static_cast<unsigned char>(end[-1])) ) {
+		end--;
+	};
+	return IniStringView(begin, static_cast<size_t>(end-begin));
+};
+
+
+/*
+ *	ParseNumber()
+ *
+ *	Converts the number starting at "begin" (the range need not be NUL
+ *	terminated). Returns false if no number was found
+ */
+inline bool IniConfig::ParseNumber(const char* begin, const char* end, double &value, const char** next)
+{
+	char		buffer[64];
+	const size_t n = std::min(static_cast<size_t>(end-begin), sizeof(buffer)-1);
+	std::memcpy(buffer, begin, n);
+	buffer[n] = 0;
+	char* stop = 0;
+	value = std::strtod(buffer, &stop);
+	if( stop==buffer ) {
+
+		/*	Logical values (e.g., mat2str of a logical array)	*/
+		if( !std::strncmp(buffer, "true", 4) || !std::strncmp(buffer, "false", 5) ) {
+			value = (buffer[0]=='t');
+			stop  = buffer + ((buffer[0]=='t') ? 4 : 5);
+		}
+		else {
+			return false;
+		};
+	};
+	if( next ) {
+		*next = begin + (stop-buffer);
+	};
+	return true;
+};
+
+
+/*
+ *	Parse()
+ */
+inline bool IniConfig::Parse(const char* text, size_t n)
+{
+	sections.clear();
+	entries.clear();
+	joinedValues.clear();
+	arrays.clear();
+	parseError = 0;
+
+	const char* cur = text;
+	const char* end = text+n;
+	if( (n>=3) && !std::memcmp(text, "\xEF\xBB\xBF", 3) ) {		/*	UTF-8 BOM	*/
+		cur += 3;
+	};
+
+	/*	Keys preceding the first section header belong to the section ""	*/
+	Section global = {IniStringView(cur,0), 0, 0, npos};
+	sections.push_back(global);
+
+	int lineNumber = 0;
+	while( cur<end ) {
+		const char* lineEnd = static_cast<const char*>( std::memchr(cur, '\n', static_cast<size_t>(end-cur)) );
+		if( !lineEnd ) {
+			lineEnd = end;
+		};
+		lineNumber++;
+		const IniStringView line		= Trim(cur, lineEnd);
+		const bool			isIndented	= (line.data>cur);
+		cur = lineEnd+1;
+		if( (line.size==0) || (line.data[0]==';') || (line.data[0]=='#') ) {
+			continue;
+		};
+
+		/*	Section header	*/
+		if( line.data[0]=='[' ) {
+			const char* close = static_cast<const char*>( std::memchr(line.data, ']', line.size) );
+			if( !close ) {
+				if( !parseError ) {
+					parseError = lineNumber;
+				};
+				continue;
+			};
+			Section section = {Trim(line.data+1, close), entries.size(), 0, npos};
+			sections.push_back(section);
+			continue;
+		};
+
+		/*	Key/value pair. Inline comments must follow white space and lie
+		 *	outside of brackets (e.g., "[1 2;3 4]")	*/
+		const char* lineStop  = line.data+line.size;
+		const char* separator = 0;
+		for(const char* ch=line.data; ch<lineStop; ch++) {
+			if( (*ch=='=') || (*ch==':') ) {
+				separator = ch;
+				break;
+			};
+		};
+		if( !separator ) {
+
+			/*	Continuation of a multi-line value	*/
+			if( isIndented && !entries.empty() && (entries.back().section==sections.size()-1) ) {
+				Entry &last = entries.back();
+				joinedValues.push_back(last.value.str() + "\n" + line.str());
+				last.value = IniStringView(joinedValues.back().data(), joinedValues.back().size());
+			}
+			else if( !parseError ) {
+				parseError = lineNumber;
+			};
+			continue;
+		};
+		int depth = 0;
+		const char* valueEnd = lineStop;
+		for(const char* ch=separator+1; ch<lineStop; ch++) {
+			if( *ch=='[' ) {
+				depth++;
+			}
+			else if( *ch==']' ) {
+				depth--;
+			}
+			else if( (depth<=0) && ((*ch==';') || (*ch=='#')) && std::isspace(static_cast<unsigned char>(ch[-1])) ) {
+				valueEnd = ch;
+				break;
+			};
+		};
+		Entry entry;
+		entry.section	  = sections.size()-1;
+		entry.key		  = Trim(line.data, separator);
+		entry.value		  = Trim(separator+1, valueEnd);
+		entry.cache		  = 0;
+		entry.real		  = 0;
+		entry.arrayOffset = 0;
+		entry.arraySize	  = 0;
+		entries.push_back(entry);
+		sections.back().nEntries++;
+	};
+
+	BuildTables();
+	return parseError==0;
+};
+
+
+/*
+ *	BuildTables()
+ *
+ *	Builds the open addressing hash tables of the sections and entries. A
+ *	repeated key within a section replaces the previous value
+ */
+inline void IniConfig::BuildTables()
+{
+	size_t nSlots = 16;
+	while( nSlots<2*entries.size() ) {
+		nSlots *= 2;
+	};
+	entrySlots.assign(nSlots, 0);
+	for(size_t idx=0; idx<entries.size(); idx++) {
+		const Entry &entry = entries[idx];
+		size_t slot = HashName(entry.key.data, entry.key.size, entry.section) & (nSlots-1);
+		while( entrySlots[slot] ) {
+			const Entry &other = entries[entrySlots[slot]-1];
+			if( (other.section==entry.section) && other.key.IsEqualNoCase(entry.key.data, entry.key.size) ) {
+				break;
+			};
+			slot = (slot+1) & (nSlots-1);
+		};
+		entrySlots[slot] = idx+1;
+	};
+
+	nSlots = 16;
+	while( nSlots<2*sections.size() ) {
+		nSlots *= 2;
+	};
+	sectionSlots.assign(nSlots, 0);
+	std::vector<size_t> lastSameName(sections.size(), static_cast<size_t>(npos));
+	for(size_t idx=0; idx<sections.size(); idx++) {
+		const Section &section = sections[idx];
+		size_t slot = HashName(section.name.data, section.name.size, npos) & (nSlots-1);
+		while( sectionSlots[slot] ) {
+			const size_t first = sectionSlots[slot]-1;
+			if( sections[first].name.IsEqualNoCase(section.name.data, section.name.size) ) {
+				break;
+			};
+			slot = (slot+1) & (nSlots-1);
+		};
+		if( sectionSlots[slot] ) {		/*	append to the list of sections of this name	*/
+			const size_t first = sectionSlots[slot]-1;
+			sections[ (lastSameName[first]==npos) ? first : lastSameName[first] ].nextSameName = idx;
+			lastSameName[first] = idx;
+		}
+		else {
+			sectionSlots[slot] = idx+1;
+		};
+	};
+};
+
+
+/*
+ *	FindSection()/FindSections()
+ *
+ *	Return the index of the first section (or all sections) of a name
+ */
+inline size_t IniConfig::FindSection(const std::string &name) const
+{
+	if( sectionSlots.empty() ) {
+		return npos;
+	};
+	const size_t mask = sectionSlots.size()-1;
+	for(size_t slot=HashName(name.data(), name.size(), npos) & mask; sectionSlots[slot]; slot=(slot+1) & mask) {
+		const size_t idx = sectionSlots[slot]-1;
+		if( sections[idx].name.IsEqualNoCase(name.data(), name.size()) ) {
+			return idx;
+		};
+	};
+	return npos;
+};
+
+inline std::vector<size_t> IniConfig::FindSections(const std::string &name) const
+{
+	std::vector<size_t> result;
+	for(size_t idx=FindSection(name); idx!=npos; idx=sections[idx].nextSameName) {
+		result.push_back(idx);
+	};
+	return result;
+};
+
+
+/*
+ *	FindEntry()
+ *
+ *	Returns the index of the entry of a key in a section (npos if the key
+ *	does not exist)
+ */
+inline size_t IniConfig::FindEntry(size_t secIdx, const std::string &key) const
+{
+	if( (secIdx==npos) || entrySlots.empty() ) {
+		return npos;
+	};
+	const size_t mask = entrySlots.size()-1;
+	for(size_t slot=HashName(key.data(), key.size(), secIdx) & mask; entrySlots[slot]; slot=(slot+1) & mask) {
+		const size_t idx = entrySlots[slot]-1;
+		if( (entries[idx].section==secIdx) && entries[idx].key.IsEqualNoCase(key.data(), key.size()) ) {
+			return idx;
+		};
+	};
+	return npos;
+};
+
+
+/*
+ *	GetString()
+ */
+inline std::string IniConfig::GetString(size_t secIdx, const std::string &key, const std::string &defaultValue) const
+{
+	const Entry* entry = GetEntry(secIdx, key);
+	return entry ? entry->value.str() : defaultValue;
+};
+
+
+/*
+ *	GetReal()/GetInteger()
+ *
+ *	Integers are also accepted in hexadecimal notation ("0x4d2")
+ */
+inline double IniConfig::GetReal(size_t secIdx, const std::string &key, double defaultValue) const
+{
+	const Entry* entry = GetEntry(secIdx, key);
+	if( !entry ) {
+		return defaultValue;
+	};
+	if( !(entry->cache & CachedReal) ) {
+		const char* next = 0;
+		const char* end	 = entry->value.data+entry->value.size;
+		if( ParseNumber(entry->value.data, end, entry->real, &next) ) {
+			entry->cache |= ValidReal;
+		};
+		entry->cache |= CachedReal;
+	};
+	return (entry->cache & ValidReal) ? entry->real : defaultValue;
+};
+
+inline long IniConfig::GetInteger(size_t secIdx, const std::string &key, long defaultValue) const
+{
+	const Entry* entry = GetEntry(secIdx, key);
+	if( !entry ) {
+		return defaultValue;
+	};
+	const IniStringView &value = entry->value;
+	if( (value.size>2) && (value.data[0]=='0') && ((value.data[1]=='x') || (value.data[1]=='X')) ) {
+		const std::string str = value.str();
+		char* stop = 0;
+		const long number = std::strtol(str.c_str(), &stop, 16);
+		return (stop>str.c_str()+2) ? number : defaultValue;
+	};
+	const double number = GetReal(secIdx, key, static_cast<double>(defaultValue));
+	return static_cast<long>(number);
+};
+
+
+/*
+ *	GetBoolean()
+ *
+ *	Valid values are "true", "yes", "on", "1" and "false", "no", "off", "0"
+ *	(case-insensitive)
+ */
+inline bool IniConfig::GetBoolean(size_t secIdx, const std::string &key, bool defaultValue) const
+{
+	const Entry* entry = GetEntry(secIdx, key);
+	if( !entry ) {
+		return defaultValue;
+	};
+	const char* trueValues[]  = {"true", "yes", "on", "1"};
+	const char* falseValues[] = {"false", "no", "off", "0"};
+	for(size_t idx=0; idx<4; idx++) {
+		if( entry->value.IsEqualNoCase(trueValues[idx], std::strlen(trueValues[idx])) ) {
+			return true;
+		}
+		else if( entry->value.IsEqualNoCase(falseValues[idx], std::strlen(falseValues[idx])) ) {
+			return false;
+		};
+	};
+	return defaultValue;
+};
+
+
+/*
+ *	GetArray()
+ *
+ *	Converts a MATLAB style array ("[1 2 3]", "[1,2;3,4]") or a list of
+ *	numbers to a vector (row-major order for matrices). Returns false if
+ *	the key does not exist or the value is not numeric
+ */
+inline bool IniConfig::GetArray(size_t secIdx, const std::string &key, std::vector<double> &values) const
+{
+	values.clear();
+	const Entry* entry = GetEntry(secIdx, key);
+	if( !entry ) {
+		return false;
+	};
+	if( !(entry->cache & CachedArray) ) {
+		entry->cache	   |= CachedArray;
+		entry->arrayOffset	= arrays.size();
+		const char* cur = entry->value.data;
+		const char* end = entry->value.data+entry->value.size;
+		bool isValid = true;
+		while( cur<end ) {
+			if( std::isspace(static_cast<unsigned char>(*cur)) || (*cur=='[') || (*cur==']') ||
+				(*cur==',') || (*cur==';') ) {
+				cur++;
+				continue;
+			};
+			double number;
+			if( !ParseNumber(cur, end, number, &cur) ) {
+				isValid = false;
+				break;
+			};
+			arrays.push_back(number);
+		};
+		if( isValid ) {
+			entry->cache	 |= ValidArray;
+			entry->arraySize  = arrays.size()-entry->arrayOffset;
+		}
+		else {
+			arrays.resize(entry->arrayOffset);
+		};
+	};
+	if( !(entry->cache & ValidArray) ) {
+		return false;
+	};
+	values.assign(arrays.begin()+entry->arrayOffset, arrays.begin()+entry->arrayOffset+entry->arraySize);
+	return true;
+};
+
+
+#endif
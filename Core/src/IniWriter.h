@@ -0,0 +1,155 @@
+/*
+ *	IniWriter.h
+ *
+ *	Buffered INI writer producing files read by IniConfig (e.g., the itkReg
+ *	job manifests). Sections and key/value pairs are appended to a memory
+ *	buffer that is written to disk with a single write, so manifests
+ *	describing thousands of jobs cost one file operation. Keys are written
+ *	in the tabbed style of inifile.m and numeric arrays use the MATLAB
+ *	syntax of mat2str ("[1 2;3 4]").
+ */
+
+
+#ifndef INIWRITER_H
+#define INIWRITER_H
+
+
+/*	C++ headers	*/
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+
+class IniWriter{
+
+ public:
+
+	IniWriter() {};
+
+	/*	Appends a section header	*/
+	void AddSection(const std::string &name)
+	{
+		if( !buffer.empty() ) {
+			buffer += '\n';
+		};
+		buffer += '[';
+		buffer += name;
+		buffer += "]\n";
+	};
+
+	/*	Appends a string value. Line breaks are written as indented
+	 *	continuation lines (see IniConfig)	*/
+	void Add(const std::string &key, const std::string &value)
+	{
+		buffer += '\t';
+		buffer += key;
+		buffer += " = ";
+		for(size_t idx=0; idx<value.size(); idx++) {
+			if( value[idx]=='\n' ) {
+				buffer += "\n\t\t";
+			}
+			else if( value[idx]!='\r' ) {
+				buffer += value[idx];
+			};
+		};
+		buffer += '\n';
+	};
+
+	void Add(const std::string &key, const char* value)
+	{
+		Add(key, std::string(value));
+	};
+
+	/*	Appends a logical value	*/
+	void Add(const std::string &key, bool value)
+	{
+		Add(key, std::string(value ? "true" : "false"));
+	};
+
+	/*	Appends a numeric scalar	*/
+	void Add(const std::string &key, double value)
+	{
+		std::string str;
+		AppendNumber(str, value);
+		Add(key, str);
+	};
+
+	/*	Appends an m-by-n numeric array stored in column-major order (as
+	 *	mat2str)	*/
+	void Add(const std::string &key, const double* values, size_t m, size_t n)
+	{
+		if( m*n==1 ) {
+			Add(key, values[0]);
+			return;
+		};
+		std::string str("[");
+		for(size_t r=0; r<m; r++) {
+			for(size_t c=0; c<n; c++) {
+				if( c ) {
+					str += ' ';
+				};
+				AppendNumber(str, values[r+c*m]);
+			};
+			if( r+1<m ) {
+				str += ';';
+			};
+		};
+		str += ']';
+		Add(key, str);
+	};
+
+	/*
+	 *	Write()
+	 *
+	 *	Writes the buffer to a file (replacing any existing file). Returns
+	 *	false on failure
+	 */
+	bool Write(const std::string &fName, std::string* error=0) const
+	{
+		FILE* fid = std::fopen(fName.c_str(), "wb");
+		if( !fid ) {
+			if( error ) {
+				*error = "Unable to open " + fName + " for writing";
+			};
+			return false;
+		};
+		const bool isWritten = (std::fwrite(buffer.data(), 1, buffer.size(), fid)==buffer.size());
+		if( (std::fclose(fid)!=0) || !isWritten ) {
+			if( error ) {
+				*error = "Unable to write " + fName;
+			};
+			return false;
+		};
+		return true;
+	};
+
+	const std::string& GetBuffer() const { return buffer; };
+
+
+ private:
+
+	std::string buffer;
+
+	static void AppendNumber(std::string &str, double value)
+	{
+		char number[32];
+		if( value!=value ) {
+			str += "NaN";
+		}
+		else if( (value>1.7976931348623157e308) || (value<-1.7976931348623157e308) ) {
+			str += (value>0) ? "Inf" : "-Inf";
+		}
+		else {
+			/*	Shortest of 15 (as mat2str) or 17 significant digits that
+			 *	reproduces the value	*/
+			std::snprintf(number, sizeof(number), "%.15g", value);
+			if( std::strtod(number, 0)!=value ) {
+				std::snprintf(number, sizeof(number), "%.17g", value);
+			};
+			str += number;
+		};
+	};
+};
+
+
+#endif
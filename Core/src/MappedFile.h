@@ -0,0 +1,227 @@
+/*
+ *	MappedFile.h
+ *
+ *	Minimal cross-platform (Windows/POSIX) memory-mapped file. Files are
+ *	mapped either read-only or copy-on-write (private writable pages that
+ *	never modify the file), or read/write for output files created with
+ *	a known size. Data are paged in by the OS on first access, so large
+ *	files can be "loaded" without copying them to memory.
+ */
+
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+
+/*	C++ headers	*/
+#include <cstddef>
+#include <string>
+
+/*	OS headers	*/
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+//	Define common types
+enum mappingType{		//	Access to the mapped pages
+	MapReadOnly,		//	writes to the pages are invalid
+	MapCopyOnWrite,		//	writes modify private copies of the pages only
+	MapReadWrite		//	writes are stored in the file
+};
+
+
+class MappedFile{
+
+ public:
+
+	MappedFile() : data(0), size(0)
+#ifdef _WIN32
+		, fileHandle(INVALID_HANDLE_VALUE), mapHandle(NULL)
+#endif
+	{};
+
+	~MappedFile() { Close(); };
+
+	/*
+	 *	Open()
+	 *
+	 *	Maps an existing file. Returns false if the file cannot be opened
+	 *	or mapped (empty files cannot be mapped)
+	 */
+	bool Open(const std::string &fName, mappingType access=MapReadOnly)
+	{
+		Close();
+#ifdef _WIN32
+		const DWORD fileAccess = (access==MapReadWrite) ? (GENERIC_READ|GENERIC_WRITE) : GENERIC_READ;
+		fileHandle = CreateFileA(fName.c_str(), fileAccess, FILE_SHARE_READ, NULL,
+								 OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+		if( fileHandle==INVALID_HANDLE_VALUE ) {
+			return false;
+		};
+		LARGE_INTEGER fileSize;
+		if( !GetFileSizeEx(fileHandle,&fileSize) || (fileSize.QuadPart==0) ) {
+			Close();
+			return false;
+		};
+		return Map(static_cast<size_t>(fileSize.QuadPart), access);
+#else
+		const int fd = open(fName.c_str(), (access==MapReadWrite) ? O_RDWR : O_RDONLY);
+		if( fd<0 ) {
+			return false;
+		};
+		struct stat info;
+		if( (fstat(fd,&info)!=0) || (info.st_size==0) ) {
+			close(fd);
+			return false;
+		};
+		const bool isMapped = Map(fd, static_cast<size_t>(info.st_size), access);
+		close(fd);	/*	the mapping keeps its own reference	*/
+		return isMapped;
+#endif
+	};
+
+	/*
+	 *	Create()
+	 *
+	 *	Creates (or truncates) a file of the requested size and maps it for
+	 *	reading and writing
+	 */
+	bool Create(const std::string &fName, size_t nBytes)
+	{
+		Close();
+		if( nBytes==0 ) {
+			return false;
+		};
+#ifdef _WIN32
+		fileHandle = CreateFileA(fName.c_str(), GENERIC_READ|GENERIC_WRITE, 0, NULL,
+								 CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if( fileHandle==INVALID_HANDLE_VALUE ) {
+			return false;
+		};
+		return Map(nBytes, MapReadWrite);
+#else
+		const int fd = open(fName.c_str(), O_RDWR|O_CREAT|O_TRUNC, 0644);
+		if( fd<0 ) {
+			return false;
+		};
+		if( ftruncate(fd, static_cast<off_t>(nBytes))!=0 ) {
+			close(fd);
+			return false;
+		};
+		const bool isMapped = Map(fd, nBytes, MapReadWrite);
+		close(fd);
+		return isMapped;
+#endif
+	};
+
+	/*
+	 *	Close()
+	 *
+	 *	Unmaps the file. Pending writes of read/write mappings are
+	 *	flushed by the OS
+	 */
+	void Close()
+	{
+#ifdef _WIN32
+		if( data ) {
+			UnmapViewOfFile(data);
+		};
+		if( mapHandle ) {
+			CloseHandle(mapHandle);
+		};
+		if( fileHandle!=INVALID_HANDLE_VALUE ) {
+			CloseHandle(fileHandle);
+		};
+		mapHandle  = NULL;
+		fileHandle = INVALID_HANDLE_VALUE;
+#else
+		if( data ) {
+			munmap(data, size);
+		};
+#endif
+		data = 0;
+		size = 0;
+	};
+
+	/*
+	 *	AdviseSequential()
+	 *
+	 *	Hints the OS that the mapping will be read front to back
+	 */
+	void AdviseSequential() const
+	{
+#ifndef _WIN32
+		if( data ) {
+			madvise(data, size, MADV_SEQUENTIAL);
+		};
+#endif
+	};
+
+	bool		IsOpen()  const { return data!=0; };
+	size_t		GetSize() const { return size; };
+	const char* GetData() const { return static_cast<const char*>(data); };
+	char*		GetWritableData() { return static_cast<char*>(data); };
+
+
+ private:
+
+	void*	data;
+	size_t	size;
+#ifdef _WIN32
+	HANDLE	fileHandle;
+	HANDLE	mapHandle;
+#endif
+
+	/*	Mappings cannot be copied	*/
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+#ifdef _WIN32
+	bool Map(size_t nBytes, mappingType access)
+	{
+		const DWORD protect = (access==MapReadWrite)   ? PAGE_READWRITE :
+							  (access==MapCopyOnWrite) ? PAGE_WRITECOPY : PAGE_READONLY;
+		const DWORD view	= (access==MapReadWrite)   ? FILE_MAP_WRITE :
+							  (access==MapCopyOnWrite) ? FILE_MAP_COPY  : FILE_MAP_READ;
+		const unsigned long long n = nBytes;
+		mapHandle = CreateFileMappingA(fileHandle, NULL, protect,
+									   static_cast<DWORD>(n>>32), static_cast<DWORD>(n & 0xFFFFFFFF), NULL);
+		if( !mapHandle ) {
+			Close();
+			return false;
+		};
+		data = MapViewOfFile(mapHandle, view, 0, 0, nBytes);
+		if( !data ) {
+			Close();
+			return false;
+		};
+		size = nBytes;
+		return true;
+	};
+#else
+	bool Map(int fd, size_t nBytes, mappingType access)
+	{
+		const int protect = (access==MapReadOnly) ? PROT_READ : (PROT_READ|PROT_WRITE);
+		const int flags	  = (access==MapReadWrite) ? MAP_SHARED : MAP_PRIVATE;
+		void* ptr = mmap(0, nBytes, protect, flags, fd, 0);
+		if( ptr==MAP_FAILED ) {
+			return false;
+		};
+		data = ptr;
+		size = nBytes;
+		return true;
+	};
+#endif
+};
+
+
+#endif
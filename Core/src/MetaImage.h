@@ -0,0 +1,815 @@
+/*
+ *	MetaImage.h
+ *
+ *	Reader/writer of ITK MetaImage files (*.mha with LOCAL data, or *.mhd
+ *	headers with a separate data file) shared by the registration
+ *	executables and the MEX front ends. The header is parsed once and the
+ *	element type of the file is preserved; uncompressed data in the host
+ *	byte order are memory-mapped, so the pixels are only paged in when
+ *	they are accessed.
+ *
+ *	Compressed data (CompressedData = True) are a single zlib stream, as
+ *	required by other MetaImage readers. The writer deflates the data in
+ *	independent chunks on all cores and joins them with sync flushes
+ *	(the zlib stream stays valid); the compressed size of every chunk is
+ *	stored in the CompressedDataChunks field, which allows the reader to
+ *	inflate the chunks in parallel. Files without this field (e.g.,
+ *	written by ITK) are inflated serially.
+ */
+
+
+#ifndef METAIMAGE_H
+#define METAIMAGE_H
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*	zlib headers	*/
+#include "zlib.h"
+
+/*	QUATTRO headers	*/
+#include "MappedFile.h"
+#include "ParallelFor.h"
+
+
+//	Define common types
+enum metaElementType{	//	MetaImage element types (MET_*)
+	MetUnknown,
+	MetChar,
+	MetUChar,
+	MetShort,
+	MetUShort,
+	MetInt,
+	MetUInt,
+	MetLongLong,
+	MetULongLong,
+	MetFloat,
+	MetDouble
+};
+
+/*	Element type names in the order of metaElementType	*/
+static const char* const metaElementNames[] = {
+	"MET_OTHER", "MET_CHAR", "MET_UCHAR", "MET_SHORT", "MET_USHORT", "MET_INT",
+	"MET_UINT", "MET_LONG_LONG", "MET_ULONG_LONG", "MET_FLOAT", "MET_DOUBLE"
+};
+
+/*	Element sizes (bytes) in the order of metaElementType	*/
+static const size_t metaElementSizes[] = { 0, 1, 1, 2, 2, 4, 4, 8, 8, 4, 8 };
+
+/*	Uncompressed bytes per chunk of compressed data	*/
+static const size_t metaChunkBytes = 4*1024*1024;
+
+
+/*
+ *	MetaElementTraits
+ *
+ *	Maps a C++ pixel type to the MetaImage element type
+ */
+template <class TPixel> struct MetaElementTraits				{ static const metaElementType type = MetUnknown; };
+template <> struct MetaElementTraits<char>					{ static const metaElementType type = MetChar; };
+template <> struct MetaElementTraits<signed char>			{ static const metaElementType type = MetChar; };
+template <> struct MetaElementTraits<unsigned char>			{ static const metaElementType type = MetUChar; };
+template <> struct MetaElementTraits<short>					{ static const metaElementType type = MetShort; };
+template <> struct MetaElementTraits<unsigned short>		{ static const metaElementType type = MetUShort; };
+template <> struct MetaElementTraits<int>					{ static const metaElementType type = MetInt; };
+template <> struct MetaElementTraits<unsigned int>			{ static const metaElementType type = MetUInt; };
+template <> struct MetaElementTraits<long long>				{ static const metaElementType type = MetLongLong; };
+template <> struct MetaElementTraits<unsigned long long>	{ static const metaElementType type = MetULongLong; };
+template <> struct MetaElementTraits<float>					{ static const metaElementType type = MetFloat; };
+template <> struct MetaElementTraits<double>				{ static const metaElementType type = MetDouble; };
+
+
+/*
+ *	MetaImageHeader
+ *
+ *	Parsed MetaImage header. All fields are also kept verbatim (in file
+ *	order) so that unknown fields can be passed through
+ */
+struct MetaImageHeader{
+	std::vector<size_t>			dimSize;
+	std::vector<double>			spacing;
+	std::vector<double>			offset;
+	std::vector<double>			transformMatrix;
+	metaElementType				elementType;
+	unsigned int				nChannels;
+	bool						isCompressed;
+	bool						isMSB;
+	size_t						compressedSize;		/*	zero if unknown	*/
+	std::vector<size_t>			chunkSizes;			/*	compressed size of each chunk	*/
+	size_t						chunkBytes;			/*	uncompressed bytes per chunk	*/
+	long long					headerSize;			/*	HeaderSize of separate data files	*/
+	std::string					dataFile;
+	std::vector< std::pair<std::string,std::string> > fields;
+
+	MetaImageHeader() : elementType(MetUnknown), nChannels(1), isCompressed(false),
+						isMSB(false), compressedSize(0), chunkBytes(0), headerSize(0),
+						dataFile("LOCAL") {};
+
+	size_t GetNumberOfPixels() const
+	{
+		size_t n = dimSize.empty() ? 0 : 1;
+		for(size_t dim=0; dim<dimSize.size(); dim++) {
+			n *= dimSize[dim];
+		};
+		return n;
+	};
+
+	size_t GetNumberOfElements() const	{ return GetNumberOfPixels()*nChannels; };
+	size_t GetElementSize() const		{ return metaElementSizes[elementType]; };
+	size_t GetDataSize() const			{ return GetNumberOfElements()*GetElementSize(); };
+
+	/*	Returns the verbatim value of a field (empty if missing)	*/
+	std::string GetField(const std::string &key) const
+	{
+		for(size_t idx=0; idx<fields.size(); idx++) {
+			if( fields[idx].first==key ) {
+				return fields[idx].second;
+			};
+		};
+		return std::string();
+	};
+};
+
+
+class MetaImage{
+
+ public:
+
+	MetaImage() : dataOffset(0), isDirect(false) {};
+
+	/*
+	 *	Read()
+	 *
+	 *	Parses the header of a MetaImage file and maps the data. Returns
+	 *	false (see GetError()) if the file cannot be read
+	 */
+	bool Read(const std::string &fName);
+
+	/*
+	 *	IsDirect()
+	 *
+	 *	Returns true if GetData() points to the mapped file, i.e., the
+	 *	data are uncompressed and stored in the host byte order
+	 */
+	bool IsDirect() const { return isDirect; };
+
+	/*
+	 *	GetData()
+	 *
+	 *	Returns the element data in the file's element type. Compressed or
+	 *	byte swapped data are decoded on the first call
+	 */
+	const void* GetData();
+
+	/*
+	 *	GetWritableData()
+	 *
+	 *	Same as GetData(), but the pages of a mapped file are copy-on-
+	 *	write, so the data can be modified without changing the file
+	 */
+	void* GetWritableData() { return const_cast<void*>( GetData() ); };
+
+	/*
+	 *	CopyTo()
+	 *
+	 *	Copies the elements to a buffer of type TPixel, converting from the
+	 *	file's element type if necessary. Data of the same type are decoded
+	 *	directly into the buffer
+	 */
+	template <class TPixel>
+	bool CopyTo(TPixel* dst, unsigned int nThreads=0);
+
+	/*
+	 *	Write()
+	 *
+	 *	Writes a MetaImage file with LOCAL data. The geometry, element type
+	 *	and pass-through fields are taken from the header (the data format
+	 *	fields are generated). The data are deflated in parallel chunks if
+	 *	header.isCompressed is set
+	 */
+	static bool Write(const std::string &fName, const MetaImageHeader &header, const void* data,
+					  int level=Z_DEFAULT_COMPRESSION, unsigned int nThreads=0, std::string* error=0);
+
+	const MetaImageHeader&	GetHeader() const	{ return header; };
+	const std::string&		GetError() const	{ return error; };
+
+
+ private:
+
+	MetaImageHeader				header;
+	std::shared_ptr<MappedFile>	headerFile;
+	std::shared_ptr<MappedFile>	dataFile;
+	size_t						dataOffset;		/*	first data byte in dataFile	*/
+	bool						isDirect;
+	std::vector<char>			buffer;			/*	decoded data	*/
+	std::string					error;
+
+	MetaImage(const MetaImage&);
+	MetaImage& operator=(const MetaImage&);
+
+	bool ParseHeader(const char* text, size_t n, size_t &headerEnd);
+	bool Decode(void* dst, unsigned int nThreads);
+	bool InflateChunks(const unsigned char* src, unsigned char* dst, unsigned int nThreads);
+	bool InflateStream(const unsigned char* src, size_t nSrc, unsigned char* dst);
+	bool Fail(const std::string &msg) { error = msg; return false; };
+
+	static bool IsHostMSB()
+	{
+		const unsigned short one = 1;
+		return *reinterpret_cast<const unsigned char*>(&one)==0;
+	};
+};
+
+
+/*
+ *	SwapBytes()
+ *
+ *	Reverses the byte order of n elements of the given size in place
+ */
+inline void SwapBytes(unsigned char* data, size_t n, size_t elementSize)
+{
+	if( elementSize<2 ) {
+		return;
+	};
+	ParallelFor(n, 1<<20, [&](size_t begin, size_t end, unsigned int) {
+		for(size_t idx=begin; idx<end; idx++) {
+			std::reverse(data+idx*elementSize, data+(idx+1)*elementSize);
+		};
+	});
+};
+
+
+/*
+ *	ParseMetaElementType()
+ *
+ *	Converts a MET_* name to the element type. MET_LONG and MET_ULONG are
+ *	4 byte integers in MetaIO
+ */
+inline metaElementType ParseMetaElementType(const std::string &name)
+{
+	for(unsigned int idx=1; idx<sizeof(metaElementSizes)/sizeof(size_t); idx++) {
+		if( name==metaElementNames[idx] ) {
+			return static_cast<metaElementType>(idx);
+		};
+	};
+	if( name=="MET_LONG" ) {
+		return MetInt;
+	}
+	else if( name=="MET_ULONG" ) {
+		return MetUInt;
+	};
+	return MetUnknown;
+};
+
+
+/*
+ *	ParseMetaValues()
+ *
+ *	Reads all numbers of a whitespace separated list
+ */
+template <class T>
+std::vector<T> ParseMetaValues(const std::string &str)
+{
+	std::vector<T>		values;
+	std::istringstream	stream(str);
+	T					value;
+	while( stream >> value ) {
+		values.push_back(value);
+	};
+	return values;
+};
+
+
+/*
+ *	ParseMetaBool()
+ *
+ *	Interprets True/False (any case) and 1/0 values
+ */
+inline bool ParseMetaBool(const std::string &str)
+{
+	return !str.empty() && (str[0]=='T' || str[0]=='t' || str[0]=='1');
+};
+
+
+/*
+ *	ParseHeader()
+ *
+ *	Parses the "Key = Value" lines up to (and including) ElementDataFile,
+ *	which is always the last field. headerEnd is set to the first byte
+ *	after that line
+ */
+inline bool MetaImage::ParseHeader(const char* text, size_t n, size_t &headerEnd)
+{
+	size_t pos			= 0;
+	bool   isComplete	= false;
+	while( (pos<n) && !isComplete ) {
+		const char* lineEnd = static_cast<const char*>( std::memchr(text+pos, '\n', n-pos) );
+		const size_t next	= lineEnd ? static_cast<size_t>(lineEnd-text)+1 : n;
+		std::string  line(text+pos, next-pos);
+		pos = next;
+
+		const size_t eq = line.find('=');
+		if( eq==std::string::npos ) {
+			continue;
+		};
+		const char*  space = " \t\r\n";
+		std::string  key   = line.substr(0, eq);
+		std::string  value = line.substr(eq+1);
+		key.erase(key.find_last_not_of(space)+1);
+		key.erase(0, key.find_first_not_of(space));
+		value.erase(value.find_last_not_of(space)+1);
+		value.erase(0, std::min(value.size(), value.find_first_not_of(space)));
+		header.fields.push_back( std::make_pair(key,value) );
+
+		if( key=="NDims" ) {
+			header.dimSize.resize( std::atoi(value.c_str()), 1 );
+		}
+		else if( key=="DimSize" ) {
+			header.dimSize = ParseMetaValues<size_t>(value);
+		}
+		else if( key=="ElementSpacing" ) {
+			header.spacing = ParseMetaValues<double>(value);
+		}
+		else if( (key=="Offset") || (key=="Origin") || (key=="Position") ) {
+			header.offset = ParseMetaValues<double>(value);
+		}
+		else if( (key=="TransformMatrix") || (key=="Rotation") || (key=="Orientation") ) {
+			header.transformMatrix = ParseMetaValues<double>(value);
+		}
+		else if( key=="ElementType" ) {
+			header.elementType = ParseMetaElementType(value);
+		}
+		else if( key=="ElementNumberOfChannels" ) {
+			header.nChannels = std::max(1, std::atoi(value.c_str()));
+		}
+		else if( (key=="CompressedData") ) {
+			header.isCompressed = ParseMetaBool(value);
+		}
+		else if( (key=="BinaryDataByteOrderMSB") || (key=="ElementByteOrderMSB") ) {
+			header.isMSB = ParseMetaBool(value);
+		}
+		else if( key=="CompressedDataSize" ) {
+			header.compressedSize = static_cast<size_t>( std::strtod(value.c_str(),0) );
+		}
+		else if( key=="CompressedDataChunks" ) {
+			std::vector<size_t> values = ParseMetaValues<size_t>(value);
+			if( values.size()>1 ) {
+				header.chunkBytes = values[0];
+				header.chunkSizes.assign(values.begin()+1, values.end());
+			};
+		}
+		else if( key=="HeaderSize" ) {
+			header.headerSize = std::atoll(value.c_str());
+		}
+		else if( key=="ElementDataFile" ) {
+			header.dataFile = value;
+			isComplete		= true;
+		};
+	};
+	headerEnd = pos;
+
+	if( !isComplete ) {
+		return Fail("Missing ElementDataFile field");
+	};
+	if( header.dimSize.empty() || (header.GetNumberOfPixels()==0) ) {
+		return Fail("Invalid DimSize field");
+	};
+	if( header.elementType==MetUnknown ) {
+		return Fail("Unsupported ElementType: " + header.GetField("ElementType"));
+	};
+	return true;
+};
+
+
+/*
+ *	Read()
+ */
+inline bool MetaImage::Read(const std::string &fName)
+{
+	header	   = MetaImageHeader();
+	isDirect   = false;
+	dataOffset = 0;
+	buffer.clear();
+	error.clear();
+
+	headerFile = std::make_shared<MappedFile>();
+	if( !headerFile->Open(fName, MapCopyOnWrite) ) {
+		return Fail("Unable to open " + fName);
+	};
+	size_t headerEnd = 0;
+	if( !ParseHeader(headerFile->GetData(), headerFile->GetSize(), headerEnd) ) {
+		return false;
+	};
+
+	/*	Locate the data	*/
+	if( header.dataFile=="LOCAL" ) {
+		dataFile   = headerFile;
+		dataOffset = headerEnd;
+	}
+	else if( header.dataFile.find_first_of(" \t")!=std::string::npos || header.dataFile=="LIST" ) {
+		return Fail("File lists (ElementDataFile = LIST or patterns) are not supported");
+	}
+	else {
+		std::string name = header.dataFile;
+		const size_t sep = fName.find_last_of("/\\");
+		if( (sep!=std::string::npos) && (name.find_first_of("/\\")!=0) && (name.find(':')==std::string::npos) ) {
+			name = fName.substr(0, sep+1) + name;
+		};
+		headerFile.reset();	/*	the header is no longer needed	*/
+		dataFile = std::make_shared<MappedFile>();
+		if( !dataFile->Open(name, MapCopyOnWrite) ) {
+			return Fail("Unable to open the data file " + name);
+		};
+		if( header.headerSize>0 ) {
+			dataOffset = static_cast<size_t>(header.headerSize);
+		}
+		else if( (header.headerSize<0) && !header.isCompressed ) {
+			dataOffset = dataFile->GetSize() - std::min(dataFile->GetSize(), header.GetDataSize());
+		};
+	};
+
+	/*	Validate the data size	*/
+	const size_t nAvailable = (dataFile->GetSize()>dataOffset) ? dataFile->GetSize()-dataOffset : 0;
+	if( header.isCompressed ) {
+		if( header.compressedSize>nAvailable ) {
+			return Fail("Truncated compressed data");
+		};
+	}
+	else if( nAvailable<header.GetDataSize() ) {
+		return Fail("Truncated image data");
+	};
+
+	/*	Use the mapped pages directly when possible. The data offset of
+	 *	LOCAL data is rarely aligned, in which case the elements are
+	 *	copied on first access	*/
+	const size_t alignment = header.GetElementSize();
+	isDirect = !header.isCompressed && ( (header.isMSB==IsHostMSB()) || (alignment==1) ) &&
+			   ( reinterpret_cast<size_t>(dataFile->GetData()+dataOffset) % alignment==0 );
+	if( !isDirect && !header.isCompressed ) {
+		dataFile->AdviseSequential();
+	};
+	return true;
+};
+
+
+/*
+ *	GetData()
+ */
+inline const void* MetaImage::GetData()
+{
+	if( !buffer.empty() ) {
+		return &buffer[0];
+	};
+	if( !dataFile ) {
+		return 0;
+	};
+	if( isDirect ) {
+		return dataFile->GetData()+dataOffset;
+	};
+
+	/*	The decoded data replace the mapping	*/
+	buffer.resize( header.GetDataSize() );
+	if( !Decode(&buffer[0], 0) ) {
+		buffer.clear();
+		return 0;
+	};
+	dataFile.reset();
+	headerFile.reset();
+	return &buffer[0];
+};
+
+
+/*
+ *	CopyTo()
+ */
+template <class TPixel>
+bool MetaImage::CopyTo(TPixel* dst, unsigned int nThreads)
+{
+	const size_t n = header.GetNumberOfElements();
+	if( MetaElementTraits<TPixel>::type==header.elementType ) {
+		if( isDirect || !buffer.empty() ) {
+			const char* src = static_cast<const char*>( GetData() );
+			ParallelFor(n*sizeof(TPixel), metaChunkBytes, [&](size_t begin, size_t end, unsigned int) {
+				std::memcpy(reinterpret_cast<char*>(dst)+begin, src+begin, end-begin);
+			}, nThreads);
+			return true;
+		};
+		return Decode(dst, nThreads);
+	};
+
+	/*	Convert the element type	*/
+	const void* src = GetData();
+	if( !src ) {
+		return false;
+	};
+	#define METAIMAGE_CONVERT(TElement)													\
+		ParallelFor(n, 1<<18, [&](size_t begin, size_t end, unsigned int) {			\
+			const TElement* ptr = static_cast<const TElement*>(src);					\
+			for(size_t idx=begin; idx<end; idx++) {										\
+				dst[idx] = static_cast<TPixel>(ptr[idx]);								\
+			};																			\
+		}, nThreads);
+	switch( header.elementType ) {
+		case MetChar:		METAIMAGE_CONVERT(signed char);			break;
+		case MetUChar:		METAIMAGE_CONVERT(unsigned char);		break;
+		case MetShort:		METAIMAGE_CONVERT(short);				break;
+		case MetUShort:		METAIMAGE_CONVERT(unsigned short);		break;
+		case MetInt:		METAIMAGE_CONVERT(int);					break;
+		case MetUInt:		METAIMAGE_CONVERT(unsigned int);		break;
+		case MetLongLong:	METAIMAGE_CONVERT(long long);			break;
+		case MetULongLong:	METAIMAGE_CONVERT(unsigned long long);	break;
+		case MetFloat:		METAIMAGE_CONVERT(float);				break;
+		case MetDouble:		METAIMAGE_CONVERT(double);				break;
+		default:			return Fail("Unsupported ElementType");
+	};
+	#undef METAIMAGE_CONVERT
+	return true;
+};
+
+
+/*
+ *	Decode()
+ *
+ *	Copies/inflates the data to dst (GetDataSize() bytes) and converts
+ *	them to the host byte order
+ */
+inline bool MetaImage::Decode(void* dst, unsigned int nThreads)
+{
+	const unsigned char* src  = reinterpret_cast<const unsigned char*>( dataFile->GetData()+dataOffset );
+	unsigned char*		 out  = static_cast<unsigned char*>(dst);
+	const size_t		 nOut = header.GetDataSize();
+	if( header.isCompressed ) {
+		const size_t nSrc = header.compressedSize ? header.compressedSize : dataFile->GetSize()-dataOffset;
+		size_t nChunked = 0;
+		for(size_t idx=0; idx<header.chunkSizes.size(); idx++) {
+			nChunked += header.chunkSizes[idx];
+		};
+		const bool isChunked = (header.chunkBytes>0) && (nChunked+6<=nSrc) &&
+							   (header.chunkSizes.size()==(nOut+header.chunkBytes-1)/header.chunkBytes);
+		if( isChunked ? !InflateChunks(src, out, nThreads) : !InflateStream(src, nSrc, out) ) {
+			return false;
+		};
+	}
+	else {
+		ParallelFor(nOut, metaChunkBytes, [&](size_t begin, size_t end, unsigned int) {
+			std::memcpy(out+begin, src+begin, end-begin);
+		}, nThreads);
+	};
+	if( header.isMSB!=IsHostMSB() ) {
+		SwapBytes(out, header.GetNumberOfElements(), header.GetElementSize());
+	};
+	return true;
+};
+
+
+/*
+ *	InflateStream()
+ *
+ *	Serial inflate of a zlib (or gzip) stream
+ */
+inline bool MetaImage::InflateStream(const unsigned char* src, size_t nSrc, unsigned char* dst)
+{
+	z_stream stream;
+	std::memset(&stream, 0, sizeof(stream));
+	if( inflateInit2(&stream, 15+32)!=Z_OK ) {
+		return Fail("Unable to initialize zlib");
+	};
+
+	/*	zlib counts are 32-bit, so large buffers are fed in pieces	*/
+	const size_t nMax = 1u<<30;
+	size_t		 nIn  = 0, nOut = 0;
+	const size_t nDst = header.GetDataSize();
+	int			 status = Z_OK;
+	while( status==Z_OK ) {
+		stream.next_in	 = const_cast<unsigned char*>(src+nIn);
+		stream.avail_in	 = static_cast<uInt>( std::min(nMax, nSrc-nIn) );
+		stream.next_out	 = dst+nOut;
+		stream.avail_out = static_cast<uInt>( std::min(nMax, nDst-nOut) );
+		const uInt availIn = stream.avail_in, availOut = stream.avail_out;
+		status = inflate(&stream, Z_NO_FLUSH);
+		nIn	  += availIn-stream.avail_in;
+		nOut  += availOut-stream.avail_out;
+		if( (status==Z_BUF_ERROR) && (nIn<nSrc) && (nOut<nDst) ) {
+			status = Z_OK;
+		};
+	};
+	inflateEnd(&stream);
+	if( nOut!=nDst ) {
+		return Fail("Corrupt or truncated compressed data");
+	};
+	return true;
+};
+
+
+/*
+ *	InflateChunks()
+ *
+ *	Parallel inflate of a stream written by Write(). The raw deflate data
+ *	of every chunk follow the 2 byte zlib header and can be inflated
+ *	independently because the chunks do not share a dictionary
+ */
+inline bool MetaImage::InflateChunks(const unsigned char* src, unsigned char* dst, unsigned int nThreads)
+{
+	const size_t		nChunks = header.chunkSizes.size();
+	const size_t		nDst	= header.GetDataSize();
+	std::vector<size_t> offsets(nChunks, 2);
+	for(size_t idx=1; idx<nChunks; idx++) {
+		offsets[idx] = offsets[idx-1] + header.chunkSizes[idx-1];
+	};
+
+	std::vector<char> isValid(nChunks, 0);
+	ParallelFor(nChunks, 1, [&](size_t begin, size_t end, unsigned int) {
+		for(size_t idx=begin; idx<end; idx++) {
+			z_stream stream;
+			std::memset(&stream, 0, sizeof(stream));
+			if( inflateInit2(&stream, -15)!=Z_OK ) {
+				continue;
+			};
+			const size_t nOut = std::min(header.chunkBytes, nDst-idx*header.chunkBytes);
+			stream.next_in	 = const_cast<unsigned char*>(src+offsets[idx]);
+			stream.avail_in	 = static_cast<uInt>( header.chunkSizes[idx] );
+			stream.next_out	 = dst+idx*header.chunkBytes;
+			stream.avail_out = static_cast<uInt>(nOut);
+			const int status = inflate(&stream, Z_SYNC_FLUSH);
+			isValid[idx] = ( (status==Z_OK) || (status==Z_STREAM_END) || (status==Z_BUF_ERROR) ) &&
+						   (stream.avail_out==0);
+			inflateEnd(&stream);
+		};
+	}, nThreads);
+
+	if( std::find(isValid.begin(), isValid.end(), 0)!=isValid.end() ) {
+		return Fail("Corrupt compressed data chunk");
+	};
+	return true;
+};
+
+
+/*
+ *	Write()
+ */
+inline bool MetaImage::Write(const std::string &fName, const MetaImageHeader &header, const void* data,
+							 int level, unsigned int nThreads, std::string* error)
+{
+	const unsigned char* src   = static_cast<const unsigned char*>(data);
+	const size_t		 nData = header.GetDataSize();
+	if( (header.elementType==MetUnknown) || (nData==0) ) {
+		if( error ) {
+			*error = "Invalid image size or element type";
+		};
+		return false;
+	};
+
+	/*	Deflate the chunks in parallel. Every chunk but the last ends with
+	 *	a sync flush so that the concatenation is a valid deflate stream	*/
+	std::vector< std::vector<unsigned char> > chunks;
+	std::vector<uLong>						  checksums;
+	if( header.isCompressed ) {
+		const size_t nChunks = (nData+metaChunkBytes-1)/metaChunkBytes;
+		chunks.resize(nChunks);
+		checksums.resize(nChunks);
+		std::vector<char> isValid(nChunks, 0);
+		ParallelFor(nChunks, 1, [&](size_t begin, size_t end, unsigned int) {
+			for(size_t idx=begin; idx<end; idx++) {
+				const size_t nIn = std::min(metaChunkBytes, nData-idx*metaChunkBytes);
+				const unsigned char* in = src+idx*metaChunkBytes;
+				z_stream stream;
+				std::memset(&stream, 0, sizeof(stream));
+				if( deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY)!=Z_OK ) {
+					continue;
+				};
+				chunks[idx].resize( deflateBound(&stream, static_cast<uLong>(nIn))+16 );
+				stream.next_in	 = const_cast<unsigned char*>(in);
+				stream.avail_in	 = static_cast<uInt>(nIn);
+				stream.next_out	 = &chunks[idx][0];
+				stream.avail_out = static_cast<uInt>( chunks[idx].size() );
+				const int status = deflate(&stream, (idx+1==nChunks) ? Z_FINISH : Z_SYNC_FLUSH);
+				isValid[idx] = (status==Z_STREAM_END) || ( (status==Z_OK) && (stream.avail_in==0) );
+				chunks[idx].resize( stream.total_out );
+				checksums[idx] = adler32(adler32(0L,Z_NULL,0), in, static_cast<uInt>(nIn));
+				deflateEnd(&stream);
+			};
+		}, nThreads);
+		if( std::find(isValid.begin(), isValid.end(), 0)!=isValid.end() ) {
+			if( error ) {
+				*error = "Unable to compress the image data";
+			};
+			return false;
+		};
+	};
+
+	/*	Header	*/
+	std::ostringstream out;
+	out.precision(17);
+	out << "ObjectType = Image\n";
+	out << "NDims = " << header.dimSize.size() << "\n";
+	out << "BinaryData = True\n";
+	out << "BinaryDataByteOrderMSB = " << (IsHostMSB() ? "True" : "False") << "\n";
+	out << "CompressedData = " << (header.isCompressed ? "True" : "False") << "\n";
+	uLong checksum = adler32(0L,Z_NULL,0);
+	size_t nCompressed = 6;		/*	zlib header and trailer	*/
+	if( header.isCompressed ) {
+		out << "CompressedDataChunks = " << metaChunkBytes;
+		for(size_t idx=0; idx<chunks.size(); idx++) {
+			const size_t nIn = std::min(metaChunkBytes, nData-idx*metaChunkBytes);
+			checksum	 = adler32_combine(checksum, checksums[idx], static_cast<z_off_t>(nIn));
+			nCompressed += chunks[idx].size();
+			out << " " << chunks[idx].size();
+		};
+		out << "\n";
+		out << "CompressedDataSize = " << nCompressed << "\n";
+	};
+
+	/*	Pass-through fields	*/
+	const char* generated[] = { "ObjectType", "NDims", "BinaryData", "BinaryDataByteOrderMSB", "ElementByteOrderMSB",
+								"CompressedData", "CompressedDataSize", "CompressedDataChunks", "ElementSpacing",
+								"Offset", "Origin", "Position", "TransformMatrix", "Rotation", "Orientation",
+								"DimSize", "ElementNumberOfChannels", "ElementType", "HeaderSize",
+								"ElementDataFile" };
+	for(size_t idx=0; idx<header.fields.size(); idx++) {
+		const std::string &key = header.fields[idx].first;
+		bool isGenerated = key.empty();
+		for(size_t gIdx=0; gIdx<sizeof(generated)/sizeof(generated[0]); gIdx++) {
+			isGenerated = isGenerated || (key==generated[gIdx]);
+		};
+		if( !isGenerated ) {
+			out << key << " = " << header.fields[idx].second << "\n";
+		};
+	};
+
+	/*	Geometry and data format	*/
+	struct {
+		const char*					 key;
+		const std::vector<double>*	 values;
+	} geometry[] = { {"TransformMatrix", &header.transformMatrix}, {"Offset", &header.offset},
+					 {"ElementSpacing", &header.spacing} };
+	for(size_t idx=0; idx<3; idx++) {
+		if( geometry[idx].values->empty() ) {
+			continue;
+		};
+		out << geometry[idx].key << " =";
+		for(size_t vIdx=0; vIdx<geometry[idx].values->size(); vIdx++) {
+			out << " " << (*geometry[idx].values)[vIdx];
+		};
+		out << "\n";
+	};
+	out << "DimSize =";
+	for(size_t dim=0; dim<header.dimSize.size(); dim++) {
+		out << " " << header.dimSize[dim];
+	};
+	out << "\n";
+	if( header.nChannels>1 ) {
+		out << "ElementNumberOfChannels = " << header.nChannels << "\n";
+	};
+	out << "ElementType = " << metaElementNames[header.elementType] << "\n";
+	out << "ElementDataFile = LOCAL\n";
+
+	/*	Pad the first key so that uncompressed data start on an 8 byte
+	 *	boundary and can be used directly from the mapped file (MetaImage
+	 *	readers ignore white space around the keys)	*/
+	std::string text = out.str();
+	if( !header.isCompressed && (text.size()%8) ) {
+		text.insert(text.find(' '), 8-text.size()%8, ' ');
+	};
+
+	/*	Write the file	*/
+	FILE* fid = std::fopen(fName.c_str(), "wb");
+	if( !fid ) {
+		if( error ) {
+			*error = "Unable to open " + fName + " for writing";
+		};
+		return false;
+	};
+	bool isWritten = std::fwrite(text.data(), 1, text.size(), fid)==text.size();
+	if( header.isCompressed ) {
+		const unsigned char zlibHeader[2] = { 0x78, 0x9C };
+		const unsigned char zlibTrailer[4] = { static_cast<unsigned char>(checksum>>24),
+											   static_cast<unsigned char>(checksum>>16),
+											   static_cast<unsigned char>(checksum>>8),
+											   static_cast<unsigned char>(checksum) };
+		isWritten = isWritten && (std::fwrite(zlibHeader, 1, 2, fid)==2);
+		for(size_t idx=0; isWritten && (idx<chunks.size()); idx++) {
+			isWritten = std::fwrite(&chunks[idx][0], 1, chunks[idx].size(), fid)==chunks[idx].size();
+		};
+		isWritten = isWritten && (std::fwrite(zlibTrailer, 1, 4, fid)==4);
+	}
+	else {
+		isWritten = isWritten && (std::fwrite(src, 1, nData, fid)==nData);
+	};
+	isWritten = (std::fclose(fid)==0) && isWritten;
+	if( !isWritten && error ) {
+		*error = "Unable to write " + fName;
+	};
+	return isWritten;
+};
+
+
+#endif
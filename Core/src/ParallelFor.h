@@ -0,0 +1,128 @@
+/*
+ *	ParallelFor.h
+ *
+ *	Lightweight parallel loop used by QUATTRO's native engines. Work is
+ *	handed out to the worker threads in chunks of a user specified size
+ *	from a shared atomic counter (dynamic chunking), so uneven work (e.g.,
+ *	voxels that fail to converge) is balanced without a task queue.
+ */
+
+
+#ifndef PARALLELFOR_H
+#define PARALLELFOR_H
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/*
+ *	GetNumberOfWorkerThreads()
+ *
+ *	Returns the number of threads used by ParallelFor. The value can be
+ *	capped by setting the environment variable QUATTRO_NUM_THREADS,
+ *	which is useful when several MATLAB sessions share a node.
+ */
+inline unsigned int GetNumberOfWorkerThreads()
+{
+	unsigned int nThreads = std::thread::hardware_concurrency();
+	const char*	 envValue = std::getenv("QUATTRO_NUM_THREADS");
+	if( envValue ) {
+		int envThreads = std::atoi(envValue);
+		if( envThreads>0 ) {
+			nThreads = static_cast<unsigned int>(envThreads);
+		};
+	};
+	return (nThreads>0) ? nThreads : 1;
+};
+
+
+/*
+ *	ParallelFor()
+ *
+ *	Calls fcn(begin,end,threadId) for consecutive ranges [begin,end) of
+ *	at most "chunk" items until all "n" items have been processed. The
+ *	thread identifier (0 to nThreads-1) can be used to index thread
+ *	local workspaces. When nThreads is zero, GetNumberOfWorkerThreads()
+ *	is used. The first exception thrown by a worker is re-thrown on the
+ *	calling thread after all workers have stopped.
+ */
+template <class TFunction>
+void ParallelFor(size_t n, size_t chunk, TFunction fcn, unsigned int nThreads=0)
+{
+	if( n==0 ) {
+		return;
+	};
+	if( chunk==0 ) {
+		chunk = 1;
+	};
+	if( nThreads==0 ) {
+		nThreads = GetNumberOfWorkerThreads();
+	};
+	nThreads = static_cast<unsigned int>( std::min<size_t>(nThreads, (n+chunk-1)/chunk) );
+
+	/*	Avoid the thread overhead for small problems	*/
+	if( nThreads<=1 ) {
+		for(size_t begin=0; begin<n; begin+=chunk) {
+			fcn(begin, std::min(begin+chunk,n), 0u);
+		};
+		return;
+	};
+
+	std::atomic<size_t>	next(0);
+	std::exception_ptr	error;
+	std::mutex			errorLock;
+	std::vector<std::thread> workers;
+	workers.reserve(nThreads);
+	for(unsigned int threadId=0; threadId<nThreads; threadId++) {
+		workers.push_back( std::thread([&, threadId]() {
+			try {
+				for(size_t begin=next.fetch_add(chunk); begin<n; begin=next.fetch_add(chunk)) {
+					fcn(begin, std::min(begin+chunk,n), threadId);
+				};
+			}
+			catch( ... ) {
+				std::lock_guard<std::mutex> lock(errorLock);
+				if( !error ) {
+					error = std::current_exception();
+				};
+				next = n;	/*	stop handing out work	*/
+			};
+		}) );
+	};
+	for(size_t idx=0; idx<workers.size(); idx++) {
+		workers[idx].join();
+	};
+	if( error ) {
+		std::rethrow_exception(error);
+	};
+};
+
+
+/*
+ *	GetNumberOfParallelSlots()
+ *
+ *	Returns the number of thread local workspaces that should be allocated
+ *	for a call to ParallelFor with the same arguments.
+ */
+inline unsigned int GetNumberOfParallelSlots(size_t n, size_t chunk, unsigned int nThreads=0)
+{
+	if( chunk==0 ) {
+		chunk = 1;
+	};
+	if( nThreads==0 ) {
+		nThreads = GetNumberOfWorkerThreads();
+	};
+	size_t nChunks = (n+chunk-1)/chunk;
+	return static_cast<unsigned int>( std::max<size_t>(1, std::min<size_t>(nThreads, nChunks)) );
+};
+
+
+#endif
@@ -0,0 +1,384 @@
+/*
+ *	display_cache.cxx
+ *
+ *	MEX front end of the image display engine (see DisplayCache.h)
+ *
+ *	ID = display_cache('add',V) caches the M-by-N-by-P-by-... real numeric
+ *	or logical array V (e.g., all slices and frames of a series) as P*...
+ *	planes together with their downsampled pyramid, returning the numeric
+ *	identifier of the cache. Caches persist until removed or until the MEX
+ *	file is cleared.
+ *
+ *	display_cache('remove',ID) removes the cache ID and display_cache('clear')
+ *	removes all caches.
+ *
+ *	[RGB,ALPHA] = display_cache('render',ID,PLANE,CLIM,CMAP) renders the plane
+ *	PLANE (linear index of the third and higher dimensions) of the cache ID
+ *	using the color limits CLIM ([WL-WW/2 WL+WW/2]) and the n-by-3 colormap
+ *	CMAP. RGB is a uint8 true color image and ALPHA is a single precision
+ *	array that is 0 for NaN voxels and the transparency elsewhere.
+ *
+ *	[RGB,ALPHA] = display_cache('renderimage',I,CLIM,CMAP) renders the 2-D
+ *	array I without caching.
+ *
+ *	Both render syntaxes accept the following options:
+ *
+ *		Option String		Description
+ *		===========================================================
+ *		'Size'				Two element vector specifying the display size in
+ *							pixels. The coarsest pyramid level with at least
+ *							this many rows and columns is rendered (cached
+ *							syntax only). Default: full resolution
+ *
+ *		'Transparency'		Scalar in [0,1] specifying the opacity of the
+ *							overlay (or of the image when no overlay is
+ *							specified). Default: 1
+ *
+ *		'Overlay'			Map to blend onto the image: a cache identifier
+ *							(cached syntax; the same plane is rendered) or an
+ *							array of the same size as I
+ *
+ *		'OverlayLimits'		Color limits of the overlay. Default: [0 1]
+ *
+ *		'OverlayColormap'	Colormap of the overlay. Default: CMAP
+ */
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+/*	MATLAB headers	*/
+#include "mex.h"
+
+/*	QUATTRO headers	*/
+#include "DisplayCache.h"
+
+
+/*	Series caches and the next cache identifier	*/
+static std::map<unsigned int, std::shared_ptr<DisplaySeries> > caches;
+static unsigned int nextId = 1;
+
+
+static void ClearCaches()
+{
+	caches.clear();
+};
+
+
+/*
+ *	ConvertElements()
+ *
+ *	Converts the elements of an array to single precision
+ */
+template <class TIn>
+void ConvertElements(const TIn* src, size_t n, float* dst)
+{
+	ParallelFor(n, 1<<18, [&](size_t begin, size_t end, unsigned int) {
+		for(size_t idx=begin; idx<end; idx++) {
+			dst[idx] = static_cast<float>(src[idx]);
+		};
+	});
+};
+
+static void ConvertElements(const mxArray* array, float* dst)
+{
+	const void*	 data = mxGetData(array);
+	const size_t n	  = mxGetNumberOfElements(array);
+	switch( mxGetClassID(array) ) {
+		case mxINT8_CLASS:		ConvertElements(static_cast<const signed char*>(data), n, dst);			break;
+		case mxLOGICAL_CLASS:
+		case mxUINT8_CLASS:		ConvertElements(static_cast<const unsigned char*>(data), n, dst);		break;
+		case mxINT16_CLASS:		ConvertElements(static_cast<const short*>(data), n, dst);				break;
+		case mxUINT16_CLASS:	ConvertElements(static_cast<const unsigned short*>(data), n, dst);		break;
+		case mxINT32_CLASS:		ConvertElements(static_cast<const int*>(data), n, dst);					break;
+		case mxUINT32_CLASS:	ConvertElements(static_cast<const unsigned int*>(data), n, dst);		break;
+		case mxINT64_CLASS:		ConvertElements(static_cast<const long long*>(data), n, dst);			break;
+		case mxUINT64_CLASS:	ConvertElements(static_cast<const unsigned long long*>(data), n, dst);	break;
+		case mxSINGLE_CLASS:	ConvertElements(static_cast<const float*>(data), n, dst);				break;
+		case mxDOUBLE_CLASS:	ConvertElements(static_cast<const double*>(data), n, dst);				break;
+		default:
+			mexErrMsgIdAndTxt("QUATTRO:display_cache:invalidImage",
+							  "Unsupported image class");
+	};
+};
+
+
+static void ValidateImage(const mxArray* array, const char* name)
+{
+	if( (!mxIsNumeric(array) && !mxIsLogical(array)) || mxIsComplex(array) || mxIsEmpty(array) ) {
+		mexErrMsgIdAndTxt("QUATTRO:display_cache:invalidImage",
+						  "%s must be a real, non-empty numeric or logical array", name);
+	};
+};
+
+
+static std::shared_ptr<DisplaySeries> GetCache(const mxArray* id)
+{
+	if( !mxIsNumeric(id) || (mxGetNumberOfElements(id)!=1) ) {
+		mexErrMsgIdAndTxt("QUATTRO:display_cache:invalidId",
+						  "Cache identifiers must be numeric scalars");
+	};
+	std::map<unsigned int, std::shared_ptr<DisplaySeries> >::const_iterator it =
+									caches.find( static_cast<unsigned int>(mxGetScalar(id)) );
+	if( it==caches.end() ) {
+		mexErrMsgIdAndTxt("QUATTRO:display_cache:invalidId",
+						  "No cache exists with the identifier %g", mxGetScalar(id));
+	};
+	return it->second;
+};
+
+
+static void SetLimits(DisplayLut &lut, const mxArray* clim)
+{
+	if( !mxIsDouble(clim) || (mxGetNumberOfElements(clim)!=2) ) {
+		mexErrMsgIdAndTxt("QUATTRO:display_cache:invalidLimits",
+						  "Color limits must be specified as a two element double vector");
+	};
+	lut.SetLimits(mxGetPr(clim)[0], mxGetPr(clim)[1]);
+};
+
+
+static void SetColormap(DisplayLut &lut, const mxArray* map)
+{
+	if( !mxIsDouble(map) || (mxGetN(map)!=3) || (mxGetM(map)==0) ) {
+		mexErrMsgIdAndTxt("QUATTRO:display_cache:invalidColormap",
+						  "Colormaps must be n-by-3 double arrays");
+	};
+	lut.SetColormap(mxGetPr(map), mxGetM(map));
+};
+
+
+/*	Render options	*/
+struct RenderOptions{
+	const mxArray*	size;
+	const mxArray*	overlay;
+	const mxArray*	overlayLimits;
+	const mxArray*	overlayColormap;
+	double			transparency;
+};
+
+
+static RenderOptions ParseOptions(int nrhs, const mxArray *prhs[])
+{
+	RenderOptions opts = {0, 0, 0, 0, 1.0};
+	if( nrhs%2 ) {
+		mexErrMsgIdAndTxt("QUATTRO:display_cache:invalidInput",
+						  "Options must be specified as name/value pairs");
+	};
+	for(int idx=0; idx<nrhs; idx+=2) {
+		if( !mxIsChar(prhs[idx]) ) {
+			mexErrMsgIdAndTxt("QUATTRO:display_cache:invalidInput",
+							  "Option names must be strings");
+		};
+		char* str = mxArrayToString(prhs[idx]);
+		const std::string name(str);
+		mxFree(str);
+		const mxArray* value = prhs[idx+1];
+		if( name=="Size" ) {
+			if( !mxIsDouble(value) || (mxGetNumberOfElements(value)<2) ) {
+				mexErrMsgIdAndTxt("QUATTRO:display_cache:invalidInput",
+								  "Size must be a two element double vector");
+			};
+			opts.size = value;
+		}
+		else if( name=="Transparency" ) {
+			if( !mxIsNumeric(value) || (mxGetNumberOfElements(value)!=1) ) {
+				mexErrMsgIdAndTxt("QUATTRO:display_cache:invalidInput",
+								  "Transparency must be a numeric scalar");
+			};
+			opts.transparency = std::min(std::max(mxGetScalar(value),0.0),1.0);
+		}
+		else if( name=="Overlay" ) {
+			opts.overlay = value;
+		}
+		else if( name=="OverlayLimits" ) {
+			opts.overlayLimits = value;
+		}
+		else if( name=="OverlayColormap" ) {
+			opts.overlayColormap = value;
+		}
+		else {
+			mexErrMsgIdAndTxt("QUATTRO:display_cache:invalidInput",
+							  "Unknown option: %s", name.c_str());
+		};
+	};
+	return opts;
+};
+
+
+/*
+ *	Render()
+ *
+ *	Maps an image (and optional overlay) of rows-by-cols voxels to the
+ *	outputs of the render syntaxes
+ */
+static void Render(int nlhs, mxArray *plhs[], const float* image, const float* overlay,
+				   size_t rows, size_t cols, const DisplayLut &lut, const DisplayLut &overlayLut,
+				   double transparency)
+{
+	const size_t n = rows*cols;
+	std::vector<DisplayColor> colors(n);
+	lut.Apply(image, n, &colors[0]);
+	const unsigned int alpha = static_cast<unsigned int>(transparency*255.0+0.5);
+	if( overlay ) {
+		std::vector<DisplayColor> overColors(n);
+		overlayLut.Apply(overlay, n, &overColors[0]);
+		BlendColors(&colors[0], &overColors[0], n, alpha);
+	};
+
+	mwSize dims[3] = {rows, cols, 3};
+	plhs[0] = mxCreateNumericArray(3, dims, mxUINT8_CLASS, mxREAL);
+	std::vector<unsigned char> alphaData(nlhs>1 ? n : 0);
+	SplitColors(&colors[0], n, static_cast<unsigned char*>(mxGetData(plhs[0])),
+				alphaData.empty() ? 0 : &alphaData[0]);
+	if( nlhs>1 ) {
+		plhs[1] = mxCreateNumericMatrix(rows, cols, mxSINGLE_CLASS, mxREAL);
+		float* out = static_cast<float*>(mxGetData(plhs[1]));
+		const float value = overlay ? 1.0f : static_cast<float>(transparency);
+		for(size_t idx=0; idx<n; idx++) {
+			out[idx] = alphaData[idx] ? value : 0.0f;
+		};
+	};
+};
+
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+
+	/*	Validate the command	*/
+	if( (nrhs<1) || !mxIsChar(prhs[0]) ) {
+		mexErrMsgIdAndTxt("QUATTRO:display_cache:invalidInput",
+						  "A command string must be specified");
+	};
+	char* str = mxArrayToString(prhs[0]);
+	const std::string cmd(str);
+	mxFree(str);
+	mexAtExit(ClearCaches);
+
+	if( cmd=="add" ) {
+		if( nrhs!=2 ) {
+			mexErrMsgIdAndTxt("QUATTRO:display_cache:invalidInput",
+							  "The add command requires an image array");
+		};
+		ValidateImage(prhs[1], "V");
+		const mwSize* dims = mxGetDimensions(prhs[1]);
+		const size_t  rows = dims[0];
+		const size_t  cols = dims[1];
+		std::shared_ptr<DisplaySeries> series(new DisplaySeries);
+		try {
+			series->Initialize(rows, cols, mxGetNumberOfElements(prhs[1])/(rows*cols));
+			ConvertElements(prhs[1], series->GetPlane(0,0));
+			series->BuildPyramid();
+		}
+		catch( const std::bad_alloc& ) {
+			mexErrMsgIdAndTxt("QUATTRO:display_cache:outOfMemory",
+							  "Insufficient memory to cache the series");
+		};
+		caches[nextId] = series;
+		plhs[0] = mxCreateDoubleScalar(nextId++);
+	}
+	else if( cmd=="remove" ) {
+		if( nrhs!=2 ) {
+			mexErrMsgIdAndTxt("QUATTRO:display_cache:invalidInput",
+							  "The remove command requires a cache identifier");
+		};
+		GetCache(prhs[1]);
+		caches.erase( static_cast<unsigned int>(mxGetScalar(prhs[1])) );
+	}
+	else if( cmd=="clear" ) {
+		ClearCaches();
+	}
+	else if( cmd=="render" ) {
+		if( nrhs<5 ) {
+			mexErrMsgIdAndTxt("QUATTRO:display_cache:invalidInput",
+							  "The render command requires ID, PLANE, CLIM and CMAP");
+		};
+		std::shared_ptr<DisplaySeries> series = GetCache(prhs[1]);
+		const double plane = mxIsNumeric(prhs[2]) ? mxGetScalar(prhs[2]) : 0.0;
+		if( (plane<1) || (plane>series->GetNumberOfPlanes()) ) {
+			mexErrMsgIdAndTxt("QUATTRO:display_cache:invalidPlane",
+							  "PLANE must be in the range [1 %u]",
+							  static_cast<unsigned int>(series->GetNumberOfPlanes()));
+		};
+		DisplayLut lut, overlayLut;
+		SetLimits(lut, prhs[3]);
+		SetColormap(lut, prhs[4]);
+		const RenderOptions opts = ParseOptions(nrhs-5, prhs+5);
+
+		/*	Pyramid level	*/
+		size_t level = 0;
+		if( opts.size ) {
+			const double* size = mxGetPr(opts.size);
+			level = series->GetLevel(static_cast<size_t>(std::max(size[0],1.0)),
+									 static_cast<size_t>(std::max(size[1],1.0)));
+		};
+
+		/*	Overlay	*/
+		const float* overlay = 0;
+		std::shared_ptr<DisplaySeries> overlaySeries;
+		if( opts.overlay ) {
+			overlaySeries = GetCache(opts.overlay);
+			if( (overlaySeries->GetRows(0)!=series->GetRows(0)) || (overlaySeries->GetCols(0)!=series->GetCols(0)) ||
+				(overlaySeries->GetNumberOfPlanes()<plane) || (overlaySeries->GetNumberOfLevels()<=level) ) {
+				mexErrMsgIdAndTxt("QUATTRO:display_cache:invalidOverlay",
+								  "The overlay cache must have the size of the image cache");
+			};
+			overlayLut.SetLimits(0.0, 1.0);
+			if( opts.overlayLimits ) {
+				SetLimits(overlayLut, opts.overlayLimits);
+			};
+			SetColormap(overlayLut, opts.overlayColormap ? opts.overlayColormap : prhs[4]);
+			overlay = overlaySeries->GetPlane(level, static_cast<size_t>(plane)-1);
+		};
+
+		Render(nlhs, plhs, series->GetPlane(level, static_cast<size_t>(plane)-1), overlay,
+			   series->GetRows(level), series->GetCols(level), lut, overlayLut, opts.transparency);
+	}
+	else if( cmd=="renderimage" ) {
+		if( nrhs<4 ) {
+			mexErrMsgIdAndTxt("QUATTRO:display_cache:invalidInput",
+							  "The renderimage command requires I, CLIM and CMAP");
+		};
+		ValidateImage(prhs[1], "I");
+		if( mxGetNumberOfDimensions(prhs[1])!=2 ) {
+			mexErrMsgIdAndTxt("QUATTRO:display_cache:invalidImage",
+							  "I must be a 2-D array");
+		};
+		DisplayLut lut, overlayLut;
+		SetLimits(lut, prhs[2]);
+		SetColormap(lut, prhs[3]);
+		const RenderOptions opts = ParseOptions(nrhs-4, prhs+4);
+
+		const size_t rows = mxGetM(prhs[1]);
+		const size_t cols = mxGetN(prhs[1]);
+		std::vector<float> image(rows*cols), overlay;
+		ConvertElements(prhs[1], &image[0]);
+		if( opts.overlay ) {
+			ValidateImage(opts.overlay, "The overlay");
+			if( (mxGetM(opts.overlay)!=rows) || (mxGetN(opts.overlay)!=cols) ||
+				(mxGetNumberOfDimensions(opts.overlay)!=2) ) {
+				mexErrMsgIdAndTxt("QUATTRO:display_cache:invalidOverlay",
+								  "The overlay must have the size of I");
+			};
+			overlay.resize(rows*cols);
+			ConvertElements(opts.overlay, &overlay[0]);
+			overlayLut.SetLimits(0.0, 1.0);
+			if( opts.overlayLimits ) {
+				SetLimits(overlayLut, opts.overlayLimits);
+			};
+			SetColormap(overlayLut, opts.overlayColormap ? opts.overlayColormap : prhs[3]);
+		};
+
+		Render(nlhs, plhs, &image[0], overlay.empty() ? 0 : &overlay[0],
+			   rows, cols, lut, overlayLut, opts.transparency);
+	}
+	else {
+		mexErrMsgIdAndTxt("QUATTRO:display_cache:invalidInput",
+						  "Unknown command: %s", cmd.c_str());
+	};
+};
@@ -0,0 +1,113 @@
+/*
+ *	mr_noise.cxx
+ *
+ *	MEX front end of the counter-based noise generator (see CounterRng.h)
+ *
+ *	J = mr_noise(I,SIG) adds Rician noise of standard deviation SIG to the real
+ *	double or single array I: zero-mean Gaussian noise is added to the real
+ *	and imaginary channels and J (double) is the magnitude, as in addmrinoise.
+ *	The noise of each element depends only on the seed and the element index,
+ *	so the result does not depend on the number of threads. Elements are
+ *	processed on all cores.
+ *
+ *	J = mr_noise(...,'Option',VALUE,...) specifies the following options:
+ *
+ *		Option String		Description
+ *		===========================================================
+ *		'Distribution'		'rician' or 'gaussian' (real channel only).
+ *							Default: 'rician'
+ *
+ *		'Seed'				Non-negative integer seed of the generator.
+ *							Default: 0
+ */
+
+
+/*	C++ headers	*/
+#include <string>
+
+/*	MATLAB headers	*/
+#include "mex.h"
+
+/*	QUATTRO headers	*/
+#include "CounterRng.h"
+#include "ParallelFor.h"
+
+
+template <class T>
+void AddNoise(const CounterRng &rng, const T* im, size_t n, double sigma, bool isRician, double* out)
+{
+	ParallelFor(n, 65536, [&](size_t begin, size_t end, unsigned int) {
+		rng.AddNoise(im+begin, end-begin, sigma, isRician, begin, 0, out+begin);
+	});
+};
+
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+
+	/*	Validate the inputs	*/
+	if( nrhs<2 ) {
+		mexErrMsgIdAndTxt("QUATTRO:mr_noise:invalidInput",
+						  "I and SIG must be specified");
+	};
+	if( !(mxIsDouble(prhs[0]) || mxIsSingle(prhs[0])) || mxIsComplex(prhs[0]) ) {
+		mexErrMsgIdAndTxt("QUATTRO:mr_noise:invalidInput",
+						  "I must be a real double or single array");
+	};
+	if( !mxIsNumeric(prhs[1]) || (mxGetNumberOfElements(prhs[1])!=1) ) {
+		mexErrMsgIdAndTxt("QUATTRO:mr_noise:invalidInput",
+						  "SIG must be a numeric scalar");
+	};
+	const double sigma = mxGetScalar(prhs[1]);
+
+	/*	Parse the options	*/
+	bool	 isRician = true;
+	uint64_t seed	  = 0;
+	if( nrhs%2 ) {
+		mexErrMsgIdAndTxt("QUATTRO:mr_noise:invalidInput",
+						  "Options must be specified as name/value pairs");
+	};
+	for(int idx=2; idx<nrhs; idx+=2) {
+		if( !mxIsChar(prhs[idx]) ) {
+			mexErrMsgIdAndTxt("QUATTRO:mr_noise:invalidInput",
+							  "Option names must be strings");
+		};
+		char* str = mxArrayToString(prhs[idx]);
+		const std::string name(str);
+		mxFree(str);
+		const mxArray* value = prhs[idx+1];
+		if( name=="Distribution" ) {
+			char* dStr = mxIsChar(value) ? mxArrayToString(value) : 0;
+			const std::string dist(dStr ? dStr : "");
+			mxFree(dStr);
+			if( (dist!="rician") && (dist!="gaussian") ) {
+				mexErrMsgIdAndTxt("QUATTRO:mr_noise:invalidInput",
+								  "Distribution must be 'rician' or 'gaussian'");
+			};
+			isRician = (dist=="rician");
+		}
+		else if( name=="Seed" ) {
+			if( !mxIsNumeric(value) || (mxGetNumberOfElements(value)!=1) || !(mxGetScalar(value)>=0) ) {
+				mexErrMsgIdAndTxt("QUATTRO:mr_noise:invalidInput",
+								  "Seed must be a non-negative numeric scalar");
+			};
+			seed = static_cast<uint64_t>( mxGetScalar(value) );
+		}
+		else {
+			mexErrMsgIdAndTxt("QUATTRO:mr_noise:invalidInput",
+							  "Unknown option: %s", name.c_str());
+		};
+	};
+
+	/*	Create the output and add the noise	*/
+	const size_t n = mxGetNumberOfElements(prhs[0]);
+	plhs[0] = mxCreateNumericArray(mxGetNumberOfDimensions(prhs[0]), mxGetDimensions(prhs[0]),
+								   mxDOUBLE_CLASS, mxREAL);
+	const CounterRng rng(seed);
+	if( mxIsDouble(prhs[0]) ) {
+		AddNoise(rng, mxGetPr(prhs[0]), n, sigma, isRician, mxGetPr(plhs[0]));
+	}
+	else {
+		AddNoise(rng, static_cast<const float*>( mxGetData(prhs[0]) ), n, sigma, isRician, mxGetPr(plhs[0]));
+	};
+};
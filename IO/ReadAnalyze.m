@@ -14,6 +14,19 @@ end
 volsize = double(header.hdr.dime.dim(2:4));
 voxdims = double(header.hdr.dime.pixdim(2:4));
 
+% Read the volume (any datatype, including 4D files) with the native reader
+% and reorder it as below: transposed slices, flipped rows and reversed slice
+% order
+if (exist('nifti_read','file')==3)
+    if isempty( strfind(filename,'.img') )
+        V = nifti_read([filename '.img']);
+    else
+        V = nifti_read(filename);
+    end
+    V = permute(V(:,end:-1:1,end:-1:1,:),[2 1 3 4]);
+    return
+end
+
 % Find image type (precision)
 switch (header.hdr.dime.bitpix)
     case 16
@@ -3,45 +3,51 @@ function roi = imagejread(sData)
 %
 %   ROI = imagejread(FILE) reads the ImageJ ROI data contained in FILE.
 %
+%   ROI = imagejread(S) converts the ROI data S, either a cell array of the
+%   file's lines or an element of the structure returned by roi_read.
+%
 %   See also nordiciceread
 
 % Initialize output
 roi = struct('colors',[],'coordinates',[],'names','','slice',[],'types',''); %#ok<*NASGU>
 
-% Determine input type
-if ischar(sData) && exist(sData,'file')
+% Determine input type. When available, files are parsed by the roi_read MEX
+% file, which also returns structures parsed previously (e.g., by import_rois)
+if ischar(sData) && exist(sData,'file') && (exist('roi_read','file')==3)
+    sData = roi_read(sData);
+elseif ischar(sData) && exist(sData,'file')
     fid = fopen(sData,'r');
     sData = textscan(fid,'%s','Delimiter','\n' );
     sData = sData{1}; fclose(fid);
 end
 
-% Scan data points
-roi_coors = cellfun(@(x) sscanf(x,'%d;%d'),sData(3:end)',...
+% Scan data points, storing the n-by-2 array of coordinates
+if isstruct(sData)
+    roi_type  = sData.Type;
+    roi_coors = sData.Coordinates;
+else
+    roi_type  = sData{2};
+    roi_coors = cellfun(@(x) sscanf(x,'%d;%d'),sData(3:end)',...
                                                          'UniformOutput',false);
+    try
+        roi_coors = permute(cell2mat(roi_coors),[2 1]);
+    catch ME
+        rethrow(ME);
+    end
+end
 
 % Restructure data
-switch lower(sData{2})
+switch lower(roi_type)
     case {'freehand','polygon'}
-        sData{2} = strrep(sData{2},'freehand','imspline');
-        sData{2} = strrep(sData{2},'polygon','impoly');
-        try
-            roi_coors = cell2mat(roi_coors);
-            roi_coors = permute(roi_coors,[2 1]);
-        catch ME
-            rethrow(ME);
-        end
+        roi_type = strrep(roi_type,'freehand','imspline');
+        roi_type = strrep(roi_type,'polygon','impoly');
 
     case {'ellipse','rectangle'}
-        sData{2} = strrep(sData{2},'ellipse','imellipse');
-        sData{2} = strrep(sData{2},'rectangle','imrect');
-        try
-            roi_coors = cell2mat(roi_coors);
-            roi_coors = roi_coors(:)'; roi_coors = roi_coors([3 4 1 2]);
-        catch ME
-            rethrow(ME);
-        end
+        roi_type  = strrep(roi_type,'ellipse','imellipse');
+        roi_type  = strrep(roi_type,'rectangle','imrect');
+        roi_coors = reshape(roi_coors',1,[]); roi_coors = roi_coors([3 4 1 2]);
 end
 
 % Store ROI output data
 roi = struct('colors',[],'coordinates',roi_coors,'names','','slice',1,...
-                                                          'types',sData{2});
\ No newline at end of file
+                                                          'types',roi_type);
\ No newline at end of file
@@ -133,6 +133,12 @@ mapData = eval([fmt '_import']);
         file_types = {'AUC90', 'AUC180', 'CER', 'fp', 'Ke', 'Kt', 'MxSlp',...
                       'r2mask', 'r2', 'Slp', 'TTP', 've', 'WshOut'};
 
+        % When available, all maps are read in parallel by the roi_batch MEX file
+        batchMaps = [];
+        if (exist('roi_batch','file')==3)
+            [batchMaps,isValid] = roi_batch('maps',fullfile(fPaths,files),fliplr(m(1:2)));
+        end
+
         % Loads each map
         for i = 1:length( slices )
 
@@ -166,30 +172,39 @@ mapData = eval([fmt '_import']);
                     continue
                 end
 
-                % Opens file for reading
-                fid = fopen(fullfile(fPaths, files{ind(j)}), 'r');
+                % Read the map (maps read by roi_batch are already in place)
+                if ~isempty(batchMaps)
+                    if ~isValid(ind(j))
+                        error_list{i} = files{ind(j)};
+                        continue
+                    end
+                    tempMap = double(batchMaps(:,:,ind(j)));
+                else
+                    % Opens file for reading
+                    fid = fopen(fullfile(fPaths, files{ind(j)}), 'r');
+
+                    % ERROR CHECK: Ensures that the file opened properly
+                    if isequal( fid, -1 )
+                        errordlg([files{ind(j)} ' could not be loaded'],...
+                                 'Read Error.');
+                        continue
+                    end
 
-                % ERROR CHECK: Ensures that the file opened properly
-                if isequal( fid, -1 )
-                    errordlg([files{ind(j)} ' could not be loaded'],...
-                             'Read Error.');
-                    continue
-                end
+                    % Temporarily stores file data and closes the open file
+                    tempMap = fread(fid, 'single', 0, 'l');
+                    fclose(fid);
 
-                % Temporarily stores file data and closes the open file
-                tempMap = fread(fid, 'single', 0, 'l');
-                fclose(fid);
+                    % ERROR CHECK: Ensures that the loaded data is the same size as the
+                    % image
+                    if ~isequal( numel(tempMap), im_pixels )
+                        error_list{i} = files{ind(j)};
+                        continue
+                    end
 
-                % ERROR CHECK: Ensures that the loaded data is the same size as the
-                % image
-                if ~isequal( numel(tempMap), im_pixels )
-                    error_list{i} = files{ind(j)};
-                    continue
+                    % Resize parametric map to fit size of DICOM image
+                    tempMap = reshape(tempMap,m)';
                 end
 
-                % Resize parametric map to fit size of DICOM image
-                tempMap = reshape(tempMap,m)';
-
                 switch map_type
                     case {'fp'}
                         temp_overlays{end+1} = tempMap;
@@ -1,4 +1,4 @@
-function [rData fInfo] = import_rois
+function [rData fInfo batch] = import_rois(varargin)
 %import_rois  Deteremines the ROI data type and loads all data
 %
 %   [rois f_info] = import_rois allows the user to select and import ROI
@@ -7,35 +7,80 @@ function [rData fInfo] = import_rois
 %   that varies by software package (e.g. Pinnacle header is stored in
 %   f_info). An attempt is made to automatically determine the header
 %   software package; if this fails, no data is returned. 
+%
+%   [rois f_info B] = import_rois(FILES,M) imports the ROI files FILES (a cell
+%   array of file names or a directory, searched recursively for *.roi files)
+%   without user interaction. When the roi_batch MEX file is available, all
+%   files are read and their ROIs are rasterised onto the M(1)-by-M(2) image
+%   grid in a single parallel call. B is the batch structure of roi_batch,
+%   which also holds the run-length encoded mask of each ROI, and the ROI
+%   coordinates are one-based image coordinates (see roi_batch).
+%
+%   [...] = import_rois(FILES,M,HDR) converts Pinnacle contours to image
+%   coordinates using the Pinnacle header structure HDR.
 
 % Initialize output
 rData = struct('colors','','coordinates',[],'names','','slice',[],'types','');
 roiType = struct('Filename','','Filepath','','Software','');
+batch = [];
 
-% Get file names
-[fNames,ok] = qt_uigetfile({'*.roi','ROI file (*.roi)'},...
-                            'Select ROIs to import.','','on');
-if ~ok
-    [rData,fInfo] = deal([]);
+% Bulk import of a list or directory tree of files
+if nargin>1 && (exist('roi_batch','file')==3)
+    [rData,batch] = import_batch(varargin{:});
+    fInfo         = [];
     return
 end
 
+% Get file names
+if nargin
+    fNames = varargin{1};
+    if ischar(fNames) && (exist(fNames,'dir')==7)
+        fList  = dir( fullfile(fNames,'*.roi') );
+        fNames = fullfile(fNames,{fList.name});
+    end
+else
+    [fNames,ok] = qt_uigetfile({'*.roi','ROI file (*.roi)'},...
+                                'Select ROIs to import.','','on');
+    if ~ok
+        [rData,fInfo] = deal([]);
+        return
+    end
+end
+
+% qt_uigetfile returns full file names
+fNames = cellstr(fNames);
+fPath  = '';
+
+% When available, all files are parsed in parallel by the roi_read MEX file
+parsed = [];
+if (exist('roi_read','file')==3)
+    parsed = roi_read(fNames);
+end
+
 % Load ROIs
 n = length(fNames); roiType = repmat(roiType,1,n);
 for i = 1:n
 
     % Load ROI data
-    fid = fopen( fullfile(fPath,fNames{i}), 'r' );
-    if fid==-1
-        errordlg(['Unable to load ' fNames{i}],'Load Error');
-        continue
-    end
-    s = textscan(fid,'%s','Delimiter','\n' ); s = s{1};
-    fclose(fid);
+    if ~isempty(parsed)
+        s = parsed(i);
+        if ~isempty(s.Error)
+            errordlg(['Unable to load ' fNames{i}],'Load Error');
+            continue
+        end
+    else
+        fid = fopen( fullfile(fPath,fNames{i}), 'r' );
+        if fid==-1
+            errordlg(['Unable to load ' fNames{i}],'Load Error');
+            continue
+        end
+        s = textscan(fid,'%s','Delimiter','\n' ); s = s{1};
+        fclose(fid);
 
-    if isempty(s)
-        errordlg(['No data found in ' fNames{i}],'Read Error');
-        continue
+        if isempty(s)
+            errordlg(['No data found in ' fNames{i}],'Read Error');
+            continue
+        end
     end
 
     [roiType(i),rData(i)] = find_roi_type(s);
@@ -71,6 +116,15 @@ end
                                                      'Software','Unknown');
         roi = struct('colors',[],'coordinates',[],'names','','slice',[],'types','');
 
+        % Natively parsed files
+        if isstruct(sdata)
+            s.Software = sdata.Software;
+            if strcmpi(s.Software,'NordicICE')
+                roi = nordiciceread(sdata);
+            end
+            return
+        end
+
         % Pinnacle definition
         if strcmpi( sdata{1}, '// Region of Interest file' )
             s.Software = 'Pinnacle';
@@ -87,4 +141,37 @@ end
         end
     end %find_roi_type
 
-end %import_rois
\ No newline at end of file
+end %import_rois
+
+
+%------------------------------------------------------
+function [rData,b] = import_batch(files,m,hdr)
+%import_batch  Imports ROI files using the roi_batch MEX file
+
+    % Read and rasterise all ROIs
+    if (nargin>2)
+        b = roi_batch('import',files,m,'Header',hdr);
+    else
+        b = roi_batch('import',files,m);
+    end
+
+    % Rectangles and ellipses are stored by two corners in the batch structure,
+    % while imrect and imellipse expect the position [X Y WIDTH HEIGHT]
+    coors = b.Vertices;
+    isBox = ismember(b.Types,{'imrect','imellipse'});
+    coors(isBox) = cellfun(@(v) [v(1,:) v(2,:)-v(1,:)],coors(isBox),...
+                                                         'UniformOutput',false);
+
+    % Deal the ROI structure
+    [fPaths,fNames,fExts] = cellfun(@fileparts,b.Files,'UniformOutput',false);
+    fNames = strcat(fNames,fExts);
+    rData  = struct('colors','',...
+                    'coordinates',coors,...
+                    'names',b.Names,...
+                    'slice',num2cell(b.Slices),...
+                    'types',b.Types,...
+                    'Filename',fNames(b.FileIndex),...
+                    'Filepath',fPaths(b.FileIndex),...
+                    'Software',b.Software(b.FileIndex))';
+
+end %import_batch
\ No newline at end of file
@@ -23,7 +23,11 @@ function metadata = mhainfo(varargin)
     logical_flds     = {'BinaryData',...
                         'BinaryDataByteOrderMSB',...
                         'CompressedData'};
-    int_array_flds   = {'DimSize',...
+    int_array_flds   = {'CompressedDataChunks',...
+                        'CompressedDataSize',...
+                        'DimSize',...
+                        'ElementNumberOfChannels',...
+                        'HeaderSize',...
                         'NDims'};
     float_array_flds = {'CenterOfRotation',....
                         'ElementSpacing',...
@@ -2,35 +2,122 @@ function I = mharead(varargin)
 %mharead  Read MHA image
 %
 %   I = mharead(FILENAME) attempts to read the image data from an MHA image file
-%   specified by the string FILENAME. The output will be an ND array.
+%   specified by the string FILENAME. The output will be an ND array of the
+%   class specified by the ElementType field (e.g., MET_SHORT images are
+%   returned as int16).
 %
 %   I = mharead(INFO) reads the image data from an MHA header structure INFO.
 %   The INFO structure is generated from the mhainfo function.
 %
-%   See also mhainfo mhawrite
+%   M = mharead(...,'MemoryMap',true) returns a memmapfile object M instead of
+%   reading the data. The image is accessed as M.Data.I and the pages of the
+%   file are only read when the corresponding voxels are accessed, which is
+%   useful for large 4D series. Only uncompressed data stored in the byte order
+%   of the computer can be memory-mapped.
+%
+%   When the compiled mha_read MEX file is available, it is used to read the
+%   data (compressed data are inflated on all cores).
+%
+%   See also mhainfo mhawrite mha_read
+
+    % Parse the inputs
+    isMap = (nargin>2) && strcmpi(varargin{2},'MemoryMap') && varargin{3};
+
+    % Determine if input was struct or file name
+    if ~isstruct(varargin{1})
+        fName = varargin{1};
+        if ~isMap && (exist('mha_read','file')==3)
+            I = mha_read(fName);
+            return
+        end
+        hdr = mhainfo(fName);
+    else
+        hdr = varargin{1};
+        if ~isMap && (exist('mha_read','file')==3)
+            I = mha_read(hdr.Filename);
+            return
+        end
+    end
+
+    % Determine the location and format of the data
+    isCompressed = isfield(hdr,'CompressedData') && hdr.CompressedData;
+    [~,~,endian] = computer;
+    isMSB        = isfield(hdr,'BinaryDataByteOrderMSB') &&...
+                                                      hdr.BinaryDataByteOrderMSB;
+    fmt          = {'b','l'};
+    fmt          = fmt{2-isMSB};
+    dataFile     = hdr.Filename;
+    offset       = hdr.BeginningOfImage;
+    if ~strcmpi(hdr.ElementDataFile,'local')
+        dataFile = fullfile(fileparts(hdr.Filename),hdr.ElementDataFile);
+        offset   = 0;
+    end
+    precision = mha_precision(hdr.ElementType);
+
+    % Memory-map the data
+    if isMap
+        if isCompressed || (isMSB~=strcmpi(endian,'B'))
+            error([mfilename ':invalidMemoryMap'],...
+                  'Only uncompressed data in the native byte order can be mapped.');
+        end
+        I = memmapfile(dataFile,'Offset',offset,...
+                                'Format',{precision,hdr.DimSize,'I'});
+        return
+    end
+
+    if isCompressed
+        error([mfilename ':compressedData'],...
+              'Compressed MHA files require the mha_read MEX file.');
+    end
+
+    % Open file for reading
+    fid = fopen(dataFile,'r',fmt);
+    if fid==-1
+        error([mfilename ':invalidFile'],'Unable to read specified file.');
+    end
+
+    % Seek to the image
+    fseek(fid,offset,-1);
+
+    % Read the image, preserving the element type
+    I = fread(fid,prod(hdr.DimSize),['*' precision]);
+
+    % Resize the image
+    I = reshape(I,[hdr.DimSize 1]);
 
-% Determine if input was struct or file name
-if ~isstruct(varargin{1})
-    hdr = mhainfo(varargin{1});
-else
-    hdr = varargin{1};
-end
+    % Close the image
+    fclose(fid);
 
-% Open file for reading
-fid = fopen(hdr.Filename,'r');
-if fid==-1
-    error([mfilename ':invalidFile'],'Unable to read specified file.');
-end
+end %mharead
 
-% Seek to the image
-fseek(fid,hdr.BeginningOfImage,-1);
 
-% Read the image
-perc = lower( strrep(hdr.ElementType,'MET_','') );
-I = fread(fid,inf,perc);
+%----------------------------------------
+function precision = mha_precision(type)
 
-% Resize the image
-I = reshape(I,hdr.DimSize);
+    switch upper(type)
+        case 'MET_CHAR'
+            precision = 'int8';
+        case 'MET_UCHAR'
+            precision = 'uint8';
+        case 'MET_SHORT'
+            precision = 'int16';
+        case 'MET_USHORT'
+            precision = 'uint16';
+        case {'MET_INT','MET_LONG'}
+            precision = 'int32';
+        case {'MET_UINT','MET_ULONG'}
+            precision = 'uint32';
+        case 'MET_LONG_LONG'
+            precision = 'int64';
+        case 'MET_ULONG_LONG'
+            precision = 'uint64';
+        case 'MET_FLOAT'
+            precision = 'single';
+        case 'MET_DOUBLE'
+            precision = 'double';
+        otherwise
+            error('mharead:invalidElementType',...
+                  'Unsupported element type: %s',type);
+    end
 
-% Close the image
-fclose(fid);
\ No newline at end of file
+end %mha_precision
@@ -20,11 +20,16 @@ function mhawrite(varargin)
 %           http://www.itk.org/Wiki/ITK/MetaIO/Documentation
 %
 %
+%   Set the field CompressedData of HDR to true to deflate the image data. When
+%   the compiled mha_write MEX file is available, the image is written in its
+%   native class (or the class specified by the ElementType field) and
+%   compressed data are deflated on all cores.
+%
 %   Note: to avoid toolbox dependencies, error checking is performed on DICOM
 %   files and those headers parsed only when the Image Processing Toolbox is
 %   present
 %
-%   See also mhainfo mharead
+%   See also mhainfo mharead mha_write
 
     % Parse inputs
     hdr = parse_inputs( varargin{:} );
@@ -34,8 +39,19 @@ function mhawrite(varargin)
     fName = hdr.Filename;
     hdr   = rmfield(hdr,{'Image','Filename'});
 
-    % Attempt to open file
+    % Use the native writer for images stored in the MHA file
     [fPath,fName] = fileparts(fName);
+    if strcmpi(hdr.ElementDataFile,'local') && (exist('mha_write','file')==3)
+        mha_write(I,fullfile(fPath,[fName '.mha']),hdr);
+        return
+    end
+    if isfield(hdr,'CompressedData') && strcmpi(hdr.CompressedData,'True')
+        warning([mfilename ':compressedData'],...
+                'Compressed data require the mha_write MEX file. Writing raw data.');
+        hdr.CompressedData = 'False';
+    end
+
+    % Attempt to open file
     fid = fopen(fullfile(fPath,[fName '.mha']),'w');
     if (fid==-1)
         error([mfilename ':invalidFile'],...
@@ -170,6 +186,7 @@ function hdr = cast_mha_header(varargin)
                      'NDims',                 'int',       1,          true;...
                      'BinaryData',            'logical',   1,          false;...
                      'BinaryDataByteOrderMSB','logical',   1,          true;...
+                     'CompressedData',        'logical',   1,          false;...
                      'TransformMatrix',       'float',    2:12,        false;...
                      'Offset',                'float',    2:3,         false;...
                      'CenterOfRotation',      'float',    2:3,         false;...
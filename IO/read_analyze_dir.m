@@ -13,6 +13,15 @@ end
 
 % Loads all data
 f_list = dir(p_name); f_list(1:2) = [];
+if (exist('nifti_read','file')==3)
+    % Reads all images concurrently (see ReadAnalyze for the orientation)
+    isImg = ~cellfun(@isempty,strfind({f_list.name},'img')) & ~[f_list.isdir];
+    im = cell(1,length(f_list));
+    im(isImg) = nifti_read(strcat(p_name,filesep,{f_list(isImg).name}));
+    im(isImg) = cellfun(@(v) permute(v(:,end:-1:1,end:-1:1,:),[2 1 3 4]),...
+                                                im(isImg),'UniformOutput',false);
+    f_list = [];
+end
 for i = 1:length(f_list)
     if ~isempty( strfind(f_list(i).name, 'img') ) && ~f_list(i).isdir
         [im{i} dump dump hdr(i)] = ReadAnalyze([p_name filesep f_list(i).name]);
@@ -3,6 +3,10 @@ function varargout = read_pinnacle(varargin)
 %
 %   roi = read_pinnacle(s) parses a Pinnacle ROI file.
 %
+%   roi = read_pinnacle(FILE,S) uses the data S, either the cell array of the
+%   file's lines or the element of the structure returned by roi_read for the
+%   file FILE. When the roi_read MEX file is available, it is used to parse
+%   the file.
 
 % Initialize output
 [varargout{1:nargout}] = deal([]);
@@ -11,12 +15,59 @@ function varargout = read_pinnacle(varargin)
 fName  = varargin{1};
 if nargin>1
     sData = varargin{2};
+elseif (exist('roi_read','file')==3)
+    sData = roi_read(fName);
 else
     fid   = fopen(fName,'r');
     sData = textscan(fid,'%s','Delimiter','\n');
     fclose(fid);
 end
 
+% Natively parsed ROIs only require the color conversion
+if isstruct(sData)
+    if ~isempty(sData.Error) || ~strcmpi(sData.Software,'Pinnacle')
+        error([mfilename ':chkROIinfo'],...
+                           'An invalid Pinnacle ROI format was detected.');
+    end
+    name      = sData.Names;
+    color     = cellfun(@colorlookup,sData.Colors,'UniformOutput',false);
+    roiPts    = sData.Curves;
+    errorFlag = ~sData.IsComplete;
+else
+    [name,color,roiPts,errorFlag] = parse_rois(sData);
+end
+
+% Find ROI file
+header = find_header(fName);
+if isempty(header)
+    [hdrFName,ok] = cine_dlgs('use_pinnacle_header');
+    if ok
+        header = find_header(hdrFName);
+    end        
+end
+
+% Informs the user if some data was not loaded
+if errorFlag
+    hMsg = msgbox( {'Some contours were not imported,',...
+                     'the result of improper formatting.'});
+    uiwait( hMsg );
+end
+
+% Process output
+roiInfo = process_roi_raw(roiPts,name,color);
+
+% Process Pinnacle ROI coordinates
+if ~isempty(header)
+    roiInfo = convert_pinnacle_coordinates(roiInfo,header);
+end
+
+% Deal output
+[varargout{1:2}] = deal(roiInfo,header);
+
+
+% --- Parses the lines of a Pinnacle ROI file
+function [name,color,roiPts,errorFlag] = parse_rois(sData)
+
 % Finds the start/end indices for each ROI and curve details
 indS = find( strcmpi('points={',sData) );
 indE = find( ~cellfun(@isempty,strfind(sData,'};  // End of points') ) );
@@ -100,33 +151,6 @@ end
 % Deletes the waitbar
 delete( hProg );
 
-% Find ROI file
-header = find_header(fName);
-if isempty(header)
-    [hdrFName,ok] = cine_dlgs('use_pinnacle_header');
-    if ok
-        header = find_header(hdrFName);
-    end        
-end
-
-% Informs the user if some data was not loaded
-if errorFlag
-    hMsg = msgbox( {'Some contours were not imported,',...
-                     'the result of improper formatting.'});
-    uiwait( hMsg );
-end
-
-% Process output
-roiInfo = process_roi_raw(roiPts,name,color);
-
-% Process Pinnacle ROI coordinates
-if ~isempty(header)
-    roiInfo = convert_pinnacle_coordinates(roiInfo,header);
-end
-
-% Deal output
-[varargout{1:2}] = deal(roiInfo,header);
-
 
 % --- Attempts to find a Pinnacle header file
 function [hdr,fName] = find_header(f)
@@ -0,0 +1,925 @@
+/*
+ *	DicomSeries.h
+ *
+ *	Native DICOM series loader used by qt_exam.import (see dicom_series).
+ *	Directory trees are scanned in parallel and the headers of all files
+ *	are parsed on all cores, reading only the tags used by QUATTRO and
+ *	stopping at the pixel data. The images are then grouped by series
+ *	(SeriesInstanceUID and matrix size), sorted by slice position and,
+ *	within every slice, by the acquisition parameters that distinguish the
+ *	images of a slice (temporal position, time, flip angle, TE, TI, TR,
+ *	b-value). Finally, the pixel data of a series are decoded in parallel
+ *	into a single pre-allocated rows-by-columns-by-slices-by-frames
+ *	buffer.
+ *
+ *	Uncompressed transfer syntaxes (implicit/explicit VR little endian,
+ *	explicit VR big endian and deflated explicit VR little endian) of
+ *	single frame, single sample images are supported. Other files (e.g.,
+ *	JPEG compressed or multi-frame images) are reported as unsupported so
+ *	that the caller can read them with dicomread.
+ */
+
+
+#ifndef DICOMSERIES_H
+#define DICOMSERIES_H
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*	zlib headers	*/
+#include "zlib.h"
+
+/*	QUATTRO headers	*/
+#include "DirectoryScan.h"
+#include "MappedFile.h"
+#include "ParallelFor.h"
+
+
+//	Define common types
+enum dicomSyntaxType{		//	Supported transfer syntaxes
+	ImplicitLittleEndian,
+	ExplicitLittleEndian,
+	ExplicitBigEndian,
+	DeflatedLittleEndian,
+	UnsupportedSyntax
+};
+
+enum dicomPixelType{		//	Element type of the decoded pixel data
+	DicomUInt8,
+	DicomInt8,
+	DicomUInt16,
+	DicomInt16,
+	DicomUInt32,
+	DicomInt32
+};
+
+
+/*
+ *	DicomTagInfo
+ *
+ *	Tags read by the loader. The VR is used for implicit VR files and the
+ *	names follow the MATLAB DICOM dictionary (private GE tags are named
+ *	Private_gggg_eeee and renamed by the caller)
+ */
+struct DicomTagInfo{
+	unsigned short	group;
+	unsigned short	element;
+	const char*		vr;
+	const char*		name;
+};
+
+static const DicomTagInfo dicomTags[] = {
+	{0x0008, 0x0008, "CS", "ImageType"},
+	{0x0008, 0x0016, "UI", "SOPClassUID"},
+	{0x0008, 0x0018, "UI", "SOPInstanceUID"},
+	{0x0008, 0x0020, "DA", "StudyDate"},
+	{0x0008, 0x0021, "DA", "SeriesDate"},
+	{0x0008, 0x0022, "DA", "AcquisitionDate"},
+	{0x0008, 0x0030, "TM", "StudyTime"},
+	{0x0008, 0x0031, "TM", "SeriesTime"},
+	{0x0008, 0x0032, "TM", "AcquisitionTime"},
+	{0x0008, 0x0033, "TM", "ContentTime"},
+	{0x0008, 0x0060, "CS", "Modality"},
+	{0x0008, 0x0070, "LO", "Manufacturer"},
+	{0x0008, 0x1030, "LO", "StudyDescription"},
+	{0x0008, 0x103E, "LO", "SeriesDescription"},
+	{0x0010, 0x0010, "PN", "PatientName"},
+	{0x0010, 0x0020, "LO", "PatientID"},
+	{0x0018, 0x0020, "CS", "ScanningSequence"},
+	{0x0018, 0x0023, "CS", "MRAcquisitionType"},
+	{0x0018, 0x0050, "DS", "SliceThickness"},
+	{0x0018, 0x0080, "DS", "RepetitionTime"},
+	{0x0018, 0x0081, "DS", "EchoTime"},
+	{0x0018, 0x0082, "DS", "InversionTime"},
+	{0x0018, 0x0086, "IS", "EchoNumber"},
+	{0x0018, 0x0087, "DS", "MagneticFieldStrength"},
+	{0x0018, 0x0088, "DS", "SpacingBetweenSlices"},
+	{0x0018, 0x1060, "DS", "TriggerTime"},
+	{0x0018, 0x1314, "DS", "FlipAngle"},
+	{0x0018, 0x9087, "FD", "DiffusionBValue"},
+	{0x0019, 0x109C, "LO", "Private_0019_109c"},
+	{0x0019, 0x10BB, "DS", "Private_0019_10bb"},
+	{0x0019, 0x10BC, "DS", "Private_0019_10bc"},
+	{0x0019, 0x10BD, "DS", "Private_0019_10bd"},
+	{0x0020, 0x000D, "UI", "StudyInstanceUID"},
+	{0x0020, 0x000E, "UI", "SeriesInstanceUID"},
+	{0x0020, 0x0011, "IS", "SeriesNumber"},
+	{0x0020, 0x0012, "IS", "AcquisitionNumber"},
+	{0x0020, 0x0013, "IS", "InstanceNumber"},
+	{0x0020, 0x0032, "DS", "ImagePositionPatient"},
+	{0x0020, 0x0037, "DS", "ImageOrientationPatient"},
+	{0x0020, 0x0100, "IS", "TemporalPositionIdentifier"},
+	{0x0020, 0x0105, "IS", "NumberOfTemporalPositions"},
+	{0x0020, 0x1041, "DS", "SliceLocation"},
+	{0x0028, 0x0002, "US", "SamplesPerPixel"},
+	{0x0028, 0x0004, "CS", "PhotometricInterpretation"},
+	{0x0028, 0x0008, "IS", "NumberOfFrames"},
+	{0x0028, 0x0010, "US", "Rows"},
+	{0x0028, 0x0011, "US", "Columns"},
+	{0x0028, 0x0030, "DS", "PixelSpacing"},
+	{0x0028, 0x0100, "US", "BitsAllocated"},
+	{0x0028, 0x0101, "US", "BitsStored"},
+	{0x0028, 0x0102, "US", "HighBit"},
+	{0x0028, 0x0103, "US", "PixelRepresentation"},
+	{0x0028, 0x1050, "DS", "WindowCenter"},
+	{0x0028, 0x1051, "DS", "WindowWidth"},
+	{0x0028, 0x1052, "DS", "RescaleIntercept"},
+	{0x0028, 0x1053, "DS", "RescaleSlope"},
+	{0x0043, 0x1030, "SS", "Private_0043_1030"},
+	{0x0043, 0x1039, "IS", "Private_0043_1039"},
+	{0x0043, 0x107F, "DS", "Private_0043_107f"},
+	{0x0053, 0x1075, "DS", "Private_0053_1075"},
+	{0x0053, 0x1079, "LO", "Private_0053_1079"}
+};
+static const unsigned int dicomTagCount = sizeof(dicomTags)/sizeof(DicomTagInfo);
+
+
+/*
+ *	DicomValue
+ *
+ *	Value of a tag. Numeric VRs (including IS and DS) are stored in "num",
+ *	all others in "str"
+ */
+struct DicomValue{
+	bool				isPresent;
+	bool				isNumeric;
+	std::string			str;
+	std::vector<double>	num;
+
+	DicomValue() : isPresent(false), isNumeric(false) {};
+};
+
+
+/*
+ *	DicomFileInfo
+ *
+ *	Parsed header of a single file
+ */
+struct DicomFileInfo{
+	std::string				fileName;
+	bool					isDicom;		/*	DICOM file (possibly unsupported)	*/
+	bool					isSupported;	/*	pixel data can be decoded	*/
+	std::vector<DicomValue>	values;			/*	one per entry of dicomTags	*/
+	dicomSyntaxType			syntax;
+	size_t					datasetOffset;	/*	first byte after the file meta information	*/
+	size_t					pixelOffset;	/*	relative to the (inflated) data set	*/
+	size_t					pixelLength;
+	unsigned int			rows;
+	unsigned int			columns;
+	unsigned int			bitsAllocated;
+	bool					isSigned;
+	double					position;		/*	position along the slice normal	*/
+
+	DicomFileInfo() : isDicom(false), isSupported(false), values(dicomTagCount), syntax(UnsupportedSyntax),
+					  datasetOffset(0), pixelOffset(0), pixelLength(0), rows(0), columns(0),
+					  bitsAllocated(0), isSigned(false), position(0) {};
+
+	/*	Returns the first numeric value of a tag or a default	*/
+	double GetNumber(unsigned int tagIdx, double defaultValue=0) const
+	{
+		const DicomValue &value = values[tagIdx];
+		if( value.isPresent && value.isNumeric && !value.num.empty() ) {
+			return value.num[0];
+		};
+		return defaultValue;
+	};
+};
+
+
+/*
+ *	DicomSeriesInfo
+ *
+ *	Sorted series. "files" holds the index (into the parsed files) of the
+ *	image at slice s and frame f at s+f*nSlices, or -1 for missing images
+ */
+struct DicomSeriesInfo{
+	std::string			uid;
+	unsigned int		rows;
+	unsigned int		columns;
+	size_t				nSlices;
+	size_t				nFrames;
+	dicomPixelType		pixelType;
+	std::vector<long>	files;
+	std::vector<double>	positions;
+};
+
+
+/*
+ *	GetDicomTagIndex()
+ *
+ *	Index of a tag in dicomTags (dicomTagCount if the tag is not read)
+ */
+inline unsigned int GetDicomTagIndex(unsigned short group, unsigned short element)
+{
+	for(unsigned int idx=0; idx<dicomTagCount; idx++) {
+		if( (dicomTags[idx].group==group) && (dicomTags[idx].element==element) ) {
+			return idx;
+		};
+	};
+	return dicomTagCount;
+};
+
+
+/*
+ *	DicomReader
+ *
+ *	Sequential reader of the data elements of a memory buffer
+ */
+class DicomReader{
+
+ public:
+
+	DicomReader(const unsigned char* buffer, size_t n, size_t start, bool explicitVR, bool bigEndian) :
+		data(buffer), size(n), pos(start), isExplicit(explicitVR), isBigEndian(bigEndian) {};
+
+	/*	Element header. Returns false at the end of the buffer	*/
+	bool ReadElement(unsigned short &group, unsigned short &element, char vr[3], size_t &length)
+	{
+		if( pos+8>size ) {
+			return false;
+		};
+		group	= Read16(pos);
+		element = Read16(pos+2);
+		vr[0] = 'U';
+		vr[1] = 'N';
+		vr[2] = 0;
+		if( group==0xFFFE ) {				/*	items and delimiters have no VR	*/
+			length = Read32(pos+4);
+			pos	  += 8;
+		}
+		else if( isExplicit ) {
+			vr[0] = static_cast<char>(data[pos+4]);
+			vr[1] = static_cast<char>(data[pos+5]);
+			if( IsLongVR(vr) ) {
+				if( pos+12>size ) {
+					return false;
+				};
+				length = Read32(pos+8);
+				pos	  += 12;
+			}
+			else {
+				length = Read16(pos+6);
+				pos	  += 8;
+			};
+		}
+		else {
+			length = Read32(pos+4);
+			pos	  += 8;
+		};
+		return true;
+	};
+
+	/*	Skips the contents of a sequence (or UN value) of undefined length	*/
+	bool SkipUndefined(bool isImplicitContent)
+	{
+		const bool wasExplicit = isExplicit;
+		isExplicit = isExplicit && !isImplicitContent;
+		unsigned int depth = 1;
+		bool		 isValid = false;
+		unsigned short group, element;
+		char		 vr[3];
+		size_t		 length;
+		while( ReadElement(group, element, vr, length) ) {
+			if( (group==0xFFFE) && (element==0xE0DD) ) {		/*	sequence delimiter	*/
+				if( --depth==0 ) {
+					isValid = true;
+					break;
+				};
+			}
+			else if( (group==0xFFFE) && (element==0xE000) ) {	/*	item	*/
+				if( length!=0xFFFFFFFF ) {
+					pos += length;
+				};
+			}
+			else if( (group==0xFFFE) && (element==0xE00D) ) {	/*	item delimiter	*/
+				continue;
+			}
+			else if( length==0xFFFFFFFF ) {						/*	nested sequence	*/
+				depth++;
+			}
+			else {
+				pos += length;
+			};
+		};
+		isExplicit = wasExplicit;
+		return isValid;
+	};
+
+	unsigned int Read16(size_t offset) const
+	{
+		return isBigEndian ? (data[offset]<<8 | data[offset+1]) : (data[offset] | data[offset+1]<<8);
+	};
+
+	size_t Read32(size_t offset) const
+	{
+		const unsigned char* p = data+offset;
+		const unsigned long	 v = isBigEndian ? (static_cast<unsigned long>(p[0])<<24 | p[1]<<16 | p[2]<<8 | p[3]) :
+											   (static_cast<unsigned long>(p[3])<<24 | p[2]<<16 | p[1]<<8 | p[0]);
+		return static_cast<size_t>(v & 0xFFFFFFFFul);
+	};
+
+	static bool IsLongVR(const char vr[3])
+	{
+		const char* longVRs[] = {"OB","OD","OF","OL","OV","OW","SQ","SV","UC","UN","UR","UT","UV"};
+		for(size_t idx=0; idx<sizeof(longVRs)/sizeof(longVRs[0]); idx++) {
+			if( (vr[0]==longVRs[idx][0]) && (vr[1]==longVRs[idx][1]) ) {
+				return true;
+			};
+		};
+		return false;
+	};
+
+	const unsigned char*	data;
+	size_t					size;
+	size_t					pos;
+	bool					isExplicit;
+	bool					isBigEndian;
+};
+
+
+class DicomSeriesLoader{
+
+ public:
+
+	DicomSeriesLoader() : nThreads(0) {};
+
+	void SetNumberOfThreads(unsigned int n) { nThreads = n; };
+
+	/*
+	 *	Scan()
+	 *
+	 *	Lists all files of the directories (up to maxDepth sub-directory
+	 *	levels, see ScanDirectoryTree) and parses their headers in parallel
+	 */
+	void Scan(const std::vector<std::string> &dirs, int maxDepth=-1)
+	{
+		AddFiles( ScanDirectoryTree(dirs, maxDepth, nThreads) );
+	};
+
+	/*
+	 *	AddFiles()
+	 *
+	 *	Parses the headers of the files in parallel. Files that are not
+	 *	DICOM files are ignored
+	 */
+	void AddFiles(const std::vector<std::string> &fNames)
+	{
+		std::vector<DicomFileInfo> parsed(fNames.size());
+		ParallelFor(fNames.size(), 8, [&](size_t begin, size_t end, unsigned int) {
+			for(size_t idx=begin; idx<end; idx++) {
+				parsed[idx].fileName = fNames[idx];
+				ParseFile(parsed[idx]);
+			};
+		}, nThreads);
+		for(size_t idx=0; idx<parsed.size(); idx++) {
+			if( parsed[idx].isDicom ) {
+				files.push_back(parsed[idx]);
+			};
+		};
+	};
+
+	/*
+	 *	Sort()
+	 *
+	 *	Groups the supported files into series and sorts the images of
+	 *	every series by slice position and acquisition parameters
+	 */
+	void Sort();
+
+	/*
+	 *	ReadPixels()
+	 *
+	 *	Decodes the images of a series (in parallel) into the buffer, which
+	 *	must hold rows*columns*nSlices*nFrames elements of the series' pixel
+	 *	type. Images are stored in MATLAB (column-major) order; missing
+	 *	images are not written. Returns false if a file cannot be read
+	 */
+	bool ReadPixels(const DicomSeriesInfo &series, void* buffer, std::string* error=0) const;
+
+	const std::vector<DicomFileInfo>&	GetFiles() const	{ return files; };
+	const std::vector<DicomSeriesInfo>&	GetSeries() const	{ return series; };
+
+
+ private:
+
+	std::vector<DicomFileInfo>		files;
+	std::vector<DicomSeriesInfo>	series;
+	unsigned int					nThreads;
+
+	static bool	ParseFile(DicomFileInfo &info);
+	static bool	ParseDataset(const unsigned char* data, size_t n, size_t start, DicomFileInfo &info);
+	static bool	InflateDataset(const unsigned char* data, size_t n, std::vector<unsigned char> &out);
+	static void	StoreValue(const DicomReader &reader, const char vr[3], size_t length, DicomValue &value);
+};
+
+
+/*
+ *	ParseDicomTime()
+ *
+ *	Converts a DICOM time string (HHMMSS.FFFFFF) to seconds
+ */
+inline double ParseDicomTime(const std::string &str)
+{
+	if( str.size()<2 ) {
+		return 0;
+	};
+	const double hh = std::atof( str.substr(0,2).c_str() );
+	const double mm = (str.size()>=4) ? std::atof( str.substr(2,2).c_str() ) : 0;
+	const double ss = (str.size()>4)  ? std::atof( str.substr(4).c_str() )	 : 0;
+	return 3600*hh + 60*mm + ss;
+};
+
+
+/*
+ *	StoreValue()
+ *
+ *	Converts the value of an element (at the reader position) to a
+ *	DicomValue
+ */
+inline void DicomSeriesLoader::StoreValue(const DicomReader &reader, const char vr[3], size_t length,
+										  DicomValue &value)
+{
+	const unsigned char* ptr = reader.data+reader.pos;
+	const std::string	 type(vr, 2);
+	value.isPresent = true;
+	value.str.clear();
+	value.num.clear();
+
+	/*	Binary numbers	*/
+	size_t elementSize = 0;
+	if( (type=="US") || (type=="SS") ) {
+		elementSize = 2;
+	}
+	else if( (type=="UL") || (type=="SL") || (type=="FL") ) {
+		elementSize = 4;
+	}
+	else if( type=="FD" ) {
+		elementSize = 8;
+	};
+	if( elementSize ) {
+		value.isNumeric = true;
+		for(size_t offset=0; offset+elementSize<=length; offset+=elementSize) {
+			unsigned char bytes[8];
+			for(size_t b=0; b<elementSize; b++) {
+				bytes[b] = reader.isBigEndian ? ptr[offset+elementSize-1-b] : ptr[offset+b];
+			};
+			double number = 0;
+			if( type=="US" ) {
+				unsigned short v; std::memcpy(&v, bytes, 2); number = v;
+			}
+			else if( type=="SS" ) {
+				short v; std::memcpy(&v, bytes, 2); number = v;
+			}
+			else if( type=="UL" ) {
+				unsigned int v; std::memcpy(&v, bytes, 4); number = v;
+			}
+			else if( type=="SL" ) {
+				int v; std::memcpy(&v, bytes, 4); number = v;
+			}
+			else if( type=="FL" ) {
+				float v; std::memcpy(&v, bytes, 4); number = v;
+			}
+			else {
+				double v; std::memcpy(&v, bytes, 8); number = v;
+			};
+			value.num.push_back(number);
+		};
+		return;
+	};
+
+	/*	Strings (trailing spaces/NULs are padding)	*/
+	std::string str(reinterpret_cast<const char*>(ptr), length);
+	const size_t last = str.find_last_not_of(std::string(" \0",2));
+	str.erase( (last==std::string::npos) ? 0 : last+1 );
+	str.erase(0, std::min(str.size(), str.find_first_not_of(' ')));
+
+	/*	Decimal and integer strings	*/
+	if( (type=="DS") || (type=="IS") ) {
+		value.isNumeric = true;
+		const char* cur = str.c_str();
+		while( *cur ) {
+			char* next = 0;
+			const double number = std::strtod(cur, &next);
+			if( next==cur ) {
+				break;
+			};
+			value.num.push_back(number);
+			cur = next;
+			while( (*cur==' ') || (*cur=='\\') ) {
+				cur++;
+			};
+		};
+		return;
+	};
+	value.isNumeric = false;
+	value.str		= str;
+};
+
+
+/*
+ *	ParseDataset()
+ *
+ *	Reads the tags of interest from a data set (starting at "start") up to
+ *	the pixel data
+ */
+inline bool DicomSeriesLoader::ParseDataset(const unsigned char* data, size_t n, size_t start, DicomFileInfo &info)
+{
+	DicomReader reader(data, n, start, info.syntax!=ImplicitLittleEndian, info.syntax==ExplicitBigEndian);
+	unsigned short group, element;
+	char		   vr[3];
+	size_t		   length;
+	while( reader.ReadElement(group, element, vr, length) ) {
+
+		/*	Pixel data	*/
+		if( (group==0x7FE0) && (element==0x0010) ) {
+			if( length==0xFFFFFFFF ) {		/*	encapsulated (compressed)	*/
+				return false;
+			};
+			info.pixelOffset = reader.pos;
+			info.pixelLength = std::min(length, n-reader.pos);
+			return true;
+		};
+
+		/*	Sequences and UN values of undefined length	*/
+		if( length==0xFFFFFFFF ) {
+			if( !reader.SkipUndefined(vr[0]=='U' && vr[1]=='N') ) {
+				return false;
+			};
+			continue;
+		};
+		if( reader.pos+length>n ) {
+			return false;
+		};
+
+		/*	Tags of interest	*/
+		const unsigned int tagIdx = GetDicomTagIndex(group, element);
+		if( tagIdx<dicomTagCount ) {
+			if( !reader.isExplicit || ( (vr[0]=='U') && (vr[1]=='N') ) ) {
+				vr[0] = dicomTags[tagIdx].vr[0];
+				vr[1] = dicomTags[tagIdx].vr[1];
+			};
+			StoreValue(reader, vr, length, info.values[tagIdx]);
+		};
+		reader.pos += length;
+	};
+	return false;
+};
+
+
+/*
+ *	InflateDataset()
+ *
+ *	Inflates the (raw deflate) data set of the deflated transfer syntax
+ */
+inline bool DicomSeriesLoader::InflateDataset(const unsigned char* data, size_t n, std::vector<unsigned char> &out)
+{
+	z_stream stream;
+	std::memset(&stream, 0, sizeof(stream));
+	if( inflateInit2(&stream, -15)!=Z_OK ) {
+		return false;
+	};
+	out.resize( std::max<size_t>(4*n, 1<<16) );
+	stream.next_in	= const_cast<unsigned char*>(data);
+	stream.avail_in = static_cast<uInt>(n);
+	int status = Z_OK;
+	while( status==Z_OK ) {
+		if( stream.total_out==out.size() ) {
+			out.resize(2*out.size());
+		};
+		stream.next_out	 = &out[0]+stream.total_out;
+		stream.avail_out = static_cast<uInt>( out.size()-stream.total_out );
+		status = inflate(&stream, Z_NO_FLUSH);
+	};
+	out.resize(stream.total_out);
+	inflateEnd(&stream);
+	return status==Z_STREAM_END;
+};
+
+
+/*
+ *	ParseFile()
+ *
+ *	Reads the file meta information and the tags of interest of a file
+ */
+inline bool DicomSeriesLoader::ParseFile(DicomFileInfo &info)
+{
+	MappedFile file;
+	if( !file.Open(info.fileName, MapReadOnly) ) {
+		return false;
+	};
+	const unsigned char* data = reinterpret_cast<const unsigned char*>( file.GetData() );
+	const size_t		 n	  = file.GetSize();
+
+	/*	Part 10 files start with a 128 byte preamble and "DICM". Files
+	 *	without the preamble must start with a group 0x0008 element	*/
+	size_t pos = 0;
+	info.syntax = ImplicitLittleEndian;
+	if( (n>=132) && !std::memcmp(data+128, "DICM", 4) ) {
+		pos = 132;
+		DicomReader meta(data, n, pos, true, false);
+		unsigned short group, element;
+		char		   vr[3];
+		size_t		   length;
+		std::string	   syntaxUID;
+		while( (meta.pos+6<=n) && (meta.Read16(meta.pos)==0x0002) && meta.ReadElement(group, element, vr, length) ) {
+			if( meta.pos+length>n ) {
+				return false;
+			};
+			if( element==0x0010 ) {
+				syntaxUID.assign(reinterpret_cast<const char*>(data+meta.pos), length);
+				syntaxUID.erase( syntaxUID.find_last_not_of(std::string(" \0",2))+1 );
+			};
+			meta.pos += length;
+		};
+		pos = meta.pos;
+		if( (syntaxUID=="1.2.840.10008.1.2") || syntaxUID.empty() ) {
+			info.syntax = ImplicitLittleEndian;
+		}
+		else if( syntaxUID=="1.2.840.10008.1.2.1" ) {
+			info.syntax = ExplicitLittleEndian;
+		}
+		else if( syntaxUID=="1.2.840.10008.1.2.2" ) {
+			info.syntax = ExplicitBigEndian;
+		}
+		else if( syntaxUID=="1.2.840.10008.1.2.1.99" ) {
+			info.syntax = DeflatedLittleEndian;
+		}
+		else {
+			info.syntax = UnsupportedSyntax;
+		};
+	}
+	else if( (n>=8) && (data[0]==0x08) && (data[1]==0x00) ) {
+		const bool isExplicit = std::isupper(data[4]) && std::isupper(data[5]);
+		info.syntax = isExplicit ? ExplicitLittleEndian : ImplicitLittleEndian;
+	}
+	else {
+		return false;
+	};
+	info.isDicom	   = true;
+	info.datasetOffset = pos;
+
+	/*	Parse the data set. Compressed images are parsed as explicit VR
+	 *	little endian (the header is not compressed) for their tags	*/
+	bool hasPixels = false;
+	if( info.syntax==DeflatedLittleEndian ) {
+		std::vector<unsigned char> dataset;
+		if( !InflateDataset(data+pos, n-pos, dataset) || dataset.empty() ) {
+			return false;
+		};
+		hasPixels = ParseDataset(&dataset[0], dataset.size(), 0, info);
+	}
+	else if( info.syntax==UnsupportedSyntax ) {
+		info.syntax = ExplicitLittleEndian;
+		ParseDataset(data, n, pos, info);
+		info.syntax = UnsupportedSyntax;
+	}
+	else {
+		hasPixels = ParseDataset(data, n, pos, info);
+	};
+
+	/*	Validate the pixel data	*/
+	info.rows		   = static_cast<unsigned int>( info.GetNumber(GetDicomTagIndex(0x0028,0x0010)) );
+	info.columns	   = static_cast<unsigned int>( info.GetNumber(GetDicomTagIndex(0x0028,0x0011)) );
+	info.bitsAllocated = static_cast<unsigned int>( info.GetNumber(GetDicomTagIndex(0x0028,0x0100)) );
+	info.isSigned	   = info.GetNumber(GetDicomTagIndex(0x0028,0x0103))!=0;
+	const double samples = info.GetNumber(GetDicomTagIndex(0x0028,0x0002), 1);
+	const double frames  = info.GetNumber(GetDicomTagIndex(0x0028,0x0008), 1);
+	const size_t nBytes  = static_cast<size_t>(info.rows)*info.columns*(info.bitsAllocated/8);
+	info.isSupported = hasPixels && (info.rows>0) && (info.columns>0) && (samples==1) && (frames==1) &&
+					   ( (info.bitsAllocated==8) || (info.bitsAllocated==16) || (info.bitsAllocated==32) ) &&
+					   (info.pixelLength>=nBytes);
+
+	/*	Position along the slice normal (ImagePositionPatient projected on
+	 *	the normal of ImageOrientationPatient), SliceLocation otherwise	*/
+	const DicomValue &ipp = info.values[ GetDicomTagIndex(0x0020,0x0032) ];
+	const DicomValue &iop = info.values[ GetDicomTagIndex(0x0020,0x0037) ];
+	if( (ipp.num.size()==3) && (iop.num.size()==6) ) {
+		const double normal[3] = { iop.num[1]*iop.num[5] - iop.num[2]*iop.num[4],
+								   iop.num[2]*iop.num[3] - iop.num[0]*iop.num[5],
+								   iop.num[0]*iop.num[4] - iop.num[1]*iop.num[3] };
+		info.position = ipp.num[0]*normal[0] + ipp.num[1]*normal[1] + ipp.num[2]*normal[2];
+	}
+	else {
+		info.position = info.GetNumber(GetDicomTagIndex(0x0020,0x1041));
+	};
+	return info.isSupported;
+};
+
+
+/*
+ *	Sort()
+ */
+inline void DicomSeriesLoader::Sort()
+{
+	series.clear();
+
+	/*	Group the supported files by series and matrix size	*/
+	std::map<std::string, std::vector<size_t> > groups;
+	std::vector<std::string>					 order;		/*	first occurrence	*/
+	const unsigned int uidIdx = GetDicomTagIndex(0x0020,0x000E);
+	for(size_t idx=0; idx<files.size(); idx++) {
+		const DicomFileInfo &info = files[idx];
+		if( !info.isSupported ) {
+			continue;
+		};
+		char size[32];
+		std::snprintf(size, sizeof(size), "|%ux%u", info.rows, info.columns);
+		const std::string key = info.values[uidIdx].str + size;
+		if( groups.find(key)==groups.end() ) {
+			order.push_back(key);
+		};
+		groups[key].push_back(idx);
+	};
+
+	/*	Acquisition parameters distinguishing the images of a slice, in
+	 *	order of precedence	*/
+	const unsigned int keyTags[] = {
+		GetDicomTagIndex(0x0020,0x0100),	/*	TemporalPositionIdentifier	*/
+		GetDicomTagIndex(0x0018,0x1060),	/*	TriggerTime	*/
+		GetDicomTagIndex(0x0008,0x0032),	/*	AcquisitionTime	*/
+		GetDicomTagIndex(0x0018,0x1314),	/*	FlipAngle	*/
+		GetDicomTagIndex(0x0018,0x0081),	/*	EchoTime	*/
+		GetDicomTagIndex(0x0018,0x0082),	/*	InversionTime	*/
+		GetDicomTagIndex(0x0018,0x0080),	/*	RepetitionTime	*/
+		GetDicomTagIndex(0x0018,0x9087),	/*	DiffusionBValue	*/
+		GetDicomTagIndex(0x0043,0x1039),	/*	b-value (GE)	*/
+		GetDicomTagIndex(0x0018,0x0086),	/*	EchoNumber	*/
+		GetDicomTagIndex(0x0020,0x0013)		/*	InstanceNumber	*/
+	};
+	const unsigned int nKeys = sizeof(keyTags)/sizeof(keyTags[0]);
+
+	for(size_t gIdx=0; gIdx<order.size(); gIdx++) {
+		std::vector<size_t> &members = groups[ order[gIdx] ];
+		const DicomFileInfo &first	 = files[members[0]];
+
+		/*	Sort keys of every image	*/
+		std::vector< std::vector<double> > keys(files.size());
+		for(size_t mIdx=0; mIdx<members.size(); mIdx++) {
+			const DicomFileInfo &info = files[members[mIdx]];
+			std::vector<double> &key  = keys[members[mIdx]];
+			key.push_back(info.position);
+			for(unsigned int k=0; k<nKeys; k++) {
+				const DicomValue &value = info.values[keyTags[k]];
+				if( !value.isPresent ) {
+					key.push_back(-std::numeric_limits<double>::max());
+				}
+				else if( value.isNumeric ) {
+					key.push_back( value.num.empty() ? 0 : value.num[0] );
+				}
+				else {
+					key.push_back( ParseDicomTime(value.str) );
+				};
+			};
+		};
+		std::stable_sort(members.begin(), members.end(), [&](size_t a, size_t b) {
+			return keys[a]<keys[b];
+		});
+
+		/*	Cluster the positions (the tolerance accounts for rounding of
+		 *	the position tags)	*/
+		std::vector<size_t> sliceStart(1, 0);
+		for(size_t mIdx=1; mIdx<members.size(); mIdx++) {
+			if( std::fabs(files[members[mIdx]].position - files[members[mIdx-1]].position)>1e-3 ) {
+				sliceStart.push_back(mIdx);
+			};
+		};
+		sliceStart.push_back(members.size());
+
+		DicomSeriesInfo info;
+		info.uid	 = first.values[uidIdx].str;
+		info.rows	 = first.rows;
+		info.columns = first.columns;
+		info.nSlices = sliceStart.size()-1;
+		info.nFrames = 0;
+		for(size_t s=0; s<info.nSlices; s++) {
+			info.nFrames = std::max(info.nFrames, sliceStart[s+1]-sliceStart[s]);
+			info.positions.push_back( files[members[sliceStart[s]]].position );
+		};
+		info.files.assign(info.nSlices*info.nFrames, -1);
+		for(size_t s=0; s<info.nSlices; s++) {
+			for(size_t f=0; f<sliceStart[s+1]-sliceStart[s]; f++) {
+				info.files[s+f*info.nSlices] = static_cast<long>( members[sliceStart[s]+f] );
+			};
+		};
+
+		/*	Pixel type that represents all images of the series	*/
+		unsigned int bits	  = 0;
+		bool		 isSigned = false, isUnsigned = false;
+		for(size_t mIdx=0; mIdx<members.size(); mIdx++) {
+			bits		= std::max(bits, files[members[mIdx]].bitsAllocated);
+			isSigned   |= files[members[mIdx]].isSigned;
+			isUnsigned |= !files[members[mIdx]].isSigned;
+		};
+		if( isSigned && isUnsigned && (bits<32) ) {
+			bits *= 2;
+		};
+		info.pixelType = (bits==8)  ? (isSigned ? DicomInt8  : DicomUInt8)  :
+						 (bits==16) ? (isSigned ? DicomInt16 : DicomUInt16) :
+									  (isSigned ? DicomInt32 : DicomUInt32);
+		series.push_back(info);
+	};
+};
+
+
+/*
+ *	DecodeImage()
+ *
+ *	Converts the row-major pixel data of an image to a column-major image
+ *	of the output type
+ */
+template <class TOut>
+void DecodeImage(const unsigned char* src, const DicomFileInfo &info, bool isBigEndian, TOut* dst)
+{
+	const size_t rows = info.rows, cols = info.columns;
+	for(size_t r=0; r<rows; r++) {
+		for(size_t c=0; c<cols; c++) {
+			const unsigned char* p = src + (r*cols+c)*(info.bitsAllocated/8);
+			TOut value;
+			if( info.bitsAllocated==8 ) {
+				value = info.isSigned ? static_cast<TOut>( static_cast<signed char>(p[0]) ) : static_cast<TOut>(p[0]);
+			}
+			else if( info.bitsAllocated==16 ) {
+				const unsigned short v = isBigEndian ? (p[0]<<8 | p[1]) : (p[0] | p[1]<<8);
+				value = info.isSigned ? static_cast<TOut>( static_cast<short>(v) ) : static_cast<TOut>(v);
+			}
+			else {
+				const unsigned int v = isBigEndian ? (static_cast<unsigned int>(p[0])<<24 | p[1]<<16 | p[2]<<8 | p[3]) :
+													 (static_cast<unsigned int>(p[3])<<24 | p[2]<<16 | p[1]<<8 | p[0]);
+				value = info.isSigned ? static_cast<TOut>( static_cast<int>(v) ) : static_cast<TOut>(v);
+			};
+			dst[r+c*rows] = value;
+		};
+	};
+};
+
+
+/*
+ *	ReadPixels()
+ */
+inline bool DicomSeriesLoader::ReadPixels(const DicomSeriesInfo &info, void* buffer, std::string* error) const
+{
+	const size_t		nPixels = static_cast<size_t>(info.rows)*info.columns;
+	std::vector<char>	isValid(info.files.size(), 1);
+	ParallelFor(info.files.size(), 1, [&](size_t begin, size_t end, unsigned int) {
+		for(size_t idx=begin; idx<end; idx++) {
+			if( info.files[idx]<0 ) {
+				continue;
+			};
+			const DicomFileInfo &file = files[ info.files[idx] ];
+			MappedFile			 mapping;
+			std::vector<unsigned char> dataset;
+			const unsigned char* data = 0;
+			if( !mapping.Open(file.fileName, MapReadOnly) ) {
+				isValid[idx] = 0;
+				continue;
+			};
+			data = reinterpret_cast<const unsigned char*>( mapping.GetData() );
+			if( file.syntax==DeflatedLittleEndian ) {
+				if( !InflateDataset(data+file.datasetOffset, mapping.GetSize()-file.datasetOffset, dataset) ) {
+					isValid[idx] = 0;
+					continue;
+				};
+				data = &dataset[0];
+			};
+			const size_t nAvailable = (file.syntax==DeflatedLittleEndian) ? dataset.size() : mapping.GetSize();
+			if( file.pixelOffset+nPixels*(file.bitsAllocated/8)>nAvailable ) {
+				isValid[idx] = 0;
+				continue;
+			};
+			const unsigned char* src = data+file.pixelOffset;
+			const bool isBigEndian	 = (file.syntax==ExplicitBigEndian);
+			switch( info.pixelType ) {
+				case DicomUInt8:	DecodeImage(src, file, isBigEndian, static_cast<unsigned char*>(buffer)+idx*nPixels);	break;
+				case DicomInt8:		DecodeImage(src, file, isBigEndian, static_cast<signed char*>(buffer)+idx*nPixels);		break;
+				case DicomUInt16:	DecodeImage(src, file, isBigEndian, static_cast<unsigned short*>(buffer)+idx*nPixels);	break;
+				case DicomInt16:	DecodeImage(src, file, isBigEndian, static_cast<short*>(buffer)+idx*nPixels);			break;
+				case DicomUInt32:	DecodeImage(src, file, isBigEndian, static_cast<unsigned int*>(buffer)+idx*nPixels);	break;
+				case DicomInt32:	DecodeImage(src, file, isBigEndian, static_cast<int*>(buffer)+idx*nPixels);				break;
+			};
+		};
+	}, nThreads);
+
+	for(size_t idx=0; idx<isValid.size(); idx++) {
+		if( !isValid[idx] ) {
+			if( error ) {
+				*error = "Unable to read the pixel data of " + files[ info.files[idx] ].fileName;
+			};
+			return false;
+		};
+	};
+	return true;
+};
+
+
+#endif
@@ -0,0 +1,632 @@
+/*
+ *	NiftiImage.h
+ *
+ *	Reader of Analyze 7.5 and NIfTI-1 images: header/image pairs (*.hdr and
+ *	*.img) and single files (*.nii), optionally gzip compressed (*.nii.gz,
+ *	*.img.gz). The byte order is detected from the header size, all
+ *	datatypes except float128, complex256 and binary are supported, and the
+ *	data are returned in the datatype of the file. The scaling (scl_slope
+ *	and scl_inter) is reported, but not applied.
+ *
+ *	Uncompressed data are memory-mapped and copied (and byte swapped) on
+ *	all cores. A gzip stream can only be inflated serially, except when it
+ *	consists of independent blocks with the BGZF block size field (e.g.,
+ *	written by bgzip or other block-gzip writers), in which case the
+ *	blocks are inflated in parallel.
+ */
+
+
+#ifndef NIFTIIMAGE_H
+#define NIFTIIMAGE_H
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*	zlib headers	*/
+#include "zlib.h"
+
+/*	QUATTRO headers	*/
+#include "MappedFile.h"
+#include "ParallelFor.h"
+
+
+//	Define common types
+enum niftiDataType{		//	NIfTI-1 datatype codes (DT_*)
+	NiftiUInt8		= 2,
+	NiftiInt16		= 4,
+	NiftiInt32		= 8,
+	NiftiFloat32	= 16,
+	NiftiComplex64	= 32,
+	NiftiFloat64	= 64,
+	NiftiRGB24		= 128,
+	NiftiInt8		= 256,
+	NiftiUInt16		= 512,
+	NiftiUInt32		= 768,
+	NiftiInt64		= 1024,
+	NiftiUInt64		= 1280,
+	NiftiComplex128 = 1792,
+	NiftiRGBA32		= 2304
+};
+
+/*	Supported datatypes: code, bits per voxel and components per voxel	*/
+static const struct { short code; short bitpix; short nComponents; } niftiDataTypes[] = {
+	{NiftiUInt8, 8, 1},		{NiftiInt16, 16, 1},		{NiftiInt32, 32, 1},	{NiftiFloat32, 32, 1},
+	{NiftiComplex64, 64, 2},{NiftiFloat64, 64, 1},		{NiftiRGB24, 24, 3},	{NiftiInt8, 8, 1},
+	{NiftiUInt16, 16, 1},	{NiftiUInt32, 32, 1},		{NiftiInt64, 64, 1},	{NiftiUInt64, 64, 1},
+	{NiftiComplex128, 128, 2},{NiftiRGBA32, 32, 4}
+};
+
+/*	Size of the header (sizeof_hdr) and offset of the data in *.nii files
+ *	without extensions	*/
+static const int	niftiHeaderSize	   = 348;
+static const size_t niftiMinDataOffset = 352;
+
+/*	Bytes copied per chunk of the parallel loops	*/
+static const size_t niftiChunkBytes = 4*1024*1024;
+
+
+/*
+ *	NiftiHeader
+ *
+ *	Parsed Analyze/NIfTI-1 header (in host byte order). The fields are
+ *	named as in nifti1.h; Analyze 7.5 files use the same layout, the
+ *	NIfTI-1 specific fields being unused (funused1, used by SPM as a
+ *	scale factor, is scl_slope)
+ */
+struct NiftiHeader{
+	bool		isNifti;		/*	magic is "n+1" or "ni1"	*/
+	bool		isSingleFile;	/*	header and data in one file	*/
+	bool		isSwapped;		/*	file byte order differs from the host	*/
+	char		dimInfo;
+	short		dim[8];
+	float		intentP[3];
+	short		intentCode;
+	short		datatype;
+	short		bitpix;
+	short		sliceStart;
+	float		pixdim[8];
+	float		voxOffset;
+	float		sclSlope;
+	float		sclInter;
+	short		sliceEnd;
+	char		sliceCode;
+	char		xyztUnits;
+	float		calMax;
+	float		calMin;
+	float		sliceDuration;
+	float		tOffset;
+	int			glMax;
+	int			glMin;
+	std::string descrip;
+	std::string auxFile;
+	short		qformCode;
+	short		sformCode;
+	float		quatern[3];		/*	quatern_b, quatern_c, quatern_d	*/
+	float		qOffset[3];
+	float		srow[12];		/*	srow_x, srow_y, srow_z	*/
+	std::string intentName;
+	std::string magic;
+
+	NiftiHeader() { Clear(); };
+
+	void Clear()
+	{
+		isNifti = isSingleFile = isSwapped = false;
+		dimInfo = sliceCode = xyztUnits = 0;
+		intentCode = datatype = bitpix = sliceStart = sliceEnd = qformCode = sformCode = 0;
+		voxOffset = sclSlope = sclInter = calMax = calMin = sliceDuration = tOffset = 0;
+		glMax = glMin = 0;
+		std::fill(dim, dim+8, static_cast<short>(0));
+		std::fill(pixdim, pixdim+8, 0.0f);
+		std::fill(intentP, intentP+3, 0.0f);
+		std::fill(quatern, quatern+3, 0.0f);
+		std::fill(qOffset, qOffset+3, 0.0f);
+		std::fill(srow, srow+12, 0.0f);
+		descrip.clear();
+		auxFile.clear();
+		intentName.clear();
+		magic.clear();
+	};
+
+	int GetNumberOfDimensions() const { return dim[0]; };
+
+	size_t GetNumberOfVoxels() const
+	{
+		size_t n = 1;
+		for(int idx=1; idx<=dim[0]; idx++) {
+			n *= static_cast<size_t>(dim[idx]);
+		};
+		return n;
+	};
+
+	/*	Components per voxel (3 or 4 for RGB(A), 2 for complex data)	*/
+	unsigned int GetNumberOfComponents() const
+	{
+		for(size_t idx=0; idx<sizeof(niftiDataTypes)/sizeof(niftiDataTypes[0]); idx++) {
+			if( niftiDataTypes[idx].code==datatype ) {
+				return niftiDataTypes[idx].nComponents;
+			};
+		};
+		return 0;
+	};
+
+	size_t GetComponentSize() const
+	{
+		const unsigned int nComponents = GetNumberOfComponents();
+		return nComponents ? static_cast<size_t>(bitpix)/8/nComponents : 0;
+	};
+
+	size_t GetDataSize() const { return GetNumberOfVoxels()*(bitpix/8); };
+
+	/*	Determines if the data should be scaled (scl_slope is non-zero and
+	 *	the scaling is not the identity)	*/
+	bool IsScaled() const { return (sclSlope!=0) && ((sclSlope!=1) || (sclInter!=0)); };
+};
+
+
+class NiftiImage{
+
+ public:
+
+	NiftiImage() : dataOffset(0), isCompressed(false) {};
+
+	/*
+	 *	Read()
+	 *
+	 *	Parses the header and locates the data. FILENAME is a *.nii,
+	 *	*.hdr or *.img file (optionally gzip compressed) or the file name
+	 *	without extension. Returns false (see GetError()) if the file
+	 *	cannot be read
+	 */
+	bool Read(const std::string &fName);
+
+	/*
+	 *	CopyTo()
+	 *
+	 *	Copies the data (GetHeader().GetDataSize() bytes) to a buffer in
+	 *	the datatype of the file and the host byte order. Components of
+	 *	RGB(A) and complex voxels are interleaved
+	 */
+	bool CopyTo(void* dst, unsigned int nThreads=0);
+
+	const NiftiHeader&	GetHeader() const		{ return header; };
+	const std::string&	GetHeaderFileName() const { return headerFileName; };
+	const std::string&	GetDataFileName() const	{ return dataFileName; };
+	const std::string&	GetError() const		{ return error; };
+
+
+ private:
+
+	NiftiHeader		header;
+	std::string		headerFileName;
+	std::string		dataFileName;
+	size_t			dataOffset;		/*	first data byte in the (uncompressed) data file	*/
+	bool			isCompressed;
+	MappedFile		dataFile;
+	std::string		error;
+
+	NiftiImage(const NiftiImage&);
+	NiftiImage& operator=(const NiftiImage&);
+
+	bool ResolveFileNames(const std::string &fName);
+	bool ParseHeader(const unsigned char* buffer);
+	bool InflateStream(unsigned char* dst);
+	bool InflateBlocks(unsigned char* dst, unsigned int nThreads, bool &isBlocked);
+	bool Fail(const std::string &msg) { error = msg; return false; };
+
+	static bool FileExists(const std::string &fName)
+	{
+		FILE* fid = std::fopen(fName.c_str(), "rb");
+		if( fid ) {
+			std::fclose(fid);
+		};
+		return fid!=0;
+	};
+
+	static bool HasSuffix(const std::string &str, const char* suffix)
+	{
+		const size_t n = std::strlen(suffix);
+		if( str.size()<n ) {
+			return false;
+		};
+		for(size_t idx=0; idx<n; idx++) {
+			if( std::tolower(static_cast<unsigned char>(str[str.size()-n+idx]))!=suffix[idx] ) {
+				return false;
+			};
+		};
+		return true;
+	};
+
+	static void SwapBytes(unsigned char* data, size_t n, size_t elementSize)
+	{
+		for(size_t idx=0; idx<n; idx++) {
+			std::reverse(data+idx*elementSize, data+(idx+1)*elementSize);
+		};
+	};
+};
+
+
+/*
+ *	ResolveFileNames()
+ *
+ *	Determines the header and data files from the file name (or prefix)
+ */
+inline bool NiftiImage::ResolveFileNames(const std::string &fName)
+{
+	std::string prefix;
+	if( HasSuffix(fName, ".nii") || HasSuffix(fName, ".nii.gz") ) {
+		headerFileName = dataFileName = fName;
+		return FileExists(fName) || Fail("Unable to open " + fName);
+	}
+	else if( HasSuffix(fName, ".hdr") || HasSuffix(fName, ".img") ) {
+		prefix = fName.substr(0, fName.size()-4);
+	}
+	else if( HasSuffix(fName, ".hdr.gz") || HasSuffix(fName, ".img.gz") ) {
+		prefix = fName.substr(0, fName.size()-7);
+	}
+	else {
+		const char* singleExt[] = {".nii", ".nii.gz"};
+		for(size_t idx=0; idx<2; idx++) {
+			if( FileExists(fName+singleExt[idx]) ) {
+				headerFileName = dataFileName = fName+singleExt[idx];
+				return true;
+			};
+		};
+		prefix = fName;
+	};
+
+	/*	Header/image pair (either file may be compressed)	*/
+	headerFileName = FileExists(prefix+".hdr") ? prefix+".hdr" : prefix+".hdr.gz";
+	dataFileName   = FileExists(prefix+".img") ? prefix+".img" : prefix+".img.gz";
+	if( !FileExists(headerFileName) ) {
+		return Fail("Unable to open " + prefix + ".hdr");
+	}
+	else if( !FileExists(dataFileName) ) {
+		return Fail("Unable to open " + prefix + ".img");
+	};
+	return true;
+};
+
+
+/*
+ *	Read()
+ *
+ *	See the class declaration
+ */
+inline bool NiftiImage::Read(const std::string &fName)
+{
+	header.Clear();
+	dataFile.Close();
+	error.clear();
+	if( !ResolveFileNames(fName) ) {
+		return false;
+	};
+
+	/*	The header (and the NIfTI-1 extension flag) is read with zlib's
+	 *	file functions, which also read uncompressed files	*/
+	unsigned char buffer[niftiMinDataOffset];
+	gzFile fid = gzopen(headerFileName.c_str(), "rb");
+	if( !fid ) {
+		return Fail("Unable to open " + headerFileName);
+	};
+	const int nRead = gzread(fid, buffer, sizeof(buffer));
+	gzclose(fid);
+	if( nRead<niftiHeaderSize ) {
+		return Fail(headerFileName + " is not an Analyze or NIfTI-1 header");
+	};
+	if( !ParseHeader(buffer) ) {
+		return false;
+	};
+
+	/*	Locate the data. Single files store the data at vox_offset, which
+	 *	must not overlap the header	*/
+	header.isSingleFile = (headerFileName==dataFileName);
+	if( header.isSingleFile ) {
+		if( header.voxOffset<niftiMinDataOffset ) {
+			return Fail("Invalid vox_offset in " + headerFileName);
+		};
+	}
+	else if( header.voxOffset<0 ) {
+		return Fail("Invalid vox_offset in " + headerFileName);
+	};
+	dataOffset	 = static_cast<size_t>(header.voxOffset);
+	isCompressed = HasSuffix(dataFileName, ".gz");
+	if( !isCompressed ) {
+		if( !dataFile.Open(dataFileName) ) {
+			return Fail("Unable to map " + dataFileName);
+		}
+		else if( dataFile.GetSize()<dataOffset+header.GetDataSize() ) {
+			return Fail(dataFileName + " is smaller than specified by the header");
+		};
+	};
+	return true;
+};
+
+
+/*
+ *	ParseHeader()
+ *
+ *	Parses the first 348 bytes of a header. The byte order is that which
+ *	gives sizeof_hdr = 348
+ */
+inline bool NiftiImage::ParseHeader(const unsigned char* buffer)
+{
+	int sizeofHdr;
+	std::memcpy(&sizeofHdr, buffer, sizeof(int));
+	header.isSwapped = (sizeofHdr!=niftiHeaderSize);
+	const bool isSwapped = header.isSwapped;
+
+	/*	Field readers (offsets as in nifti1.h)	*/
+	auto read = [buffer,isSwapped](size_t offset, void* value, size_t n) {
+		unsigned char* bytes = static_cast<unsigned char*>(value);
+		std::memcpy(bytes, buffer+offset, n);
+		if( isSwapped ) {
+			std::reverse(bytes, bytes+n);
+		};
+	};
+	auto readShort = [&read](size_t offset) { short value; read(offset, &value, 2); return value; };
+	auto readInt   = [&read](size_t offset) { int value;   read(offset, &value, 4); return value; };
+	auto readFloat = [&read](size_t offset) { float value; read(offset, &value, 4); return value; };
+	auto readString = [buffer](size_t offset, size_t n) {
+		const char* str = reinterpret_cast<const char*>(buffer+offset);
+		return std::string(str, std::find(str, str+n, '\0'));
+	};
+
+	if( readInt(0)!=niftiHeaderSize ) {
+		return Fail(headerFileName + " is not an Analyze or NIfTI-1 header");
+	};
+	header.dimInfo = static_cast<char>(buffer[39]);
+	for(size_t idx=0; idx<8; idx++) {
+		header.dim[idx]	   = readShort(40+2*idx);
+		header.pixdim[idx] = readFloat(76+4*idx);
+	};
+	for(size_t idx=0; idx<3; idx++) {
+		header.intentP[idx] = readFloat(56+4*idx);
+		header.quatern[idx] = readFloat(256+4*idx);
+		header.qOffset[idx] = readFloat(268+4*idx);
+	};
+	for(size_t idx=0; idx<12; idx++) {
+		header.srow[idx] = readFloat(280+4*idx);
+	};
+	header.intentCode	 = readShort(68);
+	header.datatype		 = readShort(70);
+	header.bitpix		 = readShort(72);
+	header.sliceStart	 = readShort(74);
+	header.voxOffset	 = readFloat(108);
+	header.sclSlope		 = readFloat(112);
+	header.sclInter		 = readFloat(116);
+	header.sliceEnd		 = readShort(120);
+	header.sliceCode	 = static_cast<char>(buffer[122]);
+	header.xyztUnits	 = static_cast<char>(buffer[123]);
+	header.calMax		 = readFloat(124);
+	header.calMin		 = readFloat(128);
+	header.sliceDuration = readFloat(132);
+	header.tOffset		 = readFloat(136);
+	header.glMax		 = readInt(140);
+	header.glMin		 = readInt(144);
+	header.descrip		 = readString(148, 80);
+	header.auxFile		 = readString(228, 24);
+	header.qformCode	 = readShort(252);
+	header.sformCode	 = readShort(254);
+	header.intentName	 = readString(328, 16);
+	header.magic		 = readString(344, 4);
+	header.isNifti		 = (header.magic=="n+1") || (header.magic=="ni1");
+
+	/*	SPM flags the Analyze types it added (int8, uint16 and uint32) by
+	 *	adding 128 to the code of the unsigned/signed counterpart	*/
+	if( !header.isNifti ) {
+		switch( header.datatype ) {
+			case 130: header.datatype = NiftiInt8;	 break;
+			case 132: header.datatype = NiftiUInt16; break;
+			case 136: header.datatype = NiftiUInt32; break;
+		};
+	};
+
+	/*	Validate the geometry and datatype	*/
+	if( (header.dim[0]<1) || (header.dim[0]>7) ) {
+		return Fail("Invalid number of dimensions in " + headerFileName);
+	};
+	for(int idx=1; idx<=header.dim[0]; idx++) {
+		if( header.dim[idx]<1 ) {
+			return Fail("Invalid image size in " + headerFileName);
+		};
+	};
+	const unsigned int nComponents = header.GetNumberOfComponents();
+	if( !nComponents ) {
+		char msg[64];
+		std::snprintf(msg, sizeof(msg), "Unsupported datatype (%d) in ", header.datatype);
+		return Fail(msg + headerFileName);
+	};
+	for(size_t idx=0; idx<sizeof(niftiDataTypes)/sizeof(niftiDataTypes[0]); idx++) {
+		if( niftiDataTypes[idx].code==header.datatype ) {
+			header.bitpix = niftiDataTypes[idx].bitpix;
+		};
+	};
+	return true;
+};
+
+
+/*
+ *	CopyTo()
+ *
+ *	See the class declaration
+ */
+inline bool NiftiImage::CopyTo(void* dst, unsigned int nThreads)
+{
+	unsigned char*	out			  = static_cast<unsigned char*>(dst);
+	const size_t	nBytes		  = header.GetDataSize();
+	const size_t	componentSize = header.GetComponentSize();
+	const bool		isSwapped	  = header.isSwapped && (componentSize>1);
+
+	if( !isCompressed ) {
+		if( !dataFile.IsOpen() ) {
+			return Fail("No image has been read");
+		};
+
+		/*	Copy from the mapped pages (chunks are multiples of 16 bytes,
+		 *	so swapping never splits a component)	*/
+		const unsigned char* src = reinterpret_cast<const unsigned char*>(dataFile.GetData())+dataOffset;
+		dataFile.AdviseSequential();
+		ParallelFor(nBytes, niftiChunkBytes, [&](size_t begin, size_t end, unsigned int) {
+			std::memcpy(out+begin, src+begin, end-begin);
+			if( isSwapped ) {
+				SwapBytes(out+begin, (end-begin)/componentSize, componentSize);
+			};
+		}, nThreads);
+		return true;
+	};
+
+	bool isBlocked = false;
+	if( !InflateBlocks(out, nThreads, isBlocked) ) {
+		return false;
+	}
+	else if( !isBlocked && !InflateStream(out) ) {
+		return false;
+	};
+	if( isSwapped ) {
+		ParallelFor(nBytes, niftiChunkBytes, [&](size_t begin, size_t end, unsigned int) {
+			SwapBytes(out+begin, (end-begin)/componentSize, componentSize);
+		}, nThreads);
+	};
+	return true;
+};
+
+
+/*
+ *	InflateStream()
+ *
+ *	Serial inflate of a gzip file (any number of members)
+ */
+inline bool NiftiImage::InflateStream(unsigned char* dst)
+{
+	gzFile fid = gzopen(dataFileName.c_str(), "rb");
+	if( !fid ) {
+		return Fail("Unable to open " + dataFileName);
+	};
+	gzbuffer(fid, 1u<<20);
+
+	/*	Skip to the data, then read in pieces (gzread counts are 32-bit)	*/
+	bool isRead = (gzseek(fid, static_cast<z_off_t>(dataOffset), SEEK_SET)==static_cast<z_off_t>(dataOffset));
+	const size_t nBytes = header.GetDataSize();
+	const size_t nMax	= 1u<<30;
+	for(size_t nOut=0; isRead && (nOut<nBytes); ) {
+		const unsigned int nRequest = static_cast<unsigned int>( std::min(nMax, nBytes-nOut) );
+		const int nRead = gzread(fid, dst+nOut, nRequest);
+		isRead = (nRead==static_cast<int>(nRequest));
+		nOut  += (nRead>0) ? nRead : 0;
+	};
+	gzclose(fid);
+	if( !isRead ) {
+		return Fail("Corrupt or truncated compressed data in " + dataFileName);
+	};
+	return true;
+};
+
+
+/*
+ *	InflateBlocks()
+ *
+ *	Parallel inflate of BGZF files. The members of these files carry their
+ *	compressed size in the "BC" extra field and the uncompressed size in
+ *	the trailer, so all members can be located with a single pass over the
+ *	member headers and inflated independently. ISBLOCKED is false (and no
+ *	data are written) if the file is not a BGZF file
+ */
+inline bool NiftiImage::InflateBlocks(unsigned char* dst, unsigned int nThreads, bool &isBlocked)
+{
+	isBlocked = false;
+	if( !dataFile.Open(dataFileName) ) {
+		return Fail("Unable to map " + dataFileName);
+	};
+	const unsigned char* src   = reinterpret_cast<const unsigned char*>(dataFile.GetData());
+	const size_t		 nSrc  = dataFile.GetSize();
+	const size_t		 nData = header.GetDataSize();
+
+	/*	Locate the blocks: compressed offset, size and uncompressed offset	*/
+	struct Block{ size_t offset, size, payload, uOffset, uSize; };
+	std::vector<Block> blocks;
+	size_t uOffset = 0;
+	for(size_t offset=0; (offset<nSrc) && (uOffset<dataOffset+nData); ) {
+		if( (nSrc-offset<18) || (src[offset]!=0x1f) || (src[offset+1]!=0x8b) ||
+			(src[offset+2]!=8) || !(src[offset+3]&4) ) {
+			dataFile.Close();
+			return true;
+		};
+		const size_t xLen = src[offset+10] | (src[offset+11]<<8);
+		size_t		 size = 0;
+		for(size_t sub=offset+12; sub+4<=offset+12+xLen && sub+4<=nSrc; ) {
+			const size_t subLen = src[sub+2] | (src[sub+3]<<8);
+			if( (src[sub]=='B') && (src[sub+1]=='C') && (subLen==2) && (sub+6<=nSrc) ) {
+				size = (src[sub+4] | (src[sub+5]<<8)) + 1;
+			};
+			sub += 4+subLen;
+		};
+		if( !size || (offset+size>nSrc) || (size<12+xLen+8) ) {
+			dataFile.Close();
+			return true;
+		};
+		const unsigned char* trailer = src+offset+size-4;
+		Block block;
+		block.offset  = offset;
+		block.size	  = size;
+		block.payload = 12+xLen;
+		block.uOffset = uOffset;
+		block.uSize	  = trailer[0] | (trailer[1]<<8) | (trailer[2]<<16) | (static_cast<size_t>(trailer[3])<<24);
+		blocks.push_back(block);
+		uOffset += block.uSize;
+		offset	+= size;
+	};
+	isBlocked = true;
+	if( uOffset<dataOffset+nData ) {
+		dataFile.Close();
+		return Fail("Corrupt or truncated compressed data in " + dataFileName);
+	};
+
+	/*	Inflate the blocks (at most 64 kB each) to a local buffer and copy
+	 *	the part overlapping the data	*/
+	std::atomic<bool> isValid(true);
+	ParallelFor(blocks.size(), 16, [&](size_t begin, size_t end, unsigned int) {
+		std::vector<unsigned char> buffer;
+		z_stream stream;
+		std::memset(&stream, 0, sizeof(stream));
+		if( inflateInit2(&stream, -15)!=Z_OK ) {
+			isValid = false;
+			return;
+		};
+		for(size_t idx=begin; idx<end; idx++) {
+			const Block &block = blocks[idx];
+			const size_t dataBegin = std::max(block.uOffset, dataOffset);
+			const size_t dataEnd   = std::min(block.uOffset+block.uSize, dataOffset+nData);
+			if( dataBegin>=dataEnd ) {
+				continue;
+			};
+			buffer.resize(block.uSize);
+			inflateReset(&stream);
+			stream.next_in	 = const_cast<unsigned char*>(src+block.offset+block.payload);
+			stream.avail_in	 = static_cast<uInt>(block.size-block.payload-8);
+			stream.next_out	 = buffer.data();
+			stream.avail_out = static_cast<uInt>(block.uSize);
+			if( (inflate(&stream, Z_FINISH)!=Z_STREAM_END) || stream.avail_out ) {
+				isValid = false;
+				break;
+			};
+			std::memcpy(dst+(dataBegin-dataOffset), buffer.data()+(dataBegin-block.uOffset), dataEnd-dataBegin);
+		};
+		inflateEnd(&stream);
+	}, nThreads);
+	dataFile.Close();
+	if( !isValid ) {
+		return Fail("Corrupt compressed data in " + dataFileName);
+	};
+	return true;
+};
+
+
+#endif
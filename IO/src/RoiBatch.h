@@ -0,0 +1,291 @@
+/*
+ *	RoiBatch.h
+ *
+ *	Bulk ROI engine used by roi_batch. The ROIs of parsed exports (see
+ *	RoiFile.h) are converted to image coordinates and rasterised onto the
+ *	exam grid as run-length encoded masks: each run is a one-based linear
+ *	(column-major) index of the rows-by-cols plane and a length, so a run
+ *	never crosses a column. Masks are sampled at the voxel centres using
+ *	the even-odd rule, as poly2mask does for most shapes.
+ *
+ *	The reverse operation writes ROIs as NordicICE files with the layout
+ *	of nordicicewrite.m.
+ */
+
+
+#ifndef ROIBATCH_H
+#define ROIBATCH_H
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*	QUATTRO headers	*/
+#include "RoiFile.h"
+
+
+/*	Run-length encoded mask	*/
+struct RoiRuns{
+	std::vector<unsigned int> starts;	/*	one-based linear indices	*/
+	std::vector<unsigned int> lengths;
+
+	size_t GetNumberOfVoxels() const
+	{
+		size_t n = 0;
+		for(size_t idx=0; idx<lengths.size(); idx++) {
+			n += lengths[idx];
+		};
+		return n;
+	};
+
+	/*	Appends the rows [r0,r1] (one-based) of the column c (one-based)	*/
+	void AddRun(long r0, long r1, long c, long rows)
+	{
+		r0 = std::max(r0, 1L);
+		r1 = std::min(r1, rows);
+		if( r1<r0 ) {
+			return;
+		};
+		const unsigned int start = static_cast<unsigned int>((c-1)*rows+r0);
+		if( !starts.empty() && (starts.back()+lengths.back()==start) ) {
+			lengths.back() += static_cast<unsigned int>(r1-r0+1);
+			return;
+		};
+		starts.push_back(start);
+		lengths.push_back( static_cast<unsigned int>(r1-r0+1) );
+	};
+};
+
+
+/*	Pinnacle image grid (fields of the Pinnacle *.header file)	*/
+struct PinnacleGrid{
+	double	start[3];	/*	x_start, y_start, z_start	*/
+	double	pixdim[3];	/*	x_pixdim, y_pixdim, z_pixdim	*/
+	double	dim[3];		/*	x_dim, y_dim, z_dim	*/
+};
+
+
+/*	ROI of a batch	*/
+struct BatchRoi{
+	size_t		fileIdx;
+	std::string	name;
+	std::string	type;	/*	MATLAB ROI type: impoly, imspline, imrect, imellipse	*/
+	double		slice;
+	std::vector<double> x;	/*	one-based image coordinates (columns)	*/
+	std::vector<double> y;	/*	one-based image coordinates (rows)	*/
+	RoiRuns		runs;
+};
+
+
+/*
+ *	RasterizePolygon()
+ *
+ *	Encodes the voxels of a rows-by-cols plane whose centres lie within the
+ *	closed polygon (x,y). Each column is intersected with the polygon edges
+ *	and the rows between pairs of crossings are added as a run
+ */
+inline void RasterizePolygon(const std::vector<double> &x, const std::vector<double> &y,
+							 long rows, long cols, RoiRuns &runs)
+{
+	const size_t n = x.size();
+	if( n<3 ) {
+		return;
+	};
+	const double xMin = *std::min_element(x.begin(), x.end());
+	const double xMax = *std::max_element(x.begin(), x.end());
+	const long	 c0	  = std::max(1L, static_cast<long>(std::ceil(xMin)));
+	const long	 c1	  = std::min(cols, static_cast<long>(std::floor(xMax)));
+	std::vector<double> crossings;
+	for(long c=c0; c<=c1; c++) {
+		crossings.clear();
+		for(size_t idx=0, prev=n-1; idx<n; prev=idx++) {
+			const double xa = x[prev], xb = x[idx];
+			if( (xa<=c && c<xb) || (xb<=c && c<xa) ) {
+				crossings.push_back( y[prev]+(c-xa)*(y[idx]-y[prev])/(xb-xa) );
+			};
+		};
+		std::sort(crossings.begin(), crossings.end());
+		for(size_t idx=0; idx+1<crossings.size(); idx+=2) {
+			runs.AddRun(static_cast<long>(std::ceil(crossings[idx])),
+						static_cast<long>(std::ceil(crossings[idx+1]))-1, c, rows);
+		};
+	};
+};
+
+
+/*
+ *	RasterizeEllipse()
+ *
+ *	Encodes the ellipse inscribed in the box [XMIN YMIN WIDTH HEIGHT] (the
+ *	imellipse position vector)
+ */
+inline void RasterizeEllipse(const double pos[4], long rows, long cols, RoiRuns &runs)
+{
+	const double a	= pos[2]/2, b = pos[3]/2;
+	const double cx = pos[0]+a, cy = pos[1]+b;
+	if( (a<=0) || (b<=0) ) {
+		return;
+	};
+	const long c0 = std::max(1L, static_cast<long>(std::ceil(cx-a)));
+	const long c1 = std::min(cols, static_cast<long>(std::floor(cx+a)));
+	for(long c=c0; c<=c1; c++) {
+		const double dx = (c-cx)/a;
+		const double h	= b*std::sqrt(std::max(0.0, 1.0-dx*dx));
+		runs.AddRun(static_cast<long>(std::ceil(cy-h)), static_cast<long>(std::floor(cy+h)), c, rows);
+	};
+};
+
+
+/*
+ *	RasterizeRectangle()
+ *
+ *	Encodes the rectangle [XMIN YMIN WIDTH HEIGHT] (the imrect position
+ *	vector)
+ */
+inline void RasterizeRectangle(const double pos[4], long rows, long cols, RoiRuns &runs)
+{
+	const long c0 = std::max(1L, static_cast<long>(std::ceil(pos[0])));
+	const long c1 = std::min(cols, static_cast<long>(std::floor(pos[0]+pos[2])));
+	for(long c=c0; c<=c1; c++) {
+		runs.AddRun(static_cast<long>(std::ceil(pos[1])), static_cast<long>(std::floor(pos[1]+pos[3])), c, rows);
+	};
+};
+
+
+/*
+ *	Rasterize()
+ *
+ *	Encodes a batch ROI according to its type. Rectangles and ellipses are
+ *	stored as the two corners of their bounding box
+ */
+inline void Rasterize(BatchRoi &roi, long rows, long cols)
+{
+	roi.runs = RoiRuns();
+	if( ((roi.type=="imrect") || (roi.type=="imellipse")) && (roi.x.size()==2) ) {
+		const double pos[4] = {roi.x[0], roi.y[0], roi.x[1]-roi.x[0], roi.y[1]-roi.y[0]};
+		if( roi.type=="imrect" ) {
+			RasterizeRectangle(pos, rows, cols, roi.runs);
+		}
+		else {
+			RasterizeEllipse(pos, rows, cols, roi.runs);
+		};
+		return;
+	};
+	RasterizePolygon(roi.x, roi.y, rows, cols, roi.runs);
+};
+
+
+/*
+ *	GetBatchRois()
+ *
+ *	Converts the ROIs of a parsed export to batch ROIs in image coordinates.
+ *	NordicICE points are zero-based (see nordicicewrite.m). Pinnacle
+ *	contours are converted using the grid, when given, following the
+ *	conversion of read_pinnacle.m (which also drops contours that fall
+ *	before the first slice); otherwise the coordinates are used as is
+ */
+inline void GetBatchRois(const RoiFile &file, size_t fileIdx, const PinnacleGrid* grid,
+						 std::vector<BatchRoi> &rois)
+{
+	if( file.GetType()==RoiNordicIce ) {
+		const std::vector<double> &points = file.GetPoints();
+		std::string type = file.GetShape();
+		std::transform(type.begin(), type.end(), type.begin(), ::tolower);
+		BatchRoi roi;
+		roi.fileIdx = fileIdx;
+		roi.slice	= 1;
+		for(size_t idx=0; idx+1<points.size(); idx+=2) {
+			roi.x.push_back(points[idx]+1);
+			roi.y.push_back(points[idx+1]+1);
+		};
+		if( (type=="ellipse") || (type=="rectangle") ) {
+
+			/*	The file holds the width/height followed by the origin	*/
+			roi.type = (type=="ellipse") ? "imellipse" : "imrect";
+			if( roi.x.size()!=2 ) {
+				return;
+			};
+			std::swap(roi.x[0], roi.x[1]);
+			std::swap(roi.y[0], roi.y[1]);
+			roi.x[1] += roi.x[0]-1;
+			roi.y[1] += roi.y[0]-1;
+		}
+		else {
+			roi.type = (type=="freehand") ? "imspline" : "impoly";
+		};
+		rois.push_back(roi);
+	}
+	else if( file.GetType()==RoiPinnacle ) {
+		const std::vector<PinnacleRoi> &pRois = file.GetRois();
+		for(size_t roiIdx=0; roiIdx<pRois.size(); roiIdx++) {
+			for(size_t cIdx=0; cIdx<pRois[roiIdx].curves.size(); cIdx++) {
+				const std::vector<double> &curve = pRois[roiIdx].curves[cIdx];
+				BatchRoi roi;
+				roi.fileIdx = fileIdx;
+				roi.name	= pRois[roiIdx].name;
+				roi.type	= "impoly";
+				roi.slice	= 1;
+				for(size_t idx=0; idx+2<curve.size(); idx+=3) {
+					if( grid ) {
+						roi.x.push_back( (curve[idx]-grid->start[0])/grid->pixdim[0]+1 );
+						roi.y.push_back( grid->dim[1]-(curve[idx+1]-grid->start[1])/grid->pixdim[1]+1 );
+					}
+					else {
+						roi.x.push_back(curve[idx]);
+						roi.y.push_back(curve[idx+1]);
+					};
+				};
+				if( grid && !curve.empty() ) {
+					roi.slice = grid->dim[2]-std::floor((curve[2]-grid->start[2])/grid->pixdim[2]+0.5)+1;
+					if( roi.slice<=0 ) {
+						continue;
+					};
+				};
+				rois.push_back(roi);
+			};
+		};
+	};
+};
+
+
+/*
+ *	WriteNordicIce()
+ *
+ *	Writes a batch ROI to a NordicICE file. Rectangles and ellipses are
+ *	written as width/height and origin and other ROIs as polygons
+ *	(freehand for splines); coordinates are rounded and zero-based
+ */
+inline bool WriteNordicIce(const std::string &fName, const BatchRoi &roi, const std::string &size="MEDIUM")
+{
+	FILE* fid = std::fopen(fName.c_str(), "wb");
+	if( !fid ) {
+		return false;
+	};
+	const bool isBox = ((roi.type=="imrect") || (roi.type=="imellipse")) && (roi.x.size()==2);
+	const char* type = isBox				 ? ((roi.type=="imrect") ? "rectangle" : "ellipse") :
+					   (roi.type=="imspline") ? "freehand" : "polygon";
+	std::string text = size + "\n" + type + "\n";
+	char line[64];
+	if( isBox ) {
+		std::snprintf(line, sizeof(line), "%.0f;%.0f\n%.0f;%.0f\n",
+					  std::floor(roi.x[1]-roi.x[0]+0.5), std::floor(roi.y[1]-roi.y[0]+0.5),
+					  std::floor(roi.x[0]-0.5), std::floor(roi.y[0]-0.5));
+		text += line;
+	}
+	else {
+		for(size_t idx=0; idx<roi.x.size(); idx++) {
+			std::snprintf(line, sizeof(line), "%.0f;%.0f\n",
+						  std::max(0.0, std::floor(roi.x[idx]-0.5)), std::max(0.0, std::floor(roi.y[idx]-0.5)));
+			text += line;
+		};
+	};
+	const bool isWritten = (std::fwrite(text.data(), 1, text.size(), fid)==text.size());
+	return (std::fclose(fid)==0) && isWritten;
+};
+
+
+#endif
@@ -0,0 +1,329 @@
+/*
+ *	RoiFile.h
+ *
+ *	Parser of the ROI exports imported by QUATTRO (see roi_read). Files
+ *	are memory mapped and parsed line by line without intermediate
+ *	strings, so batches of exports can be parsed on all cores. Two
+ *	formats are supported:
+ *
+ *		NordicICE/ImageJ	Size ("SMALL", "MEDIUM" or "LARGE") and type
+ *							("ellipse", "polygon", "rectangle" or "freehand")
+ *							lines followed by one "x;y" line per point (see
+ *							nordicicewrite.m)
+ *
+ *		Pinnacle			"// Region of Interest file" exports holding one
+ *							or more named ROIs, each with a color and
+ *							num_curve contours of "x y z" points enclosed by
+ *							"points={" and "};  // End of points"
+ *
+ *	The values are returned as written; conversions to image coordinates
+ *	are performed by the MATLAB readers.
+ */
+
+
+#ifndef ROIFILE_H
+#define ROIFILE_H
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*	QUATTRO headers	*/
+#include "MappedFile.h"
+
+
+enum roiFileType {
+	RoiUnknown,
+	RoiNordicIce,
+	RoiPinnacle
+};
+
+
+/*	Pinnacle ROI	*/
+struct PinnacleRoi{
+	std::string	name;
+	std::string	color;
+	int			nCurves;	/*	num_curve of the ROI definition	*/
+	std::vector< std::vector<double> > curves;	/*	x,y,z triplets	*/
+	PinnacleRoi() : nCurves(0) {};
+};
+
+
+class RoiFile{
+
+ public:
+
+	RoiFile() : type(RoiUnknown), isComplete(true) {};
+
+	/*
+	 *	Read()
+	 *
+	 *	Reads and parses a file. Returns false if the file cannot be read;
+	 *	files of an unknown format are read successfully with the type
+	 *	RoiUnknown
+	 */
+	bool Read(const std::string &fName)
+	{
+		MappedFile file;
+		if( !file.Open(fName) ) {
+			error = "Unable to read " + fName;
+			return false;
+		};
+		file.AdviseSequential();
+		Parse(file.GetData(), file.GetSize());
+		return true;
+	};
+
+	/*
+	 *	Parse()
+	 *
+	 *	Parses the text of an export, determining the format from the first
+	 *	line
+	 */
+	void Parse(const char* text, size_t n)
+	{
+		type		= RoiUnknown;
+		isComplete	= true;
+		size.clear();
+		shape.clear();
+		points.clear();
+		rois.clear();
+
+		const char* pos = text;
+		const char* end = text+n;
+		Line line;
+		if( !NextLine(pos, end, line) ) {
+			return;
+		};
+		if( line.IsEqualNoCase("// Region of Interest file") ) {
+			type = RoiPinnacle;
+			ParsePinnacle(pos, end);
+		}
+		else if( line.IsEqualNoCase("small") || line.IsEqualNoCase("medium") || line.IsEqualNoCase("large") ) {
+			type = RoiNordicIce;
+			size.assign(line.begin, line.end);
+			ParseNordicIce(pos, end);
+		};
+	};
+
+	roiFileType	GetType() const { return type; };
+
+	/*	False when some contours were malformed and skipped	*/
+	bool		IsComplete() const { return isComplete; };
+
+	/*	NordicICE size, type and "x;y" points (interleaved)	*/
+	const std::string&		  GetSize()	  const { return size; };
+	const std::string&		  GetShape()  const { return shape; };
+	const std::vector<double>& GetPoints() const { return points; };
+
+	/*	Pinnacle ROIs	*/
+	const std::vector<PinnacleRoi>& GetRois() const { return rois; };
+
+	const std::string&	GetError() const { return error; };
+
+
+ private:
+
+	roiFileType	type;
+	bool		isComplete;
+	std::string	size;
+	std::string	shape;
+	std::vector<double> points;
+	std::vector<PinnacleRoi> rois;
+	std::string	error;
+
+	/*	Line with leading and trailing white space removed	*/
+	struct Line{
+		const char* begin;
+		const char* end;
+
+		bool IsEmpty() const { return begin==end; };
+
+		bool IsEqualNoCase(const char* str) const
+		{
+			const size_t n = std::strlen(str);
+			if( static_cast<size_t>(end-begin)!=n ) {
+				return false;
+			};
+			for(size_t idx=0; idx<n; idx++) {
+				if( std::tolower(static_cast<unsigned char>(begin[idx]))!=std::tolower(static_cast<unsigned char>(str[idx])) ) {
+					return false;
+				};
+			};
+			return true;
+		};
+
+		bool StartsWith(const char* str) const
+		{
+			const size_t n = std::strlen(str);
+			return (static_cast<size_t>(end-begin)>=n) && !std::strncmp(begin, str, n);
+		};
+
+		bool Contains(const char* str) const
+		{
+			const size_t n = std::strlen(str);
+			for(const char* pos=begin; pos+n<=end; pos++) {
+				if( !std::strncmp(pos, str, n) ) {
+					return true;
+				};
+			};
+			return false;
+		};
+
+		/*	Text following the first occurrence of the character c	*/
+		std::string After(char c) const
+		{
+			const char* pos = begin;
+			while( (pos<end) && (*pos!=c) ) {
+				pos++;
+			};
+			Line value = {pos<end ? pos+1 : end, end};
+			Trim(value);
+			return std::string(value.begin, value.end);
+		};
+	};
+
+	static void Trim(Line &line)
+	{
+		while( (line.begin<line.end) && std::isspace(static_cast<unsigned char>(*line.begin)) ) {
+			line.begin++;
+		};
+		while( (line.end>line.begin) && std::isspace(static_cast<unsigned char>(line.end[-1])) ) {
+			line.end--;
+		};
+	};
+
+	/*
+	 *	NextLine()
+	 *
+	 *	Returns the next non-empty line and advances pos past it
+	 */
+	static bool NextLine(const char* &pos, const char* end, Line &line)
+	{
+		while( pos<end ) {
+			line.begin = pos;
+			const char* eol = static_cast<const char*>( std::memchr(pos, '\n', end-pos) );
+			line.end = eol ? eol : end;
+			pos		 = eol ? eol+1 : end;
+			Trim(line);
+			if( !line.IsEmpty() ) {
+				return true;
+			};
+		};
+		return false;
+	};
+
+	/*
+	 *	ParseNumbers()
+	 *
+	 *	Parses up to n numbers separated by white space or the character sep.
+	 *	Returns the number of values parsed
+	 */
+	static size_t ParseNumbers(const Line &line, double* values, size_t n, char sep)
+	{
+		std::string str(line.begin, line.end);	/*	strtod requires termination	*/
+		const char* pos = str.c_str();
+		size_t		nValues = 0;
+		while( nValues<n ) {
+			while( std::isspace(static_cast<unsigned char>(*pos)) || (*pos==sep) ) {
+				pos++;
+			};
+			char* next = 0;
+			values[nValues] = std::strtod(pos, &next);
+			if( next==pos ) {
+				break;
+			};
+			pos = next;
+			nValues++;
+		};
+		return nValues;
+	};
+
+	void ParseNordicIce(const char* pos, const char* end)
+	{
+		Line line;
+		if( !NextLine(pos, end, line) ) {
+			isComplete = false;
+			return;
+		};
+		shape.assign(line.begin, line.end);
+		double xy[2];
+		while( NextLine(pos, end, line) ) {
+			if( ParseNumbers(line, xy, 2, ';')!=2 ) {
+				isComplete = false;
+				continue;
+			};
+			points.push_back(xy[0]);
+			points.push_back(xy[1]);
+		};
+	};
+
+	void ParsePinnacle(const char* pos, const char* end)
+	{
+		Line line;
+		PinnacleRoi* roi = 0;
+		while( NextLine(pos, end, line) ) {
+			if( line.Contains("//  Beginning") ) {
+				rois.push_back( PinnacleRoi() );
+				roi		  = &rois.back();
+				roi->name = line.After(':');
+			}
+			else if( !roi ) {
+				continue;
+			}
+			else if( line.StartsWith("num_curve") ) {
+				roi->nCurves = std::atoi( line.After('=').c_str() );
+			}
+			else if( line.StartsWith("color:") ) {
+				roi->color = line.After(':');
+			}
+			else if( line.IsEqualNoCase("points={") ) {
+				ParseCurve(pos, end, *roi);
+			};
+		};
+
+		/*	Contours that do not match the ROI definition are flagged	*/
+		for(size_t idx=0; idx<rois.size(); idx++) {
+			if( static_cast<size_t>(rois[idx].nCurves)!=rois[idx].curves.size() ) {
+				isComplete = false;
+			};
+		};
+	};
+
+	/*
+	 *	ParseCurve()
+	 *
+	 *	Reads the points of a contour up to the end of points line. Curves
+	 *	are closed and single point curves are skipped
+	 */
+	void ParseCurve(const char* &pos, const char* end, PinnacleRoi &roi)
+	{
+		std::vector<double> curve;
+		Line   line;
+		double xyz[3];
+		while( NextLine(pos, end, line) && !line.Contains("// End of points") ) {
+			if( ParseNumbers(line, xyz, 3, ' ')!=3 ) {
+				isComplete = false;
+				continue;
+			};
+			curve.insert(curve.end(), xyz, xyz+3);
+		};
+		if( curve.size()<6 ) {
+			isComplete = false;
+			return;
+		};
+		const double first[3] = {curve[0], curve[1], curve[2]};
+		if( !std::equal(first, first+3, curve.end()-3) ) {
+			curve.insert(curve.end(), first, first+3);
+		};
+		roi.curves.push_back(curve);
+	};
+};
+
+
+#endif
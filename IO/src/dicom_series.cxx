@@ -0,0 +1,264 @@
+/*
+ *	dicom_series.cxx
+ *
+ *	MEX front end of the native DICOM series loader (see DicomSeries.h)
+ *
+ *	S = dicom_series(DIRS) scans the directory DIRS (a string or a cell
+ *	array of directories) and all sub-directories for DICOM files, sorts
+ *	them into series and reads the images. S is a structure array with one
+ *	element per series and the fields:
+ *
+ *		Field				Description
+ *		-------------------------------
+ *
+ *		SeriesInstanceUID	Series UID
+ *
+ *		SeriesDescription	Series description (empty if not present)
+ *
+ *		SeriesNumber		Series number (empty if not present)
+ *
+ *		Modality			Modality (empty if not present)
+ *
+ *		Image				Rows-by-columns-by-slices-by-frames array of
+ *							the class of the pixel data (e.g., int16).
+ *							Missing images are zero
+ *
+ *		FileNames			Slices-by-frames cell array of file names
+ *							(empty for missing images)
+ *
+ *		Headers				Slices-by-frames structure of the header
+ *							tags (dicominfo field names)
+ *
+ *		SliceLocations		Slice positions along the slice normal
+ *
+ *	Slices are sorted by position and the images of a slice by temporal
+ *	position, trigger/acquisition time, flip angle, TE, TI, TR, b-value
+ *	and finally instance number. No rescaling is applied (see dicomread).
+ *
+ *	[S,UNSUPPORTED] = dicom_series(...) also returns a cell array of the
+ *	DICOM files that could not be decoded (e.g., compressed transfer
+ *	syntaxes or multi-frame images).
+ *
+ *	S = dicom_series(...,'PropertyName1',PropertyValue1,...) uses the
+ *	options specified by the property/value pairs:
+ *
+ *		Option String		Description
+ *		-------------------------------
+ *
+ *		MaxDepth			Maximum depth of sub-directories to scan (0
+ *							scans only DIRS). Default: no limit
+ *
+ *		NumberOfThreads		Number of worker threads (default: all cores)
+ */
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/*	MATLAB headers	*/
+#include "mex.h"
+
+/*	QUATTRO headers	*/
+#include "DicomSeries.h"
+
+
+/*
+ *	GetClassID()
+ *
+ *	Returns the MATLAB class corresponding to a DICOM pixel type
+ */
+static mxClassID GetClassID(dicomPixelType type)
+{
+	switch( type ) {
+		case DicomUInt8:	return mxUINT8_CLASS;
+		case DicomInt8:		return mxINT8_CLASS;
+		case DicomUInt16:	return mxUINT16_CLASS;
+		case DicomInt16:	return mxINT16_CLASS;
+		case DicomUInt32:	return mxUINT32_CLASS;
+		case DicomInt32:	return mxINT32_CLASS;
+		default:			return mxUNKNOWN_CLASS;
+	};
+};
+
+
+/*
+ *	ValueToArray()
+ *
+ *	Converts a tag value to a MATLAB array (char or double column vector)
+ */
+static mxArray* ValueToArray(const DicomValue &value)
+{
+	if( !value.isPresent ) {
+		return mxCreateDoubleMatrix(0, 0, mxREAL);
+	};
+	if( !value.isNumeric ) {
+		return mxCreateString( value.str.c_str() );
+	};
+	mxArray* array = mxCreateDoubleMatrix(value.num.size(), (value.num.empty() ? 0 : 1), mxREAL);
+	std::copy(value.num.begin(), value.num.end(), mxGetPr(array));
+	return array;
+};
+
+
+/*
+ *	CreateHeaders()
+ *
+ *	Creates the slices-by-frames header structure of a series. Tags are
+ *	only included if present in at least one image of the series (as with
+ *	dicominfo)
+ */
+static mxArray* CreateHeaders(const DicomSeriesLoader &loader, const DicomSeriesInfo &series)
+{
+	const std::vector<DicomFileInfo> &files = loader.GetFiles();
+	std::vector<const char*> names;
+	std::vector<unsigned int> tags;
+	for(unsigned int tIdx=0; tIdx<dicomTagCount; tIdx++) {
+		for(size_t idx=0; idx<series.files.size(); idx++) {
+			if( (series.files[idx]>=0) && files[ series.files[idx] ].values[tIdx].isPresent ) {
+				names.push_back(dicomTags[tIdx].name);
+				tags.push_back(tIdx);
+				break;
+			};
+		};
+	};
+	const char* extraNames[] = {"Filename", "Format", "Width", "Height", "BitDepth", "ColorType"};
+	const size_t nExtra = sizeof(extraNames)/sizeof(extraNames[0]);
+	names.insert(names.begin(), extraNames, extraNames+nExtra);
+
+	mxArray* headers = mxCreateStructMatrix(series.nSlices, series.nFrames, static_cast<int>(names.size()), &names[0]);
+	for(size_t idx=0; idx<series.files.size(); idx++) {
+		if( series.files[idx]<0 ) {
+			continue;
+		};
+		const DicomFileInfo &file = files[ series.files[idx] ];
+		mxSetFieldByNumber(headers, idx, 0, mxCreateString( file.fileName.c_str() ));
+		mxSetFieldByNumber(headers, idx, 1, mxCreateString("DICOM"));
+		mxSetFieldByNumber(headers, idx, 2, mxCreateDoubleScalar(file.columns));
+		mxSetFieldByNumber(headers, idx, 3, mxCreateDoubleScalar(file.rows));
+		mxSetFieldByNumber(headers, idx, 4, mxCreateDoubleScalar( file.GetNumber(GetDicomTagIndex(0x0028,0x0101), file.bitsAllocated) ));
+		mxSetFieldByNumber(headers, idx, 5, mxCreateString("grayscale"));
+		for(size_t tIdx=0; tIdx<tags.size(); tIdx++) {
+			mxSetFieldByNumber(headers, idx, static_cast<int>(nExtra+tIdx), ValueToArray( file.values[tags[tIdx]] ));
+		};
+	};
+	return headers;
+};
+
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+
+	/*	Validate the inputs	*/
+	if( (nrhs<1) || !(nrhs%2) ) {
+		mexErrMsgIdAndTxt("QUATTRO:dicom_series:invalidInput",
+						  "A directory name (or cell array of names) and property/value pairs must be specified");
+	};
+	std::vector<std::string> dirs;
+	if( mxIsChar(prhs[0]) ) {
+		char* str = mxArrayToString(prhs[0]);
+		dirs.push_back(str);
+		mxFree(str);
+	}
+	else if( mxIsCell(prhs[0]) ) {
+		for(size_t idx=0; idx<mxGetNumberOfElements(prhs[0]); idx++) {
+			const mxArray* cell = mxGetCell(prhs[0], idx);
+			if( !cell || !mxIsChar(cell) ) {
+				mexErrMsgIdAndTxt("QUATTRO:dicom_series:invalidInput",
+								  "DIRS must be a string or a cell array of strings");
+			};
+			char* str = mxArrayToString(cell);
+			dirs.push_back(str);
+			mxFree(str);
+		};
+	}
+	else {
+		mexErrMsgIdAndTxt("QUATTRO:dicom_series:invalidInput",
+						  "DIRS must be a string or a cell array of strings");
+	};
+
+	/*	Parse the options	*/
+	int			 maxDepth = -1;
+	unsigned int nThreads = 0;
+	for(int idx=1; idx<nrhs; idx+=2) {
+		char* prop = mxArrayToString(prhs[idx]);
+		if( !prop ) {
+			mexErrMsgIdAndTxt("QUATTRO:dicom_series:invalidOptions",
+							  "Property names must be strings");
+		};
+		std::string name(prop);
+		mxFree(prop);
+		if( name=="MaxDepth" ) {
+			const double value = mxGetScalar(prhs[idx+1]);
+			maxDepth = (value<0 || mxIsInf(value)) ? -1 : static_cast<int>(value);
+		}
+		else if( name=="NumberOfThreads" ) {
+			nThreads = static_cast<unsigned int>( mxGetScalar(prhs[idx+1]) );
+		}
+		else {
+			mexErrMsgIdAndTxt("QUATTRO:dicom_series:invalidOptions",
+							  "Unknown property: %s", name.c_str());
+		};
+	};
+
+	/*	Parse and sort the files	*/
+	DicomSeriesLoader loader;
+	loader.SetNumberOfThreads(nThreads);
+	loader.Scan(dirs, maxDepth);
+	loader.Sort();
+	const std::vector<DicomSeriesInfo> &series = loader.GetSeries();
+	const std::vector<DicomFileInfo>   &files  = loader.GetFiles();
+
+	/*	Series structure	*/
+	const char* fieldNames[] = {"SeriesInstanceUID", "SeriesDescription", "SeriesNumber", "Modality",
+								"Image", "FileNames", "Headers", "SliceLocations"};
+	plhs[0] = mxCreateStructMatrix(series.size(), (series.empty() ? 0 : 1), 8, fieldNames);
+	for(size_t sIdx=0; sIdx<series.size(); sIdx++) {
+		const DicomSeriesInfo &info	 = series[sIdx];
+		const DicomFileInfo	  &first = files[ info.files[0]>=0 ? info.files[0] : 0 ];
+
+		mwSize dims[4] = {info.rows, info.columns, info.nSlices, info.nFrames};
+		mxArray* image = mxCreateNumericArray(4, dims, GetClassID(info.pixelType), mxREAL);
+		if( !image ) {
+			mexErrMsgIdAndTxt("QUATTRO:dicom_series:outOfMemory",
+							  "Unable to allocate the images of series %s", info.uid.c_str());
+		};
+		std::string error;
+		if( !loader.ReadPixels(info, mxGetData(image), &error) ) {
+			mxDestroyArray(image);
+			mexErrMsgIdAndTxt("QUATTRO:dicom_series:readFailure", "%s", error.c_str());
+		};
+
+		mxArray* fileNames = mxCreateCellMatrix(info.nSlices, info.nFrames);
+		for(size_t idx=0; idx<info.files.size(); idx++) {
+			const char* fName = (info.files[idx]>=0) ? files[ info.files[idx] ].fileName.c_str() : "";
+			mxSetCell(fileNames, idx, mxCreateString(fName));
+		};
+		mxArray* positions = mxCreateDoubleMatrix(info.nSlices, 1, mxREAL);
+		std::copy(info.positions.begin(), info.positions.end(), mxGetPr(positions));
+
+		mxSetFieldByNumber(plhs[0], sIdx, 0, mxCreateString( info.uid.c_str() ));
+		mxSetFieldByNumber(plhs[0], sIdx, 1, ValueToArray( first.values[GetDicomTagIndex(0x0008,0x103E)] ));
+		mxSetFieldByNumber(plhs[0], sIdx, 2, ValueToArray( first.values[GetDicomTagIndex(0x0020,0x0011)] ));
+		mxSetFieldByNumber(plhs[0], sIdx, 3, ValueToArray( first.values[GetDicomTagIndex(0x0008,0x0060)] ));
+		mxSetFieldByNumber(plhs[0], sIdx, 4, image);
+		mxSetFieldByNumber(plhs[0], sIdx, 5, fileNames);
+		mxSetFieldByNumber(plhs[0], sIdx, 6, CreateHeaders(loader, info));
+		mxSetFieldByNumber(plhs[0], sIdx, 7, positions);
+	};
+
+	/*	Unsupported DICOM files	*/
+	if( nlhs>1 ) {
+		std::vector<const char*> unsupported;
+		for(size_t idx=0; idx<files.size(); idx++) {
+			if( !files[idx].isSupported ) {
+				unsupported.push_back( files[idx].fileName.c_str() );
+			};
+		};
+		plhs[1] = mxCreateCellMatrix(unsupported.size(), 1);
+		for(size_t idx=0; idx<unsupported.size(); idx++) {
+			mxSetCell(plhs[1], idx, mxCreateString(unsupported[idx]));
+		};
+	};
+};
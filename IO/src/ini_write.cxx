@@ -0,0 +1,111 @@
+/*
+ *	ini_write.cxx
+ *
+ *	MEX front end of the buffered INI writer (see IniWriter.h)
+ *
+ *	ini_write(FILENAME,SECTION,S) writes the fields of the structure S as
+ *	key/value pairs of the section named SECTION to the INI file FILENAME,
+ *	replacing any existing file. When S is a structure array, one section
+ *	is written per element (e.g., one [Job] section per frame of a batch
+ *	registration). Empty fields are omitted.
+ *
+ *	ini_write(FILENAME,SECTION1,S1,SECTION2,S2,...) writes all sections to
+ *	the file in a single write operation.
+ *
+ *	Field values are strings, logicals (written as true/false) or real
+ *	numeric arrays; arrays are written using the syntax of mat2str (e.g.,
+ *	"[1 2;3 4]"). The file is read by itkReg (see IniConfig.h).
+ */
+
+
+/*	C++ headers	*/
+#include <string>
+#include <vector>
+
+/*	MATLAB headers	*/
+#include "mex.h"
+
+/*	QUATTRO headers	*/
+#include "IniWriter.h"
+
+
+/*
+ *	AddValue()
+ *
+ *	Appends a field value to the writer
+ */
+static void AddValue(IniWriter &writer, const std::string &key, const mxArray* value)
+{
+	if( mxIsChar(value) ) {
+		char* str = mxArrayToString(value);
+		writer.Add(key, std::string(str ? str : ""));
+		mxFree(str);
+	}
+	else if( mxIsLogical(value) ) {
+		if( mxGetNumberOfElements(value)!=1 ) {
+			mexErrMsgIdAndTxt("QUATTRO:ini_write:invalidValue",
+							  "Logical values of \"%s\" must be scalars", key.c_str());
+		};
+		writer.Add(key, mxGetLogicals(value)[0]!=0);
+	}
+	else if( mxIsNumeric(value) && !mxIsComplex(value) && (mxGetNumberOfDimensions(value)==2) ) {
+
+		/*	Numeric values are converted to double	*/
+		mxArray* input	= const_cast<mxArray*>(value);
+		mxArray* output = 0;
+		mexCallMATLAB(1, &output, 1, &input, "double");
+		writer.Add(key, mxGetPr(output), mxGetM(output), mxGetN(output));
+		mxDestroyArray(output);
+	}
+	else {
+		mexErrMsgIdAndTxt("QUATTRO:ini_write:invalidValue",
+						  "The value of \"%s\" must be a string, a logical or a real 2-D numeric array", key.c_str());
+	};
+};
+
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+
+	/*	Validate the inputs	*/
+	if( (nrhs<3) || !(nrhs%2) ) {
+		mexErrMsgIdAndTxt("QUATTRO:ini_write:invalidInput",
+						  "A file name and section name/structure pairs must be specified");
+	};
+	if( !mxIsChar(prhs[0]) ) {
+		mexErrMsgIdAndTxt("QUATTRO:ini_write:invalidInput",
+						  "FILENAME must be a string");
+	};
+	char* str = mxArrayToString(prhs[0]);
+	std::string fName(str);
+	mxFree(str);
+
+	/*	Buffer all sections	*/
+	IniWriter writer;
+	for(int idx=1; idx<nrhs; idx+=2) {
+		if( !mxIsChar(prhs[idx]) || !mxIsStruct(prhs[idx+1]) ) {
+			mexErrMsgIdAndTxt("QUATTRO:ini_write:invalidInput",
+							  "Sections must be specified as name/structure pairs");
+		};
+		str = mxArrayToString(prhs[idx]);
+		const std::string section(str);
+		mxFree(str);
+
+		const mxArray* s = prhs[idx+1];
+		for(size_t sIdx=0; sIdx<mxGetNumberOfElements(s); sIdx++) {
+			writer.AddSection(section);
+			for(int fIdx=0; fIdx<mxGetNumberOfFields(s); fIdx++) {
+				const mxArray* value = mxGetFieldByNumber(s, sIdx, fIdx);
+				if( value && !mxIsEmpty(value) ) {
+					AddValue(writer, mxGetFieldNameByNumber(s, fIdx), value);
+				};
+			};
+		};
+	};
+
+	/*	Write the file	*/
+	std::string error;
+	if( !writer.Write(fName, &error) ) {
+		mexErrMsgIdAndTxt("QUATTRO:ini_write:writeFailure", "%s", error.c_str());
+	};
+};
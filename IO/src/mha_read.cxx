@@ -0,0 +1,151 @@
+/*
+ *	mha_read.cxx
+ *
+ *	MEX front end of the MetaImage reader (see MetaImage.h)
+ *
+ *	I = mha_read(FILENAME) reads the image stored in the MetaImage file
+ *	FILENAME (*.mha or *.mhd). The class of I is the element type of the
+ *	file (e.g., MET_SHORT images are returned as int16) and the size of I
+ *	is given by the DimSize field. Multi-channel images have an additional
+ *	leading dimension indexing the channels. Uncompressed data are copied
+ *	straight from the mapped file; compressed data are inflated on all
+ *	cores when the file was written by mha_write.
+ *
+ *	[I,INFO] = mha_read(FILENAME) also returns the header fields as a
+ *	structure of strings.
+ */
+
+
+/*	C++ headers	*/
+#include <cctype>
+#include <string>
+#include <vector>
+
+/*	MATLAB headers	*/
+#include "mex.h"
+
+/*	QUATTRO headers	*/
+#include "MetaImage.h"
+
+
+/*
+ *	GetClassID()
+ *
+ *	Returns the MATLAB class corresponding to a MetaImage element type
+ */
+static mxClassID GetClassID(metaElementType type)
+{
+	switch( type ) {
+		case MetChar:		return mxINT8_CLASS;
+		case MetUChar:		return mxUINT8_CLASS;
+		case MetShort:		return mxINT16_CLASS;
+		case MetUShort:		return mxUINT16_CLASS;
+		case MetInt:		return mxINT32_CLASS;
+		case MetUInt:		return mxUINT32_CLASS;
+		case MetLongLong:	return mxINT64_CLASS;
+		case MetULongLong:	return mxUINT64_CLASS;
+		case MetFloat:		return mxSINGLE_CLASS;
+		case MetDouble:		return mxDOUBLE_CLASS;
+		default:			return mxUNKNOWN_CLASS;
+	};
+};
+
+
+/*
+ *	IsValidFieldName()
+ *
+ *	Determines if a header key can be used as a MATLAB field name
+ */
+static bool IsValidFieldName(const std::string &key)
+{
+	if( key.empty() || !std::isalpha(static_cast<unsigned char>(key[0])) ) {
+		return false;
+	};
+	for(size_t idx=1; idx<key.size(); idx++) {
+		if( !std::isalnum(static_cast<unsigned char>(key[idx])) && (key[idx]!='_') ) {
+			return false;
+		};
+	};
+	return true;
+};
+
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+
+	/*	Validate the inputs	*/
+	if( (nrhs!=1) || !mxIsChar(prhs[0]) ) {
+		mexErrMsgIdAndTxt("QUATTRO:mha_read:invalidInput",
+						  "A file name must be specified");
+	};
+	char* str = mxArrayToString(prhs[0]);
+	std::string fName(str);
+	mxFree(str);
+
+	/*	Parse the header and map the data	*/
+	MetaImage image;
+	if( !image.Read(fName) ) {
+		mexErrMsgIdAndTxt("QUATTRO:mha_read:invalidFile",
+						  "Unable to read %s: %s", fName.c_str(), image.GetError().c_str());
+	};
+	const MetaImageHeader &header = image.GetHeader();
+
+	/*	Create the output array in the element type of the file	*/
+	std::vector<mwSize> dims;
+	if( header.nChannels>1 ) {
+		dims.push_back(header.nChannels);
+	};
+	dims.insert(dims.end(), header.dimSize.begin(), header.dimSize.end());
+	if( dims.size()<2 ) {
+		dims.push_back(1);
+	};
+	plhs[0] = mxCreateUninitNumericArray(dims.size(), &dims[0], GetClassID(header.elementType), mxREAL);
+	if( !plhs[0] ) {
+		mexErrMsgIdAndTxt("QUATTRO:mha_read:outOfMemory",
+						  "Unable to allocate the image");
+	};
+
+	/*	Copy/decode the data	*/
+	bool isRead = false;
+	void* data	= mxGetData(plhs[0]);
+	try {
+		switch( header.elementType ) {
+			case MetChar:		isRead = image.CopyTo( static_cast<signed char*>(data) );			break;
+			case MetUChar:		isRead = image.CopyTo( static_cast<unsigned char*>(data) );			break;
+			case MetShort:		isRead = image.CopyTo( static_cast<short*>(data) );					break;
+			case MetUShort:		isRead = image.CopyTo( static_cast<unsigned short*>(data) );		break;
+			case MetInt:		isRead = image.CopyTo( static_cast<int*>(data) );					break;
+			case MetUInt:		isRead = image.CopyTo( static_cast<unsigned int*>(data) );			break;
+			case MetLongLong:	isRead = image.CopyTo( static_cast<long long*>(data) );				break;
+			case MetULongLong:	isRead = image.CopyTo( static_cast<unsigned long long*>(data) );	break;
+			case MetFloat:		isRead = image.CopyTo( static_cast<float*>(data) );					break;
+			case MetDouble:		isRead = image.CopyTo( static_cast<double*>(data) );				break;
+			default:			break;
+		};
+	}
+	catch( std::exception &err ) {
+		mexErrMsgIdAndTxt("QUATTRO:mha_read:readFailure", "%s", err.what());
+	};
+	if( !isRead ) {
+		mexErrMsgIdAndTxt("QUATTRO:mha_read:readFailure",
+						  "Unable to read the image data of %s: %s", fName.c_str(), image.GetError().c_str());
+	};
+
+	/*	Header structure	*/
+	if( nlhs>1 ) {
+		plhs[1] = mxCreateStructMatrix(1, 1, 0, 0);
+		for(size_t idx=0; idx<header.fields.size(); idx++) {
+			const std::string &key = header.fields[idx].first;
+			if( !IsValidFieldName(key) ) {
+				continue;
+			};
+			if( mxGetFieldNumber(plhs[1], key.c_str())<0 ) {
+				mxAddField(plhs[1], key.c_str());
+			}
+			else {
+				mxDestroyArray( mxGetField(plhs[1], 0, key.c_str()) );
+			};
+			mxSetField(plhs[1], 0, key.c_str(), mxCreateString( header.fields[idx].second.c_str() ));
+		};
+	};
+};
@@ -0,0 +1,244 @@
+/*
+ *	mha_write.cxx
+ *
+ *	MEX front end of the MetaImage writer (see MetaImage.h)
+ *
+ *	mha_write(I,FILENAME) writes the numeric array I to the MetaImage file
+ *	FILENAME using the class of I as the element type (e.g., int16 images
+ *	are stored as MET_SHORT).
+ *
+ *	mha_write(I,FILENAME,HDR) uses the MetaImage fields stored in the
+ *	structure HDR (see mhawrite). Values are strings, logicals or numeric
+ *	arrays. The following fields are interpreted:
+ *
+ *		Field				Description
+ *		-------------------------------
+ *
+ *		CompressedData		Deflates the data in parallel chunks (single
+ *							zlib stream readable by any MetaImage reader)
+ *
+ *		ElementType			Element type of the file. I is converted if
+ *							the type differs from the class of I
+ *
+ *		NDims/DimSize		Trailing singleton dimensions of I beyond
+ *							NDims are dropped
+ *
+ *		ElementSpacing, Offset and TransformMatrix define the geometry. All
+ *		other fields (except the data format fields, which are generated)
+ *		are written verbatim. The data are always stored in the file
+ *		(ElementDataFile = LOCAL).
+ */
+
+
+/*	C++ headers	*/
+#include <cstdio>
+#include <string>
+#include <vector>
+
+/*	MATLAB headers	*/
+#include "mex.h"
+
+/*	QUATTRO headers	*/
+#include "MetaImage.h"
+
+
+/*
+ *	GetElementType()
+ *
+ *	Returns the MetaImage element type corresponding to a MATLAB class
+ */
+static metaElementType GetElementType(mxClassID classId)
+{
+	switch( classId ) {
+		case mxINT8_CLASS:		return MetChar;
+		case mxUINT8_CLASS:		return MetUChar;
+		case mxLOGICAL_CLASS:	return MetUChar;
+		case mxINT16_CLASS:		return MetShort;
+		case mxUINT16_CLASS:	return MetUShort;
+		case mxINT32_CLASS:		return MetInt;
+		case mxUINT32_CLASS:	return MetUInt;
+		case mxINT64_CLASS:		return MetLongLong;
+		case mxUINT64_CLASS:	return MetULongLong;
+		case mxSINGLE_CLASS:	return MetFloat;
+		case mxDOUBLE_CLASS:	return MetDouble;
+		default:				return MetUnknown;
+	};
+};
+
+
+/*
+ *	ValueToString()
+ *
+ *	Converts a header value to the MetaImage string representation
+ */
+static std::string ValueToString(const mxArray* value)
+{
+	if( mxIsChar(value) ) {
+		char* str = mxArrayToString(value);
+		std::string result(str ? str : "");
+		mxFree(str);
+		return result;
+	}
+	else if( mxIsLogical(value) ) {
+		return ( mxGetNumberOfElements(value) && mxGetLogicals(value)[0] ) ? "True" : "False";
+	}
+	else if( !mxIsNumeric(value) ) {
+		mexErrMsgIdAndTxt("QUATTRO:mha_write:invalidHeader",
+						  "Header values must be strings, logicals or numeric arrays");
+	};
+
+	/*	Numeric values are converted to double	*/
+	mxArray* input	= const_cast<mxArray*>(value);
+	mxArray* output = 0;
+	mexCallMATLAB(1, &output, 1, &input, "double");
+	const double* data = mxGetPr(output);
+	std::string	  result;
+	char		  str[32];
+	for(size_t idx=0; idx<mxGetNumberOfElements(output); idx++) {
+		std::snprintf(str, sizeof(str), (idx ? " %.17g" : "%.17g"), data[idx]);
+		result += str;
+	};
+	mxDestroyArray(output);
+	return result;
+};
+
+
+/*
+ *	ConvertElements()
+ *
+ *	Converts the elements of I to the element type of the file
+ */
+template <class TIn, class TOut>
+void ConvertElements(const TIn* src, size_t n, TOut* dst)
+{
+	ParallelFor(n, 1<<18, [&](size_t begin, size_t end, unsigned int) {
+		for(size_t idx=begin; idx<end; idx++) {
+			dst[idx] = static_cast<TOut>(src[idx]);
+		};
+	});
+};
+
+template <class TIn>
+void ConvertElements(const TIn* src, size_t n, metaElementType type, void* dst)
+{
+	switch( type ) {
+		case MetChar:		ConvertElements(src, n, static_cast<signed char*>(dst));			break;
+		case MetUChar:		ConvertElements(src, n, static_cast<unsigned char*>(dst));			break;
+		case MetShort:		ConvertElements(src, n, static_cast<short*>(dst));					break;
+		case MetUShort:		ConvertElements(src, n, static_cast<unsigned short*>(dst));			break;
+		case MetInt:		ConvertElements(src, n, static_cast<int*>(dst));					break;
+		case MetUInt:		ConvertElements(src, n, static_cast<unsigned int*>(dst));			break;
+		case MetLongLong:	ConvertElements(src, n, static_cast<long long*>(dst));				break;
+		case MetULongLong:	ConvertElements(src, n, static_cast<unsigned long long*>(dst));		break;
+		case MetFloat:		ConvertElements(src, n, static_cast<float*>(dst));					break;
+		case MetDouble:		ConvertElements(src, n, static_cast<double*>(dst));					break;
+		default:			break;
+	};
+};
+
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+
+	/*	Validate the inputs	*/
+	if( (nrhs<2) || (nrhs>3) ) {
+		mexErrMsgIdAndTxt("QUATTRO:mha_write:invalidInput",
+						  "An image and a file name must be specified");
+	};
+	const mxArray* I = prhs[0];
+	if( (!mxIsNumeric(I) && !mxIsLogical(I)) || mxIsComplex(I) || mxIsEmpty(I) ) {
+		mexErrMsgIdAndTxt("QUATTRO:mha_write:invalidImage",
+						  "I must be a real, non-empty numeric or logical array");
+	};
+	if( !mxIsChar(prhs[1]) ) {
+		mexErrMsgIdAndTxt("QUATTRO:mha_write:invalidInput",
+						  "FILENAME must be a string");
+	};
+	if( (nrhs>2) && !mxIsStruct(prhs[2]) ) {
+		mexErrMsgIdAndTxt("QUATTRO:mha_write:invalidHeader",
+						  "HDR must be a structure");
+	};
+	char* str = mxArrayToString(prhs[1]);
+	std::string fName(str);
+	mxFree(str);
+
+	/*	Header	*/
+	MetaImageHeader header;
+	header.elementType = GetElementType( mxGetClassID(I) );
+	const mwSize* dims = mxGetDimensions(I);
+	header.dimSize.assign(dims, dims+mxGetNumberOfDimensions(I));
+	size_t nDims = header.dimSize.size();
+	if( nrhs>2 ) {
+		const mxArray* hdr = prhs[2];
+		for(int fIdx=0; fIdx<mxGetNumberOfFields(hdr); fIdx++) {
+			const mxArray* value = mxGetFieldByNumber(hdr, 0, fIdx);
+			const std::string key(mxGetFieldNameByNumber(hdr, fIdx));
+			if( !value || mxIsEmpty(value) ) {
+				continue;
+			};
+			const std::string strValue = ValueToString(value);
+			if( key=="CompressedData" ) {
+				header.isCompressed = ParseMetaBool(strValue);
+			}
+			else if( key=="ElementType" ) {
+				header.elementType = ParseMetaElementType(strValue);
+				if( header.elementType==MetUnknown ) {
+					mexErrMsgIdAndTxt("QUATTRO:mha_write:invalidHeader",
+									  "Unsupported ElementType: %s", strValue.c_str());
+				};
+			}
+			else if( key=="NDims" ) {
+				nDims = static_cast<size_t>( std::atoi(strValue.c_str()) );
+			}
+			else if( key=="ElementSpacing" ) {
+				header.spacing = ParseMetaValues<double>(strValue);
+			}
+			else if( key=="Offset" ) {
+				header.offset = ParseMetaValues<double>(strValue);
+			}
+			else if( key=="TransformMatrix" ) {
+				header.transformMatrix = ParseMetaValues<double>(strValue);
+			}
+			else {
+				header.fields.push_back( std::make_pair(key,strValue) );
+			};
+		};
+	};
+	while( (header.dimSize.size()>std::max<size_t>(nDims,1)) && (header.dimSize.back()==1) ) {
+		header.dimSize.pop_back();
+	};
+	if( header.spacing.size()>header.dimSize.size() ) {
+		header.spacing.resize( header.dimSize.size() );
+	};
+
+	/*	Convert the data if the element type differs from the class of I	*/
+	const void*		  data = mxGetData(I);
+	std::vector<char> buffer;
+	const size_t	  n	   = mxGetNumberOfElements(I);
+	if( header.elementType!=GetElementType( mxGetClassID(I) ) ) {
+		buffer.resize( n*header.GetElementSize() );
+		switch( mxGetClassID(I) ) {
+			case mxINT8_CLASS:		ConvertElements(static_cast<const signed char*>(data), n, header.elementType, &buffer[0]);		  break;
+			case mxLOGICAL_CLASS:
+			case mxUINT8_CLASS:		ConvertElements(static_cast<const unsigned char*>(data), n, header.elementType, &buffer[0]);	  break;
+			case mxINT16_CLASS:		ConvertElements(static_cast<const short*>(data), n, header.elementType, &buffer[0]);			  break;
+			case mxUINT16_CLASS:	ConvertElements(static_cast<const unsigned short*>(data), n, header.elementType, &buffer[0]);	  break;
+			case mxINT32_CLASS:		ConvertElements(static_cast<const int*>(data), n, header.elementType, &buffer[0]);				  break;
+			case mxUINT32_CLASS:	ConvertElements(static_cast<const unsigned int*>(data), n, header.elementType, &buffer[0]);	  break;
+			case mxINT64_CLASS:		ConvertElements(static_cast<const long long*>(data), n, header.elementType, &buffer[0]);		  break;
+			case mxUINT64_CLASS:	ConvertElements(static_cast<const unsigned long long*>(data), n, header.elementType, &buffer[0]); break;
+			case mxSINGLE_CLASS:	ConvertElements(static_cast<const float*>(data), n, header.elementType, &buffer[0]);			  break;
+			case mxDOUBLE_CLASS:	ConvertElements(static_cast<const double*>(data), n, header.elementType, &buffer[0]);			  break;
+			default:
+				mexErrMsgIdAndTxt("QUATTRO:mha_write:invalidImage",
+								  "Unsupported image class");
+		};
+		data = &buffer[0];
+	};
+
+	/*	Write the file	*/
+	std::string error;
+	if( !MetaImage::Write(fName, header, data, Z_DEFAULT_COMPRESSION, 0, &error) ) {
+		mexErrMsgIdAndTxt("QUATTRO:mha_write:writeFailure", "%s", error.c_str());
+	};
+};
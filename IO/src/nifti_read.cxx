@@ -0,0 +1,392 @@
+/*
+ *	nifti_read.cxx
+ *
+ *	MEX front end of the Analyze 7.5/NIfTI-1 reader (see NiftiImage.h)
+ *
+ *	I = nifti_read(FILENAME) reads the image stored in FILENAME (*.nii,
+ *	*.nii.gz, *.hdr, *.img or the file name without extension). The class
+ *	of I is the datatype of the file (e.g., DT_FLOAT32 images are returned
+ *	as single), complex data are returned as complex arrays and RGB(A)
+ *	images as uint8 arrays with an additional leading dimension indexing
+ *	the channels. The size of I is given by the dim field and the voxels
+ *	are in file order (i.e., I(x,y,z,t)).
+ *
+ *	[I,HDR] = nifti_read(FILENAME) also returns the header as a structure
+ *	with the nifti1.h field names (e.g., dim, pixdim, scl_slope) and the
+ *	additional fields Filename and Format ('NIfTI-1' or 'Analyze').
+ *
+ *	FILENAME can also be a cell array of file names, in which case I is a
+ *	cell array of images and HDR a structure array. The files are read
+ *	concurrently.
+ *
+ *	I = nifti_read(...,'PropertyName1',PropertyValue1,...) uses the options
+ *	specified by the property/value pairs:
+ *
+ *		Option String		Description
+ *		-------------------------------
+ *
+ *		Scale				Logical flag. When true, the scaling (scl_slope
+ *							and scl_inter) is applied and I is of class
+ *							double (single for single images). Default:
+ *							false
+ *
+ *		NumberOfThreads		Number of worker threads (default: all cores)
+ */
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*	MATLAB headers	*/
+#include "mex.h"
+
+/*	QUATTRO headers	*/
+#include "NiftiImage.h"
+
+
+/*
+ *	GetClassID()
+ *
+ *	Returns the MATLAB class corresponding to a NIfTI-1 datatype
+ */
+static mxClassID GetClassID(short datatype)
+{
+	switch( datatype ) {
+		case NiftiUInt8:		return mxUINT8_CLASS;
+		case NiftiInt8:			return mxINT8_CLASS;
+		case NiftiInt16:		return mxINT16_CLASS;
+		case NiftiUInt16:		return mxUINT16_CLASS;
+		case NiftiInt32:		return mxINT32_CLASS;
+		case NiftiUInt32:		return mxUINT32_CLASS;
+		case NiftiInt64:		return mxINT64_CLASS;
+		case NiftiUInt64:		return mxUINT64_CLASS;
+		case NiftiFloat32:		return mxSINGLE_CLASS;
+		case NiftiComplex64:	return mxSINGLE_CLASS;
+		case NiftiFloat64:		return mxDOUBLE_CLASS;
+		case NiftiComplex128:	return mxDOUBLE_CLASS;
+		case NiftiRGB24:		return mxUINT8_CLASS;
+		case NiftiRGBA32:		return mxUINT8_CLASS;
+		default:				return mxUNKNOWN_CLASS;
+	};
+};
+
+
+/*
+ *	Convert()
+ *
+ *	Splits the interleaved components (one for real data, two for complex
+ *	data) and applies the scaling Y = SLOPE*X+INTER
+ */
+template <class TIn, class TOut>
+static void Convert(const void* src, TOut* re, TOut* im, size_t nVoxels, unsigned int nComponents,
+					double slope, double inter, unsigned int nThreads)
+{
+	const TIn* in = static_cast<const TIn*>(src);
+	ParallelFor(nVoxels, 1<<16, [&](size_t begin, size_t end, unsigned int) {
+		for(size_t idx=begin; idx<end; idx++) {
+			re[idx] = static_cast<TOut>( slope*in[nComponents*idx]+inter );
+			if( im ) {
+				im[idx] = static_cast<TOut>( slope*in[nComponents*idx+1]+inter );
+			};
+		};
+	}, nThreads);
+};
+
+
+/*
+ *	ConvertData()
+ *
+ *	Copies the raw data of an image to the array IMAGE (of class double or
+ *	single, or the class of the datatype for unscaled complex data)
+ */
+template <class TOut>
+static void ConvertData(const NiftiHeader &header, const void* raw, mxArray* image,
+						double slope, double inter, unsigned int nThreads)
+{
+	TOut* re = static_cast<TOut*>( mxGetData(image) );
+	TOut* im = static_cast<TOut*>( mxGetImagData(image) );
+	const size_t		n  = header.GetNumberOfVoxels();
+	const unsigned int	nC = header.GetNumberOfComponents();
+	switch( header.datatype ) {
+		case NiftiUInt8:		Convert<unsigned char>(raw, re, im, n, nC, slope, inter, nThreads);		 break;
+		case NiftiInt8:			Convert<signed char>(raw, re, im, n, nC, slope, inter, nThreads);		 break;
+		case NiftiInt16:		Convert<short>(raw, re, im, n, nC, slope, inter, nThreads);				 break;
+		case NiftiUInt16:		Convert<unsigned short>(raw, re, im, n, nC, slope, inter, nThreads);	 break;
+		case NiftiInt32:		Convert<int>(raw, re, im, n, nC, slope, inter, nThreads);				 break;
+		case NiftiUInt32:		Convert<unsigned int>(raw, re, im, n, nC, slope, inter, nThreads);		 break;
+		case NiftiInt64:		Convert<long long>(raw, re, im, n, nC, slope, inter, nThreads);			 break;
+		case NiftiUInt64:		Convert<unsigned long long>(raw, re, im, n, nC, slope, inter, nThreads); break;
+		case NiftiFloat32:
+		case NiftiComplex64:	Convert<float>(raw, re, im, n, nC, slope, inter, nThreads);				 break;
+		case NiftiFloat64:
+		case NiftiComplex128:	Convert<double>(raw, re, im, n, nC, slope, inter, nThreads);			 break;
+	};
+};
+
+
+/*
+ *	CreateImage()
+ *
+ *	Allocates the output array of an image
+ */
+static mxArray* CreateImage(const NiftiHeader &header, bool isScaled)
+{
+	std::vector<mwSize> dims;
+	const unsigned int nComponents = header.GetNumberOfComponents();
+	const bool		   isRGB	   = (header.datatype==NiftiRGB24) || (header.datatype==NiftiRGBA32);
+	if( isRGB ) {
+		dims.push_back(nComponents);
+	};
+	for(int idx=1; idx<=header.GetNumberOfDimensions(); idx++) {
+		dims.push_back(header.dim[idx]);
+	};
+	if( dims.size()<2 ) {
+		dims.push_back(1);
+	};
+
+	mxClassID classID = GetClassID(header.datatype);
+	if( isScaled && (classID!=mxSINGLE_CLASS) ) {
+		classID = mxDOUBLE_CLASS;
+	};
+	const mxComplexity complexity = (!isRGB && (nComponents==2)) ? mxCOMPLEX : mxREAL;
+	return mxCreateUninitNumericArray(dims.size(), &dims[0], classID, complexity);
+};
+
+
+/*
+ *	ReadImage()
+ *
+ *	Reads the data of an image to the array created by CreateImage().
+ *	Real data are copied directly to the array unless they are scaled
+ *	(ISSCALED is set and the image has a non-identity scaling)
+ */
+static bool ReadImage(NiftiImage &reader, mxArray* image, bool isScaled, unsigned int nThreads)
+{
+	const NiftiHeader &header = reader.GetHeader();
+	if( (!isScaled || !header.IsScaled()) && !mxIsComplex(image) && (mxGetClassID(image)==GetClassID(header.datatype)) ) {
+		return reader.CopyTo(mxGetData(image), nThreads);
+	};
+	std::vector<unsigned char> raw(header.GetDataSize());
+	if( !reader.CopyTo(raw.data(), nThreads) ) {
+		return false;
+	};
+	const double slope = header.IsScaled() ? header.sclSlope : 1;
+	const double inter = header.IsScaled() ? header.sclInter : 0;
+	if( mxIsDouble(image) ) {
+		ConvertData<double>(header, raw.data(), image, slope, inter, nThreads);
+	}
+	else {
+		ConvertData<float>(header, raw.data(), image, slope, inter, nThreads);
+	};
+	return true;
+};
+
+
+/*	Header structure fields in the order set by CreateHeader()	*/
+static const char* headerFields[] = {
+	"Filename", "Format", "dim", "pixdim", "datatype", "bitpix", "vox_offset", "scl_slope", "scl_inter",
+	"dim_info", "intent_code", "intent_p1", "intent_p2", "intent_p3", "intent_name", "slice_start",
+	"slice_end", "slice_code", "slice_duration", "xyzt_units", "cal_max", "cal_min", "toffset", "glmax",
+	"glmin", "descrip", "aux_file", "qform_code", "sform_code", "quatern_b", "quatern_c", "quatern_d",
+	"qoffset_x", "qoffset_y", "qoffset_z", "srow_x", "srow_y", "srow_z", "magic"
+};
+
+/*
+ *	CreateVector()
+ *
+ *	Converts N header values to a row vector
+ */
+static mxArray* CreateVector(const float* values, size_t n)
+{
+	mxArray* array = mxCreateDoubleMatrix(1, n, mxREAL);
+	std::copy(values, values+n, mxGetPr(array));
+	return array;
+};
+
+/*
+ *	CreateHeader()
+ *
+ *	Sets the header fields of element IDX of the structure array HDR
+ */
+static void CreateHeader(const NiftiImage &reader, mxArray* hdr, size_t idx)
+{
+	const NiftiHeader &header = reader.GetHeader();
+	const double dim[8] = {	static_cast<double>(header.dim[0]), static_cast<double>(header.dim[1]),
+							static_cast<double>(header.dim[2]), static_cast<double>(header.dim[3]),
+							static_cast<double>(header.dim[4]), static_cast<double>(header.dim[5]),
+							static_cast<double>(header.dim[6]), static_cast<double>(header.dim[7]) };
+	mxArray* dimArray = mxCreateDoubleMatrix(1, 8, mxREAL);
+	std::copy(dim, dim+8, mxGetPr(dimArray));
+
+	int field = 0;
+	mxSetFieldByNumber(hdr, idx, field++, mxCreateString( reader.GetHeaderFileName().c_str() ));
+	mxSetFieldByNumber(hdr, idx, field++, mxCreateString( header.isNifti ? "NIfTI-1" : "Analyze" ));
+	mxSetFieldByNumber(hdr, idx, field++, dimArray);
+	mxSetFieldByNumber(hdr, idx, field++, CreateVector(header.pixdim, 8));
+	mxSetFieldByNumber(hdr, idx, field++, mxCreateDoubleScalar(header.datatype));
+	mxSetFieldByNumber(hdr, idx, field++, mxCreateDoubleScalar(header.bitpix));
+	mxSetFieldByNumber(hdr, idx, field++, mxCreateDoubleScalar(header.voxOffset));
+	mxSetFieldByNumber(hdr, idx, field++, mxCreateDoubleScalar(header.sclSlope));
+	mxSetFieldByNumber(hdr, idx, field++, mxCreateDoubleScalar(header.sclInter));
+	mxSetFieldByNumber(hdr, idx, field++, mxCreateDoubleScalar(static_cast<unsigned char>(header.dimInfo)));
+	mxSetFieldByNumber(hdr, idx, field++, mxCreateDoubleScalar(header.intentCode));
+	for(size_t pIdx=0; pIdx<3; pIdx++) {
+		mxSetFieldByNumber(hdr, idx, field++, mxCreateDoubleScalar(header.intentP[pIdx]));
+	};
+	mxSetFieldByNumber(hdr, idx, field++, mxCreateString( header.intentName.c_str() ));
+	mxSetFieldByNumber(hdr, idx, field++, mxCreateDoubleScalar(header.sliceStart));
+	mxSetFieldByNumber(hdr, idx, field++, mxCreateDoubleScalar(header.sliceEnd));
+	mxSetFieldByNumber(hdr, idx, field++, mxCreateDoubleScalar(static_cast<unsigned char>(header.sliceCode)));
+	mxSetFieldByNumber(hdr, idx, field++, mxCreateDoubleScalar(header.sliceDuration));
+	mxSetFieldByNumber(hdr, idx, field++, mxCreateDoubleScalar(static_cast<unsigned char>(header.xyztUnits)));
+	mxSetFieldByNumber(hdr, idx, field++, mxCreateDoubleScalar(header.calMax));
+	mxSetFieldByNumber(hdr, idx, field++, mxCreateDoubleScalar(header.calMin));
+	mxSetFieldByNumber(hdr, idx, field++, mxCreateDoubleScalar(header.tOffset));
+	mxSetFieldByNumber(hdr, idx, field++, mxCreateDoubleScalar(header.glMax));
+	mxSetFieldByNumber(hdr, idx, field++, mxCreateDoubleScalar(header.glMin));
+	mxSetFieldByNumber(hdr, idx, field++, mxCreateString( header.descrip.c_str() ));
+	mxSetFieldByNumber(hdr, idx, field++, mxCreateString( header.auxFile.c_str() ));
+	mxSetFieldByNumber(hdr, idx, field++, mxCreateDoubleScalar(header.qformCode));
+	mxSetFieldByNumber(hdr, idx, field++, mxCreateDoubleScalar(header.sformCode));
+	for(size_t qIdx=0; qIdx<3; qIdx++) {
+		mxSetFieldByNumber(hdr, idx, field++, mxCreateDoubleScalar(header.quatern[qIdx]));
+	};
+	for(size_t qIdx=0; qIdx<3; qIdx++) {
+		mxSetFieldByNumber(hdr, idx, field++, mxCreateDoubleScalar(header.qOffset[qIdx]));
+	};
+	for(size_t row=0; row<3; row++) {
+		mxSetFieldByNumber(hdr, idx, field++, CreateVector(header.srow+4*row, 4));
+	};
+	mxSetFieldByNumber(hdr, idx, field++, mxCreateString( header.magic.c_str() ));
+};
+
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+
+	/*	Validate the inputs	*/
+	if( (nrhs<1) || !(nrhs%2) ) {
+		mexErrMsgIdAndTxt("QUATTRO:nifti_read:invalidInput",
+						  "A file name (or cell array of names) and property/value pairs must be specified");
+	};
+	std::vector<std::string> fNames;
+	const bool isCell = mxIsCell(prhs[0]);
+	if( mxIsChar(prhs[0]) ) {
+		char* str = mxArrayToString(prhs[0]);
+		fNames.push_back(str);
+		mxFree(str);
+	}
+	else if( isCell ) {
+		for(size_t idx=0; idx<mxGetNumberOfElements(prhs[0]); idx++) {
+			const mxArray* cell = mxGetCell(prhs[0], idx);
+			if( !cell || !mxIsChar(cell) ) {
+				mexErrMsgIdAndTxt("QUATTRO:nifti_read:invalidInput",
+								  "FILENAME must be a string or a cell array of strings");
+			};
+			char* str = mxArrayToString(cell);
+			fNames.push_back(str);
+			mxFree(str);
+		};
+	}
+	else {
+		mexErrMsgIdAndTxt("QUATTRO:nifti_read:invalidInput",
+						  "FILENAME must be a string or a cell array of strings");
+	};
+
+	/*	Parse the options	*/
+	bool		 isScaled = false;
+	unsigned int nThreads = 0;
+	for(int idx=1; idx<nrhs; idx+=2) {
+		char* prop = mxArrayToString(prhs[idx]);
+		if( !prop ) {
+			mexErrMsgIdAndTxt("QUATTRO:nifti_read:invalidOptions",
+							  "Property names must be strings");
+		};
+		std::string name(prop);
+		mxFree(prop);
+		if( name=="Scale" ) {
+			isScaled = (mxGetScalar(prhs[idx+1])!=0);
+		}
+		else if( name=="NumberOfThreads" ) {
+			nThreads = static_cast<unsigned int>( mxGetScalar(prhs[idx+1]) );
+		}
+		else {
+			mexErrMsgIdAndTxt("QUATTRO:nifti_read:invalidOptions",
+							  "Unknown property: %s", name.c_str());
+		};
+	};
+
+	/*	Read the headers and allocate the images (the MATLAB API must only
+	 *	be called from this thread). RGB(A) data are never scaled	*/
+	const size_t nFiles = fNames.size();
+	std::vector< std::unique_ptr<NiftiImage> > readers(nFiles);
+	std::vector<mxArray*> images(nFiles, static_cast<mxArray*>(0));
+	std::vector<bool>	  scaled(nFiles, false);
+	for(size_t idx=0; idx<nFiles; idx++) {
+		readers[idx].reset(new NiftiImage);
+		if( !readers[idx]->Read(fNames[idx]) ) {
+			for(size_t dIdx=0; dIdx<idx; dIdx++) {
+				mxDestroyArray(images[dIdx]);
+			};
+			mexErrMsgIdAndTxt("QUATTRO:nifti_read:readFailure", "%s", readers[idx]->GetError().c_str());
+		};
+		const NiftiHeader &header = readers[idx]->GetHeader();
+		scaled[idx] = isScaled && (header.datatype!=NiftiRGB24) && (header.datatype!=NiftiRGBA32);
+		images[idx] = CreateImage(header, scaled[idx]);
+		if( !images[idx] ) {
+			for(size_t dIdx=0; dIdx<idx; dIdx++) {
+				mxDestroyArray(images[dIdx]);
+			};
+			mexErrMsgIdAndTxt("QUATTRO:nifti_read:outOfMemory",
+							  "Unable to allocate the image of %s", fNames[idx].c_str());
+		};
+	};
+
+	/*	Read the data. Several files are read concurrently, each by a
+	 *	single thread	*/
+	std::vector<bool> isRead(nFiles, false);
+	if( nFiles==1 ) {
+		isRead[0] = ReadImage(*readers[0], images[0], scaled[0], nThreads);
+	}
+	else {
+		std::vector<char> status(nFiles, 0);
+		ParallelFor(nFiles, 1, [&](size_t begin, size_t end, unsigned int) {
+			for(size_t idx=begin; idx<end; idx++) {
+				status[idx] = ReadImage(*readers[idx], images[idx], scaled[idx], 1);
+			};
+		}, nThreads);
+		for(size_t idx=0; idx<nFiles; idx++) {
+			isRead[idx] = (status[idx]!=0);
+		};
+	};
+	for(size_t idx=0; idx<nFiles; idx++) {
+		if( !isRead[idx] ) {
+			for(size_t dIdx=0; dIdx<nFiles; dIdx++) {
+				mxDestroyArray(images[dIdx]);
+			};
+			mexErrMsgIdAndTxt("QUATTRO:nifti_read:readFailure", "%s", readers[idx]->GetError().c_str());
+		};
+	};
+
+	/*	Outputs	*/
+	if( isCell ) {
+		plhs[0] = mxCreateCellMatrix(mxGetM(prhs[0]), mxGetN(prhs[0]));
+		for(size_t idx=0; idx<nFiles; idx++) {
+			mxSetCell(plhs[0], idx, images[idx]);
+		};
+	}
+	else {
+		plhs[0] = images[0];
+	};
+	if( nlhs>1 ) {
+		const int nFields = sizeof(headerFields)/sizeof(headerFields[0]);
+		plhs[1] = isCell ? mxCreateStructMatrix(mxGetM(prhs[0]), mxGetN(prhs[0]), nFields, headerFields)
+						 : mxCreateStructMatrix(1, 1, nFields, headerFields);
+		for(size_t idx=0; idx<nFiles; idx++) {
+			CreateHeader(*readers[idx], plhs[1], idx);
+		};
+	};
+};
@@ -0,0 +1,173 @@
+/*
+ *	qtx_read.cxx
+ *
+ *	MEX front end of the exam container reader (see ExamContainer.h)
+ *
+ *	INFO = qtx_read(FILENAME) returns the datasets of the QUATTRO exam
+ *	container FILENAME (*.qtx) as a structure array with the fields Name,
+ *	Class and Size.
+ *
+ *	A = qtx_read(FILENAME,NAME) reads the dataset NAME.
+ *
+ *	A = qtx_read(FILENAME,NAME,SLICES,FRAMES) reads only the planes of the
+ *	given slices (third dimension) and frames (fourth dimension; further
+ *	dimensions are treated as additional frames). A is of size M-by-N-by-
+ *	numel(SLICES)-by-numel(FRAMES). Only the tiles of these planes are
+ *	decompressed, so the images being viewed or modeled can be fetched
+ *	without loading the remainder of the exam. An empty SLICES or FRAMES
+ *	selects all slices or frames, respectively.
+ */
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/*	MATLAB headers	*/
+#include "mex.h"
+
+/*	QUATTRO headers	*/
+#include "ExamContainer.h"
+
+
+/*
+ *	GetClassID()
+ *
+ *	Returns the MATLAB class corresponding to a container data type
+ */
+static mxClassID GetClassID(examDataType type)
+{
+	switch( type ) {
+		case ExamLogical:	return mxLOGICAL_CLASS;
+		case ExamInt8:		return mxINT8_CLASS;
+		case ExamUInt8:		return mxUINT8_CLASS;
+		case ExamInt16:		return mxINT16_CLASS;
+		case ExamUInt16:	return mxUINT16_CLASS;
+		case ExamInt32:		return mxINT32_CLASS;
+		case ExamUInt32:	return mxUINT32_CLASS;
+		case ExamInt64:		return mxINT64_CLASS;
+		case ExamUInt64:	return mxUINT64_CLASS;
+		case ExamSingle:	return mxSINGLE_CLASS;
+		case ExamDouble:	return mxDOUBLE_CLASS;
+		case ExamChar:		return mxCHAR_CLASS;
+		default:			return mxUNKNOWN_CLASS;
+	};
+};
+
+
+/*	MATLAB class names in the order of examDataType	*/
+static const char* const classNames[] = {
+	"", "logical", "int8", "uint8", "int16", "uint16", "int32", "uint32", "int64", "uint64",
+	"single", "double", "char"
+};
+
+
+/*
+ *	GetIndices()
+ *
+ *	Converts a vector of one-based indices to zero-based indices, checking
+ *	them against N. An empty vector selects all indices
+ */
+static std::vector<size_t> GetIndices(const mxArray* array, size_t n, const char* name)
+{
+	std::vector<size_t> indices;
+	if( mxIsEmpty(array) ) {
+		for(size_t idx=0; idx<n; idx++) {
+			indices.push_back(idx);
+		};
+		return indices;
+	}
+	else if( !mxIsDouble(array) ) {
+		mexErrMsgIdAndTxt("QUATTRO:qtx_read:invalidInput",
+						  "%s must be a vector of (double) indices", name);
+	};
+	const double* values = mxGetPr(array);
+	for(size_t idx=0; idx<mxGetNumberOfElements(array); idx++) {
+		if( (values[idx]<1) || (values[idx]>n) || (values[idx]!=static_cast<double>(static_cast<size_t>(values[idx]))) ) {
+			mexErrMsgIdAndTxt("QUATTRO:qtx_read:invalidIndex",
+							  "%s must be integers between 1 and %u", name, static_cast<unsigned int>(n));
+		};
+		indices.push_back(static_cast<size_t>(values[idx])-1);
+	};
+	return indices;
+};
+
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+
+	/*	Validate the inputs	*/
+	if( (nrhs<1) || (nrhs==3) || (nrhs>4) || !mxIsChar(prhs[0]) || ((nrhs>1) && !mxIsChar(prhs[1])) ) {
+		mexErrMsgIdAndTxt("QUATTRO:qtx_read:invalidInput",
+						  "A file name and, optionally, a dataset name, slices and frames must be specified");
+	};
+	char* str = mxArrayToString(prhs[0]);
+	const std::string fName(str);
+	mxFree(str);
+
+	ExamContainer container;
+	if( !container.Open(fName) ) {
+		mexErrMsgIdAndTxt("QUATTRO:qtx_read:readFailure", "%s", container.GetError().c_str());
+	};
+	const std::vector<ExamDataset> &datasets = container.GetDatasets();
+
+	/*	Dataset information	*/
+	if( nrhs==1 ) {
+		const char* fieldNames[] = {"Name", "Class", "Size"};
+		plhs[0] = mxCreateStructMatrix(datasets.size(), 1, 3, fieldNames);
+		for(size_t idx=0; idx<datasets.size(); idx++) {
+			mxArray* size = mxCreateDoubleMatrix(1, datasets[idx].dims.size(), mxREAL);
+			std::copy(datasets[idx].dims.begin(), datasets[idx].dims.end(), mxGetPr(size));
+			mxSetFieldByNumber(plhs[0], idx, 0, mxCreateString( datasets[idx].name.c_str() ));
+			mxSetFieldByNumber(plhs[0], idx, 1, mxCreateString( classNames[datasets[idx].type] ));
+			mxSetFieldByNumber(plhs[0], idx, 2, size);
+		};
+		return;
+	};
+
+	str = mxArrayToString(prhs[1]);
+	const std::string name(str);
+	mxFree(str);
+	const long dsIdx = container.FindDataset(name);
+	if( dsIdx<0 ) {
+		mexErrMsgIdAndTxt("QUATTRO:qtx_read:missingDataset",
+						  "%s does not contain the dataset %s", fName.c_str(), name.c_str());
+	};
+	const ExamDataset &dataset = datasets[dsIdx];
+
+	/*	Determine the tiles to read	*/
+	std::vector<size_t> tiles;
+	std::vector<mwSize> dims(dataset.dims.begin(), dataset.dims.end());
+	if( nrhs==2 ) {
+		for(size_t idx=0; idx<dataset.tiles.size(); idx++) {
+			tiles.push_back(idx);
+		};
+	}
+	else {
+		dims.resize(4, 1);
+		const size_t nSlices = (dataset.dims.size()>2) ? dataset.dims[2] : 1;
+		const size_t nFrames = nSlices ? dataset.GetNumberOfTiles()/nSlices : 0;
+		const std::vector<size_t> slices = GetIndices(prhs[2], nSlices, "SLICES");
+		const std::vector<size_t> frames = GetIndices(prhs[3], nFrames, "FRAMES");
+		for(size_t fIdx=0; fIdx<frames.size(); fIdx++) {
+			for(size_t sIdx=0; sIdx<slices.size(); sIdx++) {
+				tiles.push_back(slices[sIdx]+frames[fIdx]*nSlices);
+			};
+		};
+		dims[2] = slices.size();
+		dims[3] = frames.size();
+	};
+
+	mxArray* array = (dataset.type==ExamChar) ? mxCreateCharArray(dims.size(), &dims[0])
+											  : mxCreateUninitNumericArray(dims.size(), &dims[0], GetClassID(dataset.type), mxREAL);
+	if( !array ) {
+		mexErrMsgIdAndTxt("QUATTRO:qtx_read:outOfMemory",
+						  "Unable to allocate the dataset %s", name.c_str());
+	};
+	if( !container.ReadTiles(static_cast<size_t>(dsIdx), tiles, mxGetData(array)) ) {
+		mxDestroyArray(array);
+		mexErrMsgIdAndTxt("QUATTRO:qtx_read:readFailure", "%s", container.GetError().c_str());
+	};
+	plhs[0] = array;
+};
@@ -0,0 +1,116 @@
+/*
+ *	qtx_write.cxx
+ *
+ *	MEX front end of the exam container writer (see ExamContainer.h)
+ *
+ *	qtx_write(FILENAME,NAME,VALUE) writes the array VALUE to the dataset
+ *	NAME of the QUATTRO exam container FILENAME (*.qtx), replacing any
+ *	existing dataset with that name. The file is created if it does not
+ *	exist. VALUE is a real numeric, logical or char array; every 2D plane
+ *	of VALUE (e.g., every slice and time point of an image series) is
+ *	stored as an independently compressed tile. An empty double array ([])
+ *	removes the dataset.
+ *
+ *	qtx_write(FILENAME,NAME1,VALUE1,NAME2,VALUE2,...) writes several
+ *	datasets in a single save.
+ *
+ *	Planes that are identical to the stored planes are not written again,
+ *	so saving an exam in which only some maps or ROIs changed appends only
+ *	the changed tiles (and the new index) to the file.
+ *
+ *	[NWRITTEN,NREUSED] = qtx_write(...) also returns the number of tiles
+ *	written and the number of unchanged tiles.
+ */
+
+
+/*	C++ headers	*/
+#include <string>
+#include <vector>
+
+/*	MATLAB headers	*/
+#include "mex.h"
+
+/*	QUATTRO headers	*/
+#include "ExamContainer.h"
+
+
+/*
+ *	GetDataType()
+ *
+ *	Returns the container data type corresponding to a MATLAB class
+ */
+static examDataType GetDataType(mxClassID classID)
+{
+	switch( classID ) {
+		case mxLOGICAL_CLASS:	return ExamLogical;
+		case mxINT8_CLASS:		return ExamInt8;
+		case mxUINT8_CLASS:		return ExamUInt8;
+		case mxINT16_CLASS:		return ExamInt16;
+		case mxUINT16_CLASS:	return ExamUInt16;
+		case mxINT32_CLASS:		return ExamInt32;
+		case mxUINT32_CLASS:	return ExamUInt32;
+		case mxINT64_CLASS:		return ExamInt64;
+		case mxUINT64_CLASS:	return ExamUInt64;
+		case mxSINGLE_CLASS:	return ExamSingle;
+		case mxDOUBLE_CLASS:	return ExamDouble;
+		case mxCHAR_CLASS:		return ExamChar;
+		default:				return ExamUnknown;
+	};
+};
+
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+
+	/*	Validate the inputs	*/
+	if( (nrhs<3) || !(nrhs%2) || !mxIsChar(prhs[0]) ) {
+		mexErrMsgIdAndTxt("QUATTRO:qtx_write:invalidInput",
+						  "A file name and dataset name/value pairs must be specified");
+	};
+	for(int idx=1; idx<nrhs; idx+=2) {
+		if( !mxIsChar(prhs[idx]) || mxIsEmpty(prhs[idx]) ) {
+			mexErrMsgIdAndTxt("QUATTRO:qtx_write:invalidInput",
+							  "Dataset names must be non-empty strings");
+		}
+		else if( mxIsComplex(prhs[idx+1]) || (GetDataType( mxGetClassID(prhs[idx+1]) )==ExamUnknown) ) {
+			mexErrMsgIdAndTxt("QUATTRO:qtx_write:invalidValue",
+							  "Dataset values must be real numeric, logical or char arrays");
+		};
+	};
+	char* str = mxArrayToString(prhs[0]);
+	const std::string fName(str);
+	mxFree(str);
+
+	ExamContainerWriter writer;
+	if( !writer.Open(fName) ) {
+		mexErrMsgIdAndTxt("QUATTRO:qtx_write:openFailure", "%s", writer.GetError().c_str());
+	};
+	for(int idx=1; idx<nrhs; idx+=2) {
+		str = mxArrayToString(prhs[idx]);
+		const std::string name(str);
+		mxFree(str);
+
+		const mxArray* value = prhs[idx+1];
+		if( mxIsDouble(value) && mxIsEmpty(value) && (mxGetNumberOfDimensions(value)==2) &&
+			!mxGetM(value) && !mxGetN(value) ) {
+			writer.Remove(name);
+			continue;
+		};
+		const mwSize*		dimArray = mxGetDimensions(value);
+		std::vector<size_t> dims(dimArray, dimArray+mxGetNumberOfDimensions(value));
+		if( !writer.Write(name, GetDataType( mxGetClassID(value) ), dims, mxGetData(value)) ) {
+			writer.Close();
+			mexErrMsgIdAndTxt("QUATTRO:qtx_write:writeFailure", "%s", writer.GetError().c_str());
+		};
+	};
+	if( !writer.Commit() ) {
+		mexErrMsgIdAndTxt("QUATTRO:qtx_write:writeFailure", "%s", writer.GetError().c_str());
+	};
+
+	if( nlhs>0 ) {
+		plhs[0] = mxCreateDoubleScalar( static_cast<double>(writer.GetNumberOfWrittenTiles()) );
+	};
+	if( nlhs>1 ) {
+		plhs[1] = mxCreateDoubleScalar( static_cast<double>(writer.GetNumberOfReusedTiles()) );
+	};
+};
@@ -0,0 +1,528 @@
+/*
+ *	roi_batch.cxx
+ *
+ *	MEX front end of the bulk ROI/map engine (see RoiBatch.h)
+ *
+ *	B = roi_batch('import',FILES,M) reads the NordicICE and Pinnacle ROI
+ *	exports specified by the cell array of file names FILES, or all *.roi
+ *	files of the directory tree FILES, and rasterises the ROIs onto an image
+ *	grid of size M ([ROWS COLS]). Files are read and ROIs are rasterised in
+ *	parallel. B is a scalar structure with the fields:
+ *
+ *		Field			Description
+ *		===========================================================
+ *		Size			Image grid size [ROWS COLS]
+ *
+ *		Files			Cell array of the file names
+ *
+ *		Software		Cell array of the software ('NordicICE', 'Pinnacle'
+ *						or 'Unknown') of each file (empty when unreadable)
+ *
+ *		FileIndex		Index of the file of each ROI
+ *
+ *		Names			Cell array of ROI names (Pinnacle ROI names or empty)
+ *
+ *		Types			Cell array of ROI types ('impoly', 'imspline',
+ *						'imrect' or 'imellipse')
+ *
+ *		Slices			Slice index of each ROI
+ *
+ *		Vertices		Cell array of n-by-2 [X Y] vertices of each ROI in
+ *						image coordinates (rectangles and ellipses are given
+ *						by two corners)
+ *
+ *		Runs			Cell array of uint32 k-by-2 arrays of run-length
+ *						encoded masks. Each row holds a one-based linear
+ *						index of the image plane and the number of voxels
+ *						of the run
+ *
+ *	B = roi_batch('import',FILES,M,'Header',HDR) converts Pinnacle contours to
+ *	image coordinates using the Pinnacle header structure HDR (fields x_start,
+ *	y_start, z_start, x_pixdim, y_pixdim, z_pixdim, x_dim, y_dim and z_dim).
+ *
+ *	B = roi_batch('export',B,DIR) writes all ROIs of the batch structure B to
+ *	NordicICE files in the directory DIR, returning the file names in the
+ *	additional field Exported. Files are named after the ROI (or "roi") and
+ *	the ROI index.
+ *
+ *	MASK = roi_batch('mask',B,IDX) decodes the run-length encoded mask of the
+ *	ROI IDX into a logical array of size B.Size.
+ *
+ *	MAPS = roi_batch('maps',FILES,M) reads the raw little-endian single
+ *	precision maps (e.g., CineTool overlays) specified by FILES, or all *.raw
+ *	files of the directory tree FILES, into an M(1)-by-M(2)-by-N array. The
+ *	maps are stored row by row (see importOverlays). Maps of an unexpected
+ *	size are NaN. [MAPS,ISVALID,FILES] = roi_batch('maps',...) also returns
+ *	a logical vector flagging the maps that were read and the file names.
+ *
+ *	roi_batch('exportmaps',MAPS,FILES) writes the planes of the single
+ *	precision array MAPS to the raw files FILES in the same layout.
+ */
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+/*	MATLAB headers	*/
+#include "mex.h"
+
+/*	QUATTRO headers	*/
+#include "DirectoryScan.h"
+#include "MappedFile.h"
+#include "ParallelFor.h"
+#include "RoiBatch.h"
+
+
+static const char* batchFields[] = {
+	"Size", "Files", "Software", "FileIndex", "Names", "Types", "Slices", "Vertices", "Runs"
+};
+
+
+static std::string GetString(const mxArray* array, const char* name)
+{
+	if( !array || !mxIsChar(array) ) {
+		mexErrMsgIdAndTxt("QUATTRO:roi_batch:invalidInput", "%s must be a string", name);
+	};
+	char* str = mxArrayToString(array);
+	const std::string value(str);
+	mxFree(str);
+	return value;
+};
+
+
+static bool HasExtension(const std::string &fName, const char* ext)
+{
+	const size_t n = std::strlen(ext);
+	if( fName.size()<n ) {
+		return false;
+	};
+	for(size_t idx=0; idx<n; idx++) {
+		if( std::tolower(static_cast<unsigned char>(fName[fName.size()-n+idx]))!=ext[idx] ) {
+			return false;
+		};
+	};
+	return true;
+};
+
+
+/*
+ *	GetFiles()
+ *
+ *	Returns the file names of a cell array or the files with the extension
+ *	ext of a directory tree
+ */
+static std::vector<std::string> GetFiles(const mxArray* array, const char* ext)
+{
+	std::vector<std::string> files;
+	if( mxIsCell(array) ) {
+		for(size_t idx=0; idx<mxGetNumberOfElements(array); idx++) {
+			files.push_back( GetString(mxGetCell(array, idx), "FILES") );
+		};
+		return files;
+	};
+	const std::string dir = GetString(array, "FILES");
+	std::vector<std::string> subDirs;
+	if( !ListDirectory(dir, files, subDirs) ) {
+		files.assign(1, dir);	/*	single file	*/
+		return files;
+	};
+	const std::vector<std::string> all = ScanDirectoryTree(std::vector<std::string>(1, dir));
+	files.clear();
+	for(size_t idx=0; idx<all.size(); idx++) {
+		if( HasExtension(all[idx], ext) ) {
+			files.push_back(all[idx]);
+		};
+	};
+	return files;
+};
+
+
+static void GetSize(const mxArray* array, long &rows, long &cols)
+{
+	if( !mxIsDouble(array) || (mxGetNumberOfElements(array)<2) ||
+		(mxGetPr(array)[0]<1) || (mxGetPr(array)[1]<1) ) {
+		mexErrMsgIdAndTxt("QUATTRO:roi_batch:invalidSize",
+						  "M must be a vector of two positive values");
+	};
+	rows = static_cast<long>(mxGetPr(array)[0]);
+	cols = static_cast<long>(mxGetPr(array)[1]);
+};
+
+
+static mxArray* CreateCellString(const std::vector<std::string> &values)
+{
+	mxArray* cell = mxCreateCellMatrix(values.size(), 1);
+	for(size_t idx=0; idx<values.size(); idx++) {
+		mxSetCell(cell, idx, mxCreateString(values[idx].c_str()));
+	};
+	return cell;
+};
+
+
+static double GetHeaderValue(const mxArray* hdr, const char* field)
+{
+	const mxArray* value = mxGetField(hdr, 0, field);
+	if( !value ) {
+		mexErrMsgIdAndTxt("QUATTRO:roi_batch:invalidHeader",
+						  "The Pinnacle header has no field \"%s\"", field);
+	};
+	if( mxIsChar(value) ) {
+		return std::atof( GetString(value, field).c_str() );
+	};
+	return mxGetScalar(value);
+};
+
+
+/*
+ *	GetBatch()
+ *
+ *	Converts a batch structure to batch ROIs
+ */
+static std::vector<BatchRoi> GetBatch(const mxArray* b, long &rows, long &cols)
+{
+	if( !mxIsStruct(b) ) {
+		mexErrMsgIdAndTxt("QUATTRO:roi_batch:invalidBatch", "B must be a batch structure");
+	};
+	for(size_t idx=0; idx<sizeof(batchFields)/sizeof(batchFields[0]); idx++) {
+		if( !mxGetField(b, 0, batchFields[idx]) ) {
+			mexErrMsgIdAndTxt("QUATTRO:roi_batch:invalidBatch",
+							  "B has no field \"%s\"", batchFields[idx]);
+		};
+	};
+	GetSize(mxGetField(b, 0, "Size"), rows, cols);
+	const mxArray* names	= mxGetField(b, 0, "Names");
+	const mxArray* types	= mxGetField(b, 0, "Types");
+	const mxArray* slices	= mxGetField(b, 0, "Slices");
+	const mxArray* vertices = mxGetField(b, 0, "Vertices");
+	const size_t   n		= mxGetNumberOfElements(vertices);
+	if( !mxIsCell(vertices) || !mxIsCell(names) || !mxIsCell(types) || !mxIsDouble(slices) ||
+		(mxGetNumberOfElements(names)!=n) || (mxGetNumberOfElements(types)!=n) ||
+		(mxGetNumberOfElements(slices)!=n) ) {
+		mexErrMsgIdAndTxt("QUATTRO:roi_batch:invalidBatch",
+						  "The Names, Types, Slices and Vertices of B must have one element per ROI");
+	};
+	std::vector<BatchRoi> rois(n);
+	for(size_t idx=0; idx<n; idx++) {
+		const mxArray* v = mxGetCell(vertices, idx);
+		if( !v || !mxIsDouble(v) || (mxGetN(v)!=2) ) {
+			mexErrMsgIdAndTxt("QUATTRO:roi_batch:invalidBatch", "Vertices must be n-by-2 arrays");
+		};
+		const size_t   nV = mxGetM(v);
+		const double*  pV = mxGetPr(v);
+		rois[idx].x.assign(pV, pV+nV);
+		rois[idx].y.assign(pV+nV, pV+2*nV);
+		rois[idx].name	= GetString(mxGetCell(names, idx), "Names");
+		rois[idx].type	= GetString(mxGetCell(types, idx), "Types");
+		rois[idx].slice = mxGetPr(slices)[idx];
+	};
+	return rois;
+};
+
+
+static void ImportRois(int nrhs, mxArray *plhs[], const mxArray *prhs[])
+{
+	if( (nrhs!=3) && (nrhs!=5) ) {
+		mexErrMsgIdAndTxt("QUATTRO:roi_batch:invalidInput",
+						  "The import command requires FILES, M and an optional Pinnacle header");
+	};
+	long rows, cols;
+	GetSize(prhs[2], rows, cols);
+	PinnacleGrid grid;
+	const PinnacleGrid* gridPtr = 0;
+	if( nrhs==5 ) {
+		if( (GetString(prhs[3], "Option")!="Header") || !mxIsStruct(prhs[4]) ) {
+			mexErrMsgIdAndTxt("QUATTRO:roi_batch:invalidInput",
+							  "The Pinnacle header must be specified as 'Header',HDR");
+		};
+		const char* axes = "xyz";
+		for(int dim=0; dim<3; dim++) {
+			const std::string prefix(1, axes[dim]);
+			grid.start[dim]	 = GetHeaderValue(prhs[4], (prefix+"_start").c_str());
+			grid.pixdim[dim] = GetHeaderValue(prhs[4], (prefix+"_pixdim").c_str());
+			grid.dim[dim]	 = GetHeaderValue(prhs[4], (prefix+"_dim").c_str());
+			if( grid.pixdim[dim]==0 ) {
+				mexErrMsgIdAndTxt("QUATTRO:roi_batch:invalidHeader",
+								  "Pinnacle voxel dimensions must be non-zero");
+			};
+		};
+		gridPtr = &grid;
+	};
+	const std::vector<std::string> files = GetFiles(prhs[1], ".roi");
+
+	/*	Read the files and rasterise their ROIs in parallel	*/
+	const size_t n = files.size();
+	std::vector< std::vector<BatchRoi> > fileRois(n);
+	std::vector<std::string> software(n);
+	ParallelFor(n, 1, [&](size_t begin, size_t end, unsigned int) {
+		for(size_t idx=begin; idx<end; idx++) {
+			RoiFile file;
+			if( !file.Read(files[idx]) ) {
+				continue;
+			};
+			software[idx] = (file.GetType()==RoiNordicIce) ? "NordicICE" :
+							(file.GetType()==RoiPinnacle)  ? "Pinnacle"  : "Unknown";
+			GetBatchRois(file, idx, gridPtr, fileRois[idx]);
+			for(size_t roiIdx=0; roiIdx<fileRois[idx].size(); roiIdx++) {
+				Rasterize(fileRois[idx][roiIdx], rows, cols);
+			};
+		};
+	});
+
+	/*	Create the batch structure	*/
+	size_t nRois = 0;
+	for(size_t idx=0; idx<n; idx++) {
+		nRois += fileRois[idx].size();
+	};
+	mxArray* b		  = mxCreateStructMatrix(1, 1, sizeof(batchFields)/sizeof(batchFields[0]), batchFields);
+	mxArray* size	  = mxCreateDoubleMatrix(1, 2, mxREAL);
+	mxArray* fileIdx  = mxCreateDoubleMatrix(nRois, 1, mxREAL);
+	mxArray* names	  = mxCreateCellMatrix(nRois, 1);
+	mxArray* types	  = mxCreateCellMatrix(nRois, 1);
+	mxArray* slices	  = mxCreateDoubleMatrix(nRois, 1, mxREAL);
+	mxArray* vertices = mxCreateCellMatrix(nRois, 1);
+	mxArray* runs	  = mxCreateCellMatrix(nRois, 1);
+	mxGetPr(size)[0] = static_cast<double>(rows);
+	mxGetPr(size)[1] = static_cast<double>(cols);
+	size_t roiIdx = 0;
+	for(size_t idx=0; idx<n; idx++) {
+		for(size_t k=0; k<fileRois[idx].size(); k++, roiIdx++) {
+			const BatchRoi &roi = fileRois[idx][k];
+			mxGetPr(fileIdx)[roiIdx] = static_cast<double>(idx+1);
+			mxGetPr(slices)[roiIdx]	 = roi.slice;
+			mxSetCell(names, roiIdx, mxCreateString(roi.name.c_str()));
+			mxSetCell(types, roiIdx, mxCreateString(roi.type.c_str()));
+
+			mxArray* v = mxCreateDoubleMatrix(roi.x.size(), 2, mxREAL);
+			std::copy(roi.x.begin(), roi.x.end(), mxGetPr(v));
+			std::copy(roi.y.begin(), roi.y.end(), mxGetPr(v)+roi.x.size());
+			mxSetCell(vertices, roiIdx, v);
+
+			const size_t nRuns = roi.runs.starts.size();
+			mxArray* r = mxCreateNumericMatrix(nRuns, 2, mxUINT32_CLASS, mxREAL);
+			unsigned int* pR = static_cast<unsigned int*>(mxGetData(r));
+			std::copy(roi.runs.starts.begin(), roi.runs.starts.end(), pR);
+			std::copy(roi.runs.lengths.begin(), roi.runs.lengths.end(), pR+nRuns);
+			mxSetCell(runs, roiIdx, r);
+		};
+	};
+	mxSetField(b, 0, "Size", size);
+	mxSetField(b, 0, "Files", CreateCellString(files));
+	mxSetField(b, 0, "Software", CreateCellString(software));
+	mxSetField(b, 0, "FileIndex", fileIdx);
+	mxSetField(b, 0, "Names", names);
+	mxSetField(b, 0, "Types", types);
+	mxSetField(b, 0, "Slices", slices);
+	mxSetField(b, 0, "Vertices", vertices);
+	mxSetField(b, 0, "Runs", runs);
+	plhs[0] = b;
+};
+
+
+static void ExportRois(int nrhs, mxArray *plhs[], const mxArray *prhs[])
+{
+	if( nrhs!=3 ) {
+		mexErrMsgIdAndTxt("QUATTRO:roi_batch:invalidInput",
+						  "The export command requires B and DIR");
+	};
+	long rows, cols;
+	const std::vector<BatchRoi> rois = GetBatch(prhs[1], rows, cols);
+	std::string dir = GetString(prhs[2], "DIR");
+	if( !dir.empty() && (dir[dir.size()-1]!='/') && (dir[dir.size()-1]!='\\') ) {
+		dir += '/';
+	};
+
+	/*	File names are created up front so that parallel writes are unique	*/
+	const size_t n = rois.size();
+	std::vector<std::string> files(n);
+	for(size_t idx=0; idx<n; idx++) {
+		std::string name = rois[idx].name.empty() ? std::string("roi") : rois[idx].name;
+		for(size_t k=0; k<name.size(); k++) {
+			if( !std::isalnum(static_cast<unsigned char>(name[k])) && (name[k]!='-') && (name[k]!='_') ) {
+				name[k] = '_';
+			};
+		};
+		char suffix[32];
+		std::snprintf(suffix, sizeof(suffix), "_%05u.roi", static_cast<unsigned int>(idx+1));
+		files[idx] = dir + name + suffix;
+	};
+	std::vector<char> isWritten(n, 0);
+	ParallelFor(n, 16, [&](size_t begin, size_t end, unsigned int) {
+		for(size_t idx=begin; idx<end; idx++) {
+			isWritten[idx] = WriteNordicIce(files[idx], rois[idx]);
+		};
+	});
+	for(size_t idx=0; idx<n; idx++) {
+		if( !isWritten[idx] ) {
+			mexErrMsgIdAndTxt("QUATTRO:roi_batch:writeFailure",
+							  "Unable to write %s", files[idx].c_str());
+		};
+	};
+
+	plhs[0] = mxDuplicateArray(prhs[1]);
+	mxAddField(plhs[0], "Exported");
+	mxSetField(plhs[0], 0, "Exported", CreateCellString(files));
+};
+
+
+static void DecodeMask(int nrhs, mxArray *plhs[], const mxArray *prhs[])
+{
+	if( (nrhs!=3) || !mxIsStruct(prhs[1]) || !mxGetField(prhs[1], 0, "Runs") ) {
+		mexErrMsgIdAndTxt("QUATTRO:roi_batch:invalidInput",
+						  "The mask command requires B and IDX");
+	};
+	long rows, cols;
+	GetSize(mxGetField(prhs[1], 0, "Size"), rows, cols);
+	const mxArray* runs = mxGetField(prhs[1], 0, "Runs");
+	const double   idx	= mxIsNumeric(prhs[2]) ? mxGetScalar(prhs[2]) : 0.0;
+	if( !mxIsCell(runs) || (idx<1) || (idx>mxGetNumberOfElements(runs)) ) {
+		mexErrMsgIdAndTxt("QUATTRO:roi_batch:invalidIndex",
+						  "IDX must be a valid ROI index");
+	};
+	const mxArray* r = mxGetCell(runs, static_cast<size_t>(idx)-1);
+	if( !r || (mxGetClassID(r)!=mxUINT32_CLASS) || (mxGetN(r)!=2) ) {
+		mexErrMsgIdAndTxt("QUATTRO:roi_batch:invalidBatch",
+						  "Runs must be k-by-2 uint32 arrays");
+	};
+	plhs[0] = mxCreateLogicalMatrix(rows, cols);
+	mxLogical*			mask  = mxGetLogicals(plhs[0]);
+	const size_t		nRuns = mxGetM(r);
+	const size_t		nVox  = static_cast<size_t>(rows)*cols;
+	const unsigned int* pR	  = static_cast<const unsigned int*>(mxGetData(r));
+	for(size_t k=0; k<nRuns; k++) {
+		const size_t start = pR[k];
+		const size_t stop  = std::min<size_t>(start+pR[k+nRuns], nVox+1);
+		if( start>=1 ) {
+			std::fill(mask+start-1, mask+std::max(start,stop)-1, true);
+		};
+	};
+};
+
+
+static void ReadMaps(int nlhs, int nrhs, mxArray *plhs[], const mxArray *prhs[])
+{
+	if( nrhs!=3 ) {
+		mexErrMsgIdAndTxt("QUATTRO:roi_batch:invalidInput",
+						  "The maps command requires FILES and M");
+	};
+	long rows, cols;
+	GetSize(prhs[2], rows, cols);
+	const std::vector<std::string> files = GetFiles(prhs[1], ".raw");
+	const size_t n	   = files.size();
+	const size_t nVox  = static_cast<size_t>(rows)*cols;
+	mwSize		 dims[3] = {static_cast<mwSize>(rows), static_cast<mwSize>(cols), n};
+	plhs[0] = mxCreateNumericArray(3, dims, mxSINGLE_CLASS, mxREAL);
+	float* maps = static_cast<float*>(mxGetData(plhs[0]));
+	std::vector<char> isValid(n, 0);
+
+	/*	The maps are stored row by row in little-endian byte order	*/
+	ParallelFor(n, 1, [&](size_t begin, size_t end, unsigned int) {
+		for(size_t idx=begin; idx<end; idx++) {
+			float* map = maps+idx*nVox;
+			MappedFile file;
+			if( !file.Open(files[idx]) || (file.GetSize()!=nVox*sizeof(float)) ) {
+				std::fill(map, map+nVox, std::numeric_limits<float>::quiet_NaN());
+				continue;
+			};
+			const unsigned char* src = reinterpret_cast<const unsigned char*>(file.GetData());
+			for(long r=0; r<rows; r++) {
+				for(long c=0; c<cols; c++, src+=4) {
+					const unsigned int bits = src[0] | (src[1]<<8) | (src[2]<<16) | (static_cast<unsigned int>(src[3])<<24);
+					std::memcpy(map+r+c*rows, &bits, sizeof(float));
+				};
+			};
+			isValid[idx] = 1;
+		};
+	});
+
+	if( nlhs>1 ) {
+		plhs[1] = mxCreateLogicalMatrix(n, 1);
+		std::copy(isValid.begin(), isValid.end(), mxGetLogicals(plhs[1]));
+	};
+	if( nlhs>2 ) {
+		plhs[2] = CreateCellString(files);
+	};
+};
+
+
+static void WriteMaps(int nrhs, const mxArray *prhs[])
+{
+	if( (nrhs!=3) || !mxIsSingle(prhs[1]) || mxIsComplex(prhs[1]) || !mxIsCell(prhs[2]) ) {
+		mexErrMsgIdAndTxt("QUATTRO:roi_batch:invalidInput",
+						  "The exportmaps command requires a real single array and a cell array of file names");
+	};
+	const mwSize* dims = mxGetDimensions(prhs[1]);
+	const size_t  rows = dims[0];
+	const size_t  cols = (mxGetNumberOfDimensions(prhs[1])>1) ? dims[1] : 1;
+	const size_t  nVox = rows*cols;
+	const std::vector<std::string> files = GetFiles(prhs[2], "");
+	if( files.size()*nVox!=mxGetNumberOfElements(prhs[1]) ) {
+		mexErrMsgIdAndTxt("QUATTRO:roi_batch:invalidInput",
+						  "One file name must be specified per map");
+	};
+	const float* maps = static_cast<const float*>(mxGetData(prhs[1]));
+	std::vector<char> isWritten(files.size(), 0);
+	ParallelFor(files.size(), 1, [&](size_t begin, size_t end, unsigned int) {
+		std::vector<unsigned char> buffer(4*nVox);
+		for(size_t idx=begin; idx<end; idx++) {
+			const float*   map = maps+idx*nVox;
+			unsigned char* dst = buffer.data();
+			for(size_t r=0; r<rows; r++) {
+				for(size_t c=0; c<cols; c++, dst+=4) {
+					unsigned int bits;
+					std::memcpy(&bits, map+r+c*rows, sizeof(float));
+					dst[0] = static_cast<unsigned char>(bits);
+					dst[1] = static_cast<unsigned char>(bits>>8);
+					dst[2] = static_cast<unsigned char>(bits>>16);
+					dst[3] = static_cast<unsigned char>(bits>>24);
+				};
+			};
+			FILE* fid = std::fopen(files[idx].c_str(), "wb");
+			if( fid ) {
+				isWritten[idx] = (std::fwrite(buffer.data(), 1, buffer.size(), fid)==buffer.size());
+				isWritten[idx] = (std::fclose(fid)==0) && isWritten[idx];
+			};
+		};
+	});
+	for(size_t idx=0; idx<files.size(); idx++) {
+		if( !isWritten[idx] ) {
+			mexErrMsgIdAndTxt("QUATTRO:roi_batch:writeFailure",
+							  "Unable to write %s", files[idx].c_str());
+		};
+	};
+};
+
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+	if( nrhs<1 ) {
+		mexErrMsgIdAndTxt("QUATTRO:roi_batch:invalidInput",
+						  "A command string must be specified");
+	};
+	const std::string cmd = GetString(prhs[0], "The command");
+	if( cmd=="import" ) {
+		ImportRois(nrhs, plhs, prhs);
+	}
+	else if( cmd=="export" ) {
+		ExportRois(nrhs, plhs, prhs);
+	}
+	else if( cmd=="mask" ) {
+		DecodeMask(nrhs, plhs, prhs);
+	}
+	else if( cmd=="maps" ) {
+		ReadMaps(nlhs, nrhs, plhs, prhs);
+	}
+	else if( cmd=="exportmaps" ) {
+		WriteMaps(nrhs, prhs);
+	}
+	else {
+		mexErrMsgIdAndTxt("QUATTRO:roi_batch:invalidInput",
+						  "Unknown command: %s", cmd.c_str());
+	};
+};
@@ -0,0 +1,161 @@
+/*
+ *	roi_read.cxx
+ *
+ *	MEX front end of the ROI export parser (see RoiFile.h)
+ *
+ *	S = roi_read(FILES) parses the NordicICE/ImageJ and Pinnacle ROI exports
+ *	specified by the file name or cell array of file names FILES. The files
+ *	are parsed in parallel and S is a structure array (one element per
+ *	file) with the fields:
+ *
+ *		Field			Description
+ *		===========================================================
+ *		Filename		Full file name
+ *
+ *		Software		'NordicICE', 'Pinnacle' or 'Unknown'. Empty when
+ *						the file could not be read (see Error)
+ *
+ *		Size			NordicICE ROI size (e.g., 'MEDIUM')
+ *
+ *		Type			NordicICE ROI type (e.g., 'polygon')
+ *
+ *		Coordinates		NordicICE points as an n-by-2 array of the "x;y"
+ *						values in the file
+ *
+ *		Names			Cell array of Pinnacle ROI names
+ *
+ *		Colors			Cell array of Pinnacle ROI color names
+ *
+ *		Curves			Cell array (one cell per Pinnacle ROI) of cell arrays
+ *						of n-by-3 closed contour coordinates
+ *
+ *		IsComplete		FALSE when malformed contours were skipped or the
+ *						number of contours differs from the ROI definition
+ *
+ *		Error			Error message for files that could not be read
+ */
+
+
+/*	C++ headers	*/
+#include <string>
+#include <vector>
+
+/*	MATLAB headers	*/
+#include "mex.h"
+
+/*	QUATTRO headers	*/
+#include "ParallelFor.h"
+#include "RoiFile.h"
+
+
+static const char* fieldNames[] = {
+	"Filename", "Software", "Size", "Type", "Coordinates", "Names", "Colors", "Curves",
+	"IsComplete", "Error"
+};
+
+
+static mxArray* CreatePoints(const std::vector<double> &values, size_t nCols)
+{
+	const size_t n = values.size()/nCols;
+	mxArray*	 array = mxCreateDoubleMatrix(n, nCols, mxREAL);
+	double*		 dst   = mxGetPr(array);
+	for(size_t idx=0; idx<n; idx++) {
+		for(size_t col=0; col<nCols; col++) {
+			dst[idx+col*n] = values[idx*nCols+col];
+		};
+	};
+	return array;
+};
+
+
+static void CreateOutput(const std::string &fName, bool isRead, const RoiFile &file, mxArray* s, size_t idx)
+{
+	mxSetField(s, idx, "Filename", mxCreateString(fName.c_str()));
+	mxSetField(s, idx, "IsComplete", mxCreateLogicalScalar(isRead && file.IsComplete()));
+	if( !isRead ) {
+		mxSetField(s, idx, "Software", mxCreateString(""));
+		mxSetField(s, idx, "Error", mxCreateString(file.GetError().c_str()));
+		return;
+	};
+	mxSetField(s, idx, "Error", mxCreateString(""));
+
+	switch( file.GetType() ) {
+		case RoiNordicIce:
+			mxSetField(s, idx, "Software", mxCreateString("NordicICE"));
+			mxSetField(s, idx, "Size", mxCreateString(file.GetSize().c_str()));
+			mxSetField(s, idx, "Type", mxCreateString(file.GetShape().c_str()));
+			mxSetField(s, idx, "Coordinates", CreatePoints(file.GetPoints(), 2));
+			break;
+		case RoiPinnacle: {
+			const std::vector<PinnacleRoi> &rois = file.GetRois();
+			mxArray* names	= mxCreateCellMatrix(rois.size(), 1);
+			mxArray* colors = mxCreateCellMatrix(rois.size(), 1);
+			mxArray* curves = mxCreateCellMatrix(rois.size(), 1);
+			for(size_t roiIdx=0; roiIdx<rois.size(); roiIdx++) {
+				mxSetCell(names, roiIdx, mxCreateString(rois[roiIdx].name.c_str()));
+				mxSetCell(colors, roiIdx, mxCreateString(rois[roiIdx].color.c_str()));
+				mxArray* roiCurves = mxCreateCellMatrix(rois[roiIdx].curves.size(), 1);
+				for(size_t cIdx=0; cIdx<rois[roiIdx].curves.size(); cIdx++) {
+					mxSetCell(roiCurves, cIdx, CreatePoints(rois[roiIdx].curves[cIdx], 3));
+				};
+				mxSetCell(curves, roiIdx, roiCurves);
+			};
+			mxSetField(s, idx, "Software", mxCreateString("Pinnacle"));
+			mxSetField(s, idx, "Names", names);
+			mxSetField(s, idx, "Colors", colors);
+			mxSetField(s, idx, "Curves", curves);
+			break;
+		}
+		default:
+			mxSetField(s, idx, "Software", mxCreateString("Unknown"));
+	};
+};
+
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+
+	/*	Validate the inputs	*/
+	if( nrhs!=1 ) {
+		mexErrMsgIdAndTxt("QUATTRO:roi_read:invalidInput",
+						  "A file name or cell array of file names must be specified");
+	};
+	std::vector<std::string> fNames;
+	if( mxIsChar(prhs[0]) ) {
+		char* str = mxArrayToString(prhs[0]);
+		fNames.push_back(str);
+		mxFree(str);
+	}
+	else if( mxIsCell(prhs[0]) ) {
+		for(size_t idx=0; idx<mxGetNumberOfElements(prhs[0]); idx++) {
+			const mxArray* cell = mxGetCell(prhs[0], idx);
+			if( !cell || !mxIsChar(cell) ) {
+				mexErrMsgIdAndTxt("QUATTRO:roi_read:invalidInput",
+								  "FILES must contain only strings");
+			};
+			char* str = mxArrayToString(cell);
+			fNames.push_back(str);
+			mxFree(str);
+		};
+	}
+	else {
+		mexErrMsgIdAndTxt("QUATTRO:roi_read:invalidInput",
+						  "FILES must be a string or a cell array of strings");
+	};
+
+	/*	Parse the files in parallel	*/
+	const size_t n = fNames.size();
+	std::vector<RoiFile> files(n);
+	std::vector<char>	 isRead(n, 0);
+	ParallelFor(n, 1, [&](size_t begin, size_t end, unsigned int) {
+		for(size_t idx=begin; idx<end; idx++) {
+			isRead[idx] = files[idx].Read(fNames[idx]);
+		};
+	});
+
+	/*	Create the outputs	*/
+	plhs[0] = mxCreateStructMatrix(1, n, sizeof(fieldNames)/sizeof(fieldNames[0]), fieldNames);
+	for(size_t idx=0; idx<n; idx++) {
+		CreateOutput(fNames[idx], isRead[idx]!=0, files[idx], plhs[0], idx);
+	};
+};
@@ -0,0 +1,66 @@
+function test_roi_read
+%test_roi_read  Round-trip test of the native ROI parser
+%
+%   test_roi_read writes NordicICE ROIs of every type and size with
+%   nordicicewrite, parses them back with the roi_read MEX file (as a single
+%   batch and through nordiciceread) and compares the results with the written
+%   coordinates and with the MATLAB parser of imagejread. An error is thrown on
+%   the first mismatch.
+%
+%   See also nordicicewrite, nordiciceread, roi_read
+
+    if (exist('roi_read','file')~=3)
+        error(['QUATTRO:' mfilename ':missingMex'],...
+              'The roi_read MEX file must be built to run this test.');
+    end
+
+    % Write one ROI of each type and size. The files store the rounded,
+    % 0-indexed coordinates (and, for ellipses/rectangles, the position
+    % [x y width height])
+    types   = {'polygon','freehand','ellipse','rectangle'};
+    imTypes = {'impoly','imspline','imellipse','imrect'};
+    sizes   = {'small','medium','large'};
+    [fNames,coors] = deal( cell(numel(types),numel(sizes)) );
+    for tIdx = 1:numel(types)
+        for sIdx = 1:numel(sizes)
+            switch types{tIdx}
+                case {'polygon','freehand'}
+                    r = 1+255*rand(20,2);
+                    coors{tIdx,sIdx} = round(r-1);
+                    if strcmp(types{tIdx},'freehand')
+                        coors{tIdx,sIdx} = unique(coors{tIdx,sIdx},'rows');
+                    end
+                case {'ellipse','rectangle'}
+                    r = [1+200*rand(1,2) 1+50*rand(1,2)];
+                    coors{tIdx,sIdx} = round([r(1:2)-1 r(3:4)]);
+            end
+            fNames{tIdx,sIdx} = [tempname '.roi'];
+            nordicicewrite(fNames{tIdx,sIdx},r,sizes{sIdx},types{tIdx});
+        end
+    end
+    cleanup = onCleanup(@() delete(fNames{:}));
+
+    % Parse all files in one call and compare each ROI with the written data
+    % and the MATLAB parser
+    s = roi_read(fNames(:));
+    for idx = 1:numel(fNames)
+        [tIdx,sIdx] = ind2sub(size(fNames),idx);
+        assert(isempty(s(idx).Error) && strcmp(s(idx).Software,'NordicICE'),...
+               'Unable to parse %s',fNames{idx});
+        assert(strcmpi(s(idx).Size,sizes{sIdx}) && strcmp(s(idx).Type,types{tIdx}),...
+               'Wrong size or type of a %s %s ROI',sizes{sIdx},types{tIdx});
+
+        roi   = nordiciceread(fNames{idx});
+        fid   = fopen(fNames{idx},'r');
+        lines = textscan(fid,'%s','Delimiter','\n');
+        fclose(fid);
+        assert(isequal(roi,imagejread(lines{1}),imagejread(s(idx))),...
+               'Native and MATLAB parsers differ for a %s %s ROI',...
+                                                       sizes{sIdx},types{tIdx});
+        assert(strcmp(roi.types,imTypes{tIdx}) &&...
+               isequal(roi.coordinates,coors{tIdx,sIdx}),...
+               'Round trip of a %s %s ROI failed',sizes{sIdx},types{tIdx});
+    end
+    fprintf('%s: %d ROI files passed\n',mfilename,numel(fNames));
+
+end %test_roi_read
\ No newline at end of file
@@ -1,4 +1,4 @@
-function x0 = fspgr_vfa_ols(x,y,tr)
+function x0 = fspgr_vfa_ols(x,y,tr,b1)
 %fspgr_vfa_ols  Estimates S0 and T1 from VFA FSPGR data
 %
 %   X0 = fspgr_vfa_ols(FA,SI,TR) estimates the FSPGR model parameters S0 and T1
@@ -7,13 +7,32 @@ function x0 = fspgr_vfa_ols(x,y,tr)
 %   flip angles in degrees and SI is an N-by-M array, where M specifies the
 %   numebr of measurements. The estimated model parameters are returned in the
 %   2-by-M array X0 where the first row is the estimated S0 and the second is T1
+%
+%   X0 = fspgr_vfa_ols(FA,SI,TR,B1) corrects the flip angles of each measurement
+%   using the relative B1 (actual/nominal flip angle) values in the array B1
+%   with M elements.
+%
+%   When the vfa_t1 MEX file is available, all measurements are estimated in a
+%   single vectorized pass.
+
+    % Default B1: nominal flip angles
+    mY = size(y);
+    if (nargin<4) || isempty(b1)
+        b1 = ones(1,prod(mY(2:end)));
+    end
+    b1 = reshape(b1,1,[]);
+
+    % Use the native estimator when available
+    if (exist('vfa_t1','file')==3)
+        x0 = vfa_t1(double(x(:)),double(y(:,:)),double(tr),'B1',double(b1));
+        return
+    end
 
     % Initialize the regressor and regressand for linear regression
-    mY      = size(y);
     [xi,yi] = deal(zeros(mY(1),prod(mY(2:end))));
     for idx = 1:mY(1)
-        yi(idx,:) = y(idx,:)./tand(x(idx));
-        xi(idx,:) = y(idx,:)./sind(x(idx));
+        yi(idx,:) = y(idx,:)./tand(x(idx)*b1);
+        xi(idx,:) = y(idx,:)./sind(x(idx)*b1);
     end
 
     % Estimate S0 and T1 from ordinary least squares using the linearization
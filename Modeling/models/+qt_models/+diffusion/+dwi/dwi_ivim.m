@@ -0,0 +1,81 @@
+classdef dwi_ivim < diffusion
+
+    properties (Dependent)
+
+        % Function used for model fitting
+        %
+        %   Function handle to the intra-voxel incoherent motion model (with
+        %   diffusion kurtosis) of the form @(x0,t) f(x0,t) where x0 are model
+        %   parameters and t is the dependent variable (i.e. b-values).
+        modelFcn
+
+    end
+
+    properties (Constant)
+
+        % Class defintion model name
+        %
+        %   "modelName" is a string containing a short description of the model
+        %   implemented in DWI_IVIM
+        modelName = 'Intra-voxel incoherent motion';
+
+        % Non-linear model parameter names
+        %
+        %   "nlinParams" is a cell array of strings containing the specifier for
+        %   each model parameter. Valid parameters are:
+        %
+        %       Parameter       Description
+        %       ===========================
+        %       'S0'            Equilibrium magnetization (units: a.u.)
+        %
+        %       'D'             Diffusion coefficient (units: mm^2/s)
+        %
+        %       'DStar'         Pseudo-diffusion coefficient (units: mm^2/s)
+        %
+        %       'f'             Perfusion fraction
+        %
+        %       'K'             Diffusion kurtosis
+        nlinParams = {'S0','D','DStar','f','K'};
+
+    end
+
+
+    %---------------------------- Class Constructor ----------------------------
+    methods
+
+        function obj = dwi_ivim(varargin)
+        %dwi_ivim  Class for performing quantitative IVIM modeling
+        %
+        %   OBJ = dwi_ivim(B,Y) creates a dwi_ivim modeling object for the vector
+        %   of acquisition b-values B and signal intensities Y.
+        %
+        %   OBJ = dwi_ivim(QTEXAM) creates a dwi_ivim modeling object from the
+        %   data stored in the qt_exam object QTEXAM. Associated QUATTRO links
+        %   are generated if available.
+        %
+        %   OBJ = dwi_ivim(...,'PROP1',VAL1,...) creates a dwi_ivim modeling
+        %   object as above, initializing the class properties specified by
+        %   'PROP1' to the value VAL1
+        %
+        %   See also dwi and dwi_kurtosis
+
+            % Parse the inputs
+            if nargin
+                qt_models.parse_inputs(obj,varargin{:});
+            end
+
+        end %dwi_ivim
+
+    end %class constructor
+
+
+    %------------------------------- Get Methods -------------------------------
+    methods
+
+        function val = get.modelFcn(~)
+            val = @(x,xdata) ivim(x(:),xdata);
+        end %get.modelFcn
+
+    end %get methods
+
+end %dwi_ivim
\ No newline at end of file
@@ -0,0 +1,77 @@
+classdef dwi_kurtosis < diffusion
+
+    properties (Dependent)
+
+        % Function used for model fitting
+        %
+        %   Function handle to the diffusion kurtosis model (i.e., the IVIM model
+        %   without pseudo-diffusion) of the form @(x0,t) f(x0,t) where x0 are
+        %   model parameters and t is the dependent variable (i.e. b-values).
+        modelFcn
+
+    end
+
+    properties (Constant)
+
+        % Class defintion model name
+        %
+        %   "modelName" is a string containing a short description of the model
+        %   implemented in DWI_KURTOSIS
+        modelName = 'Diffusion kurtosis';
+
+        % Non-linear model parameter names
+        %
+        %   "nlinParams" is a cell array of strings containing the specifier for
+        %   each model parameter. Valid parameters are:
+        %
+        %       Parameter       Description
+        %       ===========================
+        %       'S0'            Equilibrium magnetization (units: a.u.)
+        %
+        %       'D'             Diffusion coefficient (units: mm^2/s)
+        %
+        %       'K'             Diffusion kurtosis
+        nlinParams = {'S0','D','K'};
+
+    end
+
+
+    %---------------------------- Class Constructor ----------------------------
+    methods
+
+        function obj = dwi_kurtosis(varargin)
+        %dwi_kurtosis  Class for performing diffusion kurtosis modeling
+        %
+        %   OBJ = dwi_kurtosis(B,Y) creates a dwi_kurtosis modeling object for the
+        %   vector of acquisition b-values B and signal intensities Y.
+        %
+        %   OBJ = dwi_kurtosis(QTEXAM) creates a dwi_kurtosis modeling object from
+        %   the data stored in the qt_exam object QTEXAM. Associated QUATTRO
+        %   links are generated if available.
+        %
+        %   OBJ = dwi_kurtosis(...,'PROP1',VAL1,...) creates a dwi_kurtosis
+        %   modeling object as above, initializing the class properties
+        %   specified by 'PROP1' to the value VAL1
+        %
+        %   See also dwi and dwi_ivim
+
+            % Parse the inputs
+            if nargin
+                qt_models.parse_inputs(obj,varargin{:});
+            end
+
+        end %dwi_kurtosis
+
+    end %class constructor
+
+
+    %------------------------------- Get Methods -------------------------------
+    methods
+
+        function val = get.modelFcn(~)
+            val = @(x,xdata) ivim([x(1);x(2);0;0;x(3)],xdata);
+        end %get.modelFcn
+
+    end %get methods
+
+end %dwi_kurtosis
\ No newline at end of file
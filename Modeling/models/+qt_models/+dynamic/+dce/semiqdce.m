@@ -102,6 +102,13 @@ classdef semiqdce < t1dynamic
         %   calculating all semi-quantitative parameters as these parameters are
         %   not otherwise computed by the "fit"
 
+            % All parameters are computed in a single pass when the semiq_maps
+            % MEX file is available
+            if (exist('semiq_maps','file')==3)
+                obj.calcsemiq;
+                return
+            end
+
             obj.calciauc; %this will also call "calciauc"
             obj.calcpeak;   %this will compute SER and TTP
             obj.calcslopes;
@@ -82,8 +82,9 @@ classdef fspgrvfa_R1 < fspgrvfa & mrimagingprops
             end
 
             % Estimate S0 and T1 using least squares and convert T1 to R1
-            % (accounting for the difference in units)
-            g      = fspgr_vfa_ols(obj.xProc,obj.yProc,obj.tr);
+            % (accounting for the difference in units). The B1 map corrects the
+            % flip angles
+            g      = fspgr_vfa_ols(obj.xProc,obj.yProc,obj.tr,obj.processB1);
             val.S0 = g(1,:);
             val.R1 = 1000./g(2,:);
 
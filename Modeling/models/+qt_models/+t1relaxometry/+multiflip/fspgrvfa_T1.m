@@ -81,8 +81,9 @@ classdef fspgrvfa_T1 < fspgrvfa & mrimagingprops
                 return
             end
 
-            % Estimate S0 and T1 using ordinary least squares
-            g      = fspgr_vfa_ols(obj.xProc,obj.yProc,obj.tr);
+            % Estimate S0 and T1 using ordinary least squares, correcting the
+            % flip angles with the B1 map
+            g      = fspgr_vfa_ols(obj.xProc,obj.yProc,obj.tr,obj.processB1);
             val.S0 = g(1,:);
             val.T1 = g(2,:);
 
@@ -93,6 +93,50 @@ classdef multite < modelbase
 
 
     %------------------------------ Other Methods ------------------------------
+    methods
+
+        function [s,t2] = calcspectrum(obj,t2,lambda)
+        %calcspectrum  Computes multi-component T2 spectra
+        %
+        %   [S,T2] = calcspectrum(OBJ) computes the non-negative T2 spectrum of
+        %   each voxel of the "yProc" property over 60 logarithmically spaced T2
+        %   values (ms) between the first and ten times the last echo time using
+        %   the non-negative least squares mode of the exp_fit MEX file. S is the
+        %   M-by-N1-by-...-Nk array of amplitudes, where M is the number of T2
+        %   values and N1-by-...-Nk the size of the spatial dimensions of "y",
+        %   such that the signal of voxel v is exp(-TE(:)*(1./T2(:)'))*S(:,v).
+        %
+        %   [...] = calcspectrum(OBJ,T2) uses the vector of T2 values T2 (ms)
+        %
+        %   [...] = calcspectrum(OBJ,T2,LAMBDA) applies the Tikhonov
+        %   regularization weight LAMBDA to the spectra (see exp_fit). Default: 0
+
+            if (exist('exp_fit','file')~=3)
+                error(['qt_models:' mfilename ':missingMex'],...
+                      'The exp_fit MEX file is required to compute T2 spectra.');
+            end
+
+            % Default T2 values and regularization
+            te = obj.xProc;
+            if (nargin<2) || isempty(t2)
+                t2 = logspace(log10(max(min(te),eps)),log10(10*max(te)),60);
+            end
+            if (nargin<3)
+                lambda = 0;
+            end
+
+            % Compute the spectra of all voxels
+            y  = obj.yProc;
+            mY = size(y);
+            s  = exp_fit(double(te(:)),double(y(:,:)),...
+                         'Spectrum',double(t2(:)),'Lambda',lambda);
+            s  = reshape(s,[numel(t2) mY(2:end) 1]);
+
+        end %multite.calcspectrum
+
+    end %methods
+
+
     methods (Hidden = true)
 
         function val = process(obj,val)
@@ -0,0 +1,143 @@
+classdef diffusion < modelbase
+
+    properties (AbortSet,SetObservable)
+
+        % Flag for Bayesian IVIM maps
+        %
+        %   "useBayesianFit" is a logical flag that, when TRUE, refines the
+        %   segmented IVIM and kurtosis fits of a map computation by a maximum a
+        %   posteriori fit of each voxel using priors shared by the voxels that
+        %   are fitted together (the map or, for streamed maps, the slice). This
+        %   option only applies to the native maps of the dwi_ivim and
+        %   dwi_kurtosis models (see ivim_fit).
+        %
+        %   Default: FALSE
+        useBayesianFit = false;
+
+    end
+
+    properties (Dependent)
+
+        % Function used for plotting the model
+        %
+        %   Calls the modelFcn property and is only here for code conformity.
+        plotFcn
+
+        % Processed y values
+        %
+        %   "yProc" is a dependent property that applies the property "subset"
+        yProc
+
+    end
+
+    properties (Constant)
+
+        % Class definition independent variable units
+        %
+        %   "xUnits" is a string specifying the units of the indpendent variable
+        %   property "x". b-values (sec/mm^2) are not converted
+        xUnits = '';
+
+    end
+
+
+    %---------------------------- Class Constructor ----------------------------
+    methods
+
+        function obj = diffusion
+
+            % Construct DWI specific defaults
+            obj.xLabel = 'b-value (sec/mm^2)';
+            obj.yLabel = 'S.I. (a.u.)';
+
+            % Initialize the parameter units, bounds and guesses that are common
+            % to all diffusion sub-classes (the parameters of ivim)
+            obj.paramUnits(1).S0    = '';
+            obj.paramUnits(1).D     = 'mm^2/second';
+            obj.paramUnits(1).DStar = 'mm^2/second';
+            obj.paramUnits(1).f     = '';
+            obj.paramUnits(1).K     = '';
+
+            obj.paramBounds(1).S0    = [0 inf];
+            obj.paramBounds(1).D     = [0 0.01];
+            obj.paramBounds(1).DStar = [0 1];
+            obj.paramBounds(1).f     = [0 1];
+            obj.paramBounds(1).K     = [0 3];
+
+            % The "paramGuessCache" property is called instead of the dependent
+            % "paramGuess" property becuase validation does not need to be
+            % performed here...
+            obj.userParamGuessCache = struct('S0',1000,...
+                                             'D',0.001,...  units: mm^2/s
+                                             'DStar',0.01,...units: mm^2/s
+                                             'f',0.1,...
+                                             'K',1);
+
+        end %diffusion.diffusion
+
+    end
+
+
+    %------------------------------- Set Methods -------------------------------
+    methods
+
+        function set.useBayesianFit(obj,val)
+            validateattributes(val,{'logical'},{'scalar','nonempty'});
+            obj.useBayesianFit = val;
+            notify(obj,'updateModel');
+        end %diffusion.set.useBayesianFit
+
+    end %set methods
+
+
+    %------------------------------- Get Methods -------------------------------
+    methods
+
+        function val = get.plotFcn(obj)
+            val = obj.modelFcn;
+        end %diffusion.get.plotFcn
+
+        function val = get.yProc(obj)
+            val = obj.y;
+            if ~isempty(val)
+                val = val(obj.subset,:);
+            end
+        end %diffusion.get.yProc
+
+    end %get methods
+
+
+    %------------------------------ Other Methods ------------------------------
+    methods (Hidden)
+
+        function val = processGuess(obj,val)
+
+            % Only continue if "autoGuess" is enabled and y data exist
+            if ~obj.autoGuess || isempty(obj.y)
+                return
+            end
+
+            % Estimate S0 and D of each voxel from the log-linear regression of
+            % the mono-exponential decay. The remaining parameters (D*, f and K)
+            % cannot be estimated this way and are expanded to one guess per
+            % voxel
+            b      = obj.xProc;
+            y      = double( obj.yProc );
+            y      = log( max(y(:,:),eps) );
+            c      = [ones(numel(b),1) -b(:)]\y;
+            nVox   = size(c,2);
+            for p = obj.nlinParams
+                val.(p{1}) = repmat(val.(p{1})(1),[1 nVox]);
+            end
+            val.S0 = exp( c(1,:) );
+            val.D  = c(2,:);
+
+            % None of the parameters should be less than zero
+            val.S0(val.S0<0) = NaN;
+            val.D(val.D<0)   = NaN;
+
+        end %diffusion.processGuess
+
+    end %methods (Hidden)
+
+end %diffusion
\ No newline at end of file
@@ -0,0 +1,50 @@
+function calcsemiq(obj)
+%calcsemiq  Calculates all semi-quantitative parameters in a single pass
+%
+%   calcsemiq(OBJ) calculates the IAUC, bolus arrival time, TTP, enhancement,
+%   SER, and uptake and washout slopes of the dynamic (or sub-classed) object,
+%   OBJ, using the semiq_maps MEX file, which computes all curve features of
+%   every voxel in a single pass over the data. The computations are stored in
+%   the "results" property and are those of calciauc, calcpeak and calcslopes.
+%   The IAUC are computed by exact integration of the linearly interpolated
+%   curves rather than on the "tIntStep" grid.
+%
+%   See also calciauc, calcpeak, calcslopes
+
+    if ~obj.isReady.dynamic
+        return
+    end
+
+    % Initialize common variables
+    y    = obj.y;
+    mY   = size(y);
+    mOut = [mY(2:end) 1]; %add the trailing 1 to ensure that single data fits
+                           %don't error
+    yProc = obj.yProc;
+
+    % All features are computed in one pass over both series: the arrival and
+    % the peak information from the raw signal intensities (see calcpeak) and
+    % the slopes, anchored at the frame of that peak, and IAUC from the
+    % processed data (see calciauc and calcslopes)
+    s = semiq_maps(obj.x,double(yProc(:,:)),'Signal',double(y(:,:)),...
+                                            'Pre',obj.preInds,...
+                                            'Baseline',obj.preInds & obj.subset,...
+                                            'FirstPass',obj.firstPassInds,...
+                                            'Integrals',obj.tIntegral,...
+                                            'Start',obj.tIntStart);
+    obj.addresults('Arrival',reshape(s.Arrival,mOut));
+    obj.addresults('Enhancement',reshape(s.Enhancement,mOut));
+    obj.addresults('TTP',reshape(s.TTP,mOut));
+    obj.addresults('SER',reshape(s.SER,mOut));
+    obj.addresults('WashoutSlope',reshape(s.WashoutSlope,mOut));
+    obj.addresults('UptakeSlope',reshape(s.UptakeSlope,mOut));
+
+    % As with calciauc, the IAUC of maps are masked by "mapSubset"
+    if (numel(y)~=length(y))
+        s.IAUC(:,~obj.mapSubset(:)) = NaN;
+    end
+    for intIdx = 1:numel(obj.iaucParams)
+        obj.addresults(obj.iaucParams{intIdx},reshape(s.IAUC(intIdx,:),mOut));
+    end
+
+end %dynamic.calcsemiq
\ No newline at end of file
@@ -1,5 +1,18 @@
 classdef fspgrvfa < t1relaxometry
 
+    properties (AbortSet,SetObservable)
+
+        % Relative B1 map
+        %
+        %   "b1" is an array of relative B1 (actual/nominal flip angle) values
+        %   with one element per voxel of the "y" property. When specified, the
+        %   flip angles of each voxel are corrected by the initial guess and by
+        %   the native VFA map computations (see vfa_t1). Default: [] (nominal
+        %   flip angles)
+        b1 = [];
+
+    end
+
     properties (Dependent)
 
         % Function used for plotting the model
@@ -42,6 +55,20 @@ classdef fspgrvfa < t1relaxometry
     end
 
 
+    %------------------------------- Set Methods -------------------------------
+    methods
+
+        function set.b1(obj,val)
+            if ~isempty(val)
+                validateattributes(val,{'numeric'},{'nonnegative','real'});
+            end
+            obj.b1 = val;
+            notify(obj,'updateModel');
+        end %fspgrvfa.set.b1
+
+    end %set methods
+
+
     %------------------------------- Get Methods -------------------------------
     methods
 
@@ -86,6 +113,22 @@ classdef fspgrvfa < t1relaxometry
             
         end %fspgrvfa.processMapSubset
 
+        function val = processB1(obj)
+        %processB1  Relative B1 values of the voxels
+        %
+        %   B1 = processB1(OBJ) returns the "b1" property as a row vector when it
+        %   has one element per voxel of the "y" property and an empty array
+        %   otherwise (i.e., nominal flip angles)
+
+            val  = obj.b1;
+            mY   = size(obj.y);
+            if (numel(val)~=prod(mY(2:end)))
+                val = [];
+            end
+            val = double( reshape(val,1,[]) );
+
+        end %fspgrvfa.processB1
+
     end %methods (Hidden)
 
 
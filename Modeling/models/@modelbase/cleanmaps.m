@@ -12,6 +12,9 @@ function [yc,r2] = cleanmaps(obj,varargin)
 %   cleanmaps(...,'WaitBar',HWAIT) performs the operations described previously,
 %   using the waitbar handle, HWAIT, to graphically notify the user of the
 %   operation.
+%
+%   When the clean_maps MEX file is available, models with a native
+%   implementation (see voxel_fit) are cleaned by the MEX file
 
     % Parse the inputs and define the waitbar flag
     [r2,hWait,y,yc] = parse_inputs(obj,varargin{:});
@@ -28,6 +31,18 @@ function [yc,r2] = cleanmaps(obj,varargin)
     f         = obj.fitFcn;
     m         = size(yc);     %size of map data
     w         = floor(log2(max(m)));
+
+    % Native cleanup of the maps (see clean_maps)
+    args = nativeargs(obj);
+    if ~isempty(args)
+        [yc,r2] = clean_maps(yc,r2,'Threshold',obj.fitThresh,'Width',w,...
+                                                'Y',double(y),args{:});
+        if isWait && ishandle(hWait)
+            waitbar(1,hWait,'100% Complete');
+        end
+        return
+    end
+
     mW        = m(3)+w;
     r2Thresh  = obj.fitThresh;
     validErrs = {'MATLAB:eig:matrixWithNaNInf',...
@@ -192,6 +207,29 @@ function [yc,r2] = cleanmaps(obj,varargin)
 end %qt_models.cleanmaps
 
 
+%------------------------------
+function args = nativeargs(obj)
+%nativeargs  Model options of clean_maps
+%
+%   ARGS = nativeargs(OBJ) returns the cell array of the model, predictor,
+%   bounds and model constants options of clean_maps for the modeling object
+%   OBJ, or an empty array when the MEX file is unavailable or when the model
+%   or fitting algorithm of OBJ is not supported natively
+
+    args = {};
+    if (exist('clean_maps','file')~=3) ||...
+       ~any( strcmpi(obj.algorithm,{'levenberg-marquardt','trust-region-reflective'}) )
+        return
+    end
+    [model,limL,limU] = nativemodel(obj);
+    if isempty(model)
+        return
+    end
+    xData = obj.xProc;
+    args  = [{'Model',model{1},'X',xData(:),'LB',limL,'UB',limU} model(2:end)];
+
+end %nativeargs
+
 %-------------------------
 function B = fill_mat(A,w)
 
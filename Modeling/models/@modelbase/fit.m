@@ -11,6 +11,11 @@ function fit(obj,varargin)
 %       ===========================
 %       'WaitBar'       Handle to the wait bar used to display
 %                       parameter map computation progress
+%
+%       'OutputFile'    Name of a file to which the parameter maps are
+%                       streamed (slice by slice) during the computation,
+%                       bounding memory use by the size of a slice. See
+%                       fitmaps for the 'Source' and 'Residuals' options
 
 
     % Ensure fitting is prepared
@@ -42,9 +47,17 @@ function fit(obj,varargin)
         % Assign the R^2 value to the cache property for quick access later...
         obj.RSqCache = r2;
 
-        % Assign the values of the non-linear fitting to the "results" property
-        for idx = 1:numel(obj.nlinParams)
-            obj.addresults(obj.nlinParams{idx}, squeeze(yc(idx,:,:)) );
+        % Assign the values of the non-linear fitting to the "results" property.
+        % Streamed maps are read from the output file one map at a time
+        if isa(yc,'memmapfile')
+            for idx = 1:numel(obj.nlinParams)
+                obj.addresults(obj.nlinParams{idx},...
+                                   reshape(yc.Data.maps(:,idx),size(r2)) );
+            end
+        else
+            for idx = 1:numel(obj.nlinParams)
+                obj.addresults(obj.nlinParams{idx}, squeeze(yc(idx,:,:)) );
+            end
         end
 
     end
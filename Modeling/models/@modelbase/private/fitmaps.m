@@ -12,9 +12,39 @@ function [yc,r2] = fitmaps(obj,varargin)
 %   YC = fitmaps(OBJ,'WaitBar',H) performs fitting operations as described
 %   previously, but updates the wait bar specified by the handle H. This syntax
 %   provides a means of customizing the progress display.
+%
+%   [YC,R2] = fitmaps(OBJ,'OutputFile',FILE) streams the map computation: the
+%   data are fitted (and cleaned) one slice at a time and the parameter and R^2
+%   planes are written to the memory-mapped file FILE as they are computed. YC
+%   is a memmapfile object with the field "maps", an M-by-(N+1) array where M
+%   is the number of voxels, the columns of which are the parameter maps and
+%   the R^2 map, and R2 is the R^2 map. Additional options of this syntax are:
+%
+%       Option          Description
+%       ===========================
+%       'Source'        memmapfile object from which the response data are
+%                       read one slice at a time instead of the "yProc"
+%                       property. The first field of the mapped data must
+%                       have the size of "y" and contain the processed data
+%
+%       'Residuals'     Logical flag. When true, the residuals of each slice
+%                       are stored (compressed) in the exam container
+%                       [FILE '.qtx'] as the datasets "residuals/<slice>"
+%                       (requires qtx_write). Default: false
+%
+%   Peak memory of this syntax is that of one slice rather than of the exam.
+%
+%   Models with a native implementation are fitted on all cores by the MEX file
+%   of their engine (see nativefit below) instead of calling "fitFcn" for each
+%   voxel. Each model has a single native engine; when its MEX file is not
+%   available, "fitFcn" is used.
 
     % Parse the inputs
-    [hWait] = parse_inputs(obj,varargin{:});
+    [hWait,outFile,isRes,src] = parse_inputs(obj,varargin{:});
+    if ~isempty(outFile)
+        [yc,r2] = streammaps(obj,outFile,isRes,src,hWait);
+        return
+    end
 
     % Get some preliminary info. During this process the data stored in the "y"
     % and "guess" properties are reshaped into a 2D array so that the fitting
@@ -32,8 +62,12 @@ function [yc,r2] = fitmaps(obj,varargin)
     % data array, "y", from processing.
     yc( repmat(any(isnan(y),1),[nInds 1]) ) = NaN;
 
-    % Determines computation type
-    if (is_par<3) %serial computation
+    % Determines computation type. Models supported by the voxel_fit MEX file
+    % are fitted natively on all cores
+    nativeFcn = nativefit(obj);
+    if ~isempty(nativeFcn)
+        calcF = @nativecalc;
+    elseif (is_par<3) %serial computation
         calcF = @serialcalc;
     elseif (is_par==3) %paralell computation using Parallel Toolbox
         calcF = @parcalc;
@@ -102,6 +136,11 @@ function [yc,r2] = fitmaps(obj,varargin)
 
     end %serial_calc
 
+    % Native map calculation (see voxel_fit)
+    function [ycOut,r2Out] = nativecalc
+        [ycOut,r2Out] = nativeFcn(yc,y,1:size(y,2));
+    end %nativecalc
+
     % MATLAB Parallel map calculation
     function ycOut = parcalc
 
@@ -166,9 +205,311 @@ function varargout = parse_inputs(obj,varargin)
     % Initialize the input parser and setup the optional inputs
     parser = inputParser;
     parser.addParamValue('WaitBar',hWait,@ishandle)
+    parser.addParamValue('OutputFile','',@ischar)
+    parser.addParamValue('Residuals',false,@(x) islogical(x) || isnumeric(x))
+    parser.addParamValue('Source',[],@(x) isempty(x) || isa(x,'memmapfile'))
 
     % Parse the inputs and deal the outputs
     parser.parse(varargin{:});
-    varargout = struct2cell(parser.Results);
+    results   = parser.Results;
+    varargout = {results.WaitBar,results.OutputFile,...
+                 logical(results.Residuals),results.Source};
+
+end %parse_inputs
+
+
+%------------------------------------------------------------
+function [yc,r2] = streammaps(obj,fName,isRes,src,hWait)
+%streammaps  Out-of-core map computation
+%
+%   Slices (the first two spatial dimensions of "y") are read from the source,
+%   fitted and cleaned independently and the resulting planes are written to
+%   the memory-mapped output file, so that only one slice of the data, guesses
+%   and results is held in memory at any time
+
+    % Response data: either the memory-mapped source or the processed "y" data.
+    % Indexing the field of a memmapfile reads only the indexed elements
+    if isempty(src)
+        y    = obj.yProc;
+        mY   = size(y);
+        getY = @(vIdx) y(:,vIdx);
+    else
+        fmt  = src.Format;
+        mY   = fmt{1,2};
+        fld  = fmt{1,3};
+        getY = @(vIdx) double( src.Data(1).(fld)(:,vIdx) );
+    end
+    mY(end+1:3) = 1;
+    nVox        = prod(mY(2:end));
+    nSlVox      = prod(mY(2:3));
+    nSl         = nVox/nSlVox;
+    nParams     = numel(obj.nlinParams);
+
+    % Initial guesses and map subset. Guesses are either one value per
+    % parameter or one column per voxel
+    g = obj.paramGuess;
+    if isstruct(g)
+        g = cellfun(@(p) g.(p)(1),obj.nlinParams(:));
+    end
+    mask = obj.mapSubset;
+    if (numel(mask)~=nVox)
+        mask = true(1,nVox);
+    end
+
+    % Create the output file and map it
+    fid = fopen(fName,'w');
+    if (fid<0)
+        error(['QUATTRO:' mfilename ':fileOpenErr'],...
+              'Unable to create the output file %s.',fName);
+    end
+    fseek(fid,8*nVox*(nParams+1)-1,'bof');
+    fwrite(fid,0,'uint8');
+    fclose(fid);
+    yc = memmapfile(fName,'Format',{'double',[nVox nParams+1],'maps'},...
+                                                              'Writable',true);
+    if isRes
+        resFile = [fName '.qtx'];
+        if exist(resFile,'file')
+            delete(resFile);
+        end
+    end
+
+    % Slices are fitted in parallel when a pool is open
+    nWorkers = 0;
+    if (is_par==3)
+        nWorkers = matlabpool('size');
+    end
+    fitFcn    = obj.fitFcn;
+    nativeFcn = nativefit(obj);
+
+    for slIdx = 1:nSl
+
+        % Read the slice and exclude voxels outside the map subset or with
+        % NaN-valued data
+        vIdx  = (slIdx-1)*nSlVox+(1:nSlVox);
+        ySl   = getY(vIdx);
+        isFit = reshape(mask(vIdx),1,[]) & ~any(isnan(ySl),1);
+        if (size(g,2)==1)
+            gSl = repmat(g,[1 nSlVox]);
+        else
+            gSl = g(:,vIdx);
+        end
+        isFit = isFit & ~any(isnan(gSl),1);
+
+        % Fit the voxels
+        ycSl  = NaN(nParams,nSlVox);
+        r2Sl  = NaN(1,nSlVox);
+        resSl = zeros(size(ySl),'single');
+        if ~isempty(nativeFcn)
+            [ycSl(:,isFit),r2Sl(isFit),r] = nativeFcn(gSl(:,isFit),ySl(:,isFit),...
+                                                                  vIdx(isFit));
+            resSl(:,isFit)                = r;
+        else
+            parfor (idx = 1:nSlVox, nWorkers)
+                if ~isFit(idx)
+                    continue
+                end
+                ydata        = ySl(:,idx);
+                [x0,~,r]     = fitFcn(gSl(:,idx),ydata); %#ok
+                ycSl(:,idx)  = x0(:);
+                r2Sl(idx)    = modelmetrics.calcrsquared(ydata,r);
+                resSl(:,idx) = r(:);
+            end
+        end
+
+        % Clean up the slice and write the planes
+        [ycSl,r2Sl] = obj.cleanmaps(reshape(ySl,mY(1:3)),...
+                                    reshape(ycSl,[nParams mY(2:3)]),...
+                                    reshape(r2Sl,mY(2:3)));
+        yc.Data.maps(vIdx,:) = [reshape(ycSl,nParams,[])' r2Sl(:)];
+        if isRes
+            qtx_write(resFile,sprintf('residuals/%u',slIdx),...
+                                                 reshape(resSl,mY(1:3)));
+        end
+
+        % Update waitbar
+        if ~isempty(hWait)
+            if ~ishandle(hWait)
+                return %user cancelled
+            end
+            waitbar(slIdx/nSl,hWait,[num2str(slIdx/nSl*100) '% Complete']);
+        end
+
+    end
+
+    % Delete the waitbar
+    if ~isempty(hWait) && ishandle(hWait)
+        delete(hWait);
+    end
+
+    % Only the R^2 map is read back; the parameter maps remain on disk
+    r2 = reshape(yc.Data.maps(:,end),[mY(2:end) 1]);
+
+end %streammaps
+
+
+%------------------------------------------
+function fcn = nativefit(obj)
+%nativefit  Native fitting function of a model
+%
+%   FCN = nativefit(OBJ) returns a function handle of the form
+%   [P,R2,RES] = FCN(P0,Y,IDX) that fits all columns of Y, the voxels IDX of the
+%   "y" property (i.e., the columns of y(:,:)), using the native engine of the
+%   model, or an empty array when the MEX file of that engine is unavailable or
+%   when the model or fitting algorithm of OBJ is not supported natively. Each
+%   model has a single native engine:
+%
+%       Model                   Engine
+%       ==============================
+%       fspgrvfa_T1/R1          vfa_t1 (DESPOT1 and non-linear refinement)
+%
+%       multite, dwi            exp_fit (weighted log-linear regression)
+%
+%       multitr, fsevti_T1,     dict_fit (dictionary matching)
+%       fsevti_T1_flip
+%
+%       dwi_ivim, dwi_kurtosis  ivim_fit (segmented or Bayesian fit)
+%
+%       gkm2_ve, gkm2_kep,      voxel_fit (bounded Levenberg-Marquardt)
+%       gkm3_ve, gkm3_kep
+
+    fcn = [];
+    if ~any( strcmpi(obj.algorithm,{'levenberg-marquardt','trust-region-reflective'}) )
+        return
+    end
+    xData = obj.xProc;
+
+    % Bounds and native model constants are shared with cleanmaps and simulate
+    [args,limL,limU] = nativemodel(obj);
+
+    name = regexprep(class(obj),'.*\.','');
+    switch name
+
+        % VFA T1 maps are computed from the closed-form linear (DESPOT1)
+        % estimate, using the flip angles corrected by the B1 map, refined by a
+        % few non-linear iterations
+        case {'fspgrvfa_T1','fspgrvfa_R1'}
+            if (exist('vfa_t1','file')~=3)
+                return
+            end
+            tr     = obj.tr;
+            b1     = obj.processB1;
+            isRate = strcmp(name,'fspgrvfa_R1');
+            if isempty(b1)
+                fcn = @(x0,y,~) vfafit(xData(:),y,tr,isRate,x0,limL,limU,[]);
+            else
+                fcn = @(x0,y,idx) vfafit(xData(:),y,tr,isRate,x0,limL,limU,b1(idx));
+            end
+
+        % Mono-exponential T2 maps are computed in one pass by the weighted
+        % log-linear regression of exp_fit
+        case 'multite'
+            if (exist('exp_fit','file')==3)
+                fcn = @(x0,y,~) exp_fit(xData(:),y);
+            end
+
+        % Relaxometry models with a single relaxation time are matched with a
+        % precomputed signal dictionary and refined by a few Gauss-Newton
+        % steps. Magnitude VTI data (i.e., without polarity correction) are
+        % fitted after restoring the polarity as in restore_ir
+        case 'multitr'
+            if (exist('dict_fit','file')==3)
+                te     = obj.te;
+                isRate = (obj.modelVal==2);
+                fcn    = @(x0,y,~) dictfit('multi_tr',xData(:),y,isRate,'TE',te);
+            end
+        case {'fsevti_T1','fsevti_T1_flip'}
+            if (exist('dict_fit','file')==3)
+                model = 'fse_vti';
+                if strcmp(name,'fsevti_T1_flip')
+                    model = 'ir'; %three parameter model with the inversion FA
+                end
+                isMag = ~obj.usePolarityCorrection;
+                fcn   = @(x0,y,~) dict_fit(model,xData(:),y,'Polarity',isMag);
+            end
+
+        % ADC maps are computed by the log-linear regression of exp_fit. The
+        % full IVIM model is fitted by segments (see ivim_fit), adding the
+        % kurtosis to the high b-value segment, and the kurtosis model (D*=0)
+        % by a kurtosis mono-exponential fit of all b-values. The segmented
+        % fits are optionally refined with shared (Bayesian) priors
+        case 'dwi'
+            if (exist('exp_fit','file')==3)
+                fcn = @(x0,y,~) exp_fit(xData(:),y,'Rate',true);
+            end
+        case 'dwi_ivim'
+            if (exist('ivim_fit','file')==3)
+                isBayes = obj.useBayesianFit;
+                fcn     = @(x0,y,~) ivimfit(xData(:),y,1:5,'Kurtosis',true,...
+                                                              'Bayesian',isBayes);
+            end
+        case 'dwi_kurtosis'
+            if (exist('ivim_fit','file')==3)
+                isBayes = obj.useBayesianFit;
+                fcn     = @(x0,y,~) ivimfit(xData(:),y,[1 2 5],'Perfusion',false,...
+                                            'Kurtosis',true,'Bayesian',isBayes);
+            end
+
+        % Kinetic models are fitted by voxel_fit using the native model and
+        % constants of the class (see nativemodel)
+        case {'gkm2_ve','gkm2_kep','gkm3_ve','gkm3_kep'}
+            if (exist('voxel_fit','file')==3)
+                fcn = @(x0,y,~) voxel_fit(args{1},xData(:),y,x0,limL,limU,args{2:end});
+            end
+
+    end
+
+end %nativefit
+
+
+%------------------------------------------
+function [p,r2,res] = vfafit(fa,y,tr,isRate,x0,limL,limU,b1)
+%vfafit  VFA T1 (or R1 in 1/s for a TR in ms) maps computed by vfa_t1. Voxels
+%   without a linear estimate are refined from the guesses X0
+
+    % R1 guesses and bounds are converted to T1
+    x0 = double(x0);
+    if isRate
+        x0(2,:) = 1000./x0(2,:);
+        if ~isempty(limL)
+            [limL(2),limU(2)] = deal(1000/limU(2),1000/limL(2));
+        end
+    end
+    opts = {'Iterations',10,'Guess',x0};
+    if ~isempty(limL)
+        opts(end+1:end+4) = {'LB',limL,'UB',limU};
+    end
+    if ~isempty(b1)
+        opts(end+1:end+2) = {'B1',b1};
+    end
+
+    [p,r2,res] = vfa_t1(fa,y,tr,opts{:});
+    if isRate
+        p(2,:) = 1000./p(2,:);
+    end
+
+end %vfafit
+
+
+%------------------------------------------
+function [p,r2,res] = dictfit(model,x,y,isRate,varargin)
+%dictfit  Dictionary fit of a relaxation time (or rate) computed by dict_fit
+
+    [p,r2,res] = dict_fit(model,x,y,varargin{:});
+    if isRate
+        p(2,:) = 1./p(2,:);
+    end
+
+end %dictfit
+
+
+%------------------------------------------
+function [p,r2,res] = ivimfit(b,y,rows,varargin)
+%ivimfit  Segmented IVIM fit computed by ivim_fit, returning the parameters
+%   (rows of [S0;D;D*;f;K]) of the "nlinParams" of the dwi_ivim or dwi_kurtosis
+%   class
+
+    [p,r2,res] = ivim_fit(b,y,varargin{:});
+    p          = p(rows,:);
 
-end %parse_inputs
\ No newline at end of file
+end %ivimfit
\ No newline at end of file
@@ -0,0 +1,35 @@
+function [args,limL,limU] = nativemodel(obj)
+%nativemodel  Native model name, constants and bounds of a modeling object
+%
+%   ARGS = nativemodel(OBJ) returns the cell array {MODEL,'NAME1',VAL1,...} of
+%   the model name and model constants used by the voxel_fit and sim_fit MEX
+%   files for the modeling object OBJ, or an empty array when the model is not
+%   supported natively. These mirror the "modelFcn" property of each class
+%
+%   [ARGS,LB,UB] = nativemodel(OBJ) also returns the lower and upper bounds of
+%   the "nlinParams" used by the native engines. As with the "fitFcn" property,
+%   bounds are ignored (empty) by the Levenberg-Marquardt algorithm
+
+    [limL,limU] = deal([]);
+    if ~strcmpi(obj.algorithm,'levenberg-marquardt')
+        limL = cellfun(@(x) obj.paramBounds.(x)(1),obj.nlinParams);
+        limU = cellfun(@(x) obj.paramBounds.(x)(2),obj.nlinParams);
+    end
+
+    args = {};
+    name = regexprep(class(obj),'.*\.','');
+    switch name
+        case 'multite'
+            args = {'multi_te'};
+        case 'fspgrvfa_T1'
+            args = {'fspgr_vfa','TR',obj.tr};
+        case 'fsevti_T1'
+            if obj.usePolarityCorrection
+                args = {'fse_vti'};
+            end
+        case {'gkm2_ve','gkm2_kep','gkm3_ve','gkm3_kep'}
+            vif  = obj.vifProc;
+            args = {name,'VIF',vif(:),'Hct',obj.hctArt};
+    end
+
+end %nativemodel
\ No newline at end of file
@@ -1,24 +1,115 @@
-function simulate(obj,varargin)
+function [imOut,bias,sd] = simulate(obj,varargin)
 %simulate  Simulates the specified modeling object
 %
-%   simulate(OBJ,POS,PARAMS) generates a simulated model output for the modeling
+%   IM = simulate(OBJ,POS,PARAMS) generates a simulated model output for the modeling
 %   object OBJ where POS specifies the [HEIGHT WIDTH] of the grid squares and
-%   PARAMS is a cell 
+%   PARAMS is a cell array containing the vectors of values of each non-linear
+%   model parameter (in the order of "nlinParams"). The model is evaluated at
+%   the "xProc" values for every combination of parameter values (see ndgrid)
+%   and each combination fills one HEIGHT-by-WIDTH square of IM, an array of
+%   size [numel(xProc) HEIGHT*N1 WIDTH*N2 N3 ...], where N1, N2, ... are the
+%   numbers of values of each parameter.
+%
+%   [IM,BIAS,SD] = simulate(...) also fits every voxel of the squares and returns
+%   structures, with one field per non-linear parameter, of the bias (mean
+%   fitted minus true value) and the standard deviation of the fits of each
+%   parameter combination. This requires the sim_fit MEX file and a model that
+%   is supported natively (see voxel_fit). As with "fit", every fit starts from
+%   the "paramGuess" (for maps, the median guess) and is constrained by the
+%   "paramBounds" of OBJ, unless the Levenberg-Marquardt algorithm is used.
+%
+%   [...] = simulate(...,'Noise',SIG,'Seed',SEED) adds noise with standard
+%   deviation SIG (default: 0) to the signal of each voxel. Each voxel of a
+%   square is an independent realization and the counter-based generator
+%   reproduces the same noise for the same (non-negative integer) seed SEED
+%   (default: 0). Without noise, IM holds the (signed) model values.
+%
+%   [...] = simulate(...,'Distribution',DIST) specifies the noise distribution,
+%   'rician' (magnitude data) or 'gaussian'. The default is 'gaussian' for
+%   signed models (polarity corrected VTI signals and the concentration curves
+%   of kinetic models) and 'rician' otherwise.
 
     % Parse the inputs
-    [gPos,params] = parse_inputs(varargin{:});
+    [gPos,params,noise,seed,dist] = parse_inputs(varargin{:});
+    gPos = gPos(:)';
 
     % Create the parameter arrays
     [paramGrid{1:numel(params)}] = ndgrid(params{:});
+    gSize = size(paramGrid{1});
+    p     = cell2mat( cellfun(@(x) x(:)',paramGrid(:),'UniformOutput',false) );
+    nRep  = prod(gPos);
+    x     = obj.xProc;
+
+    % Signed models are simulated with Gaussian noise by default
+    [args,limL,limU] = nativemodel(obj);
+    if isempty(dist)
+        dist = 'rician';
+        if ~isempty(args) && (strcmp(args{1},'fse_vti') || strncmp(args{1},'gkm',3))
+            dist = 'gaussian';
+        end
+    end
 
-    % For each of the paramter values, calculate the resulting model value
-    imOut = repmat(0*paramGrid{1},gPos);
-    for paramIdx = 1:numel(paramGrid{1})
+    % For each of the paramter values, calculate the resulting model value.
+    % sim_fit simulates (and fits) all voxels on all cores
+    isFit = (nargout>1);
+    if ~isempty(args) && (exist('sim_fit','file')==3)
+        [bias,sd,y] = sim_fit(args{1},x(:),p,args{2:end},'Noise',noise,...
+                                                          'Distribution',dist,...
+                                                          'Replicates',nRep,...
+                                                          'Seed',seed,...
+                                                          'Guess',simguess(obj),...
+                                                          'LB',limL,'UB',limU,...
+                                                          'Fit',isFit);
+    elseif isFit
+        error(['QUATTRO:' mfilename ':missingMex'],...
+              'Fitting simulated data requires sim_fit and a native model.');
+    else
+        f = obj.modelFcn;
+        y = zeros(numel(x),nRep,size(p,2));
+        for paramIdx = 1:size(p,2)
+            y(:,:,paramIdx) = repmat(reshape(f(p(:,paramIdx),x),[],1),[1 nRep]);
+        end
+        if noise && strcmp(dist,'rician')
+            y = addmrinoise(y,noise,seed);
+        elseif noise && (exist('mr_noise','file')==3)
+            y = mr_noise(y,noise,'Seed',seed,'Distribution',dist);
+        elseif noise
+            y = y+noise*randn(size(y));
+        end
+    end
+
+    % Arrange the replicates of each parameter combination in a square
+    y     = reshape(y,[numel(x) gPos gSize]);
+    imOut = permute(y,[1 2 4 3 5:ndims(y)]);
+    imOut = reshape(imOut,[numel(x) gPos.*gSize(1:2) gSize(3:end)]);
+
+    % Deal the parameter maps
+    if isFit
+        bias = cell2struct( cellfun(@(b) reshape(b,gSize),num2cell(bias,2),...
+                                    'UniformOutput',false),obj.nlinParams(:),1 );
+        sd   = cell2struct( cellfun(@(s) reshape(s,gSize),num2cell(sd,2),...
+                                    'UniformOutput',false),obj.nlinParams(:),1 );
     end
 
 end %modelbase.simulate
 
 
+%-----------------------------
+function x0 = simguess(obj)
+
+    % The guess of single data is a structure of scalars and that of maps an
+    % N-by-M array of (possibly auto-guessed) values; every simulated voxel
+    % starts from the same guess
+    g = obj.paramGuess;
+    if isstruct(g)
+        x0 = cellfun(@(x) g.(x)(1),obj.nlinParams(:));
+    else
+        x0 = median(g,2);
+    end
+
+end %simguess
+
+
 %------------------------------------------
 function varargout = parse_inputs(varargin)
 
@@ -26,10 +117,18 @@ function varargout = parse_inputs(varargin)
     parser = inputParser;
     parser.addRequired('gridSize',@check_grid)
     parser.addRequired('params',@check_params);
+    parser.addParamValue('Noise',0,@check_noise);
+    parser.addParamValue('Seed',0,@check_seed);
+    parser.addParamValue('Distribution','',@check_dist);
 
     % Parse the inputs and deal the outputs
     parser.parse(varargin{:});
-    varargout = struct2cell(parser.Results);
+    results   = parser.Results;
+    dist      = results.Distribution;
+    if ~isempty(dist)
+        dist = validatestring(dist,{'rician','gaussian'});
+    end
+    varargout = {results.gridSize,results.params,results.Noise,results.Seed,dist};
 
 end %parse_inputs
 
@@ -50,4 +149,22 @@ function tf = check_params(p)
                                                             'real','nonempty'});
     end
 
-end %check_params
\ No newline at end of file
+end %check_params
+
+%---------------------------
+function tf = check_noise(x)
+    tf = true;
+    validateattributes(x,{'numeric'},{'scalar','nonnegative','finite','real'});
+end %check_noise
+
+%--------------------------
+function tf = check_dist(x)
+    tf = true;
+    validatestring(x,{'rician','gaussian'});
+end %check_dist
+
+%--------------------------
+function tf = check_seed(x)
+    tf = true;
+    validateattributes(x,{'numeric'},{'scalar','nonnegative','integer'});
+end %check_seed
\ No newline at end of file
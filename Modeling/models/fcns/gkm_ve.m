@@ -40,10 +40,14 @@ function ydata = gkm_ve(x,xdata,vif,hct)
     % Impulse function (see A. Jackson, pg. 83). Note that the factor (i.e.,
     % diff(...)) in front of the convolution comes from the need to normalize
     % the discrete convolution operation by the potentially non-unity time
-    % increments
-    H = diff(xdata(1:2)) * conv(vif, x(1)*exp(-x(1)/(x(2)+eps) * xdata));
+    % increments. The convolution with the exponential kernel is computed
+    % recursively by FILTER in O(N) operations; the result is identical to
+    % CONV(VIF,X(1)*EXP(-KEP*XDATA)) truncated to the length of XDATA
+    dt    = diff(xdata(1:2));
+    kep   = x(1)/(x(2)+eps);
+    H     = dt * x(1)*exp(-kep*xdata(1)) * filter(1,[1 -exp(-kep*dt)],vif);
 
     % equation (9)
-    ydata = (x(3)*vif + H(1:length(xdata)))/(1-hct);
+    ydata = (x(3)*vif + H)/(1-hct);
 
 end %gkm_ve
\ No newline at end of file
@@ -10,15 +10,25 @@ function varargout = regress_gp(t,y,n,hyp)
 %
 %   [t* f* hyp] = regress_gp(...) performs Gaussian process regression
 %   returning the optimized hyperparameters.
+%
+%   When the gp_fit MEX file is available, the hyperparameters are estimated
+%   using analytic gradients of the marginal likelihood and the predictions
+%   are computed from a single Cholesky factorization.
 
 if ~exist('hyp','var')
     hyp = [];
 end
+useMex = (exist('gp_fit','file')==3);
 
 % opts = optimset('MaxFunEvals',3000,'MaxIter',3000,...
 %               'PlotFcns',{@optimplotx,@optimplotfval,@optimplotfunccount});
 opts = optimset('MaxFunEvals',3000,'MaxIter',3000);
-if isempty(hyp)
+if useMex && isempty(hyp)
+    [~,f_min] = gp_fit(t,y,[],'Kernel','ad','Hyperparameters',[16 1 1]);
+elseif useMex && (length(hyp)==1) && all(~isinf(hyp))
+    [~,f_min] = gp_fit(t,y,[],'Kernel','se','Hyperparameters',[hyp 5 50],...
+                                            'Optimize',[false true true]);
+elseif isempty(hyp)
     f = @(x) -GPobjFctn(y,t,x,'ad');
     f_min = fminsearch(f,[16 1 1],opts);
 elseif length(hyp)==1 && all(~isinf(hyp))
@@ -41,16 +51,22 @@ else
     f_min = hyp;
 end
 
-K = cov_gp(t,t,f_min,'se');
+if ~useMex
+    K = cov_gp(t,t,f_min,'se');
+end
 if exist('n','var') && ~isempty(n)
     t_new = linspace(t(1),t(end),n);
 else
     t_new = t;
 end
 
-for i = 1:length(t_new)
-    K_star = cov_gp(t_new(i),t,f_min,'se');
-    y_new(i) = gpr(K,K_star,y);
+if useMex
+    y_new = transpose( gp_fit(t,y,t_new,'Hyperparameters',f_min,'Optimize',false) );
+else
+    for i = 1:length(t_new)
+        K_star = cov_gp(t_new(i),t,f_min,'se');
+        y_new(i) = gpr(K,K_star,y);
+    end
 end
 
 if nargout==1
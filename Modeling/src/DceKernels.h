@@ -0,0 +1,129 @@
+/*
+ *	DceKernels.h
+ *
+ *	General kinetic (Tofts) model kernels. The tissue concentration
+ *
+ *		Ct(t) = (vp*Cp(t) + Ktrans*(Cp*exp(-kep*t))(t))/(1-Hct)
+ *
+ *	is evaluated, with its derivatives, using the recursive form of the
+ *	exponential convolution. With S(k) the discrete convolution at sample
+ *	k, S(k) = S(k-1)*exp(-kep*(t(k)-t(k-1))) + w(k)*Cp(k), so a curve costs
+ *	O(N) operations instead of the O(N^2) of conv. For uniformly sampled
+ *	data the result is identical to that of gkm_ve.m and gkm_kep.m (w is
+ *	the sampling interval and the kernel starts at t(1)); non-uniform
+ *	sampling uses the forward interval of each sample as its weight.
+ *
+ *	Curves of W voxels are evaluated at once with the voxel as the fastest
+ *	varying index, so that the recursion of all voxels advances in the same
+ *	(vectorizable) loop over the lanes.
+ */
+
+
+#ifndef DCEKERNELS_H
+#define DCEKERNELS_H
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+
+class DceKernel{
+
+ public:
+
+	/*
+	 *	DceKernel()
+	 *
+	 *	Creates the kernel of the n acquisition times t and vascular input
+	 *	function vif, with the hematocrit hct
+	 */
+	DceKernel(const double* t, const double* vif, size_t n, double hct) :
+		vif(vif, vif+n), weights(n), intervals(n, 0.0), n(n), t0(n ? t[0] : 0), scale(1/(1-hct)), isUniform(true)
+	{
+		for(size_t k=1; k<n; k++) {
+			intervals[k] = t[k]-t[k-1];
+			isUniform	 = isUniform && (std::abs(intervals[k]-intervals[1])<=1e-9*std::abs(intervals[1]));
+		};
+		for(size_t k=0; k<n; k++) {
+			weights[k] = (k+1<n) ? intervals[k+1] : ((n>1) ? intervals[k] : 0.0);
+		};
+		if( isUniform ) {
+			std::fill(weights.begin(), weights.end(), (n>1) ? intervals[1] : 0.0);
+		};
+	};
+
+	size_t GetNumberOfSamples() const { return n; };
+
+	/*
+	 *	Evaluate()
+	 *
+	 *	Evaluates the curves of W voxels with the parameters Ktrans, kep and
+	 *	vp (W values each). ct receives the n-by-W curves and, when not
+	 *	null, dK and dKep (and dVp, when not null) the n-by-W derivatives
+	 *	with respect to each parameter (lane-major layout, index k*W+lane)
+	 */
+	template <unsigned int W>
+	void Evaluate(const double* ktrans, const double* kep, const double* vp, double* ct,
+				  double* dK=0, double* dKep=0, double* dVp=0) const
+	{
+		if( n==0 ) {
+			return;
+		};
+		double s[W], d[W], e[W], b[W], a[W];
+		for(unsigned int w=0; w<W; w++) {
+			b[w] = std::exp(-kep[w]*t0)*scale;
+			a[w] = ktrans[w]*b[w];
+			e[w] = std::exp(-kep[w]*intervals[(n>1) ? 1 : 0]);
+			s[w] = weights[0]*vif[0];
+			d[w] = 0;
+		};
+		const bool isGradient = (dK!=0);
+		for(size_t k=0; k<n; k++) {
+			if( k>0 ) {
+				if( !isUniform ) {
+					for(unsigned int w=0; w<W; w++) {
+						e[w] = std::exp(-kep[w]*intervals[k]);
+					};
+				};
+				const double wv = weights[k]*vif[k];
+				const double dt = intervals[k];
+				for(unsigned int w=0; w<W; w++) {
+					d[w] = (d[w]-dt*s[w])*e[w];
+					s[w] = s[w]*e[w]+wv;
+				};
+			};
+			const double cp = vif[k]*scale;
+			for(unsigned int w=0; w<W; w++) {
+				ct[k*W+w] = vp[w]*cp+a[w]*s[w];
+			};
+			if( isGradient ) {
+				for(unsigned int w=0; w<W; w++) {
+					dK[k*W+w]	= b[w]*s[w];
+					dKep[k*W+w] = a[w]*(d[w]-t0*s[w]);
+				};
+				if( dVp ) {
+					for(unsigned int w=0; w<W; w++) {
+						dVp[k*W+w] = cp;
+					};
+				};
+			};
+		};
+	};
+
+
+ private:
+
+	std::vector<double>	vif;
+	std::vector<double>	weights;	/*	convolution weight of each sample	*/
+	std::vector<double>	intervals;	/*	t(k)-t(k-1)	*/
+	size_t				n;
+	double				t0;
+	double				scale;		/*	1/(1-hct)	*/
+	bool				isUniform;
+};
+
+
+#endif
@@ -0,0 +1,337 @@
+/*
+ *	Despot1.h
+ *
+ *	Variable flip angle (DESPOT1) T1 engine used by vfa_t1. The spoiled
+ *	gradient echo signal S(a) = S0*sin(a)*(1-E1)/(1-cos(a)*E1), E1 =
+ *	exp(-TR/T1), is linear in the transformed variables S/tan(a) and
+ *	S/sin(a) (R Gupta, J Magn Reson 1977;25:231-235, see fspgr_vfa_ols.m):
+ *
+ *		S/sin(a) = E1*S/tan(a) + S0*(1-E1)
+ *
+ *	so the regression sums of every voxel give a closed-form estimate of S0
+ *	and T1. When a B1 map is given, the nominal flip angles are scaled by
+ *	the relative B1 of each voxel. The linear estimate can be refined by a
+ *	few damped Gauss-Newton iterations of the non-linear model, which start
+ *	from a guess where no linear estimate exists and keep the parameters
+ *	within optional bounds.
+ *
+ *	Voxels are processed in blocks with the voxel as the fastest varying
+ *	index of all accumulators, so that the sums and the refinement of a
+ *	block are computed by the same (vectorizable) inner loops.
+ */
+
+
+#ifndef DESPOT1_H
+#define DESPOT1_H
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+
+class Despot1{
+
+ public:
+
+	/*	Number of voxels processed together	*/
+	static const size_t blockSize = 64;
+
+	/*
+	 *	Despot1()
+	 *
+	 *	Creates the engine for the n flip angles fa (degrees) and the
+	 *	repetition time tr. T1 is returned in the units of tr
+	 */
+	Despot1(const double* fa, size_t n, double tr) : angles(fa, fa+n), n(n), tr(tr), nIterations(0),
+		s0Min(-std::numeric_limits<double>::infinity()), s0Max(std::numeric_limits<double>::infinity()),
+		e1Min(1e-12), e1Max(1-1e-12)
+	{
+		const double deg = std::atan(1.0)/45;
+		for(size_t k=0; k<n; k++) {
+			angles[k] *= deg;
+		};
+	};
+
+	/*	Number of non-linear refinement iterations (0 for the linear estimate)	*/
+	void SetIterations(unsigned int value) { nIterations = value; };
+
+	/*
+	 *	SetBounds()
+	 *
+	 *	Limits the estimates of S0 and T1 to [lower[0],upper[0]] and
+	 *	[lower[1],upper[1]], respectively. Since E1 increases with T1, the T1
+	 *	bounds are applied as bounds of E1
+	 */
+	void SetBounds(const double* lower, const double* upper)
+	{
+		s0Min = lower[0];
+		s0Max = upper[0];
+		e1Min = std::max((lower[1]>0) ? std::exp(-tr/lower[1]) : 0.0, 1e-12);
+		e1Max = std::min((upper[1]>0) ? std::exp(-tr/upper[1]) : 0.0, 1-1e-12);
+	};
+
+	/*
+	 *	Fit()
+	 *
+	 *	Estimates S0 and T1 of nVoxels voxels. The n signals of voxel v start
+	 *	at y[v*n] and b1, when not null, holds the relative B1 of each voxel.
+	 *	guess, when not null, holds the S0 and T1 (2-by-nVoxels) from which
+	 *	the refinement of voxels without a linear estimate starts. p receives
+	 *	S0 and T1 of each voxel (2-by-nVoxels), r2 the R^2 of the model and
+	 *	res, when not null, the residuals (model minus data). Voxels with
+	 *	non-finite or zero signals, or for which no valid estimate exists, are
+	 *	NaN.
+	 */
+	void Fit(const double* y, const double* b1, const double* guess, size_t nVoxels,
+			 double* p, double* r2, double* res) const
+	{
+		const double nan = std::numeric_limits<double>::quiet_NaN();
+		std::vector<double> s(n*blockSize), c(n*blockSize), yBlock(n*blockSize), f(n*blockSize);
+		for(size_t first=0; first<nVoxels; first+=blockSize) {
+			const size_t nBlock = std::min(blockSize, nVoxels-first);
+			Block block;
+
+			/*	Gather the signals and effective flip angles (lane-major)	*/
+			for(size_t k=0; k<n; k++) {
+				for(size_t w=0; w<blockSize; w++) {
+					const size_t v = first+std::min(w, nBlock-1);
+					const double a = angles[k]*(b1 ? b1[v] : 1.0);
+					yBlock[k*blockSize+w] = y[v*n+k];
+					s[k*blockSize+w]	  = std::sin(a);
+					c[k*blockSize+w]	  = std::cos(a);
+				};
+			};
+			for(size_t w=0; w<blockSize; w++) {
+				const size_t v = first+std::min(w, nBlock-1);
+				block.isGuess[w] = guess && std::isfinite(guess[2*v]) && (guess[2*v+1]>0);
+				block.s0Guess[w] = block.isGuess[w] ? guess[2*v] : 1;
+				block.e1Guess[w] = block.isGuess[w] ? std::exp(-tr/guess[2*v+1]) : 0.99;
+			};
+			EstimateLinear(&yBlock[0], &s[0], &c[0], block);
+			Refine(&yBlock[0], &s[0], &c[0], block, &f[0]);
+
+			/*	Write the results	*/
+			for(size_t w=0; w<nBlock; w++) {
+				const size_t v	 = first+w;
+				const bool	 isOk = block.isValid[w];
+				p[2*v]	 = isOk ? block.s0[w] : nan;
+				p[2*v+1] = isOk ? block.t1[w] : nan;
+				r2[v]	 = isOk ? 1-block.cost[w]/block.ssTot[w] : nan;
+				if( res ) {
+					for(size_t k=0; k<n; k++) {
+						res[v*n+k] = isOk ? f[k*blockSize+w]-yBlock[k*blockSize+w] : nan;
+					};
+				};
+			};
+		};
+	};
+
+
+ private:
+
+	std::vector<double>	angles;		/*	nominal flip angles (radians)	*/
+	size_t				n;
+	double				tr;
+	unsigned int		nIterations;
+	double				s0Min, s0Max;	/*	bounds of S0	*/
+	double				e1Min, e1Max;	/*	bounds of E1 (i.e., of T1)	*/
+
+	/*	Estimates of a block of voxels	*/
+	struct Block{
+		double s0[blockSize];
+		double t1[blockSize];
+		double cost[blockSize];		/*	residual sum of squares	*/
+		double ssTot[blockSize];	/*	total sum of squares	*/
+		bool   isData[blockSize];	/*	finite, non-zero signals	*/
+		bool   isValid[blockSize];
+		double s0Guess[blockSize];	/*	start of voxels without a linear estimate	*/
+		double e1Guess[blockSize];
+		bool   isGuess[blockSize];
+	};
+
+	/*
+	 *	EstimateLinear()
+	 *
+	 *	Closed-form least squares solution of the linearized model
+	 */
+	void EstimateLinear(const double* y, const double* s, const double* c, Block &block) const
+	{
+		double sx[blockSize], sy[blockSize], sxx[blockSize], sxy[blockSize], sm[blockSize];
+		std::fill(sx, sx+blockSize, 0.0);
+		std::fill(sy, sy+blockSize, 0.0);
+		std::fill(sxx, sxx+blockSize, 0.0);
+		std::fill(sxy, sxy+blockSize, 0.0);
+		std::fill(sm, sm+blockSize, 0.0);
+		std::fill(block.isData, block.isData+blockSize, true);
+		for(size_t k=0; k<n; k++) {
+			for(size_t w=0; w<blockSize; w++) {
+				const double yk = y[k*blockSize+w];
+				const double xi = yk*c[k*blockSize+w]/s[k*blockSize+w];	/*	S/tan(a)	*/
+				const double yi = yk/s[k*blockSize+w];						/*	S/sin(a)	*/
+				sx[w]  += xi;
+				sy[w]  += yi;
+				sxx[w] += xi*xi;
+				sxy[w] += xi*yi;
+				sm[w]  += yk;
+				block.isData[w] = block.isData[w] && (yk!=0) && std::isfinite(yi) && std::isfinite(xi);
+			};
+		};
+		for(size_t w=0; w<blockSize; w++) {
+			const double m = (n*sxy[w]-sx[w]*sy[w])/(n*sxx[w]-sx[w]*sx[w]);	/*	E1	*/
+			const double b = (sy[w]-m*sx[w])/n;								/*	S0*(1-E1)	*/
+			block.s0[w]		 = b/(1-m);
+			block.t1[w]		 = -tr/std::log(m);
+			block.isValid[w] = block.isData[w] && (m>0) && (m<1) && std::isfinite(block.s0[w]);
+			sm[w] /= n;
+		};
+
+		/*	Total sum of squares for R^2	*/
+		std::fill(block.ssTot, block.ssTot+blockSize, 0.0);
+		for(size_t k=0; k<n; k++) {
+			for(size_t w=0; w<blockSize; w++) {
+				const double d = y[k*blockSize+w]-sm[w];
+				block.ssTot[w] += d*d;
+			};
+		};
+	};
+
+	/*	Model values and, when not null, derivatives with respect to S0 and E1	*/
+	void Evaluate(const double* s, const double* c, const double* s0, const double* e1,
+				  double* f, double* dS0, double* dE1) const
+	{
+		for(size_t k=0; k<n; k++) {
+			for(size_t w=0; w<blockSize; w++) {
+				const size_t idx = k*blockSize+w;
+				const double d	 = 1/(1-c[idx]*e1[w]);
+				f[idx] = s0[w]*s[idx]*(1-e1[w])*d;
+				if( dS0 ) {
+					dS0[idx] = s[idx]*(1-e1[w])*d;
+					dE1[idx] = s0[w]*s[idx]*(c[idx]-1)*d*d;
+				};
+			};
+		};
+	};
+
+	void GetCost(const double* y, const double* f, double* cost) const
+	{
+		std::fill(cost, cost+blockSize, 0.0);
+		for(size_t k=0; k<n; k++) {
+			for(size_t w=0; w<blockSize; w++) {
+				const double r = f[k*blockSize+w]-y[k*blockSize+w];
+				cost[w] += r*r;
+			};
+		};
+	};
+
+	/*
+	 *	Refine()
+	 *
+	 *	Damped Gauss-Newton iterations in the parameters S0 and E1, starting
+	 *	from the linear estimate (or, when the linear estimate is invalid,
+	 *	from the guess or from E1=0.99 and the least squares S0). Estimates
+	 *	are kept within the bounds. Steps that do not reduce the residual sum
+	 *	of squares are rejected and the damping of the voxel increased. The
+	 *	model values of the final estimates are returned in f.
+	 */
+	void Refine(const double* y, const double* s, const double* c, Block &block, double* f) const
+	{
+		double s0[blockSize], e1[blockSize], lambda[blockSize];
+		for(size_t w=0; w<blockSize; w++) {
+			s0[w]	  = block.isValid[w] ? block.s0[w] : block.s0Guess[w];
+			e1[w]	  = block.isValid[w] ? std::exp(-tr/block.t1[w]) : block.e1Guess[w];
+			s0[w]	  = std::min(std::max(s0[w], s0Min), s0Max);
+			e1[w]	  = std::min(std::max(e1[w], e1Min), e1Max);
+			lambda[w] = 1e-3;
+		};
+		Evaluate(s, c, s0, e1, f, 0, 0);
+		if( nIterations>0 ) {
+			double sfy[blockSize], sff[blockSize];
+			std::fill(sfy, sfy+blockSize, 0.0);
+			std::fill(sff, sff+blockSize, 0.0);
+			for(size_t k=0; k<n; k++) {
+				for(size_t w=0; w<blockSize; w++) {
+					sfy[w] += f[k*blockSize+w]*y[k*blockSize+w];
+					sff[w] += f[k*blockSize+w]*f[k*blockSize+w];
+				};
+			};
+			for(size_t w=0; w<blockSize; w++) {
+				if( !block.isValid[w] && !block.isGuess[w] ) {
+					s0[w] = std::min(std::max(s0[w]*sfy[w]/sff[w], s0Min), s0Max);
+				};
+			};
+			Evaluate(s, c, s0, e1, f, 0, 0);
+		};
+		GetCost(y, f, block.cost);
+		if( nIterations==0 ) {
+			for(size_t w=0; w<blockSize; w++) {
+				block.s0[w] = s0[w];
+				block.t1[w] = -tr/std::log(e1[w]);
+			};
+			return;
+		};
+
+		std::vector<double> dS0(n*blockSize), dE1(n*blockSize), fTrial(n*blockSize);
+		for(unsigned int iter=0; iter<nIterations; iter++) {
+			Evaluate(s, c, s0, e1, f, &dS0[0], &dE1[0]);
+
+			/*	Normal equations	*/
+			double a11[blockSize], a12[blockSize], a22[blockSize], g1[blockSize], g2[blockSize];
+			std::fill(a11, a11+blockSize, 0.0);
+			std::fill(a12, a12+blockSize, 0.0);
+			std::fill(a22, a22+blockSize, 0.0);
+			std::fill(g1, g1+blockSize, 0.0);
+			std::fill(g2, g2+blockSize, 0.0);
+			for(size_t k=0; k<n; k++) {
+				for(size_t w=0; w<blockSize; w++) {
+					const size_t idx = k*blockSize+w;
+					const double r	 = y[idx]-f[idx];
+					a11[w] += dS0[idx]*dS0[idx];
+					a12[w] += dS0[idx]*dE1[idx];
+					a22[w] += dE1[idx]*dE1[idx];
+					g1[w]  += dS0[idx]*r;
+					g2[w]  += dE1[idx]*r;
+				};
+			};
+
+			/*	Damped 2-by-2 solution, keeping E1 within (0,1) and both
+				parameters within the bounds	*/
+			double s0Trial[blockSize], e1Trial[blockSize];
+			for(size_t w=0; w<blockSize; w++) {
+				const double d11 = a11[w]*(1+lambda[w]), d22 = a22[w]*(1+lambda[w]);
+				const double det = d11*d22-a12[w]*a12[w];
+				s0Trial[w] = std::min(std::max(s0[w]+(d22*g1[w]-a12[w]*g2[w])/det, s0Min), s0Max);
+				e1Trial[w] = std::min(std::max(e1[w]+(d11*g2[w]-a12[w]*g1[w])/det, e1Min), e1Max);
+			};
+			Evaluate(s, c, s0Trial, e1Trial, &fTrial[0], 0, 0);
+			double costTrial[blockSize];
+			GetCost(y, &fTrial[0], costTrial);
+			for(size_t w=0; w<blockSize; w++) {
+				if( costTrial[w]<block.cost[w] ) {
+					s0[w]		  = s0Trial[w];
+					e1[w]		  = e1Trial[w];
+					block.cost[w] = costTrial[w];
+					lambda[w]	  = std::max(lambda[w]/10, 1e-12);
+				}
+				else {
+					lambda[w] *= 10;
+				};
+			};
+		};
+
+		/*	Final estimates. Voxels without a linear estimate are valid when
+			the refinement found a model with a finite cost	*/
+		Evaluate(s, c, s0, e1, f, 0, 0);
+		for(size_t w=0; w<blockSize; w++) {
+			block.s0[w]		 = s0[w];
+			block.t1[w]		 = -tr/std::log(e1[w]);
+			block.isValid[w] = block.isData[w] && (block.isValid[w] || std::isfinite(block.cost[w]));
+		};
+	};
+};
+
+
+#endif
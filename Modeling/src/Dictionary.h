@@ -0,0 +1,467 @@
+/*
+ *	Dictionary.h
+ *
+ *	Dictionary fitting engine used by dict_fit for models with a single
+ *	non-linear parameter t (a relaxation time) and linear amplitudes:
+ *
+ *		f(x) = b*g(x;t)			(scaled models)
+ *		f(x) = a + b*g(x;t)		(affine models)
+ *
+ *	This is the reduced-dimension non-linear least squares (RD-NLS) approach
+ *	of restore_ir.m: for a fixed t the amplitudes have a closed form, so the
+ *	best t maximizes the inner product of the data with the normalized (and,
+ *	for affine models, mean-centred) atom g(x;t). The atoms of a grid of t
+ *	values are computed once per protocol and stored with the atom as the
+ *	fastest varying index, and the data of blocks of voxels are matched with
+ *	blocks of atoms by GEMM-style inner products so that both stay in cache.
+ *	The best match is refined by a few damped Gauss-Newton steps in the
+ *	amplitudes and t.
+ *
+ *	For magnitude inversion recovery data, the polarity of the samples up
+ *	to the signal minimum is restored by matching the two hypotheses of
+ *	restore_ir.m (sign change at or after the minimum) and keeping the one
+ *	with the smaller residual.
+ *
+ *	Atom classes are of the form:
+ *
+ *		struct TAtom{
+ *			static const bool		  isAffine = ...;
+ *			static const unsigned int nParams  = ...;
+ *			double Evaluate(double x, double t, double &dt) const;
+ *			void   GetParameters(double a, double b, double t, double* p) const;
+ *		};
+ *
+ *	where Evaluate returns g(x;t) and its derivative with respect to t and
+ *	GetParameters converts the fitted amplitudes and t to model parameters.
+ */
+
+
+#ifndef DICTIONARY_H
+#define DICTIONARY_H
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+
+template <class TAtom>
+class DictionaryFit{
+
+ public:
+
+	static const unsigned int nParams = TAtom::nParams;
+
+	/*	Voxels and atoms of the blocked inner products	*/
+	static const size_t voxelBlock = 32;
+	static const size_t atomBlock  = 256;
+
+	/*
+	 *	DictionaryFit()
+	 *
+	 *	Computes the normalized atoms of nAtoms values of t logarithmically
+	 *	spaced in [tMin,tMax] for the n predictor values x
+	 */
+	DictionaryFit(const TAtom &atom, const double* x, size_t n, double tMin, double tMax, size_t nAtoms) :
+		atom(atom), x(x, x+n), n(n), nAtoms(std::max<size_t>(nAtoms, 2)), isPolarity(false), nIterations(3),
+		grid(this->nAtoms), atoms(n*this->nAtoms), norms(this->nAtoms), means(this->nAtoms)
+	{
+		const double ratio = std::log(tMax/tMin)/(this->nAtoms-1);
+		std::vector<double> g(n);
+		for(size_t j=0; j<this->nAtoms; j++) {
+			grid[j] = tMin*std::exp(ratio*j);
+			double mean = 0, norm = 0, dt;
+			for(size_t k=0; k<n; k++) {
+				g[k]  = atom.Evaluate(x[k], grid[j], dt);
+				mean += g[k]/n;
+			};
+			if( !TAtom::isAffine ) {
+				mean = 0;
+			};
+			for(size_t k=0; k<n; k++) {
+				norm += (g[k]-mean)*(g[k]-mean);
+			};
+			norm	 = std::sqrt(norm);
+			means[j] = mean;
+			norms[j] = norm;
+			for(size_t k=0; k<n; k++) {
+				atoms[k*this->nAtoms+j] = (norm>0) ? (g[k]-mean)/norm : 0;
+			};
+		};
+	};
+
+	/*	Restore the polarity of magnitude data before fitting	*/
+	void SetPolarityRestoration(bool value) { isPolarity = value; };
+
+	/*	Number of Gauss-Newton refinement steps	*/
+	void SetIterations(unsigned int value) { nIterations = value; };
+
+	/*
+	 *	Fit()
+	 *
+	 *	Fits nVoxels voxels whose n samples start at y[v*n]. p receives the
+	 *	nParams parameters of each voxel, r2 the R^2 and res, when not null,
+	 *	the residuals (model minus data; the magnitude of the model when the
+	 *	polarity is restored). Voxels with non-finite data are NaN
+	 */
+	void Fit(const double* y, size_t nVoxels, double* p, double* r2, double* res) const
+	{
+		const size_t nHyp  = isPolarity ? 2 : 1;
+		const size_t nRows = voxelBlock*nHyp;
+		std::vector<double> rows(nRows*n), scores(nRows*atomBlock);
+		std::vector<double> best(nRows), energy(nRows);
+		std::vector<size_t> bestIdx(nRows);
+		for(size_t first=0; first<nVoxels; first+=voxelBlock) {
+			const size_t nBlock = std::min(voxelBlock, nVoxels-first);
+
+			/*	Data (and polarity hypotheses) of the block	*/
+			for(size_t w=0; w<voxelBlock; w++) {
+				const double* yv = y+(first+std::min(w, nBlock-1))*n;
+				for(size_t h=0; h<nHyp; h++) {
+					GetHypothesis(yv, h, isPolarity, &rows[(w*nHyp+h)*n]);
+				};
+			};
+			for(size_t r=0; r<nRows; r++) {
+				double mean = 0, e = 0;
+				if( TAtom::isAffine ) {
+					for(size_t k=0; k<n; k++) {
+						mean += rows[r*n+k]/n;
+					};
+				};
+				for(size_t k=0; k<n; k++) {
+					e += (rows[r*n+k]-mean)*(rows[r*n+k]-mean);
+				};
+				energy[r]  = e;
+				best[r]	   = -std::numeric_limits<double>::infinity();
+				bestIdx[r] = 0;
+			};
+
+			/*	Blocked inner products of the rows with the atoms	*/
+			for(size_t a0=0; a0<nAtoms; a0+=atomBlock) {
+				const size_t nA = std::min(atomBlock, nAtoms-a0);
+				std::fill(scores.begin(), scores.end(), 0.0);
+				for(size_t r=0; r<nRows; r++) {
+					double* s = &scores[r*atomBlock];
+					for(size_t k=0; k<n; k++) {
+						const double  yk = rows[r*n+k];
+						const double* d	 = &atoms[k*nAtoms+a0];
+						for(size_t j=0; j<nA; j++) {
+							s[j] += yk*d[j];
+						};
+					};
+					for(size_t j=0; j<nA; j++) {
+						const double c = TAtom::isAffine ? s[j]*s[j] : s[j];
+						if( c>best[r] ) {
+							best[r]	   = c;
+							bestIdx[r] = a0+j;
+						};
+					};
+				};
+			};
+
+			/*	Select the hypothesis, refine and write the results	*/
+			for(size_t w=0; w<nBlock; w++) {
+				const size_t  v	 = first+w;
+				const double* yv = y+v*n;
+				size_t r = w*nHyp;
+				for(size_t h=1; h<nHyp; h++) {
+					if( Residual(w*nHyp+h, best, energy)<Residual(r, best, energy) ) {
+						r = w*nHyp+h;
+					};
+				};
+				FitVoxel(yv, &rows[r*n], bestIdx[r], p+v*nParams, r2+v, res ? res+v*n : 0);
+			};
+		};
+	};
+
+
+ private:
+
+	TAtom				atom;
+	std::vector<double>	x;
+	size_t				n;
+	size_t				nAtoms;
+	bool				isPolarity;
+	unsigned int		nIterations;
+	std::vector<double>	grid;	/*	t of each atom	*/
+	std::vector<double>	atoms;	/*	n-by-nAtoms, atom fastest	*/
+	std::vector<double>	norms;	/*	norm of the (centred) atoms	*/
+	std::vector<double>	means;	/*	mean of the atoms (affine models)	*/
+
+	/*	Residual sum of squares of the best match of a row	*/
+	static double Residual(size_t r, const std::vector<double> &best, const std::vector<double> &energy)
+	{
+		const double c = TAtom::isAffine ? best[r] : std::max(best[r], 0.0)*std::max(best[r], 0.0);
+		return energy[r]-c;
+	};
+
+	/*
+	 *	GetHypothesis()
+	 *
+	 *	Copies the data, negating the samples before (h=1) or up to and
+	 *	including (h=0) the minimum when the polarity is restored
+	 */
+	void GetHypothesis(const double* y, size_t h, bool isRestored, double* dst) const
+	{
+		const size_t minIdx = std::min_element(y, y+n)-y;
+		for(size_t k=0; k<n; k++) {
+			const bool isNegated = isRestored && ((k<minIdx) || ((h==0) && (k==minIdx)));
+			dst[k] = isNegated ? -y[k] : y[k];
+		};
+	};
+
+	/*	Model values (and Jacobian columns) for the amplitudes a, b and t	*/
+	void Evaluate(double a, double b, double t, double* f, double* J) const
+	{
+		for(size_t k=0; k<n; k++) {
+			double dt;
+			const double g = atom.Evaluate(x[k], t, dt);
+			f[k] = (TAtom::isAffine ? a : 0)+b*g;
+			if( J ) {
+				unsigned int col = 0;
+				if( TAtom::isAffine ) {
+					J[(col++)*n+k] = 1;
+				};
+				J[(col++)*n+k] = g;
+				J[col*n+k]	   = b*dt;
+			};
+		};
+	};
+
+	static double GetCost(const double* y, const double* f, size_t n)
+	{
+		double cost = 0;
+		for(size_t k=0; k<n; k++) {
+			cost += (f[k]-y[k])*(f[k]-y[k]);
+		};
+		return cost;
+	};
+
+	/*
+	 *	FitVoxel()
+	 *
+	 *	Computes the amplitudes of the best atom and refines the fit of the
+	 *	(polarity restored) data yr. Statistics are computed with respect to
+	 *	the measured data y
+	 */
+	void FitVoxel(const double* y, const double* yr, size_t j, double* p, double* r2, double* res) const
+	{
+		const double nan = std::numeric_limits<double>::quiet_NaN();
+		double mean = 0;
+		bool   isFinite = true;
+		for(size_t k=0; k<n; k++) {
+			mean	+= y[k]/n;
+			isFinite = isFinite && std::isfinite(y[k]);
+		};
+		if( !isFinite || (norms[j]==0) ) {
+			std::fill(p, p+nParams, nan);
+			*r2 = nan;
+			if( res ) {
+				std::fill(res, res+n, nan);
+			};
+			return;
+		};
+
+		/*	Closed-form amplitudes of the matched atom	*/
+		double c = 0, yMean = 0;
+		for(size_t k=0; k<n; k++) {
+			c	  += yr[k]*atoms[k*nAtoms+j];
+			yMean += yr[k]/n;
+		};
+		double q[3];
+		const unsigned int nQ = TAtom::isAffine ? 3 : 2;
+		double* pb = q+(TAtom::isAffine ? 1 : 0);
+		q[0]  = TAtom::isAffine ? yMean-c/norms[j]*means[j] : 0;
+		pb[0] = c/norms[j];
+		pb[1] = grid[j];
+
+		/*	Damped Gauss-Newton refinement	*/
+		std::vector<double> f(n), fTrial(n), J(nQ*n);
+		Evaluate(q[0], pb[0], pb[1], &f[0], 0);
+		double cost = GetCost(yr, &f[0], n), lambda = 1e-3;
+		for(unsigned int iter=0; iter<nIterations; iter++) {
+			Evaluate(q[0], pb[0], pb[1], &f[0], &J[0]);
+			double A[9] = {0}, g[3] = {0}, step[3];
+			for(unsigned int i=0; i<nQ; i++) {
+				for(size_t k=0; k<n; k++) {
+					g[i] += J[i*n+k]*(yr[k]-f[k]);
+					for(unsigned int l=0; l<=i; l++) {
+						A[i*3+l] += J[i*n+k]*J[l*n+k];
+					};
+				};
+			};
+			for(unsigned int i=0; i<nQ; i++) {
+				A[i*3+i] *= 1+lambda;
+				for(unsigned int l=0; l<i; l++) {
+					A[l*3+i] = A[i*3+l];
+				};
+			};
+			if( !Solve(A, g, nQ, step) ) {
+				break;
+			};
+			double qTrial[3];
+			for(unsigned int i=0; i<nQ; i++) {
+				qTrial[i] = q[i]+step[i];
+			};
+			double* pbTrial = qTrial+(TAtom::isAffine ? 1 : 0);
+			pbTrial[1] = std::min(std::max(pbTrial[1], grid.front()), grid.back());
+			Evaluate(qTrial[0], pbTrial[0], pbTrial[1], &fTrial[0], 0);
+			const double costTrial = GetCost(yr, &fTrial[0], n);
+			if( costTrial<cost ) {
+				std::copy(qTrial, qTrial+nQ, q);
+				f.swap(fTrial);
+				cost   = costTrial;
+				lambda = std::max(lambda/10, 1e-12);
+			}
+			else {
+				lambda *= 10;
+			};
+		};
+		Evaluate(q[0], pb[0], pb[1], &f[0], 0);
+
+		/*	Statistics with respect to the measured data	*/
+		double ssRes = 0, ssTot = 0;
+		for(size_t k=0; k<n; k++) {
+			const double fk = isPolarity ? std::abs(f[k]) : f[k];
+			ssRes += (fk-y[k])*(fk-y[k]);
+			ssTot += (y[k]-mean)*(y[k]-mean);
+			if( res ) {
+				res[k] = fk-y[k];
+			};
+		};
+		*r2 = 1-ssRes/ssTot;
+		atom.GetParameters(q[0], pb[0], pb[1], p);
+	};
+
+	/*	Solves the nQ-by-nQ system A*x=b by Gaussian elimination	*/
+	static bool Solve(double* A, double* b, unsigned int nQ, double* x)
+	{
+		for(unsigned int i=0; i<nQ; i++) {
+			unsigned int pivot = i;
+			for(unsigned int r=i+1; r<nQ; r++) {
+				if( std::abs(A[r*3+i])>std::abs(A[pivot*3+i]) ) {
+					pivot = r;
+				};
+			};
+			if( !(std::abs(A[pivot*3+i])>0) ) {
+				return false;
+			};
+			for(unsigned int c=0; c<nQ; c++) {
+				std::swap(A[i*3+c], A[pivot*3+c]);
+			};
+			std::swap(b[i], b[pivot]);
+			for(unsigned int r=i+1; r<nQ; r++) {
+				const double m = A[r*3+i]/A[i*3+i];
+				for(unsigned int c=i; c<nQ; c++) {
+					A[r*3+c] -= m*A[i*3+c];
+				};
+				b[r] -= m*b[i];
+			};
+		};
+		for(unsigned int i=nQ; i-->0; ) {
+			double s = b[i];
+			for(unsigned int c=i+1; c<nQ; c++) {
+				s -= A[i*3+c]*x[c];
+			};
+			x[i] = s/A[i*3+i];
+		};
+		return true;
+	};
+};
+
+
+/*	Mono-exponential decay b*exp(-x/t) (multi_te.m): S0, T	*/
+struct DecayAtom{
+	static const bool		  isAffine = false;
+	static const unsigned int nParams  = 2;
+
+	double Evaluate(double x, double t, double &dt) const
+	{
+		const double e = std::exp(-x/t);
+		dt = e*x/(t*t);
+		return e;
+	};
+
+	void GetParameters(double, double b, double t, double* p) const
+	{
+		p[0] = b;
+		p[1] = t;
+	};
+};
+
+
+/*	Saturation recovery (multi_tr.m): S0, T1	*/
+struct SaturationRecoveryAtom{
+	static const bool		  isAffine = false;
+	static const unsigned int nParams  = 2;
+	double te;
+
+	explicit SaturationRecoveryAtom(double te) : te(te) {};
+
+	double Evaluate(double x, double t, double &dt) const
+	{
+		const double x1 = x-te/2;
+		const double e1 = std::exp(-x1/t), e2 = std::exp(-x/t);
+		dt = (e2*x-2*e1*x1)/(t*t);
+		return 1-2*e1+e2;
+	};
+
+	void GetParameters(double, double b, double t, double* p) const
+	{
+		p[0] = b;
+		p[1] = t;
+	};
+};
+
+
+/*	Inversion recovery with a known flip angle (fse_vti.m): S0, T1	*/
+struct InversionRecoveryAtom{
+	static const bool		  isAffine = false;
+	static const unsigned int nParams  = 2;
+	double q;	/*	1-cos(flip)	*/
+
+	explicit InversionRecoveryAtom(double flip) : q(1-std::cos(flip*std::atan(1.0)/45)) {};
+
+	double Evaluate(double x, double t, double &dt) const
+	{
+		const double e = std::exp(-x/t);
+		dt = -q*e*x/(t*t);
+		return 1-q*e;
+	};
+
+	void GetParameters(double, double b, double t, double* p) const
+	{
+		p[0] = b;
+		p[1] = t;
+	};
+};
+
+
+/*
+ *	Three parameter inversion recovery a+b*exp(-x/t) (restore_ir.m): S0, T1
+ *	and the inversion flip angle in degrees (cos(flip) = 1+b/a)
+ */
+struct InversionRecoveryFlipAtom{
+	static const bool		  isAffine = true;
+	static const unsigned int nParams  = 3;
+
+	double Evaluate(double x, double t, double &dt) const
+	{
+		const double e = std::exp(-x/t);
+		dt = e*x/(t*t);
+		return e;
+	};
+
+	void GetParameters(double a, double b, double t, double* p) const
+	{
+		p[0] = a;
+		p[1] = t;
+		p[2] = std::acos(std::min(std::max(1+b/a, -1.0), 1.0))*45/std::atan(1.0);
+	};
+};
+
+
+#endif
@@ -0,0 +1,389 @@
+/*
+ *	Exponential.h
+ *
+ *	Multi-exponential decay engines used by exp_fit.
+ *
+ *	LogLinearFit computes mono-exponential fits S(x) = S0*exp(-x*R) of all
+ *	voxels from the linear regression of log(S) on x. The normal equations of
+ *	the unweighted regression depend only on x, so their inverse (the
+ *	pseudo-inverse of the design matrix) is computed once and every voxel
+ *	costs two dot products. The weighted regression (weights S^2, which
+ *	accounts for the noise amplification of the logarithm) needs the
+ *	weighted sums of each voxel, still a single pass over the data.
+ *
+ *	NnlsFit computes the non-negative multi-exponential spectrum
+ *
+ *		S(x) = sum_j s_j*exp(-x/T_j),	s_j >= 0,
+ *
+ *	over a fixed grid of time constants T_j (e.g., multi-component T2 or
+ *	myelin water imaging) using the active set algorithm of Lawson and
+ *	Hanson on the normal equations. The Gram matrix of the decay basis is
+ *	shared by all voxels and the projections of the data on the basis are
+ *	computed for blocks of voxels at once, so that only the (small) active
+ *	set systems are solved per voxel. An optional Tikhonov term lambda*|s|^2
+ *	regularizes the spectrum.
+ */
+
+
+#ifndef EXPONENTIAL_H
+#define EXPONENTIAL_H
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+
+class LogLinearFit{
+
+ public:
+
+	static const unsigned int nParams = 2;
+
+	/*
+	 *	LogLinearFit()
+	 *
+	 *	Creates the engine for the n predictor values x
+	 */
+	LogLinearFit(const double* x, size_t n) : x(x, x+n), n(n), isWeighted(true), pinv(2*n)
+	{
+		double sx = 0, sxx = 0;
+		for(size_t k=0; k<n; k++) {
+			sx	+= x[k];
+			sxx += x[k]*x[k];
+		};
+		const double det = n*sxx-sx*sx;
+		for(size_t k=0; k<n; k++) {
+			pinv[k]	  = (sxx-sx*x[k])/det;	/*	log(S0)	*/
+			pinv[n+k] = (sx-n*x[k])/det;	/*	R	*/
+		};
+	};
+
+	/*	Weight the regression by the squared signal	*/
+	void SetWeighted(bool value) { isWeighted = value; };
+
+	/*
+	 *	Fit()
+	 *
+	 *	Fits nVoxels voxels whose n samples start at y[v*n]. p receives S0
+	 *	and the rate R of each voxel, r2 the R^2 and res, when not null, the
+	 *	residuals (model minus data). Voxels with non-finite or non-positive
+	 *	data are NaN
+	 */
+	void Fit(const double* y, size_t nVoxels, double* p, double* r2, double* res) const
+	{
+		const double nan = std::numeric_limits<double>::quiet_NaN();
+		for(size_t v=0; v<nVoxels; v++) {
+			const double* yv = y+v*n;
+			bool isValid = true;
+			for(size_t k=0; k<n; k++) {
+				isValid = isValid && std::isfinite(yv[k]) && (yv[k]>0);
+			};
+			double c0 = nan, c1 = nan;
+			if( isValid && isWeighted ) {
+				double sw = 0, swx = 0, swxx = 0, swy = 0, swxy = 0;
+				for(size_t k=0; k<n; k++) {
+					const double w	= yv[k]*yv[k];
+					const double ly = std::log(yv[k]);
+					sw	 += w;
+					swx	 += w*x[k];
+					swxx += w*x[k]*x[k];
+					swy	 += w*ly;
+					swxy += w*x[k]*ly;
+				};
+				const double det = sw*swxx-swx*swx;
+				c0 = (swxx*swy-swx*swxy)/det;
+				c1 = (swx*swy-sw*swxy)/det;
+			}
+			else if( isValid ) {
+				c0 = 0;
+				c1 = 0;
+				for(size_t k=0; k<n; k++) {
+					const double ly = std::log(yv[k]);
+					c0 += pinv[k]*ly;
+					c1 += pinv[n+k]*ly;
+				};
+			};
+			p[v*nParams]   = std::exp(c0);
+			p[v*nParams+1] = c1;
+
+			/*	Goodness of fit	*/
+			double mean = 0, ssRes = 0, ssTot = 0;
+			for(size_t k=0; k<n; k++) {
+				mean += yv[k]/n;
+			};
+			for(size_t k=0; k<n; k++) {
+				const double f = p[v*nParams]*std::exp(-x[k]*c1);
+				ssRes += (f-yv[k])*(f-yv[k]);
+				ssTot += (yv[k]-mean)*(yv[k]-mean);
+				if( res ) {
+					res[v*n+k] = f-yv[k];
+				};
+			};
+			r2[v] = 1-ssRes/ssTot;
+		};
+	};
+
+
+ private:
+
+	std::vector<double>	x;
+	size_t				n;
+	bool				isWeighted;
+	std::vector<double>	pinv;	/*	2-by-n pseudo-inverse of [1 -x]	*/
+};
+
+
+class NnlsFit{
+
+ public:
+
+	/*	Voxels of the blocked projections	*/
+	static const size_t blockSize = 32;
+
+	/*
+	 *	NnlsFit()
+	 *
+	 *	Creates the engine for the n predictor values x and the m time
+	 *	constants t of the spectrum
+	 */
+	NnlsFit(const double* x, size_t n, const double* t, size_t m) : n(n), m(m), lambda(0), basis(n*m), gram(m*m)
+	{
+		for(size_t k=0; k<n; k++) {
+			for(size_t j=0; j<m; j++) {
+				basis[k*m+j] = std::exp(-x[k]/t[j]);
+			};
+		};
+		ComputeGram();
+	};
+
+	/*	Tikhonov regularization weight of the spectrum	*/
+	void SetRegularization(double value)
+	{
+		lambda = value;
+		ComputeGram();
+	};
+
+	/*
+	 *	Fit()
+	 *
+	 *	Computes the spectra of nVoxels voxels whose n samples start at
+	 *	y[v*n]. s receives the m amplitudes of each voxel, r2 the R^2 and res,
+	 *	when not null, the residuals (model minus data). Voxels with
+	 *	non-finite data are NaN
+	 */
+	void Fit(const double* y, size_t nVoxels, double* s, double* r2, double* res) const
+	{
+		const double nan = std::numeric_limits<double>::quiet_NaN();
+		std::vector<double> proj(blockSize*m);
+		Workspace work(m);
+		for(size_t first=0; first<nVoxels; first+=blockSize) {
+			const size_t nBlock = std::min(blockSize, nVoxels-first);
+
+			/*	Projections of the block on the basis, A'*Y	*/
+			std::fill(proj.begin(), proj.end(), 0.0);
+			for(size_t w=0; w<nBlock; w++) {
+				const double* yv = y+(first+w)*n;
+				double*		  pv = &proj[w*m];
+				for(size_t k=0; k<n; k++) {
+					const double  yk = yv[k];
+					const double* a	 = &basis[k*m];
+					for(size_t j=0; j<m; j++) {
+						pv[j] += yk*a[j];
+					};
+				};
+			};
+
+			for(size_t w=0; w<nBlock; w++) {
+				const size_t  v	 = first+w;
+				const double* yv = y+v*n;
+				double*		  sv = s+v*m;
+				bool   isValid = true;
+				double mean = 0;
+				for(size_t k=0; k<n; k++) {
+					isValid = isValid && std::isfinite(yv[k]);
+					mean   += yv[k]/n;
+				};
+				if( !isValid || !Solve(&proj[w*m], sv, work) ) {
+					std::fill(sv, sv+m, nan);
+				};
+
+				/*	Goodness of fit	*/
+				double ssRes = 0, ssTot = 0;
+				for(size_t k=0; k<n; k++) {
+					double fk = 0;
+					for(size_t j=0; j<m; j++) {
+						fk += basis[k*m+j]*sv[j];
+					};
+					ssRes += (fk-yv[k])*(fk-yv[k]);
+					ssTot += (yv[k]-mean)*(yv[k]-mean);
+					if( res ) {
+						res[v*n+k] = fk-yv[k];
+					};
+				};
+				r2[v] = 1-ssRes/ssTot;
+			};
+		};
+	};
+
+
+ private:
+
+	size_t				n;
+	size_t				m;
+	double				lambda;
+	std::vector<double>	basis;	/*	n-by-m, exp(-x(k)/t(j))	*/
+	std::vector<double>	gram;	/*	m-by-m, A'*A+lambda*I	*/
+
+	/*	Per-thread storage of the active set iterations	*/
+	struct Workspace{
+		std::vector<bool>	isPassive;
+		std::vector<size_t>	passive;
+		std::vector<double>	z;
+		std::vector<double>	chol;
+		Workspace(size_t m) : isPassive(m), passive(m), z(m), chol(m*m) {};
+	};
+
+	void ComputeGram()
+	{
+		for(size_t i=0; i<m; i++) {
+			for(size_t j=0; j<m; j++) {
+				double g = (i==j) ? lambda : 0.0;
+				for(size_t k=0; k<n; k++) {
+					g += basis[k*m+i]*basis[k*m+j];
+				};
+				gram[i*m+j] = g;
+			};
+		};
+	};
+
+	/*
+	 *	SolvePassive()
+	 *
+	 *	Solves the normal equations restricted to the nP passive variables by
+	 *	Cholesky factorization, z(passive) = G(passive,passive)\b(passive)
+	 */
+	bool SolvePassive(const double* b, size_t nP, Workspace &work) const
+	{
+		double* L = &work.chol[0];
+		for(size_t i=0; i<nP; i++) {
+			for(size_t j=0; j<=i; j++) {
+				double sum = gram[work.passive[i]*m+work.passive[j]];
+				for(size_t l=0; l<j; l++) {
+					sum -= L[i*m+l]*L[j*m+l];
+				};
+				if( i==j ) {
+					if( !(sum>0) ) {
+						return false;
+					};
+					L[i*m+i] = std::sqrt(sum);
+				}
+				else {
+					L[i*m+j] = sum/L[j*m+j];
+				};
+			};
+		};
+		for(size_t i=0; i<nP; i++) {
+			double sum = b[work.passive[i]];
+			for(size_t l=0; l<i; l++) {
+				sum -= L[i*m+l]*work.z[l];
+			};
+			work.z[i] = sum/L[i*m+i];
+		};
+		for(size_t i=nP; i-->0; ) {
+			double sum = work.z[i];
+			for(size_t l=i+1; l<nP; l++) {
+				sum -= L[l*m+i]*work.z[l];
+			};
+			work.z[i] = sum/L[i*m+i];
+		};
+		return true;
+	};
+
+	/*
+	 *	Solve()
+	 *
+	 *	Lawson-Hanson active set solution of min |A*s-y|^2, s>=0, from the
+	 *	projections b=A'*y and the Gram matrix
+	 */
+	bool Solve(const double* b, double* s, Workspace &work) const
+	{
+		std::fill(s, s+m, 0.0);
+		std::fill(work.isPassive.begin(), work.isPassive.end(), false);
+		size_t nP = 0;
+		double bMax = 0;
+		for(size_t j=0; j<m; j++) {
+			bMax = std::max(bMax, std::abs(b[j]));
+		};
+		const double tol = 1e-12*m*bMax;
+		for(size_t iter=0; iter<3*m; iter++) {
+
+			/*	Gradient of the active variables	*/
+			size_t jMax = m;
+			double wMax = tol;
+			for(size_t j=0; j<m; j++) {
+				if( work.isPassive[j] ) {
+					continue;
+				};
+				double wj = b[j];
+				for(size_t i=0; i<nP; i++) {
+					wj -= gram[j*m+work.passive[i]]*s[work.passive[i]];
+				};
+				if( wj>wMax ) {
+					wMax = wj;
+					jMax = j;
+				};
+			};
+			if( jMax==m ) {
+				return true;
+			};
+			work.isPassive[jMax] = true;
+			work.passive[nP++]	 = jMax;
+
+			/*	Inner loop: keep the passive solution feasible	*/
+			while( nP>0 ) {
+				if( !SolvePassive(b, nP, work) ) {
+					return false;
+				};
+				double alpha = 1;
+				size_t iMin	 = nP;
+				for(size_t i=0; i<nP; i++) {
+					const double si = s[work.passive[i]];
+					if( (work.z[i]<=0) && (si/(si-work.z[i])<alpha) ) {
+						alpha = si/(si-work.z[i]);
+						iMin  = i;
+					};
+				};
+				for(size_t i=0; i<nP; i++) {
+					double &si = s[work.passive[i]];
+					si += alpha*(work.z[i]-si);
+				};
+				if( iMin==nP ) {
+					break;
+				};
+
+				/*	Move the variables at zero to the active set	*/
+				s[work.passive[iMin]] = 0;
+				size_t nKept = 0;
+				for(size_t i=0; i<nP; i++) {
+					const size_t j = work.passive[i];
+					if( s[j]<=0 ) {
+						s[j] = 0;
+						work.isPassive[j] = false;
+					}
+					else {
+						work.passive[nKept++] = j;
+					};
+				};
+				nP = nKept;
+			};
+		};
+		return true;
+	};
+};
+
+
+#endif
@@ -0,0 +1,584 @@
+/*
+ *	GaussianProcess.h
+ *
+ *	Gaussian process (GP) regression engine used by gp_fit. The covariance
+ *	functions and hyperparameters [s l sigma] are those of cov_gp.m:
+ *
+ *		'se'	k(t,t') = s^2*exp(-(t-t')^2/(2*l^2))
+ *		'ad'	k(t,t') = s^2*exp(-|t-t'|*l^2)
+ *
+ *	with the noise variance sigma^2 added to the diagonal. All curves of a
+ *	batch (e.g., the voxels of a DCE series) share the time grid and the
+ *	hyperparameters, so the Cholesky factor of the covariance is computed
+ *	once per set of hyperparameters and cached. The log marginal likelihood
+ *	(marg_ll.m) of the batch is the sum over the curves and its gradient
+ *
+ *		d(LL)/d(theta) = 1/2*trace((sum_i a_i*a_i' - M*inv(K))*dK/d(theta)),
+ *
+ *	with a_i = K\y_i, needs only the outer products of the a_i, which are
+ *	accumulated on all cores. The hyperparameters are optimized by BFGS in
+ *	the logarithms of their absolute values and predictions of all curves
+ *	use the weights inv(K)*K(t,t*), computed once.
+ *
+ *	For long time series, the optional deterministic training conditional
+ *	(DTC) approximation with m inducing points replaces the n-by-n
+ *	factorization by m-by-m factorizations (O(n*m^2) operations). In this
+ *	mode the gradient is computed by central differences.
+ */
+
+
+#ifndef GAUSSIANPROCESS_H
+#define GAUSSIANPROCESS_H
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+/*	QUATTRO headers	*/
+#include "ParallelFor.h"
+
+
+class GaussianProcess{
+
+ public:
+
+	static const unsigned int nHyperparameters = 3;
+
+	/*	Covariance functions of cov_gp.m	*/
+	enum Kernel{ SquaredExponential, AbsoluteDifference };
+
+	/*
+	 *	GaussianProcess()
+	 *
+	 *	Creates the engine for the n training times t and the covariance
+	 *	function kernel
+	 */
+	GaussianProcess(const double* t, size_t n, Kernel kernel) : t(t, t+n), n(n), kernel(kernel), isFactorized(false)
+	{
+		std::fill(hyp, hyp+nHyperparameters, 0.0);
+	};
+
+	/*	Use the DTC approximation with the m inducing times u	*/
+	void SetInducingPoints(const double* u, size_t m)
+	{
+		inducing.assign(u, u+m);
+		isFactorized = false;
+	};
+
+	bool IsSparse() const { return !inducing.empty(); };
+
+	/*
+	 *	SetHyperparameters()
+	 *
+	 *	Factorizes the covariance of the hyperparameters [s l sigma], unless
+	 *	they are those of the cached factorization. Returns false when the
+	 *	covariance is not positive definite
+	 */
+	bool SetHyperparameters(const double* value)
+	{
+		if( isFactorized && std::equal(value, value+nHyperparameters, hyp) ) {
+			return true;
+		};
+		std::copy(value, value+nHyperparameters, hyp);
+		isFactorized = IsSparse() ? FactorizeSparse() : FactorizeExact();
+		return isFactorized;
+	};
+
+	const double* GetHyperparameters() const { return hyp; };
+
+	/*
+	 *	GetLogLikelihood()
+	 *
+	 *	Returns the log marginal likelihood of the nCurves curves whose n
+	 *	samples start at y[c*n] (-Inf when the covariance is not positive
+	 *	definite). When grad is not null, it receives the derivatives with
+	 *	respect to the logarithms of the hyperparameters
+	 */
+	double GetLogLikelihood(const double* y, size_t nCurves, double* grad)
+	{
+		const double ninf = -std::numeric_limits<double>::infinity();
+		if( !isFactorized ) {
+			return ninf;
+		};
+		if( grad && IsSparse() ) {
+			return GetSparseGradient(y, nCurves, grad);
+		};
+
+		/*	Quadratic forms (and outer products of K\y) on all cores	*/
+		const size_t	   chunk  = 64;
+		const unsigned int nSlots = GetNumberOfParallelSlots(nCurves, chunk);
+		const size_t	   nOuter = (grad && !IsSparse()) ? n*n : 0;
+		std::vector<double> quad(nSlots, 0.0), outer(nSlots*nOuter, 0.0);
+		ParallelFor(nCurves, chunk, [&](size_t begin, size_t end, unsigned int threadId) {
+			std::vector<double> a(n);
+			for(size_t c=begin; c<end; c++) {
+				quad[threadId] += GetQuadraticForm(y+c*n, &a[0]);
+				if( nOuter ) {
+					double* A = &outer[threadId*nOuter];
+					for(size_t i=0; i<n; i++) {
+						for(size_t j=0; j<=i; j++) {
+							A[i*n+j] += a[i]*a[j];
+						};
+					};
+				};
+			};
+		}, nSlots);
+		double q = 0;
+		for(unsigned int s=0; s<nSlots; s++) {
+			q += quad[s];
+		};
+		const double ll = -0.5*q-nCurves*(0.5*logDet+0.5*n*std::log(8*std::atan(1.0)));
+		if( !grad ) {
+			return ll;
+		};
+
+		/*	Gradient of the exact GP	*/
+		for(unsigned int s=1; s<nSlots; s++) {
+			for(size_t i=0; i<nOuter; i++) {
+				outer[i] += outer[s*nOuter+i];
+			};
+		};
+		std::fill(grad, grad+nHyperparameters, 0.0);
+		for(size_t i=0; i<n; i++) {
+			for(size_t j=0; j<=i; j++) {
+				const double w = ((i==j) ? 0.5 : 1.0)*(outer[i*n+j]-nCurves*inverse[i*n+j]);
+				double dK[nHyperparameters];
+				GetCovarianceGradient(t[i], t[j], i==j, dK);
+				for(unsigned int h=0; h<nHyperparameters; h++) {
+					grad[h] += w*dK[h];
+				};
+			};
+		};
+		return ll;
+	};
+
+	/*
+	 *	Optimize()
+	 *
+	 *	Maximizes the log marginal likelihood of the curves with respect to
+	 *	the free hyperparameters (isFree), starting from the current values.
+	 *	Returns the final log marginal likelihood
+	 */
+	double Optimize(const double* y, size_t nCurves, const bool* isFree, unsigned int maxIterations)
+	{
+		const unsigned int N = nHyperparameters;
+		double x[N], g[N], H[N*N];
+		for(unsigned int h=0; h<N; h++) {
+			x[h] = std::log(std::max(std::abs(hyp[h]), 1e-12));
+		};
+		double f = -Evaluate(y, nCurves, x, isFree, g);
+		if( !std::isfinite(f) ) {
+			return -f;
+		};
+		std::fill(H, H+N*N, 0.0);
+		for(unsigned int h=0; h<N; h++) {
+			H[h*N+h] = 1;
+		};
+
+		for(unsigned int iter=0; iter<maxIterations; iter++) {
+
+			/*	Quasi-Newton direction, limited to a unit step in log space	*/
+			double d[N], norm = 0, slope = 0;
+			for(unsigned int i=0; i<N; i++) {
+				d[i] = 0;
+				for(unsigned int j=0; j<N; j++) {
+					d[i] -= H[i*N+j]*g[j];
+				};
+				norm += d[i]*d[i];
+			};
+			norm = std::sqrt(norm);
+			for(unsigned int i=0; i<N; i++) {
+				d[i]  /= std::max(norm, 1.0);
+				slope += d[i]*g[i];
+			};
+			if( !(slope<0) ) {
+				std::fill(H, H+N*N, 0.0);
+				for(unsigned int h=0; h<N; h++) {
+					H[h*N+h] = 1;
+				};
+				continue;
+			};
+
+			/*	Backtracking (Armijo) line search	*/
+			double step = 1, xTrial[N], gTrial[N], fTrial = 0;
+			bool   isAccepted = false;
+			for(unsigned int ls=0; ls<30; ls++) {
+				for(unsigned int i=0; i<N; i++) {
+					xTrial[i] = x[i]+step*d[i];
+				};
+				fTrial = -Evaluate(y, nCurves, xTrial, isFree, gTrial);
+				if( std::isfinite(fTrial) && (fTrial<=f+1e-4*step*slope) ) {
+					isAccepted = true;
+					break;
+				};
+				step /= 2;
+			};
+			if( !isAccepted ) {
+				break;
+			};
+
+			/*	BFGS update of the inverse Hessian	*/
+			double s[N], dg[N], sy = 0;
+			for(unsigned int i=0; i<N; i++) {
+				s[i]  = xTrial[i]-x[i];
+				dg[i] = gTrial[i]-g[i];
+				sy	 += s[i]*dg[i];
+			};
+			const bool isConverged = (std::abs(f-fTrial)<=1e-9*(1+std::abs(f)));
+			std::copy(xTrial, xTrial+N, x);
+			std::copy(gTrial, gTrial+N, g);
+			f = fTrial;
+			if( isConverged ) {
+				break;
+			};
+			if( sy>1e-12 ) {
+				double Hy[N], yHy = 0;
+				for(unsigned int i=0; i<N; i++) {
+					Hy[i] = 0;
+					for(unsigned int j=0; j<N; j++) {
+						Hy[i] += H[i*N+j]*dg[j];
+					};
+					yHy += dg[i]*Hy[i];
+				};
+				for(unsigned int i=0; i<N; i++) {
+					for(unsigned int j=0; j<N; j++) {
+						H[i*N+j] += ((sy+yHy)*s[i]*s[j])/(sy*sy)-(Hy[i]*s[j]+s[i]*Hy[j])/sy;
+					};
+				};
+			};
+		};
+
+		/*	Leave the engine factorized at the optimum	*/
+		double value[N];
+		for(unsigned int h=0; h<N; h++) {
+			value[h] = std::exp(x[h]);
+		};
+		SetHyperparameters(value);
+		return -f;
+	};
+
+	/*
+	 *	Predict()
+	 *
+	 *	Computes the posterior means at the nStar times tStar of the nCurves
+	 *	curves whose n samples start at y[c*n]. f receives nStar values per
+	 *	curve
+	 */
+	void Predict(const double* y, size_t nCurves, const double* tStar, size_t nStar, double* f) const
+	{
+		if( !isFactorized ) {
+			std::fill(f, f+nCurves*nStar, std::numeric_limits<double>::quiet_NaN());
+			return;
+		};
+
+		/*	Weights of the training samples of each prediction	*/
+		std::vector<double> weights(nStar*n);
+		ParallelFor(nStar, 16, [&](size_t begin, size_t end, unsigned int) {
+			for(size_t j=begin; j<end; j++) {
+				GetPredictionWeights(tStar[j], &weights[j*n]);
+			};
+		});
+
+		/*	Posterior means of all curves	*/
+		ParallelFor(nCurves, 64, [&](size_t begin, size_t end, unsigned int) {
+			for(size_t c=begin; c<end; c++) {
+				const double* yc = y+c*n;
+				for(size_t j=0; j<nStar; j++) {
+					const double* w = &weights[j*n];
+					double sum = 0;
+					for(size_t k=0; k<n; k++) {
+						sum += w[k]*yc[k];
+					};
+					f[c*nStar+j] = sum;
+				};
+			};
+		});
+	};
+
+
+ private:
+
+	std::vector<double>	t;
+	size_t				n;
+	Kernel				kernel;
+	double				hyp[nHyperparameters];
+	bool				isFactorized;
+	double				logDet;		/*	log(det(K)) (or det(Q) for DTC)	*/
+
+	/*	Exact GP: Cholesky factor and inverse of K	*/
+	std::vector<double>	chol;
+	std::vector<double>	inverse;
+
+	/*	DTC: inducing times, factor of Kuu, V = Luu\Kuf and the factor of
+		B = I+V*V'/sigma^2	*/
+	std::vector<double>	inducing;
+	std::vector<double>	cholUu;
+	std::vector<double>	v;
+	std::vector<double>	cholB;
+
+	/*	Signal covariance between t1 and t2	*/
+	double GetCovariance(double t1, double t2) const
+	{
+		const double d = t1-t2;
+		if( kernel==SquaredExponential ) {
+			return hyp[0]*hyp[0]*std::exp(-d*d/(2*hyp[1]*hyp[1]));
+		};
+		return hyp[0]*hyp[0]*std::exp(-std::abs(d)*hyp[1]*hyp[1]);
+	};
+
+	/*	Derivatives of K(i,j) with respect to the log-hyperparameters	*/
+	void GetCovarianceGradient(double t1, double t2, bool isDiagonal, double* dK) const
+	{
+		const double d = t1-t2;
+		const double k = GetCovariance(t1, t2);
+		dK[0] = 2*k;
+		dK[1] = (kernel==SquaredExponential) ? k*d*d/(hyp[1]*hyp[1]) : -2*k*std::abs(d)*hyp[1]*hyp[1];
+		dK[2] = isDiagonal ? 2*hyp[2]*hyp[2] : 0.0;
+	};
+
+	/*	In-place Cholesky factorization of the m-by-m matrix L (lower)	*/
+	static bool Cholesky(std::vector<double> &L, size_t m)
+	{
+		for(size_t j=0; j<m; j++) {
+			double diag = L[j*m+j];
+			for(size_t l=0; l<j; l++) {
+				diag -= L[j*m+l]*L[j*m+l];
+			};
+			if( !(diag>0) ) {
+				return false;
+			};
+			L[j*m+j] = std::sqrt(diag);
+			for(size_t i=j+1; i<m; i++) {
+				double sum = L[i*m+j];
+				for(size_t l=0; l<j; l++) {
+					sum -= L[i*m+l]*L[j*m+l];
+				};
+				L[i*m+j] = sum/L[j*m+j];
+			};
+			for(size_t i=0; i<j; i++) {
+				L[i*m+j] = 0;
+			};
+		};
+		return true;
+	};
+
+	/*	Solves L*x=b (isTransposed: L'*x=b) in place	*/
+	static void Solve(const std::vector<double> &L, size_t m, double* b, bool isTransposed)
+	{
+		if( !isTransposed ) {
+			for(size_t i=0; i<m; i++) {
+				double sum = b[i];
+				for(size_t l=0; l<i; l++) {
+					sum -= L[i*m+l]*b[l];
+				};
+				b[i] = sum/L[i*m+i];
+			};
+			return;
+		};
+		for(size_t i=m; i-->0; ) {
+			double sum = b[i];
+			for(size_t l=i+1; l<m; l++) {
+				sum -= L[l*m+i]*b[l];
+			};
+			b[i] = sum/L[i*m+i];
+		};
+	};
+
+	bool FactorizeExact()
+	{
+		chol.assign(n*n, 0.0);
+		for(size_t i=0; i<n; i++) {
+			for(size_t j=0; j<=i; j++) {
+				chol[i*n+j] = GetCovariance(t[i], t[j])+((i==j) ? hyp[2]*hyp[2] : 0.0);
+			};
+		};
+		if( !Cholesky(chol, n) ) {
+			return false;
+		};
+		logDet = 0;
+		for(size_t i=0; i<n; i++) {
+			logDet += 2*std::log(chol[i*n+i]);
+		};
+
+		/*	inv(K), column by column, for the gradient	*/
+		inverse.assign(n*n, 0.0);
+		std::vector<double> e(n);
+		for(size_t j=0; j<n; j++) {
+			std::fill(e.begin(), e.end(), 0.0);
+			e[j] = 1;
+			Solve(chol, n, &e[0], false);
+			Solve(chol, n, &e[0], true);
+			for(size_t i=0; i<n; i++) {
+				inverse[i*n+j] = e[i];
+			};
+		};
+		return true;
+	};
+
+	bool FactorizeSparse()
+	{
+		const size_t m	   = inducing.size();
+		const double noise = hyp[2]*hyp[2];
+		if( !(noise>0) ) {
+			return false;
+		};
+		cholUu.assign(m*m, 0.0);
+		for(size_t i=0; i<m; i++) {
+			for(size_t j=0; j<=i; j++) {
+				cholUu[i*m+j] = GetCovariance(inducing[i], inducing[j]);
+			};
+			cholUu[i*m+i] *= 1+1e-6;	/*	jitter	*/
+		};
+		if( !Cholesky(cholUu, m) ) {
+			return false;
+		};
+
+		/*	V = Luu\Kuf, column by column	*/
+		v.resize(m*n);
+		std::vector<double> col(m);
+		for(size_t k=0; k<n; k++) {
+			for(size_t i=0; i<m; i++) {
+				col[i] = GetCovariance(inducing[i], t[k]);
+			};
+			Solve(cholUu, m, &col[0], false);
+			for(size_t i=0; i<m; i++) {
+				v[i*n+k] = col[i];
+			};
+		};
+		cholB.assign(m*m, 0.0);
+		for(size_t i=0; i<m; i++) {
+			for(size_t j=0; j<=i; j++) {
+				double sum = 0;
+				for(size_t k=0; k<n; k++) {
+					sum += v[i*n+k]*v[j*n+k];
+				};
+				cholB[i*m+j] = sum/noise+((i==j) ? 1.0 : 0.0);
+			};
+		};
+		if( !Cholesky(cholB, m) ) {
+			return false;
+		};
+
+		/*	log(det(Q)) = log(det(B))+n*log(sigma^2)	*/
+		logDet = n*std::log(noise);
+		for(size_t i=0; i<m; i++) {
+			logDet += 2*std::log(cholB[i*m+i]);
+		};
+		return true;
+	};
+
+	/*	y'*inv(K)*y; a receives inv(K)*y (exact GP only)	*/
+	double GetQuadraticForm(const double* y, double* a) const
+	{
+		if( !IsSparse() ) {
+			std::copy(y, y+n, a);
+			Solve(chol, n, a, false);
+			double q = 0;
+			for(size_t k=0; k<n; k++) {
+				q += a[k]*a[k];
+			};
+			Solve(chol, n, a, true);
+			return q;
+		};
+
+		/*	Woodbury: y'*inv(Q)*y = y'*y/sigma^2-c'*c, c = LB\(V*y)/sigma^2	*/
+		const size_t m	   = inducing.size();
+		const double noise = hyp[2]*hyp[2];
+		std::vector<double> c(m, 0.0);
+		double yy = 0, cc = 0;
+		for(size_t k=0; k<n; k++) {
+			yy += y[k]*y[k];
+		};
+		for(size_t i=0; i<m; i++) {
+			for(size_t k=0; k<n; k++) {
+				c[i] += v[i*n+k]*y[k];
+			};
+			c[i] /= noise;
+		};
+		Solve(cholB, m, &c[0], false);
+		for(size_t i=0; i<m; i++) {
+			cc += c[i]*c[i];
+		};
+		return yy/noise-cc;
+	};
+
+	/*	Weights w such that the posterior mean at tStar is w'*y	*/
+	void GetPredictionWeights(double tStar, double* w) const
+	{
+		if( !IsSparse() ) {
+			for(size_t k=0; k<n; k++) {
+				w[k] = GetCovariance(tStar, t[k]);
+			};
+			Solve(chol, n, w, false);
+			Solve(chol, n, w, true);
+			return;
+		};
+
+		/*	DTC mean: (Luu\K(u,t*))'*inv(B)*V*y/sigma^2	*/
+		const size_t m = inducing.size();
+		std::vector<double> b(m);
+		for(size_t i=0; i<m; i++) {
+			b[i] = GetCovariance(tStar, inducing[i]);
+		};
+		Solve(cholUu, m, &b[0], false);
+		Solve(cholB, m, &b[0], false);
+		Solve(cholB, m, &b[0], true);
+		for(size_t k=0; k<n; k++) {
+			double sum = 0;
+			for(size_t i=0; i<m; i++) {
+				sum += b[i]*v[i*n+k];
+			};
+			w[k] = sum/(hyp[2]*hyp[2]);
+		};
+	};
+
+	/*	Central difference gradient of the DTC log marginal likelihood	*/
+	double GetSparseGradient(const double* y, size_t nCurves, double* grad)
+	{
+		const double h0[nHyperparameters] = {hyp[0], hyp[1], hyp[2]};
+		const double ll = GetLogLikelihood(y, nCurves, 0);
+		const double delta = 1e-5;
+		for(unsigned int h=0; h<nHyperparameters; h++) {
+			double value[nHyperparameters];
+			std::copy(h0, h0+nHyperparameters, value);
+			value[h] = h0[h]*std::exp(delta);
+			const double llPlus = SetHyperparameters(value) ? GetLogLikelihood(y, nCurves, 0) : ll;
+			value[h] = h0[h]*std::exp(-delta);
+			const double llMinus = SetHyperparameters(value) ? GetLogLikelihood(y, nCurves, 0) : ll;
+			grad[h] = (llPlus-llMinus)/(2*delta);
+		};
+		SetHyperparameters(h0);
+		return ll;
+	};
+
+	/*
+	 *	Evaluate()
+	 *
+	 *	Log marginal likelihood and gradient at the log-hyperparameters x;
+	 *	the gradient of fixed hyperparameters is 0 (-grad is returned so
+	 *	that the caller minimizes)
+	 */
+	double Evaluate(const double* y, size_t nCurves, const double* x, const bool* isFree, double* g)
+	{
+		double value[nHyperparameters];
+		for(unsigned int h=0; h<nHyperparameters; h++) {
+			value[h] = isFree[h] ? std::exp(x[h]) : hyp[h];
+		};
+		if( !SetHyperparameters(value) ) {
+			std::fill(g, g+nHyperparameters, 0.0);
+			return -std::numeric_limits<double>::infinity();
+		};
+		const double ll = GetLogLikelihood(y, nCurves, g);
+		for(unsigned int h=0; h<nHyperparameters; h++) {
+			g[h] = isFree[h] ? -g[h] : 0.0;
+		};
+		return ll;
+	};
+};
+
+
+#endif
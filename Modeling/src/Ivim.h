@@ -0,0 +1,471 @@
+/*
+ *	Ivim.h
+ *
+ *	Intravoxel incoherent motion (IVIM) engine used by ivim_fit. The model
+ *	of ivim.m,
+ *
+ *		S(b) = S0*((1-f)*exp(-a(b)) + f*exp(-a(b)-b*D*)),
+ *		a(b) = b*D - (b*D)^2*K/6,
+ *
+ *	is fitted by segments. The diffusion coefficient D (and the kurtosis K)
+ *	are computed from the log-linear regression of the high b-value signals,
+ *	where the pseudo-diffusion compartment has decayed, weighted by the
+ *	squared signal and repeated once with the model as weight. The perfusion
+ *	signal remaining at the low b-values has a single non-linear parameter
+ *	(D*) and a linear amplitude (S0*f): D* is found by a grid search of the
+ *	closed-form least squares amplitudes and refined by Gauss-Newton steps.
+ *
+ *	Optionally, the segmented estimates of all voxels define shared priors
+ *	(the median and the robust spread of D, D*, f and K) and each voxel is
+ *	refined by a maximum a posteriori (MAP) fit of all parameters, which
+ *	stabilizes the noisy estimates of D* and f.
+ *
+ *	Parameters are stored as [S0 D D* f K] for each voxel, the order of
+ *	ivim.m.
+ */
+
+
+#ifndef IVIM_H
+#define IVIM_H
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+
+class IvimFit{
+
+ public:
+
+	static const unsigned int nParams = 5;
+
+	/*
+	 *	IvimFit()
+	 *
+	 *	Creates the engine for the n b-values b
+	 */
+	IvimFit(const double* b, size_t n) : b(b, b+n), n(n), threshold(200), isPerfusion(true), isKurtosis(false),
+		nIterations(10), nGrid(64), dStarMin(3e-3), dStarMax(0.3), isPrior(false)
+	{
+		std::fill(priorMean, priorMean+nParams, 0.0);
+		std::fill(priorScale, priorScale+nParams, 0.0);
+		BuildGrid();
+	};
+
+	/*	Smallest b-value of the diffusion (high b-value) segment	*/
+	void SetThreshold(double value) { threshold = value; };
+
+	/*	Fit the pseudo-diffusion compartment (otherwise D* and f are 0)	*/
+	void SetPerfusion(bool value) { isPerfusion = value; };
+
+	/*	Fit the diffusion kurtosis (otherwise K is 0)	*/
+	void SetKurtosis(bool value) { isKurtosis = value; };
+
+	/*	Range of the D* grid search	*/
+	void SetPseudoDiffusionRange(double lower, double upper)
+	{
+		dStarMin = lower;
+		dStarMax = upper;
+		BuildGrid();
+	};
+
+	/*	Gauss-Newton iterations of the D* and MAP refinements	*/
+	void SetIterations(unsigned int value) { nIterations = value; };
+
+	/*
+	 *	Fit()
+	 *
+	 *	Computes the segmented (or, after SetPriors, the MAP) estimates of
+	 *	nVoxels voxels whose n samples start at y[v*n]. p receives the five
+	 *	parameters of each voxel, r2 the R^2 and res, when not null, the
+	 *	residuals (model minus data). In MAP mode, p must contain the
+	 *	segmented estimates on input. Voxels with non-finite or non-positive
+	 *	data, or without a valid estimate, are NaN
+	 */
+	void Fit(const double* y, size_t nVoxels, double* p, double* r2, double* res) const
+	{
+		std::vector<double> f(n);
+		for(size_t v=0; v<nVoxels; v++) {
+			const double* yv = y+v*n;
+			double*		  pv = p+v*nParams;
+			bool isValid = true;
+			double mean = 0;
+			for(size_t k=0; k<n; k++) {
+				isValid = isValid && std::isfinite(yv[k]) && (yv[k]>0);
+				mean   += yv[k]/n;
+			};
+			if( isPrior ) {
+				isValid = isValid && std::isfinite(pv[0]) && FitPosterior(yv, pv);
+			}
+			else {
+				isValid = isValid && FitSegmented(yv, pv);
+			};
+			if( !isValid ) {
+				std::fill(pv, pv+nParams, std::numeric_limits<double>::quiet_NaN());
+			};
+
+			/*	Goodness of fit	*/
+			Evaluate(pv, &f[0], 0);
+			double ssRes = 0, ssTot = 0;
+			for(size_t k=0; k<n; k++) {
+				ssRes += (f[k]-yv[k])*(f[k]-yv[k]);
+				ssTot += (yv[k]-mean)*(yv[k]-mean);
+				if( res ) {
+					res[v*n+k] = f[k]-yv[k];
+				};
+			};
+			r2[v] = 1-ssRes/ssTot;
+		};
+	};
+
+	/*
+	 *	SetPriors()
+	 *
+	 *	Computes the shared priors of D, D*, f and K from the segmented
+	 *	estimates p of nVoxels voxels (NaN voxels are ignored) and enables
+	 *	the MAP refinement. Returns false when there are too few estimates
+	 */
+	bool SetPriors(const double* p, size_t nVoxels)
+	{
+		std::vector<double> values;
+		values.reserve(nVoxels);
+		for(unsigned int i=1; i<nParams; i++) {
+			values.clear();
+			for(size_t v=0; v<nVoxels; v++) {
+				if( std::isfinite(p[v*nParams+i]) ) {
+					values.push_back(p[v*nParams+i]);
+				};
+			};
+			if( values.size()<3 ) {
+				return false;
+			};
+			const double median = GetMedian(values);
+			for(size_t j=0; j<values.size(); j++) {
+				values[j] = std::abs(values[j]-median);
+			};
+			priorMean[i]  = median;
+			priorScale[i] = std::max(1.4826*GetMedian(values), 1e-3*std::abs(median));
+		};
+		isPrior = true;
+		return true;
+	};
+
+
+ private:
+
+	std::vector<double>	b;
+	size_t				n;
+	double				threshold;
+	bool				isPerfusion;
+	bool				isKurtosis;
+	unsigned int		nIterations;
+	size_t				nGrid;
+	double				dStarMin;
+	double				dStarMax;
+	bool				isPrior;
+	double				priorMean[nParams];
+	double				priorScale[nParams];	/*	0 for parameters without prior	*/
+	std::vector<double>	grid;		/*	D* of the grid search	*/
+	std::vector<double>	decays;		/*	exp(-b*D*), n values per grid point	*/
+
+	void BuildGrid()
+	{
+		const double ratio = std::log(dStarMax/dStarMin)/(nGrid-1);
+		grid.resize(nGrid);
+		decays.resize(nGrid*n);
+		for(size_t j=0; j<nGrid; j++) {
+			grid[j] = dStarMin*std::exp(ratio*j);
+			for(size_t k=0; k<n; k++) {
+				decays[j*n+k] = std::exp(-b[k]*grid[j]);
+			};
+		};
+	};
+
+	static double GetMedian(std::vector<double> &values)
+	{
+		const size_t mid = values.size()/2;
+		std::nth_element(values.begin(), values.begin()+mid, values.end());
+		return values[mid];
+	};
+
+	/*	Signal and, when J is not null, the n-by-nParams Jacobian	*/
+	void Evaluate(const double* p, double* f, double* J) const
+	{
+		const double s0 = p[0], d = p[1], dStar = p[2], frac = p[3], kurt = p[4];
+		for(size_t k=0; k<n; k++) {
+			const double bd = b[k]*d;
+			const double e1 = std::exp(-bd+bd*bd*kurt/6);
+			const double e2 = e1*std::exp(-b[k]*dStar);
+			const double s	= (1-frac)*e1+frac*e2;
+			f[k] = s0*s;
+			if( J ) {
+				J[k]	   = s;
+				J[n+k]	   = -s0*s*(b[k]-b[k]*bd*kurt/3);
+				J[2*n+k]   = -s0*frac*b[k]*e2;
+				J[3*n+k]   = s0*(e2-e1);
+				J[4*n+k]   = s0*s*bd*bd/6;
+			};
+		};
+	};
+
+	/*
+	 *	FitSegmented()
+	 *
+	 *	Diffusion segment followed by the pseudo-diffusion segment
+	 */
+	bool FitSegmented(const double* y, double* p) const
+	{
+		const double nan = std::numeric_limits<double>::quiet_NaN();
+		const unsigned int nCoef = isKurtosis ? 3 : 2;
+
+		/*	Weighted log-linear regression of the diffusion segment	*/
+		double c[3] = {0, 0, 0};
+		size_t nHigh = 0;
+		for(unsigned int pass=0; pass<2; pass++) {
+			double A[9] = {0}, r[3] = {0};
+			nHigh = 0;
+			for(size_t k=0; k<n; k++) {
+				if( isPerfusion && (b[k]<threshold) ) {
+					continue;
+				};
+				const double x[3] = {1, -b[k], b[k]*b[k]/6};
+				const double w	  = (pass==0) ? y[k]*y[k] : std::exp(2*(c[0]+c[1]*x[1]+c[2]*x[2]));
+				const double ly	  = std::log(y[k]);
+				for(unsigned int i=0; i<nCoef; i++) {
+					r[i] += w*x[i]*ly;
+					for(unsigned int j=0; j<nCoef; j++) {
+						A[i*3+j] += w*x[i]*x[j];
+					};
+				};
+				nHigh++;
+			};
+			if( (nHigh<nCoef) || !Solve(A, r, nCoef, 3, c) ) {
+				return false;
+			};
+		};
+		p[0] = std::exp(c[0]);
+		p[1] = c[1];
+		p[2] = 0;
+		p[3] = 0;
+		p[4] = isKurtosis ? c[2]/(c[1]*c[1]) : 0;
+		if( !(p[1]>0) || !std::isfinite(p[4]) ) {
+			return false;
+		};
+		if( !isPerfusion ) {
+			return true;
+		};
+
+		/*	Perfusion signal remaining after the diffusion compartment	*/
+		std::vector<double> e(n), r(n);
+		for(size_t k=0; k<n; k++) {
+			const double bd = b[k]*p[1];
+			e[k] = std::exp(-bd+bd*bd*p[4]/6);
+			r[k] = y[k]-p[0]*e[k];
+		};
+
+		/*	Grid search of D* with the closed-form amplitude S0*f	*/
+		double best = 0, dStar = nan, amp = 0;
+		for(size_t j=0; j<nGrid; j++) {
+			double rg = 0, gg = 0;
+			for(size_t k=0; k<n; k++) {
+				const double g = e[k]*decays[j*n+k];
+				rg += r[k]*g;
+				gg += g*g;
+			};
+			if( (rg>0) && (rg*rg/gg>best) ) {
+				best  = rg*rg/gg;
+				dStar = grid[j];
+				amp	  = rg/gg;
+			};
+		};
+		if( !(best>0) ) {
+			return true;
+		};
+
+		/*	Gauss-Newton refinement of the amplitude and D*	*/
+		double cost = GetPerfusionCost(r, e, amp, dStar), lambda = 1e-3;
+		for(unsigned int iter=0; iter<nIterations; iter++) {
+			double A[4] = {0}, g[2] = {0}, step[2];
+			for(size_t k=0; k<n; k++) {
+				const double gk = e[k]*std::exp(-b[k]*dStar);
+				const double j0 = gk, j1 = -amp*b[k]*gk;
+				const double rk = r[k]-amp*gk;
+				A[0] += j0*j0;
+				A[1] += j0*j1;
+				A[3] += j1*j1;
+				g[0] += j0*rk;
+				g[1] += j1*rk;
+			};
+			A[2]  = A[1];
+			A[0] *= 1+lambda;
+			A[3] *= 1+lambda;
+			if( !Solve(A, g, 2, 2, step) ) {
+				break;
+			};
+			const double ampTrial	= std::max(amp+step[0], 0.0);
+			const double dStarTrial = std::min(std::max(dStar+step[1], dStarMin), dStarMax);
+			const double costTrial	= GetPerfusionCost(r, e, ampTrial, dStarTrial);
+			if( costTrial<cost ) {
+				amp	   = ampTrial;
+				dStar  = dStarTrial;
+				cost   = costTrial;
+				lambda = std::max(lambda/10, 1e-12);
+			}
+			else {
+				lambda *= 10;
+			};
+		};
+		p[2]  = dStar;
+		p[3]  = amp/(p[0]+amp);
+		p[0] += amp;
+		return true;
+	};
+
+	double GetPerfusionCost(const std::vector<double> &r, const std::vector<double> &e, double amp, double dStar) const
+	{
+		double cost = 0;
+		for(size_t k=0; k<n; k++) {
+			const double rk = r[k]-amp*e[k]*std::exp(-b[k]*dStar);
+			cost += rk*rk;
+		};
+		return cost;
+	};
+
+	/*
+	 *	FitPosterior()
+	 *
+	 *	Levenberg-Marquardt fit of the log-posterior: the residual sum of
+	 *	squares of the data plus, for each parameter with a prior, the
+	 *	squared deviation from the prior mean in units of the prior scale,
+	 *	weighted by the noise variance of the segmented fit
+	 */
+	bool FitPosterior(const double* y, double* p) const
+	{
+		const bool isFree[nParams] = {true, true, isPerfusion, isPerfusion, isKurtosis};
+		std::vector<double> f(n), J(nParams*n);
+		Evaluate(p, &f[0], 0);
+		double sigma2 = 0;
+		for(size_t k=0; k<n; k++) {
+			sigma2 += (f[k]-y[k])*(f[k]-y[k]);
+		};
+		const double dof = (n>nParams) ? n-nParams : 1;
+		sigma2 = std::max(sigma2/dof, 1e-12*p[0]*p[0]);
+
+		double cost = GetPosteriorCost(y, &f[0], p, sigma2), lambda = 1e-3;
+		for(unsigned int iter=0; iter<nIterations; iter++) {
+			Evaluate(p, &f[0], &J[0]);
+			double A[nParams*nParams] = {0}, g[nParams] = {0}, step[nParams];
+			unsigned int idx[nParams], m = 0;
+			for(unsigned int i=0; i<nParams; i++) {
+				if( isFree[i] ) {
+					idx[m++] = i;
+				};
+			};
+			for(unsigned int i=0; i<m; i++) {
+				const unsigned int pi = idx[i];
+				for(size_t k=0; k<n; k++) {
+					g[i] += J[pi*n+k]*(y[k]-f[k]);
+					for(unsigned int j=0; j<=i; j++) {
+						A[i*nParams+j] += J[pi*n+k]*J[idx[j]*n+k];
+					};
+				};
+				if( priorScale[pi]>0 ) {
+					const double w = sigma2/(priorScale[pi]*priorScale[pi]);
+					A[i*nParams+i] += w;
+					g[i]		   += w*(priorMean[pi]-p[pi]);
+				};
+			};
+			for(unsigned int i=0; i<m; i++) {
+				if( A[i*nParams+i]==0 ) {
+
+					/*	Parameter without effect (e.g., D* when f is 0)	*/
+					A[i*nParams+i] = 1;
+					g[i]		   = 0;
+				};
+				A[i*nParams+i] *= 1+lambda;
+				for(unsigned int j=0; j<i; j++) {
+					A[j*nParams+i] = A[i*nParams+j];
+				};
+			};
+			if( !Solve(A, g, m, nParams, step) ) {
+				break;
+			};
+			double pTrial[nParams];
+			std::copy(p, p+nParams, pTrial);
+			for(unsigned int i=0; i<m; i++) {
+				pTrial[idx[i]] += step[i];
+			};
+			pTrial[1] = std::max(pTrial[1], 0.0);
+			pTrial[2] = std::min(std::max(pTrial[2], 0.0), dStarMax);
+			pTrial[3] = std::min(std::max(pTrial[3], 0.0), 1.0);
+			Evaluate(pTrial, &f[0], 0);
+			const double costTrial = GetPosteriorCost(y, &f[0], pTrial, sigma2);
+			if( costTrial<cost ) {
+				std::copy(pTrial, pTrial+nParams, p);
+				cost   = costTrial;
+				lambda = std::max(lambda/10, 1e-12);
+			}
+			else {
+				lambda *= 10;
+			};
+		};
+		return std::isfinite(cost);
+	};
+
+	double GetPosteriorCost(const double* y, const double* f, const double* p, double sigma2) const
+	{
+		double cost = 0;
+		for(size_t k=0; k<n; k++) {
+			cost += (f[k]-y[k])*(f[k]-y[k]);
+		};
+		for(unsigned int i=0; i<nParams; i++) {
+			if( priorScale[i]>0 ) {
+				const double z = (p[i]-priorMean[i])/priorScale[i];
+				cost += sigma2*z*z;
+			};
+		};
+		return cost;
+	};
+
+	/*	Solves the m-by-m system A*x=r (row stride ld) by Gaussian elimination	*/
+	static bool Solve(double* A, double* r, unsigned int m, unsigned int ld, double* x)
+	{
+		for(unsigned int i=0; i<m; i++) {
+			unsigned int pivot = i;
+			for(unsigned int row=i+1; row<m; row++) {
+				if( std::abs(A[row*ld+i])>std::abs(A[pivot*ld+i]) ) {
+					pivot = row;
+				};
+			};
+			if( !(std::abs(A[pivot*ld+i])>0) ) {
+				return false;
+			};
+			for(unsigned int col=0; col<m; col++) {
+				std::swap(A[i*ld+col], A[pivot*ld+col]);
+			};
+			std::swap(r[i], r[pivot]);
+			for(unsigned int row=i+1; row<m; row++) {
+				const double s = A[row*ld+i]/A[i*ld+i];
+				for(unsigned int col=i; col<m; col++) {
+					A[row*ld+col] -= s*A[i*ld+col];
+				};
+				r[row] -= s*r[i];
+			};
+		};
+		for(unsigned int i=m; i-->0; ) {
+			double s = r[i];
+			for(unsigned int col=i+1; col<m; col++) {
+				s -= A[i*ld+col]*x[col];
+			};
+			x[i] = s/A[i*ld+i];
+		};
+		return true;
+	};
+};
+
+
+#endif
@@ -0,0 +1,313 @@
+/*
+ *	LevenbergMarquardt.h
+ *
+ *	Bounded Levenberg-Marquardt solver used by voxel_fit. Voxels are fitted
+ *	in batches of W lanes that iterate in lock step: the state of a batch
+ *	(parameters, model values, Jacobians, damping, ...) is stored as a
+ *	structure of arrays with the lane as the fastest varying index, so that
+ *	the model evaluations and normal equations of all lanes are computed by
+ *	the same (vectorizable) inner loops. Lanes that converge are frozen
+ *	while the remaining lanes of the batch continue.
+ *
+ *	Models are classes of the form:
+ *
+ *		struct TModel{
+ *			static const unsigned int nParams = ...;
+ *
+ *			template <unsigned int W>
+ *			void Evaluate(const double* p, double* f, double* J) const;
+ *		};
+ *
+ *	where p holds the nParams-by-W parameters, f receives the n-by-W model
+ *	values and J, when not null, the nParams-by-n-by-W analytic Jacobian
+ *	(the layout index is (param*n+sample)*W+lane). The predictor values and
+ *	any other constants are members of the model.
+ *
+ *	Bounds are enforced by projecting each trial step onto the feasible box,
+ *	which is what lsqcurvefit's "trust-region-reflective" algorithm is used
+ *	for in modelbase. Default stopping criteria match lsqcurvefit.
+ */
+
+
+#ifndef LEVENBERGMARQUARDT_H
+#define LEVENBERGMARQUARDT_H
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+
+template <class TModel, unsigned int W=8>
+class LevenbergMarquardt{
+
+ public:
+
+	static const unsigned int nParams = TModel::nParams;
+	static const unsigned int nLanes  = W;
+
+	LevenbergMarquardt(const TModel &model, size_t n) : model(model), n(n),
+		maxIterations(400), tolerance(1e-6), y(n*W), f(n*W), fTrial(n*W), J(nParams*n*W)
+	{
+		std::fill(lower, lower+nParams, -std::numeric_limits<double>::infinity());
+		std::fill(upper, upper+nParams, std::numeric_limits<double>::infinity());
+	};
+
+	/*	Lower and upper parameter bounds (nParams values each)	*/
+	void SetBounds(const double* lb, const double* ub)
+	{
+		std::copy(lb, lb+nParams, lower);
+		std::copy(ub, ub+nParams, upper);
+	};
+
+	void SetMaximumIterations(unsigned int value) { maxIterations = value; };
+
+	/*	Relative change of the cost and of the parameters at convergence	*/
+	void SetTolerance(double value) { tolerance = value; };
+
+	/*
+	 *	Fit()
+	 *
+	 *	Fits up to W voxels. The data of voxel v (n samples) start at
+	 *	yData[v*ldY] and its initial guess at p0[v*nParams]. The fitted
+	 *	parameters (nParams per voxel), R^2 and, when res is not null, the
+	 *	residuals (model minus data, n per voxel) are written with the same
+	 *	strides. Unused lanes replicate the last voxel.
+	 */
+	void Fit(const double* yData, size_t ldY, const double* p0, size_t nVoxels,
+			 double* p, double* r2, double* res)
+	{
+		if( nVoxels==0 ) {
+			return;
+		};
+		nVoxels = std::min<size_t>(nVoxels, W);
+
+		/*	Transpose the batch to the lane-major layout	*/
+		for(unsigned int w=0; w<W; w++) {
+			const size_t v = std::min<size_t>(w, nVoxels-1);
+			for(size_t k=0; k<n; k++) {
+				y[k*W+w] = yData[v*ldY+k];
+			};
+			for(unsigned int j=0; j<nParams; j++) {
+				pBatch[j*W+w] = std::min(std::max(p0[v*nParams+j], lower[j]), upper[j]);
+			};
+			lambda[w]	= 1e-2;
+			isActive[w] = (w<nVoxels);
+		};
+		model.template Evaluate<W>(pBatch, &f[0], &J[0]);
+		GetCost(&f[0], cost);
+
+		bool isStale = false;
+		for(unsigned int iter=0; iter<maxIterations; iter++) {
+			if( std::find(isActive, isActive+W, true)==isActive+W ) {
+				break;
+			};
+			if( isStale ) {
+				model.template Evaluate<W>(pBatch, &f[0], &J[0]);
+			};
+			BuildNormalEquations();
+
+			/*	Damped step, projected onto the bounds	*/
+			bool isSolved[W];
+			Solve(isSolved);
+			for(unsigned int j=0; j<nParams; j++) {
+				for(unsigned int w=0; w<W; w++) {
+					pTrial[j*W+w] = std::min(std::max(pBatch[j*W+w]+step[j*W+w], lower[j]), upper[j]);
+				};
+			};
+			model.template Evaluate<W>(pTrial, &fTrial[0], 0);
+			double costTrial[W];
+			GetCost(&fTrial[0], costTrial);
+
+			/*	Accept or reject the step of each lane	*/
+			isStale = false;
+			for(unsigned int w=0; w<W; w++) {
+				if( !isActive[w] ) {
+					continue;
+				};
+				if( !isSolved[w] || !(costTrial[w]<cost[w]) ) {
+					lambda[w] *= 10;
+					isActive[w] = (lambda[w]<1e16);
+					continue;
+				};
+				bool isConverged = (cost[w]-costTrial[w] <= tolerance*cost[w]);
+				bool isSmallStep = true;
+				for(unsigned int j=0; j<nParams; j++) {
+					const double dp = std::abs(pTrial[j*W+w]-pBatch[j*W+w]);
+					isSmallStep		= isSmallStep && (dp<=tolerance*(std::abs(pBatch[j*W+w])+tolerance));
+					pBatch[j*W+w]	= pTrial[j*W+w];
+				};
+				for(size_t k=0; k<n; k++) {
+					f[k*W+w] = fTrial[k*W+w];
+				};
+				cost[w]		= costTrial[w];
+				lambda[w]	= std::max(lambda[w]/10, 1e-12);
+				isActive[w] = !isConverged && !isSmallStep;
+				isStale		= true;
+			};
+		};
+
+		/*	Write the results of the used lanes	*/
+		for(size_t v=0; v<nVoxels; v++) {
+			double mean = 0, ssTot = 0;
+			for(size_t k=0; k<n; k++) {
+				mean += y[k*W+v];
+			};
+			mean /= n;
+			for(size_t k=0; k<n; k++) {
+				ssTot += (y[k*W+v]-mean)*(y[k*W+v]-mean);
+			};
+			for(unsigned int j=0; j<nParams; j++) {
+				p[v*nParams+j] = pBatch[j*W+v];
+			};
+			/*	A constant signal has no variance to explain: its fit is perfect or
+				the goodness of fit is undefined	*/
+			if( ssTot>0 ) {
+				r2[v] = 1-cost[v]/ssTot;
+			}
+			else {
+				r2[v] = (cost[v]==0) ? 1 : std::numeric_limits<double>::quiet_NaN();
+			};
+			if( res ) {
+				for(size_t k=0; k<n; k++) {
+					res[v*ldY+k] = f[k*W+v]-y[k*W+v];
+				};
+			};
+		};
+	};
+
+
+ private:
+
+	TModel		 model;
+	size_t		 n;
+	unsigned int maxIterations;
+	double		 tolerance;
+	double		 lower[nParams];
+	double		 upper[nParams];
+
+	/*	Batch state (lane-major)	*/
+	std::vector<double> y;
+	std::vector<double> f;
+	std::vector<double> fTrial;
+	std::vector<double> J;
+	double pBatch[nParams*W];
+	double pTrial[nParams*W];
+	double step[nParams*W];
+	double A[nParams*nParams*W];	/*	J'*J	*/
+	double g[nParams*W];			/*	J'*(y-f)	*/
+	double cost[W];
+	double lambda[W];
+	bool   isActive[W];
+
+	void GetCost(const double* values, double* c) const
+	{
+		std::fill(c, c+W, 0.0);
+		for(size_t k=0; k<n; k++) {
+			for(unsigned int w=0; w<W; w++) {
+				const double r = y[k*W+w]-values[k*W+w];
+				c[w] += r*r;
+			};
+		};
+		for(unsigned int w=0; w<W; w++) {
+			if( !(c[w]==c[w]) ) {
+				c[w] = std::numeric_limits<double>::infinity();
+			};
+		};
+	};
+
+	void BuildNormalEquations()
+	{
+		std::fill(A, A+nParams*nParams*W, 0.0);
+		std::fill(g, g+nParams*W, 0.0);
+		for(unsigned int i=0; i<nParams; i++) {
+			const double* Ji = &J[i*n*W];
+			for(size_t k=0; k<n; k++) {
+				for(unsigned int w=0; w<W; w++) {
+					g[i*W+w] += Ji[k*W+w]*(y[k*W+w]-f[k*W+w]);
+				};
+			};
+			for(unsigned int j=0; j<=i; j++) {
+				const double* Jj = &J[j*n*W];
+				double*		  a	 = A+(i*nParams+j)*W;
+				for(size_t k=0; k<n; k++) {
+					for(unsigned int w=0; w<W; w++) {
+						a[w] += Ji[k*W+w]*Jj[k*W+w];
+					};
+				};
+			};
+		};
+	};
+
+	/*
+	 *	Solve()
+	 *
+	 *	Solves (A+lambda*diag(A))*step = g for all lanes by Cholesky
+	 *	factorization. isSolved is false for lanes whose damped system is not
+	 *	positive definite (or not finite)
+	 */
+	void Solve(bool* isSolved)
+	{
+		double L[nParams*nParams*W];
+		for(unsigned int i=0; i<nParams; i++) {
+			for(unsigned int j=0; j<=i; j++) {
+				for(unsigned int w=0; w<W; w++) {
+					double a = A[(i*nParams+j)*W+w];
+					if( i==j ) {
+						a += lambda[w]*std::max(a, 1e-12);
+					};
+					L[(i*nParams+j)*W+w] = a;
+				};
+			};
+		};
+		std::fill(isSolved, isSolved+W, true);
+		for(unsigned int j=0; j<nParams; j++) {
+			for(unsigned int w=0; w<W; w++) {
+				double d = L[(j*nParams+j)*W+w];
+				for(unsigned int k=0; k<j; k++) {
+					d -= L[(j*nParams+k)*W+w]*L[(j*nParams+k)*W+w];
+				};
+				if( !(d>0) || !(d<std::numeric_limits<double>::infinity()) ) {
+					isSolved[w] = false;
+					d = 1;
+				};
+				L[(j*nParams+j)*W+w] = std::sqrt(d);
+			};
+			for(unsigned int i=j+1; i<nParams; i++) {
+				for(unsigned int w=0; w<W; w++) {
+					double s = L[(i*nParams+j)*W+w];
+					for(unsigned int k=0; k<j; k++) {
+						s -= L[(i*nParams+k)*W+w]*L[(j*nParams+k)*W+w];
+					};
+					L[(i*nParams+j)*W+w] = s/L[(j*nParams+j)*W+w];
+				};
+			};
+		};
+
+		/*	Forward and back substitution	*/
+		for(unsigned int i=0; i<nParams; i++) {
+			for(unsigned int w=0; w<W; w++) {
+				double s = g[i*W+w];
+				for(unsigned int k=0; k<i; k++) {
+					s -= L[(i*nParams+k)*W+w]*step[k*W+w];
+				};
+				step[i*W+w] = s/L[(i*nParams+i)*W+w];
+			};
+		};
+		for(unsigned int i=nParams; i-->0; ) {
+			for(unsigned int w=0; w<W; w++) {
+				double s = step[i*W+w];
+				for(unsigned int k=i+1; k<nParams; k++) {
+					s -= L[(k*nParams+i)*W+w]*step[k*W+w];
+				};
+				step[i*W+w] = s/L[(i*nParams+i)*W+w];
+			};
+		};
+	};
+};
+
+
+#endif
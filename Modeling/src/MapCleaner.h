@@ -0,0 +1,296 @@
+/*
+ *	MapCleaner.h
+ *
+ *	Spatial cleanup engine used by clean_maps. This is the algorithm of
+ *	modelbase.cleanmaps applied to one slice: voxels whose R^2 does not
+ *	exceed the threshold, and whose (2w+1)-by-(2w+1) neighbourhood contains
+ *	a better fit, are re-fitted starting from the median parameters of the
+ *	neighbours with acceptable fits. The slice is swept twice (columns from
+ *	the last, then rows from the first) and accepted fits are used by the
+ *	following voxels of the sweep. The maps are padded as by fill_mat in
+ *	cleanmaps.m at the start of each sweep.
+ *
+ *	The window statistics (the sorted parameters of the acceptable
+ *	neighbours, from which the medians follow) are updated incrementally:
+ *	moving the window by one voxel removes and adds one line of 2w+1
+ *	voxels and an accepted fit replaces one entry. As only voxels with poor
+ *	fits need the statistics, the window is moved lazily and is rebuilt
+ *	when the next such voxel is too far along the sweep.
+ */
+
+
+#ifndef MAPCLEANER_H
+#define MAPCLEANER_H
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+
+class MapCleaner{
+
+ public:
+
+	/*
+	 *	MapCleaner()
+	 *
+	 *	Creates the engine for nRows-by-nCols slices of nParams parameter
+	 *	maps, the R^2 threshold and the half-width w of the neighbourhood
+	 */
+	MapCleaner(size_t nParams, size_t nRows, size_t nCols, double threshold, size_t width) : nParams(nParams),
+		nRows(nRows), nCols(nCols), threshold(threshold), w(width), nPadRows(nRows+2*width),
+		nPadCols(nCols+2*width) {};
+
+	/*
+	 *	Clean()
+	 *
+	 *	Cleans the maps of one slice in place: p holds the nParams parameters
+	 *	of each voxel (column-major voxel order) and r2 the R^2 values. The
+	 *	functor refit(init,voxel,r2Old,pNew,r2New) re-fits the voxel index
+	 *	"voxel" of the slice from the initial guess init and returns true
+	 *	when the new parameters and R^2 should replace the old ones. Voxels
+	 *	with a NaN R^2 (i.e., not fitted) are left unchanged
+	 */
+	template <class TRefit>
+	void Clean(double* p, double* r2, TRefit &refit) const
+	{
+		Workspace ws(*this);
+		for(int sweep=0; sweep<2; sweep++) {
+			Pad(p, r2, ws);
+			const size_t nOuter = sweep ? nRows : nCols;
+			const size_t nInner = sweep ? nCols : nRows;
+			for(size_t o=0; o<nOuter; o++) {
+				ws.position = nInner;	/*	no window	*/
+				for(size_t i=0; i<nInner; i++) {
+
+					/*	Sweep 0: columns and rows from the last one	*/
+					const size_t outer = sweep ? o : nOuter-1-o;
+					const size_t inner = sweep ? i : nInner-1-i;
+					const size_t row   = sweep ? outer : inner;
+					const size_t col   = sweep ? inner : outer;
+					const size_t q	   = (col+w)*nPadRows+row+w;
+					const double r2Old = ws.r2[q];
+					if( !(r2Old<=threshold) ) {
+						continue;
+					};
+
+					/*	Only voxels with better neighbours are re-fitted	*/
+					if( !HasBetterNeighbour(row, col, r2Old, ws) ) {
+						continue;
+					};
+					MoveWindow(sweep, outer, inner, ws);
+					const size_t nCandidates = ws.values[0].size();
+					if( nCandidates==0 ) {
+						continue;
+					};
+					bool isZero = true;
+					for(size_t j=0; j<nParams; j++) {
+						const std::vector<double> &v = ws.values[j];
+						ws.init[j] = (nCandidates%2) ? v[nCandidates/2] : (v[nCandidates/2-1]+v[nCandidates/2])/2;
+						isZero	   = isZero && (ws.init[j]==0);
+					};
+					if( isZero ) {
+						continue;
+					};
+
+					double r2New;
+					if( !refit(&ws.init[0], col*nRows+row, r2Old, &ws.fit[0], r2New) ) {
+						continue;
+					};
+					Remove(q, ws);
+					std::copy(ws.fit.begin(), ws.fit.end(), ws.p.begin()+q*nParams);
+					ws.r2[q] = r2New;
+					Add(q, ws);
+				};
+			};
+
+			/*	Keep the center of the padded maps	*/
+			for(size_t col=0; col<nCols; col++) {
+				for(size_t row=0; row<nRows; row++) {
+					const size_t q = (col+w)*nPadRows+row+w;
+					std::copy(ws.p.begin()+q*nParams, ws.p.begin()+(q+1)*nParams, p+(col*nRows+row)*nParams);
+					r2[col*nRows+row] = ws.r2[q];
+				};
+			};
+		};
+	};
+
+
+ private:
+
+	size_t	nParams;
+	size_t	nRows;
+	size_t	nCols;
+	double	threshold;
+	size_t	w;
+	size_t	nPadRows;
+	size_t	nPadCols;
+
+	/*	Padded maps and window statistics of a slice	*/
+	struct Workspace{
+		std::vector<double>	p;
+		std::vector<double>	r2;
+		std::vector< std::vector<double> > values;	/*	sorted parameters of the
+														acceptable neighbours	*/
+		size_t				position;	/*	inner index of the window	*/
+		std::vector<double>	init;
+		std::vector<double>	fit;
+		Workspace(const MapCleaner &c) : p(c.nParams*c.nPadRows*c.nPadCols), r2(c.nPadRows*c.nPadCols),
+			values(c.nParams), position(0), init(c.nParams), fit(c.nParams)
+		{
+			for(size_t j=0; j<c.nParams; j++) {
+				values[j].reserve((2*c.w+1)*(2*c.w+1));
+			};
+		};
+	};
+
+	static void Insert(std::vector<double> &v, double value)
+	{
+		v.insert(std::upper_bound(v.begin(), v.end(), value), value);
+	};
+
+	static void Erase(std::vector<double> &v, double value)
+	{
+		v.erase(std::lower_bound(v.begin(), v.end(), value));
+	};
+
+	/*	Neighbours with acceptable fits and no NaN parameters	*/
+	bool IsCandidate(size_t q, const Workspace &ws) const
+	{
+		if( ws.r2[q]<threshold ) {
+			return false;
+		};
+		for(size_t j=0; j<nParams; j++) {
+			if( std::isnan(ws.p[q*nParams+j]) ) {
+				return false;
+			};
+		};
+		return true;
+	};
+
+	void Add(size_t q, Workspace &ws) const
+	{
+		if( IsCandidate(q, ws) ) {
+			for(size_t j=0; j<nParams; j++) {
+				Insert(ws.values[j], ws.p[q*nParams+j]);
+			};
+		};
+	};
+
+	void Remove(size_t q, Workspace &ws) const
+	{
+		if( IsCandidate(q, ws) ) {
+			for(size_t j=0; j<nParams; j++) {
+				Erase(ws.values[j], ws.p[q*nParams+j]);
+			};
+		};
+	};
+
+	/*	A NaN or larger R^2 in the window (the "all" test of cleanmaps)	*/
+	bool HasBetterNeighbour(size_t row, size_t col, double r2Old, const Workspace &ws) const
+	{
+		for(size_t c=col; c<=col+2*w; c++) {
+			const double* r2 = &ws.r2[c*nPadRows+row];
+			for(size_t k=0; k<=2*w; k++) {
+				if( !(r2[k]<=r2Old) ) {
+					return true;
+				};
+			};
+		};
+		return false;
+	};
+
+	/*	Adds (or removes) the line of the window at the inner index	*/
+	void UpdateLine(int sweep, size_t outer, size_t padInner, bool isAdd, Workspace &ws) const
+	{
+		for(size_t k=0; k<=2*w; k++) {
+			const size_t row = sweep ? outer+k : padInner;
+			const size_t col = sweep ? padInner : outer+k;
+			if( isAdd ) {
+				Add(col*nPadRows+row, ws);
+			}
+			else {
+				Remove(col*nPadRows+row, ws);
+			};
+		};
+	};
+
+	/*
+	 *	MoveWindow()
+	 *
+	 *	Centers the window on the voxel (padded window lines outer to
+	 *	outer+2w). The window slides when it is at most a few voxels away
+	 *	along the line and is rebuilt otherwise
+	 */
+	void MoveWindow(int sweep, size_t outer, size_t inner, Workspace &ws) const
+	{
+		const size_t nInner = sweep ? nCols : nRows;
+		const bool	 isValid = (ws.position<nInner);
+		const size_t dist	 = (ws.position>inner) ? ws.position-inner : inner-ws.position;
+		if( isValid && (dist<=(2*w+1)/4) ) {
+			while( ws.position!=inner ) {
+
+				/*	The padded inner index of the window line i-w is i	*/
+				if( inner>ws.position ) {
+					UpdateLine(sweep, outer, ws.position, false, ws);
+					UpdateLine(sweep, outer, ws.position+2*w+1, true, ws);
+					ws.position++;
+				}
+				else {
+					UpdateLine(sweep, outer, ws.position+2*w, false, ws);
+					UpdateLine(sweep, outer, ws.position-1, true, ws);
+					ws.position--;
+				};
+			};
+			return;
+		};
+		for(size_t j=0; j<nParams; j++) {
+			ws.values[j].clear();
+		};
+		const size_t row0 = sweep ? outer : inner, col0 = sweep ? inner : outer;
+		for(size_t col=col0; col<=col0+2*w; col++) {
+			for(size_t row=row0; row<=row0+2*w; row++) {
+				const size_t q = col*nPadRows+row;
+				if( IsCandidate(q, ws) ) {
+					for(size_t j=0; j<nParams; j++) {
+						ws.values[j].push_back(ws.p[q*nParams+j]);
+					};
+				};
+			};
+		};
+		for(size_t j=0; j<nParams; j++) {
+			std::sort(ws.values[j].begin(), ws.values[j].end());
+		};
+		ws.position = inner;
+	};
+
+	/*	Copies the block [row0,row0+nRows) x [col0,col0+nCols) of the maps	*/
+	void CopyBlock(const double* p, const double* r2, size_t row0, size_t col0, Workspace &ws) const
+	{
+		for(size_t col=0; col<nCols; col++) {
+			for(size_t row=0; row<nRows; row++) {
+				const size_t q = (col+col0)*nPadRows+row+row0;
+				std::copy(p+(col*nRows+row)*nParams, p+(col*nRows+row+1)*nParams, ws.p.begin()+q*nParams);
+				ws.r2[q] = r2[col*nRows+row];
+			};
+		};
+	};
+
+	/*	Padding of fill_mat: the four corners, then the center	*/
+	void Pad(const double* p, const double* r2, Workspace &ws) const
+	{
+		std::fill(ws.p.begin(), ws.p.end(), 0.0);
+		std::fill(ws.r2.begin(), ws.r2.end(), 0.0);
+		CopyBlock(p, r2, 0, 0, ws);
+		CopyBlock(p, r2, 2*w, 0, ws);
+		CopyBlock(p, r2, 2*w, 2*w, ws);
+		CopyBlock(p, r2, 0, 2*w, ws);
+		CopyBlock(p, r2, w, w, ws);
+	};
+};
+
+
+#endif
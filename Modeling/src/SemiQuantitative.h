@@ -0,0 +1,294 @@
+/*
+ *	SemiQuantitative.h
+ *
+ *	Semi-quantitative DCE engine used by semiq_maps. All curve features of a
+ *	voxel are computed in a single pass over time from running sums, so that
+ *	every sample is read once:
+ *
+ *		Arrival			bolus arrival time, the running mean/standard
+ *						deviation test of detect_bolus_arrival.m applied to
+ *						the curve of each voxel
+ *		TTP				time of the first-pass peak (calcpeak.m)
+ *		Enhancement		relative peak enhancement (peak-pre)/pre
+ *		SER				ratio of the peak to the pre-contrast signal
+ *		UptakeSlope		slopes of the least squares lines through the peak
+ *		WashoutSlope	before and after the peak (calcslopes.m)
+ *		IAUC			integrals of the linearly interpolated curve from
+ *						the integration start time (calciauc.m)
+ *
+ *	The peak features (arrival, TTP, enhancement and SER) can be computed
+ *	from a second series read in the same pass, e.g., the signal intensities
+ *	when the slopes and IAUC are computed from processed (e.g., delta S.I.)
+ *	curves. The slopes are then anchored at the frame of that peak, as in
+ *	calcslopes.m.
+ *
+ *	detect_bolus_arrival.m tests the mean curve of the most enhancing voxels
+ *	of a slice (preprocess_dce_images.m, 'tc'), whereas the arrival map
+ *	applies the same test to the curve of each voxel; semiq_maps applies it
+ *	to the mean curve to find the default pre-contrast frames. As in
+ *	detect_bolus_arrival.m, the arrival is the fourth frame when the test
+ *	fails.
+ *
+ *	The slopes through the peak follow from the sums of t, t^2, y and t*y
+ *	of the frames before the peak (saved whenever a new peak is found) and
+ *	of all first-pass frames. The integration weights of each frame are
+ *	computed once, so the integrals are running dot products.
+ *
+ *	Voxels are processed in blocks with the voxel as the fastest varying
+ *	index of all running sums. Samples are addressed with a voxel and a time
+ *	stride, so time-contiguous (n-by-M) and time-last (e.g., 4D image
+ *	series) layouts are both read without copying.
+ */
+
+
+#ifndef SEMIQUANTITATIVE_H
+#define SEMIQUANTITATIVE_H
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+
+/*	Output maps, one value per voxel (nIntegrals values for IAUC)	*/
+struct SemiQuantitativeMaps{
+	double*	arrival;
+	double*	ttp;
+	double*	enhancement;
+	double*	ser;
+	double*	uptake;
+	double*	washout;
+	double*	iauc;
+};
+
+
+class SemiQuantitative{
+
+ public:
+
+	/*	Number of voxels processed together	*/
+	static const size_t blockSize = 64;
+
+	/*
+	 *	SemiQuantitative()
+	 *
+	 *	Creates the engine for the n acquisition times t, the masks of the
+	 *	pre-contrast and first-pass frames and the nIntegrals integration
+	 *	times of the IAUC, starting at tStart. The pre-contrast signal is the
+	 *	mean of the baseline frames (by default, the pre-contrast frames)
+	 */
+	SemiQuantitative(const double* t, size_t n, const std::vector<bool> &isPre, const std::vector<bool> &isFirstPass,
+					 const double* tIntegrals, size_t nIntegrals, double tStart) :
+		t(t, t+n), n(n), isPre(isPre), isBaseline(isPre), isPost(n), nIntegrals(nIntegrals),
+		weights(n*nIntegrals, 0.0), isIntegral(nIntegrals, true)
+	{
+		for(size_t k=0; k<n; k++) {
+			isPost[k] = !isPre[k] && isFirstPass[k];
+		};
+
+		/*	Trapezoidal weights of the linear interpolant over [tStart,tEnd]	*/
+		for(size_t i=0; i<nIntegrals; i++) {
+			const double tEnd = tStart+tIntegrals[i];
+			isIntegral[i] = (n>1) && (tStart>=t[0]) && (tEnd<=t[n-1]);
+			for(size_t k=1; isIntegral[i] && (k<n); k++) {
+				const double a = std::max(tStart, t[k-1]), b = std::min(tEnd, t[k]);
+				const double dt = t[k]-t[k-1];
+				if( !(b>a) || !(dt>0) ) {
+					continue;
+				};
+
+				/*	Interpolation fractions of y(k) at a and b	*/
+				const double ua = (a-t[k-1])/dt, ub = (b-t[k-1])/dt;
+				weights[(k-1)*nIntegrals+i] += (b-a)*(1-(ua+ub)/2);
+				weights[k*nIntegrals+i]		+= (b-a)*(ua+ub)/2;
+			};
+		};
+	};
+
+	size_t GetNumberOfIntegrals() const { return nIntegrals; };
+
+	/*	Frames averaged for the pre-contrast signal	*/
+	void SetBaseline(const std::vector<bool> &value) { isBaseline = value; };
+
+	/*
+	 *	Compute()
+	 *
+	 *	Computes the maps of nVoxels voxels; sample k of voxel v is
+	 *	y[v*voxelStride+k*timeStride]. The peak features are computed from the
+	 *	samples of yPeak (same layout) or, when yPeak is null, of y. The maps
+	 *	are written from index 0 (i.e., the caller offsets the map pointers).
+	 *	Features that are not defined (e.g., no pre-contrast frames or
+	 *	non-finite data) are NaN
+	 */
+	template <class T>
+	void Compute(const T* y, const T* yPeak, size_t voxelStride, size_t timeStride, size_t nVoxels,
+				 const SemiQuantitativeMaps &maps) const
+	{
+		for(size_t first=0; first<nVoxels; first+=blockSize) {
+			const size_t offset = first*voxelStride;
+			ComputeBlock(y+offset, yPeak ? yPeak+offset : y+offset, voxelStride, timeStride,
+						 std::min(blockSize, nVoxels-first), maps, first);
+		};
+	};
+
+
+ private:
+
+	std::vector<double>	t;
+	size_t				n;
+	std::vector<bool>	isPre;
+	std::vector<bool>	isBaseline;	/*	frames of the pre-contrast signal	*/
+	std::vector<bool>	isPost;		/*	first-pass, post-contrast frames	*/
+	size_t				nIntegrals;
+	std::vector<double>	weights;	/*	n-by-nIntegrals integration weights	*/
+	std::vector<bool>	isIntegral;	/*	integration window within the series	*/
+
+	/*	Least squares slope of the line through (tp,yp)	*/
+	static double GetSlope(double sn, double st, double stt, double sy, double sty, double tp, double yp)
+	{
+		const double num = sty-tp*sy-yp*st+sn*tp*yp;
+		const double den = stt-2*tp*st+sn*tp*tp;
+		return (den>0) ? num/den : std::numeric_limits<double>::quiet_NaN();
+	};
+
+	template <class T>
+	void ComputeBlock(const T* y, const T* yPeak, size_t voxelStride, size_t timeStride, size_t nBlock,
+					  const SemiQuantitativeMaps &maps, size_t offset) const
+	{
+		const size_t W	 = blockSize;
+		const double nan = std::numeric_limits<double>::quiet_NaN();
+
+		/*	Running statistics of the arrival test	*/
+		double mean[W], m2[W], sumStd[W], yMax[W];
+		size_t arrival[W], maxIdx[W];
+
+		/*	Pre-contrast mean, peak (and the value of y at the peak frame)
+			and sums of the slopes	*/
+		double preSum[W], peak[W], tPeak[W], yAtPeak[W];
+		double st[W], stt[W], sy[W], sty[W], sn[W];
+		double upSt[W], upStt[W], upSy[W], upSty[W], upSn[W];
+		bool   isFinite[W];
+		std::vector<double> iauc(W*nIntegrals, 0.0);
+		size_t nPre = 0;
+
+		for(size_t w=0; w<W; w++) {
+			mean[w] = m2[w] = sumStd[w] = preSum[w] = 0;
+			st[w] = stt[w] = sy[w] = sty[w] = sn[w] = 0;
+			upSt[w] = upStt[w] = upSy[w] = upSty[w] = upSn[w] = 0;
+			yMax[w]	   = -std::numeric_limits<double>::infinity();
+			peak[w]	   = -std::numeric_limits<double>::infinity();
+			tPeak[w]   = yAtPeak[w] = nan;
+			arrival[w] = n;
+			maxIdx[w]  = 0;
+			isFinite[w] = true;
+		};
+
+		for(size_t k=0; k<n; k++) {
+			double yk[W], pk[W];
+			for(size_t w=0; w<nBlock; w++) {
+				yk[w]		 = static_cast<double>( y[w*voxelStride+k*timeStride] );
+				pk[w]		 = static_cast<double>( yPeak[w*voxelStride+k*timeStride] );
+				isFinite[w] = isFinite[w] && std::isfinite(yk[w]) && std::isfinite(pk[w]);
+			};
+
+			/*	Arrival: Welford running mean and (sample) standard deviation	*/
+			for(size_t w=0; w<nBlock; w++) {
+				const double delta = pk[w]-mean[w];
+				mean[w] += delta/(k+1);
+				m2[w]	+= delta*(pk[w]-mean[w]);
+				const double sd = (k>0) ? std::sqrt(m2[w]/k) : 0.0;
+				sumStd[w] += sd;
+				if( (k>0) && (arrival[w]==n) && (sd>2.5*sumStd[w]/(k+1)) && (sumStd[w]/(k+1)>10e-6) ) {
+					arrival[w] = k;
+				};
+				if( pk[w]>yMax[w] ) {
+					yMax[w]	  = pk[w];
+					maxIdx[w] = k;
+				};
+			};
+
+			/*	Pre-contrast signal	*/
+			if( isBaseline[k] ) {
+				nPre++;
+				for(size_t w=0; w<nBlock; w++) {
+					preSum[w] += pk[w];
+				};
+			};
+
+			/*	First-pass peak and the sums of the slopes	*/
+			if( isPost[k] ) {
+				const double tk = t[k]-t[0];
+				for(size_t w=0; w<nBlock; w++) {
+					sn[w]  += 1;
+					st[w]  += tk;
+					stt[w] += tk*tk;
+					sy[w]  += yk[w];
+					sty[w] += tk*yk[w];
+					if( pk[w]>peak[w] ) {
+						peak[w]	   = pk[w];
+						tPeak[w]   = tk;
+						yAtPeak[w] = yk[w];
+						upSn[w]	   = sn[w];
+						upSt[w]	   = st[w];
+						upStt[w]   = stt[w];
+						upSy[w]	   = sy[w];
+						upSty[w]   = sty[w];
+					};
+				};
+			};
+
+			/*	Initial areas under the curve	*/
+			for(size_t i=0; i<nIntegrals; i++) {
+				const double wk = weights[k*nIntegrals+i];
+				if( wk!=0 ) {
+					for(size_t w=0; w<nBlock; w++) {
+						iauc[i*W+w] += wk*yk[w];
+					};
+				};
+			};
+		};
+
+		/*	Write the maps	*/
+		for(size_t w=0; w<nBlock; w++) {
+			const size_t v = offset+w;
+			if( !isFinite[w] ) {
+				maps.arrival[v] = maps.ttp[v] = maps.enhancement[v] = maps.ser[v] = nan;
+				maps.uptake[v]	= maps.washout[v] = nan;
+				std::fill(maps.iauc+v*nIntegrals, maps.iauc+(v+1)*nIntegrals, nan);
+				continue;
+			};
+
+			/*	detect_bolus_arrival reports the frame before the detected one
+				and the fourth frame when the test fails	*/
+			const bool isArrival = (arrival[w]<maxIdx[w]);
+			maps.arrival[v] = isArrival ? t[arrival[w]-1] : t[std::min<size_t>(3, n-1)];
+
+			const double pre	= nPre ? preSum[w]/nPre : nan;
+			const bool	 isPeak = (sn[w]>0);
+			maps.ttp[v]			= isPeak ? tPeak[w]+t[0] : nan;
+			maps.ser[v]			= isPeak ? peak[w]/pre : nan;
+			maps.enhancement[v] = isPeak ? (peak[w]-pre)/pre : nan;
+
+			/*	Uptake: frames up to the peak; washout: frames from the peak	*/
+			if( isPeak ) {
+				const double tp = tPeak[w], yp = yAtPeak[w];
+				maps.uptake[v]	= GetSlope(upSn[w], upSt[w], upStt[w], upSy[w], upSty[w], tp, yp);
+				maps.washout[v] = GetSlope(sn[w]-upSn[w]+1, st[w]-upSt[w]+tp, stt[w]-upStt[w]+tp*tp,
+										   sy[w]-upSy[w]+yp, sty[w]-upSty[w]+tp*yp, tp, yp);
+			}
+			else {
+				maps.uptake[v] = maps.washout[v] = nan;
+			};
+
+			for(size_t i=0; i<nIntegrals; i++) {
+				maps.iauc[v*nIntegrals+i] = isIntegral[i] ? iauc[i*W+w] : nan;
+			};
+		};
+	};
+};
+
+
+#endif
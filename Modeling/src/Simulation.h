@@ -0,0 +1,168 @@
+/*
+ *	Simulation.h
+ *
+ *	Monte Carlo engine used by sim_fit. The signals of a grid of "true"
+ *	parameter values are evaluated with the models of the voxel-wise fitting
+ *	engine (see VoxelModels.h), noise is added by the counter-based
+ *	generator of CounterRng.h and every noisy replicate is fitted by the
+ *	Levenberg-Marquardt solver used for maps, which gives the bias and the
+ *	precision (standard deviation) of each parameter at each grid point.
+ *
+ *	The noise of sample k of replicate r of grid point m is drawn from the
+ *	counter m*n+k of the stream r, so simulations are reproducible for a
+ *	given seed, independent of the number of threads, and a grid point can
+ *	be re-simulated alone. Without noise (sigma=0), the signals are the
+ *	(signed) model values for either distribution. Replicates are fitted in
+ *	batches of the solver's lanes and the statistics are accumulated on the
+ *	fly (Welford), so the noisy signals are never stored.
+ */
+
+
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+/*	QUATTRO headers	*/
+#include "CounterRng.h"
+#include "LevenbergMarquardt.h"
+#include "ParallelFor.h"
+
+
+template <class TModel>
+class MonteCarloFit{
+
+ public:
+
+	static const unsigned int nParams	= TModel::nParams;
+	static const unsigned int batchSize = 8;
+	typedef LevenbergMarquardt<TModel, batchSize> TSolver;
+
+	/*
+	 *	MonteCarloFit()
+	 *
+	 *	Creates the engine for the model (n samples), nReplicates noise
+	 *	realizations per grid point and the generator seed
+	 */
+	MonteCarloFit(const TModel &model, size_t n, size_t nReplicates, uint64_t seed) : model(model), n(n),
+		nReplicates(nReplicates), rng(seed), sigma(0), isRician(true), solver(model, n) {};
+
+	/*	Standard deviation and distribution (Rician or Gaussian) of the noise	*/
+	void SetNoise(double value, bool isRicianNoise)
+	{
+		sigma	 = value;
+		isRician = isRicianNoise;
+	};
+
+	/*	Solver of the fits (bounds, iterations and tolerance)	*/
+	TSolver &GetSolver() { return solver; };
+
+	/*
+	 *	Simulate()
+	 *
+	 *	Computes the n-by-nReplicates noisy signals of each of the nPoints
+	 *	grid points whose parameters start at p[m*nParams]. y receives
+	 *	n*nReplicates values per grid point
+	 */
+	void Simulate(const double* p, size_t nPoints, double* y) const
+	{
+		ParallelFor(nPoints, 16, [&](size_t begin, size_t end, unsigned int) {
+			std::vector<double> f(n);
+			for(size_t m=begin; m<end; m++) {
+				model.template Evaluate<1>(p+m*nParams, &f[0], 0);
+				for(size_t r=0; r<nReplicates; r++) {
+					AddNoise(&f[0], m, r, y+(m*nReplicates+r)*n);
+				};
+			};
+		});
+	};
+
+	/*
+	 *	Fit()
+	 *
+	 *	Fits all replicates of the nPoints grid points p, starting from the
+	 *	guesses p0 (nParams values per grid point, or a single guess shared
+	 *	by all grid points when isGuessShared). bias and sd receive the mean
+	 *	error and the standard deviation of each fitted parameter (nParams
+	 *	per grid point); fits that fail (non-finite parameters) are excluded
+	 */
+	void Fit(const double* p, const double* p0, bool isGuessShared, size_t nPoints, double* bias, double* sd) const
+	{
+		const size_t	   chunk  = 1;
+		const unsigned int nSlots = GetNumberOfParallelSlots(nPoints, chunk);
+		std::vector<TSolver> solvers(nSlots, solver);
+		ParallelFor(nPoints, chunk, [&](size_t begin, size_t end, unsigned int threadId) {
+			std::vector<double> f(n), yBatch(n*batchSize), p0Batch(nParams*batchSize), pBatch(nParams*batchSize);
+			double r2Batch[batchSize];
+			for(size_t m=begin; m<end; m++) {
+				const double* truth = p+m*nParams;
+				const double* guess = p0+(isGuessShared ? 0 : m*nParams);
+				for(unsigned int w=0; w<batchSize; w++) {
+					std::copy(guess, guess+nParams, p0Batch.begin()+w*nParams);
+				};
+				model.template Evaluate<1>(truth, &f[0], 0);
+
+				/*	Running mean and sum of squared deviations of the fits	*/
+				double mean[nParams], m2[nParams];
+				size_t count = 0;
+				std::fill(mean, mean+nParams, 0.0);
+				std::fill(m2, m2+nParams, 0.0);
+				for(size_t first=0; first<nReplicates; first+=batchSize) {
+					const size_t nInBatch = std::min<size_t>(batchSize, nReplicates-first);
+					for(size_t w=0; w<nInBatch; w++) {
+						AddNoise(&f[0], m, first+w, &yBatch[w*n]);
+					};
+					solvers[threadId].Fit(&yBatch[0], n, &p0Batch[0], nInBatch, &pBatch[0], r2Batch, 0);
+					for(size_t w=0; w<nInBatch; w++) {
+						const double* fit = &pBatch[w*nParams];
+						if( std::find_if(fit, fit+nParams, [](double v) { return !std::isfinite(v); })!=fit+nParams ) {
+							continue;
+						};
+						count++;
+						for(unsigned int j=0; j<nParams; j++) {
+							const double delta = fit[j]-mean[j];
+							mean[j] += delta/count;
+							m2[j]	+= delta*(fit[j]-mean[j]);
+						};
+					};
+				};
+				for(unsigned int j=0; j<nParams; j++) {
+					bias[m*nParams+j] = count ? mean[j]-truth[j] : std::numeric_limits<double>::quiet_NaN();
+					sd[m*nParams+j]	  = (count>1) ? std::sqrt(m2[j]/(count-1)) : std::numeric_limits<double>::quiet_NaN();
+				};
+			};
+		}, nSlots);
+	};
+
+
+ private:
+
+	/*	Signal of replicate r of grid point m; noise is only added when
+		sigma>0 (the magnitude would otherwise rectify signed models)	*/
+	void AddNoise(const double* f, size_t m, size_t r, double* out) const
+	{
+		if( sigma>0 ) {
+			rng.AddNoise(f, n, sigma, isRician, m*n, static_cast<uint32_t>(r), out);
+		}
+		else {
+			std::copy(f, f+n, out);
+		};
+	};
+
+	TModel		model;
+	size_t		n;
+	size_t		nReplicates;
+	CounterRng	rng;
+	double		sigma;
+	bool		isRician;
+	TSolver		solver;
+};
+
+
+#endif
@@ -0,0 +1,317 @@
+/*
+ *	VoxelModels.h
+ *
+ *	Signal models of the voxel-wise fitting engine (see voxel_fit and
+ *	LevenbergMarquardt.h) with their analytic Jacobians. Each model mirrors
+ *	the MATLAB function of the same name in Modeling/models/fcns, using the
+ *	same parameters and units, so that native and lsqcurvefit maps agree.
+ *	The MEX files of these models (voxel_fit, clean_maps and sim_fit) select
+ *	a model by name with DispatchVoxelModel and share its bounds handling.
+ */
+
+
+#ifndef VOXELMODELS_H
+#define VOXELMODELS_H
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <string>
+
+/*	QUATTRO headers	*/
+#include "DceKernels.h"
+
+
+/*	Model constants (acquisition parameters) shared by all models	*/
+struct VoxelModelInputs{
+	double	tr;		/*	repetition time (fspgr_vfa)	*/
+	double	te;		/*	echo time (multi_tr)	*/
+	double	flip;	/*	refocusing/inversion flip angle in degrees (fse_vti)	*/
+	const double* vif;	/*	vascular input function, one value per sample (gkm)	*/
+	double	hct;	/*	hematocrit (gkm)	*/
+	VoxelModelInputs() : tr(0), te(0), flip(180), vif(0), hct(0) {};
+};
+
+
+/*	Lower and upper parameter bounds (e.g., the LB and UB options of the MEX
+	files); empty bounds leave the parameters unbounded	*/
+struct VoxelModelBounds{
+	const double*	lower;
+	size_t			nLower;
+	const double*	upper;
+	size_t			nUpper;
+	VoxelModelBounds() : lower(0), nLower(0), upper(0), nUpper(0) {};
+
+	/*	Expands the bounds to the nParams parameters of a model. Returns
+		false when a non-empty bound does not have nParams values	*/
+	bool Get(unsigned int nParams, double* lb, double* ub) const
+	{
+		if( (nLower && (nLower!=nParams)) || (nUpper && (nUpper!=nParams)) ) {
+			return false;
+		};
+		const double inf = std::numeric_limits<double>::infinity();
+		if( nLower ) {
+			std::copy(lower, lower+nParams, lb);
+		}
+		else {
+			std::fill(lb, lb+nParams, -inf);
+		};
+		if( nUpper ) {
+			std::copy(upper, upper+nParams, ub);
+		}
+		else {
+			std::fill(ub, ub+nParams, inf);
+		};
+		return true;
+	};
+};
+
+
+/*	Predictor values common to all models	*/
+struct VoxelModel{
+	const double* x;
+	size_t		  n;
+	VoxelModel(const double* x, size_t n) : x(x), n(n) {};
+};
+
+
+/*
+ *	MultiTe
+ *
+ *	Mono-exponential decay S0*exp(-x/T) (multi_te.m)
+ */
+struct MultiTe : public VoxelModel{
+	static const unsigned int nParams = 2;
+
+	MultiTe(const double* x, size_t n, const VoxelModelInputs&) : VoxelModel(x, n) {};
+
+	template <unsigned int W>
+	void Evaluate(const double* p, double* f, double* J) const
+	{
+		for(size_t k=0; k<n; k++) {
+			for(unsigned int w=0; w<W; w++) {
+				const double s0 = p[w], t = p[W+w];
+				const double e	= std::exp(-x[k]/t);
+				f[k*W+w] = s0*e;
+				if( J ) {
+					J[k*W+w]	 = e;
+					J[(n+k)*W+w] = s0*e*x[k]/(t*t);
+				};
+			};
+		};
+	};
+};
+
+
+/*
+ *	MultiTr
+ *
+ *	Saturation recovery S0*(1-2*exp(-(x-TE/2)/T1)+exp(-x/T1)) (multi_tr.m)
+ */
+struct MultiTr : public VoxelModel{
+	static const unsigned int nParams = 2;
+	double te;
+
+	MultiTr(const double* x, size_t n, const VoxelModelInputs &inputs) : VoxelModel(x, n), te(inputs.te) {};
+
+	template <unsigned int W>
+	void Evaluate(const double* p, double* f, double* J) const
+	{
+		for(size_t k=0; k<n; k++) {
+			const double x1 = x[k]-te/2;
+			for(unsigned int w=0; w<W; w++) {
+				const double s0 = p[w], t1 = p[W+w];
+				const double e1 = std::exp(-x1/t1);
+				const double e2 = std::exp(-x[k]/t1);
+				f[k*W+w] = s0*(1-2*e1+e2);
+				if( J ) {
+					J[k*W+w]	 = 1-2*e1+e2;
+					J[(n+k)*W+w] = s0*(e2*x[k]-2*e1*x1)/(t1*t1);
+				};
+			};
+		};
+	};
+};
+
+
+/*
+ *	FspgrVfa
+ *
+ *	Spoiled gradient echo signal of the flip angle x (degrees):
+ *	S0*sin(x)*(1-E1)/(1-cos(x)*E1) with E1=exp(-TR/T1) (fspgr_vfa.m)
+ */
+struct FspgrVfa : public VoxelModel{
+	static const unsigned int nParams = 2;
+	double tr;
+
+	FspgrVfa(const double* x, size_t n, const VoxelModelInputs &inputs) : VoxelModel(x, n), tr(inputs.tr) {};
+
+	template <unsigned int W>
+	void Evaluate(const double* p, double* f, double* J) const
+	{
+		const double deg = std::atan(1.0)/45;
+		for(size_t k=0; k<n; k++) {
+			const double s = std::sin(x[k]*deg), c = std::cos(x[k]*deg);
+			for(unsigned int w=0; w<W; w++) {
+				const double s0 = p[w], t1 = p[W+w];
+				const double e1 = std::exp(-tr/t1);
+				const double d	= 1/(1-c*e1);
+				f[k*W+w] = s0*s*(1-e1)*d;
+				if( J ) {
+					J[k*W+w]	 = s*(1-e1)*d;
+					J[(n+k)*W+w] = s0*s*(c-1)*d*d*e1*tr/(t1*t1);
+				};
+			};
+		};
+	};
+};
+
+
+/*
+ *	FseVti
+ *
+ *	Inversion recovery S0*(1-(1-cos(FLIP))*exp(-x/T1)) (fse_vti.m)
+ */
+struct FseVti : public VoxelModel{
+	static const unsigned int nParams = 2;
+	double q;
+
+	FseVti(const double* x, size_t n, const VoxelModelInputs &inputs) : VoxelModel(x, n),
+		q(1-std::cos(inputs.flip*std::atan(1.0)/45)) {};
+
+	template <unsigned int W>
+	void Evaluate(const double* p, double* f, double* J) const
+	{
+		for(size_t k=0; k<n; k++) {
+			for(unsigned int w=0; w<W; w++) {
+				const double s0 = p[w], t1 = p[W+w];
+				const double e	= std::exp(-x[k]/t1);
+				f[k*W+w] = s0*(1-q*e);
+				if( J ) {
+					J[k*W+w]	 = 1-q*e;
+					J[(n+k)*W+w] = -s0*q*e*x[k]/(t1*t1);
+				};
+			};
+		};
+	};
+};
+
+
+/*
+ *	Gkm
+ *
+ *	General kinetic model (gkm_ve.m and gkm_kep.m) with the parameters
+ *	Ktrans, ve (isVe) or kep and, for three parameter models, vp. Curves are
+ *	evaluated by the recursive convolution of DceKernel; the derivatives with
+ *	respect to ve follow from kep=Ktrans/ve
+ */
+template <bool isVe, unsigned int N>
+struct Gkm : public VoxelModel{
+	static const unsigned int nParams = N;
+	DceKernel kernel;
+
+	Gkm(const double* x, size_t n, const VoxelModelInputs &inputs) : VoxelModel(x, n),
+		kernel(x, inputs.vif, n, inputs.hct) {};
+
+	template <unsigned int W>
+	void Evaluate(const double* p, double* f, double* J) const
+	{
+		double kep[W], vp[W];
+		for(unsigned int w=0; w<W; w++) {
+			kep[w] = isVe ? p[w]/(p[W+w]+DBL_EPSILON) : p[W+w];
+			vp[w]  = (N>2) ? p[2*W+w] : 0;
+		};
+		if( !J ) {
+			kernel.Evaluate<W>(p, kep, vp, f);
+			return;
+		};
+		kernel.Evaluate<W>(p, kep, vp, f, J, J+n*W, (N>2) ? J+2*n*W : 0);
+		if( isVe ) {
+			for(size_t k=0; k<n; k++) {
+				for(unsigned int w=0; w<W; w++) {
+					const double inv  = 1/(p[W+w]+DBL_EPSILON);
+					const double dKep = J[(n+k)*W+w];
+					J[k*W+w]	 += dKep*inv;
+					J[(n+k)*W+w]  = -dKep*p[w]*inv*inv;
+				};
+			};
+		};
+	};
+};
+
+
+/*
+ *	DispatchVoxelModel()
+ *
+ *	Calls f.Run<TModel>() with the model of the given name:
+ *
+ *		Name			Model
+ *		===========================================================
+ *		'multi_te'		MultiTe
+ *		'multi_tr'		MultiTr
+ *		'fspgr_vfa'		FspgrVfa
+ *		'fse_vti'		FseVti
+ *		'gkm2_ve'		Gkm<true,2>
+ *		'gkm2_kep'		Gkm<false,2>
+ *		'gkm3_ve'		Gkm<true,3>
+ *		'gkm3_kep'		Gkm<false,3>
+ *
+ *	Returns false for unknown models
+ */
+template <class TFunctor>
+bool DispatchVoxelModel(const std::string &name, const TFunctor &f)
+{
+	if( name=="multi_te" ) {
+		f.template Run<MultiTe>();
+	}
+	else if( name=="multi_tr" ) {
+		f.template Run<MultiTr>();
+	}
+	else if( name=="fspgr_vfa" ) {
+		f.template Run<FspgrVfa>();
+	}
+	else if( name=="fse_vti" ) {
+		f.template Run<FseVti>();
+	}
+	else if( name=="gkm2_ve" ) {
+		f.template Run< Gkm<true,2> >();
+	}
+	else if( name=="gkm2_kep" ) {
+		f.template Run< Gkm<false,2> >();
+	}
+	else if( name=="gkm3_ve" ) {
+		f.template Run< Gkm<true,3> >();
+	}
+	else if( name=="gkm3_kep" ) {
+		f.template Run< Gkm<false,3> >();
+	}
+	else {
+		return false;
+	};
+	return true;
+};
+
+
+/*	Number of parameters of a model	*/
+struct VoxelModelParameters{
+	unsigned int* nParams;
+	template <class TModel>
+	void Run() const { *nParams = TModel::nParams; };
+};
+
+
+/*	Number of parameters of the named model (0 for unknown models)	*/
+inline unsigned int GetVoxelModelParameters(const std::string &name)
+{
+	unsigned int nParams = 0;
+	VoxelModelParameters f = {&nParams};
+	DispatchVoxelModel(name, f);
+	return nParams;
+};
+
+
+#endif
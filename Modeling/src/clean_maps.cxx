@@ -0,0 +1,340 @@
+/*
+ *	clean_maps.cxx
+ *
+ *	MEX front end of the spatial map cleanup engine (see MapCleaner.h)
+ *
+ *	[P,R2] = clean_maps(P,R2) replaces the parameters of voxels with poor fits
+ *	(R^2 at most the threshold, but not NaN) by the median parameters of their
+ *	neighbours with acceptable fits, as modelbase.cleanmaps does to seed its
+ *	re-fits. P is the nParams-by-rows-by-cols(-by-slices...) array of parameter
+ *	maps and R2 the array of R^2 values (one per voxel). R2 is unchanged.
+ *	Slices are processed on all cores.
+ *
+ *	[P,R2] = clean_maps(P,R2,'Model',MODEL,'X',X,'Y',Y,...) re-fits the voxels
+ *	with poor fits from the neighbourhood medians using the native model MODEL
+ *	(see voxel_fit for the valid models and their constants), the n predictor
+ *	values X and the n-by-rows-by-cols(-by-slices...) data Y, keeping the new
+ *	fit when it improves the R^2. This is the algorithm of cleanmaps.
+ *
+ *	[...] = clean_maps(...,'Option',VALUE,...) specifies the model constants
+ *	of voxel_fit ('TR', 'TE', 'Flip', 'VIF' and 'Hct') and the following
+ *	options:
+ *
+ *		Option String		Description
+ *		===========================================================
+ *		'Threshold'			R^2 threshold of acceptable fits. Default: 0.5
+ *
+ *		'Width'				Half-width of the neighbourhood.
+ *							Default: floor(log2(max(size(P))))
+ *
+ *		'LB', 'UB'			Lower and upper parameter bounds of the re-fits.
+ *							Default: [] (unbounded)
+ *
+ *		'MaxIterations'		Maximum number of iterations. Default: 400
+ *
+ *		'Tolerance'			Relative change of the residual sum of squares or
+ *							of the parameters at convergence. Default: 1e-6
+ */
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+/*	MATLAB headers	*/
+#include "mex.h"
+
+/*	QUATTRO headers	*/
+#include "LevenbergMarquardt.h"
+#include "MapCleaner.h"
+#include "ParallelFor.h"
+#include "VoxelModels.h"
+
+
+/*	Inputs of the cleanup	*/
+struct CleanInputs{
+	size_t			nParams;
+	size_t			nRows;
+	size_t			nCols;
+	size_t			nSlices;
+	double			threshold;
+	size_t			width;
+	std::string		model;
+	const double*	x;
+	size_t			n;
+	const double*	y;
+	size_t			nY;
+	size_t			nVif;
+	VoxelModelBounds bounds;
+	VoxelModelInputs constants;
+	unsigned int	maxIterations;
+	double			tolerance;
+};
+
+
+/*	Median replacement of the parameters (no re-fit)	*/
+struct MedianRefit{
+	size_t nParams;
+	bool operator()(const double* init, size_t, double r2Old, double* p, double &r2)
+	{
+		std::copy(init, init+nParams, p);
+		r2 = r2Old;
+		return true;
+	};
+};
+
+
+/*	Re-fit of a voxel by the voxel_fit solver	*/
+template <class TModel>
+struct NativeRefit{
+	LevenbergMarquardt<TModel, 1> solver;
+	const double* y;
+	size_t		  n;
+	NativeRefit(const LevenbergMarquardt<TModel, 1> &solver, const double* y, size_t n) : solver(solver), y(y),
+		n(n) {};
+	bool operator()(const double* init, size_t voxel, double r2Old, double* p, double &r2)
+	{
+		const double* yVoxel = y+voxel*n;
+		for(size_t k=0; k<n; k++) {
+			if( !std::isfinite(yVoxel[k]) ) {
+				return false;
+			};
+		};
+		solver.Fit(yVoxel, n, init, 1, p, &r2, 0);
+		return (r2>r2Old);
+	};
+};
+
+
+/*
+ *	CleanSlices()
+ *
+ *	Re-fits the voxels with poor fits of all slices with the model TModel
+ */
+template <class TModel>
+void CleanSlices(const CleanInputs &in, double* p, double* r2)
+{
+	const unsigned int nParams = TModel::nParams;
+	if( in.nParams!=nParams ) {
+		mexErrMsgIdAndTxt("QUATTRO:clean_maps:invalidInput",
+						  "P must have %u rows for %s", nParams, in.model.c_str());
+	};
+	double lower[nParams], upper[nParams];
+	if( !in.bounds.Get(nParams, lower, upper) ) {
+		mexErrMsgIdAndTxt("QUATTRO:clean_maps:invalidBounds",
+						  "LB and UB must be empty or double vectors with %u elements", nParams);
+	};
+
+	const TModel model(in.x, in.n, in.constants);
+	LevenbergMarquardt<TModel, 1> solver(model, in.n);
+	solver.SetBounds(lower, upper);
+	solver.SetMaximumIterations(in.maxIterations);
+	solver.SetTolerance(in.tolerance);
+
+	const MapCleaner cleaner(nParams, in.nRows, in.nCols, in.threshold, in.width);
+	const size_t	 nVoxels = in.nRows*in.nCols;
+	ParallelFor(in.nSlices, 1, [&](size_t begin, size_t end, unsigned int) {
+		for(size_t s=begin; s<end; s++) {
+			NativeRefit<TModel> refit(solver, in.y+s*nVoxels*in.n, in.n);
+			cleaner.Clean(p+s*nVoxels*nParams, r2+s*nVoxels, refit);
+		};
+	});
+};
+
+
+/*	Cleans the slices with the model selected by DispatchVoxelModel	*/
+struct CleanSlicesRunner{
+	const CleanInputs &in;
+	double*			  p;
+	double*			  r2;
+	template <class TModel>
+	void Run() const { CleanSlices<TModel>(in, p, r2); };
+};
+
+
+static void ParseOptions(int nrhs, const mxArray *prhs[], CleanInputs &in)
+{
+	if( nrhs%2 ) {
+		mexErrMsgIdAndTxt("QUATTRO:clean_maps:invalidInput",
+						  "Options must be specified as name/value pairs");
+	};
+	for(int idx=0; idx<nrhs; idx+=2) {
+		if( !mxIsChar(prhs[idx]) ) {
+			mexErrMsgIdAndTxt("QUATTRO:clean_maps:invalidInput",
+							  "Option names must be strings");
+		};
+		char* str = mxArrayToString(prhs[idx]);
+		const std::string name(str);
+		mxFree(str);
+		const mxArray* value = prhs[idx+1];
+		if( name=="Model" ) {
+			if( !mxIsChar(value) ) {
+				mexErrMsgIdAndTxt("QUATTRO:clean_maps:invalidInput",
+								  "Model must be a string");
+			};
+			char* mStr = mxArrayToString(value);
+			in.model = mStr;
+			mxFree(mStr);
+			continue;
+		}
+		else if( (name=="X") || (name=="Y") || (name=="VIF") ) {
+			if( !mxIsDouble(value) || mxIsComplex(value) ) {
+				mexErrMsgIdAndTxt("QUATTRO:clean_maps:invalidInput",
+								  "%s must be a real double array", name.c_str());
+			};
+			if( name=="X" ) {
+				in.x = mxGetPr(value);
+				in.n = mxGetNumberOfElements(value);
+			}
+			else if( name=="Y" ) {
+				in.y  = mxGetPr(value);
+				in.nY = mxGetNumberOfElements(value);
+			}
+			else {
+				in.constants.vif = mxGetPr(value);
+				in.nVif			 = mxGetNumberOfElements(value);
+			};
+			continue;
+		}
+		else if( (name=="LB") || (name=="UB") ) {
+			if( !mxIsEmpty(value) && !mxIsDouble(value) ) {
+				mexErrMsgIdAndTxt("QUATTRO:clean_maps:invalidBounds",
+								  "LB and UB must be empty or double vectors with %u elements",
+								  static_cast<unsigned int>(in.nParams));
+			};
+			const double* bound = mxIsEmpty(value) ? 0 : mxGetPr(value);
+			if( name=="LB" ) {
+				in.bounds.lower	 = bound;
+				in.bounds.nLower = mxGetNumberOfElements(value);
+			}
+			else {
+				in.bounds.upper	 = bound;
+				in.bounds.nUpper = mxGetNumberOfElements(value);
+			};
+			continue;
+		};
+		if( !mxIsNumeric(value) || (mxGetNumberOfElements(value)!=1) ) {
+			mexErrMsgIdAndTxt("QUATTRO:clean_maps:invalidInput",
+							  "%s must be a numeric scalar", name.c_str());
+		};
+		if( name=="Threshold" ) {
+			in.threshold = mxGetScalar(value);
+		}
+		else if( name=="Width" ) {
+			in.width = static_cast<size_t>( std::max(mxGetScalar(value), 0.0) );
+		}
+		else if( name=="TR" ) {
+			in.constants.tr = mxGetScalar(value);
+		}
+		else if( name=="TE" ) {
+			in.constants.te = mxGetScalar(value);
+		}
+		else if( name=="Flip" ) {
+			in.constants.flip = mxGetScalar(value);
+		}
+		else if( name=="Hct" ) {
+			in.constants.hct = mxGetScalar(value);
+		}
+		else if( name=="MaxIterations" ) {
+			in.maxIterations = static_cast<unsigned int>( std::max(mxGetScalar(value), 0.0) );
+		}
+		else if( name=="Tolerance" ) {
+			in.tolerance = mxGetScalar(value);
+		}
+		else {
+			mexErrMsgIdAndTxt("QUATTRO:clean_maps:invalidInput",
+							  "Unknown option: %s", name.c_str());
+		};
+	};
+};
+
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+
+	/*	Validate the inputs	*/
+	if( nrhs<2 ) {
+		mexErrMsgIdAndTxt("QUATTRO:clean_maps:invalidInput",
+						  "P and R2 must be specified");
+	};
+	for(int idx=0; idx<2; idx++) {
+		if( !mxIsDouble(prhs[idx]) || mxIsComplex(prhs[idx]) ) {
+			mexErrMsgIdAndTxt("QUATTRO:clean_maps:invalidInput",
+							  "P and R2 must be real double arrays");
+		};
+	};
+	const mwSize  nDims = mxGetNumberOfDimensions(prhs[0]);
+	const mwSize* dims	= mxGetDimensions(prhs[0]);
+
+	CleanInputs in;
+	in.nParams = dims[0];
+	in.nRows   = dims[1];
+	in.nCols   = (nDims>2) ? dims[2] : 1;
+	in.nSlices = 1;
+	for(mwSize d=3; d<nDims; d++) {
+		in.nSlices *= dims[d];
+	};
+	if( (in.nParams==0) || (mxGetNumberOfElements(prhs[1])*in.nParams!=mxGetNumberOfElements(prhs[0])) ) {
+		mexErrMsgIdAndTxt("QUATTRO:clean_maps:invalidInput",
+						  "R2 must have one element per voxel of P");
+	};
+	in.threshold = 0.5;
+	in.width	 = 0;
+	for(mwSize d=0; d<nDims; d++) {
+		in.width = std::max<size_t>(in.width, dims[d]);
+	};
+	in.width		 = static_cast<size_t>( std::floor(std::log2(static_cast<double>(in.width))) );
+	in.x			 = 0;
+	in.n			 = 0;
+	in.y			 = 0;
+	in.nY			 = 0;
+	in.nVif			 = 0;
+	in.maxIterations = 400;
+	in.tolerance	 = 1e-6;
+	ParseOptions(nrhs-2, prhs+2, in);
+	if( !in.model.empty() && (!in.x || !in.y) ) {
+		mexErrMsgIdAndTxt("QUATTRO:clean_maps:invalidInput",
+						  "X and Y must be specified to re-fit the voxels");
+	};
+	if( in.y && (in.nY!=in.n*in.nRows*in.nCols*in.nSlices) ) {
+		mexErrMsgIdAndTxt("QUATTRO:clean_maps:invalidInput",
+						  "Y must have NUMEL(X) samples per voxel");
+	};
+	if( in.constants.vif && (in.nVif!=in.n) ) {
+		mexErrMsgIdAndTxt("QUATTRO:clean_maps:invalidInput",
+						  "VIF must be a real double vector with NUMEL(X) elements");
+	};
+	if( (in.model.compare(0, 3, "gkm")==0) && !in.constants.vif ) {
+		mexErrMsgIdAndTxt("QUATTRO:clean_maps:invalidInput",
+						  "The VIF must be specified for %s", in.model.c_str());
+	};
+
+	/*	Create the outputs and clean the maps	*/
+	plhs[0] = mxDuplicateArray(prhs[0]);
+	mxArray* r2 = mxDuplicateArray(prhs[1]);
+	double*	 p	= mxGetPr(plhs[0]);
+	double*	 pR2 = mxGetPr(r2);
+	const CleanSlicesRunner clean = {in, p, pR2};
+	if( in.model.empty() ) {
+		const MapCleaner cleaner(in.nParams, in.nRows, in.nCols, in.threshold, in.width);
+		const size_t	 nVoxels = in.nRows*in.nCols;
+		ParallelFor(in.nSlices, 1, [&](size_t begin, size_t end, unsigned int) {
+			for(size_t s=begin; s<end; s++) {
+				MedianRefit refit = {in.nParams};
+				cleaner.Clean(p+s*nVoxels*in.nParams, pR2+s*nVoxels, refit);
+			};
+		});
+	}
+	else if( !DispatchVoxelModel(in.model, clean) ) {
+		mexErrMsgIdAndTxt("QUATTRO:clean_maps:invalidModel",
+						  "Unknown model: %s", in.model.c_str());
+	};
+	if( nlhs>1 ) {
+		plhs[1] = r2;
+	}
+	else {
+		mxDestroyArray(r2);
+	};
+};
@@ -0,0 +1,272 @@
+/*
+ *	dict_fit.cxx
+ *
+ *	MEX front end of the dictionary fitting engine (see Dictionary.h)
+ *
+ *	[P,R2] = dict_fit(MODEL,X,Y) fits the model specified by the string MODEL
+ *	to each column of the n-by-M array Y sampled at the n predictor values X
+ *	by matching the data with a precomputed dictionary of signals over a
+ *	grid of the relaxation time and refining the best match with a few
+ *	Gauss-Newton steps. P is the nParams-by-M array of parameters and R2 is
+ *	the 1-by-M array of R^2 values, the layout used by fitmaps. Voxels with
+ *	non-finite data are NaN. Voxels are processed on all cores. The
+ *	dictionary of each model is kept between calls with the same predictor
+ *	values, model constants and grid (e.g., the slices of a streamed map
+ *	computation) and only rebuilt when these change. Supported models and
+ *	parameters:
+ *
+ *		'multi_te'	- S0, T (multi_te.m)
+ *		'multi_tr'	- S0, T1 (multi_tr.m, requires 'TE')
+ *		'fse_vti'	- S0, T1 (fse_vti.m)
+ *		'ir'		- S0, T1 and the inversion flip angle (degrees) of the
+ *					  three parameter model of restore_ir.m
+ *
+ *	[P,R2,RES] = dict_fit(...) also returns the n-by-M array of residuals
+ *	(model minus data).
+ *
+ *	[...] = dict_fit(...,'Option',VALUE,...) specifies the following options:
+ *
+ *		Option String		Description
+ *		===========================================================
+ *		'TE'				Echo time (multi_tr). Default: 0
+ *
+ *		'Flip'				Inversion flip angle in degrees (fse_vti).
+ *							Default: 180
+ *
+ *		'Range'				Two-element vector of the smallest and largest
+ *							relaxation times of the dictionary. Default:
+ *							[min(X(X>0))/10 10*max(X)]
+ *
+ *		'Steps'				Number of (logarithmically spaced) relaxation
+ *							times of the dictionary. Default: 1000
+ *
+ *		'Iterations'		Number of Gauss-Newton iterations that refine
+ *							the dictionary match. Default: 3
+ *
+ *		'Polarity'			Logical flag; when true, the polarity of the
+ *							magnitude inversion recovery data is restored
+ *							as in restore_ir.m and the residuals are those
+ *							of the magnitude of the model. Default: false
+ */
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*	MATLAB headers	*/
+#include "mex.h"
+
+/*	QUATTRO headers	*/
+#include "Dictionary.h"
+#include "ParallelFor.h"
+
+
+/*	Dictionary options	*/
+struct DictionaryOptions{
+	double		 tMin;
+	double		 tMax;
+	size_t		 nSteps;
+	unsigned int nIterations;
+	bool		 isPolarity;
+};
+
+
+/*	Dictionary of the last call of each model and the protocol (predictor
+	values, model constant and grid) from which it was computed	*/
+template <class TAtom>
+struct DictionaryCache{
+	static std::vector<double>						key;
+	static std::shared_ptr< DictionaryFit<TAtom> >	engine;
+};
+template <class TAtom> std::vector<double> DictionaryCache<TAtom>::key;
+template <class TAtom> std::shared_ptr< DictionaryFit<TAtom> > DictionaryCache<TAtom>::engine;
+
+
+static void ClearCaches()
+{
+	DictionaryCache<DecayAtom>::engine.reset();
+	DictionaryCache<SaturationRecoveryAtom>::engine.reset();
+	DictionaryCache<InversionRecoveryAtom>::engine.reset();
+	DictionaryCache<InversionRecoveryFlipAtom>::engine.reset();
+};
+
+
+/*
+ *	FitVoxels()
+ *
+ *	Fits the nVoxels columns of y using the dictionary of the atom, which is
+ *	only built when the predictor values, the model constant of the atom or
+ *	the grid differ from those of the cached dictionary
+ */
+template <class TAtom>
+void FitVoxels(const TAtom &atom, double constant, const double* x, size_t n, const double* y, size_t nVoxels,
+			   const DictionaryOptions &opts, double* p, double* r2, double* res)
+{
+	typedef DictionaryFit<TAtom> TEngine;
+	std::vector<double> key(x, x+n);
+	key.push_back(constant);
+	key.push_back(opts.tMin);
+	key.push_back(opts.tMax);
+	key.push_back(static_cast<double>(opts.nSteps));
+	if( !DictionaryCache<TAtom>::engine || (key!=DictionaryCache<TAtom>::key) ) {
+		DictionaryCache<TAtom>::engine.reset(new TEngine(atom, x, n, opts.tMin, opts.tMax, opts.nSteps));
+		DictionaryCache<TAtom>::key.swap(key);
+	};
+	TEngine &engine = *DictionaryCache<TAtom>::engine;
+	engine.SetIterations(opts.nIterations);
+	engine.SetPolarityRestoration(opts.isPolarity);
+	ParallelFor(nVoxels, 4*TEngine::voxelBlock, [&](size_t begin, size_t end, unsigned int) {
+		engine.Fit(y+begin*n, end-begin, p+begin*TEngine::nParams, r2+begin, res ? res+begin*n : 0);
+	});
+};
+
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+
+	/*	Validate the inputs	*/
+	if( nrhs<3 ) {
+		mexErrMsgIdAndTxt("QUATTRO:dict_fit:invalidInput",
+						  "MODEL, X and Y must be specified");
+	};
+	if( !mxIsChar(prhs[0]) ) {
+		mexErrMsgIdAndTxt("QUATTRO:dict_fit:invalidInput",
+						  "MODEL must be a string");
+	};
+	for(int idx=1; idx<3; idx++) {
+		if( !mxIsDouble(prhs[idx]) || mxIsComplex(prhs[idx]) ) {
+			mexErrMsgIdAndTxt("QUATTRO:dict_fit:invalidInput",
+							  "X and Y must be real double arrays");
+		};
+	};
+	char* str = mxArrayToString(prhs[0]);
+	const std::string model(str);
+	mxFree(str);
+	const size_t  n = mxGetNumberOfElements(prhs[1]);
+	const double* x = mxGetPr(prhs[1]);
+	if( (n<2) || (mxGetM(prhs[2])!=n) ) {
+		mexErrMsgIdAndTxt("QUATTRO:dict_fit:invalidInput",
+						  "At least two predictor values and one row of Y per value are required");
+	};
+	const size_t nVoxels = mxGetNumberOfElements(prhs[2])/n;
+	mexAtExit(ClearCaches);
+
+	/*	Default dictionary range from the predictor values	*/
+	double xMin = 0, xMax = 0;
+	for(size_t k=0; k<n; k++) {
+		if( (x[k]>0) && ((xMin==0) || (x[k]<xMin)) ) {
+			xMin = x[k];
+		};
+		xMax = std::max(xMax, x[k]);
+	};
+	DictionaryOptions opts;
+	opts.tMin		 = xMin/10;
+	opts.tMax		 = 10*xMax;
+	opts.nSteps		 = 1000;
+	opts.nIterations = 3;
+	opts.isPolarity	 = false;
+
+	/*	Parse the options	*/
+	double te = 0, flip = 180;
+	if( (nrhs-3)%2 ) {
+		mexErrMsgIdAndTxt("QUATTRO:dict_fit:invalidInput",
+						  "Options must be specified as name/value pairs");
+	};
+	for(int idx=3; idx<nrhs; idx+=2) {
+		if( !mxIsChar(prhs[idx]) ) {
+			mexErrMsgIdAndTxt("QUATTRO:dict_fit:invalidInput",
+							  "Option names must be strings");
+		};
+		str = mxArrayToString(prhs[idx]);
+		const std::string name(str);
+		mxFree(str);
+		const mxArray* value = prhs[idx+1];
+		if( (name!="Polarity") && (!mxIsNumeric(value) || mxIsComplex(value)) ) {
+			mexErrMsgIdAndTxt("QUATTRO:dict_fit:invalidInput",
+							  "%s must be a real numeric value", name.c_str());
+		};
+		if( name=="TE" ) {
+			te = mxGetScalar(value);
+		}
+		else if( name=="Flip" ) {
+			flip = mxGetScalar(value);
+		}
+		else if( name=="Range" ) {
+			if( mxGetNumberOfElements(value)!=2 ) {
+				mexErrMsgIdAndTxt("QUATTRO:dict_fit:invalidInput",
+								  "Range must be a two-element vector");
+			};
+			opts.tMin = mxGetPr(value)[0];
+			opts.tMax = mxGetPr(value)[1];
+		}
+		else if( name=="Steps" ) {
+			opts.nSteps = static_cast<size_t>( std::max(mxGetScalar(value), 2.0) );
+		}
+		else if( name=="Iterations" ) {
+			opts.nIterations = static_cast<unsigned int>( std::max(mxGetScalar(value), 0.0) );
+		}
+		else if( name=="Polarity" ) {
+			if( !(mxIsLogical(value) || mxIsNumeric(value)) || (mxGetNumberOfElements(value)!=1) ) {
+				mexErrMsgIdAndTxt("QUATTRO:dict_fit:invalidInput",
+								  "Polarity must be a logical scalar");
+			};
+			opts.isPolarity = (mxGetScalar(value)!=0);
+		}
+		else {
+			mexErrMsgIdAndTxt("QUATTRO:dict_fit:invalidInput",
+							  "Unknown option: %s", name.c_str());
+		};
+	};
+	if( !(opts.tMin>0) || !(opts.tMax>opts.tMin) || !std::isfinite(opts.tMax) ) {
+		mexErrMsgIdAndTxt("QUATTRO:dict_fit:invalidInput",
+						  "Range must be finite, positive and increasing");
+	};
+
+	/*	Create the outputs and fit the model	*/
+	size_t nParams;
+	if( (model=="multi_te") || (model=="multi_tr") || (model=="fse_vti") ) {
+		nParams = 2;
+	}
+	else if( model=="ir" ) {
+		nParams = 3;
+	}
+	else {
+		mexErrMsgIdAndTxt("QUATTRO:dict_fit:invalidInput",
+						  "Unknown model: %s", model.c_str());
+		return;
+	};
+	plhs[0] = mxCreateDoubleMatrix(nParams, nVoxels, mxREAL);
+	mxArray* r2	 = mxCreateDoubleMatrix(1, nVoxels, mxREAL);
+	mxArray* res = (nlhs>2) ? mxCreateDoubleMatrix(n, nVoxels, mxREAL) : 0;
+	double*	 p	  = mxGetPr(plhs[0]);
+	double*	 pR2  = mxGetPr(r2);
+	double*	 pRes = res ? mxGetPr(res) : 0;
+	const double* y = mxGetPr(prhs[2]);
+
+	if( model=="multi_te" ) {
+		FitVoxels(DecayAtom(), 0, x, n, y, nVoxels, opts, p, pR2, pRes);
+	}
+	else if( model=="multi_tr" ) {
+		FitVoxels(SaturationRecoveryAtom(te), te, x, n, y, nVoxels, opts, p, pR2, pRes);
+	}
+	else if( model=="fse_vti" ) {
+		FitVoxels(InversionRecoveryAtom(flip), flip, x, n, y, nVoxels, opts, p, pR2, pRes);
+	}
+	else {
+		FitVoxels(InversionRecoveryFlipAtom(), 0, x, n, y, nVoxels, opts, p, pR2, pRes);
+	};
+
+	if( nlhs>1 ) {
+		plhs[1] = r2;
+	}
+	else {
+		mxDestroyArray(r2);
+	};
+	if( res ) {
+		plhs[2] = res;
+	};
+};
@@ -0,0 +1,157 @@
+/*
+ *	exp_fit.cxx
+ *
+ *	MEX front end of the exponential decay engines (see Exponential.h)
+ *
+ *	[P,R2] = exp_fit(X,Y) computes the mono-exponential fit S0*exp(-X/T) of each
+ *	column of the n-by-M array Y sampled at the n predictor values X (e.g.,
+ *	echo times or b-values) by the weighted log-linear regression of log(Y).
+ *	P is the 2-by-M array of S0 and T (or the rate, see 'Rate') and R2 is the
+ *	1-by-M array of R^2 values of the model, the layout used by fitmaps.
+ *	Voxels with non-finite or non-positive signals are NaN.
+ *
+ *	[S,R2] = exp_fit(X,Y,'Spectrum',T) computes the non-negative multi-
+ *	exponential spectra of Y over the m time constants T by non-negative least
+ *	squares. S is the m-by-M array of amplitudes, such that Y(:,v) is fitted by
+ *	exp(-X(:)*(1./T(:)'))*S(:,v). Voxels with non-finite signals are NaN.
+ *
+ *	[P,R2,RES] = exp_fit(...) also returns the n-by-M array of residuals (model
+ *	minus data). Voxels are processed on all cores.
+ *
+ *	[...] = exp_fit(...,'Option',VALUE,...) specifies the following options:
+ *
+ *		Option String		Description
+ *		===========================================================
+ *		'Rate'				Logical flag; when true, the second row of P is
+ *							the rate 1/T (e.g., ADC or R2). Default: false
+ *
+ *		'Weighted'			Logical flag; when true, the log-linear
+ *							regression is weighted by the squared signal.
+ *							Default: true
+ *
+ *		'Spectrum'			Vector of the time constants of the NNLS spectrum
+ *
+ *		'Lambda'			Tikhonov regularization weight of the spectrum
+ *							(relative to the unit amplitude decay basis).
+ *							Default: 0
+ */
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <string>
+
+/*	MATLAB headers	*/
+#include "mex.h"
+
+/*	QUATTRO headers	*/
+#include "Exponential.h"
+#include "ParallelFor.h"
+
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+
+	/*	Validate the inputs	*/
+	if( nrhs<2 ) {
+		mexErrMsgIdAndTxt("QUATTRO:exp_fit:invalidInput",
+						  "X and Y must be specified");
+	};
+	for(int idx=0; idx<2; idx++) {
+		if( !mxIsDouble(prhs[idx]) || mxIsComplex(prhs[idx]) ) {
+			mexErrMsgIdAndTxt("QUATTRO:exp_fit:invalidInput",
+							  "X and Y must be real double arrays");
+		};
+	};
+	const size_t n = mxGetNumberOfElements(prhs[0]);
+	if( (n<2) || (mxGetM(prhs[1])!=n) ) {
+		mexErrMsgIdAndTxt("QUATTRO:exp_fit:invalidInput",
+						  "At least two predictor values and one row of Y per value are required");
+	};
+	const size_t nVoxels = mxGetNumberOfElements(prhs[1])/n;
+
+	/*	Parse the options	*/
+	bool		   isRate = false, isWeighted = true;
+	const mxArray* spectrum = 0;
+	double		   lambda = 0;
+	if( nrhs%2 ) {
+		mexErrMsgIdAndTxt("QUATTRO:exp_fit:invalidInput",
+						  "Options must be specified as name/value pairs");
+	};
+	for(int idx=2; idx<nrhs; idx+=2) {
+		if( !mxIsChar(prhs[idx]) ) {
+			mexErrMsgIdAndTxt("QUATTRO:exp_fit:invalidInput",
+							  "Option names must be strings");
+		};
+		char* str = mxArrayToString(prhs[idx]);
+		const std::string name(str);
+		mxFree(str);
+		const mxArray* value = prhs[idx+1];
+		if( !(mxIsNumeric(value) || mxIsLogical(value)) || mxIsComplex(value) || mxIsEmpty(value) ) {
+			mexErrMsgIdAndTxt("QUATTRO:exp_fit:invalidInput",
+							  "%s must be a real numeric or logical value", name.c_str());
+		};
+		if( name=="Rate" ) {
+			isRate = (mxGetScalar(value)!=0);
+		}
+		else if( name=="Weighted" ) {
+			isWeighted = (mxGetScalar(value)!=0);
+		}
+		else if( name=="Spectrum" ) {
+			if( !mxIsDouble(value) ) {
+				mexErrMsgIdAndTxt("QUATTRO:exp_fit:invalidInput",
+								  "Spectrum must be a double array");
+			};
+			spectrum = value;
+		}
+		else if( name=="Lambda" ) {
+			lambda = std::max(mxGetScalar(value), 0.0);
+		}
+		else {
+			mexErrMsgIdAndTxt("QUATTRO:exp_fit:invalidInput",
+							  "Unknown option: %s", name.c_str());
+		};
+	};
+
+	/*	Create the outputs	*/
+	const size_t nRows = spectrum ? mxGetNumberOfElements(spectrum) : LogLinearFit::nParams;
+	plhs[0] = mxCreateDoubleMatrix(nRows, nVoxels, mxREAL);
+	mxArray* r2	 = mxCreateDoubleMatrix(1, nVoxels, mxREAL);
+	mxArray* res = (nlhs>2) ? mxCreateDoubleMatrix(n, nVoxels, mxREAL) : 0;
+	double*	 p	  = mxGetPr(plhs[0]);
+	double*	 pR2  = mxGetPr(r2);
+	double*	 pRes = res ? mxGetPr(res) : 0;
+	const double* x = mxGetPr(prhs[0]);
+	const double* y = mxGetPr(prhs[1]);
+
+	/*	Compute the spectra or the mono-exponential maps	*/
+	if( spectrum ) {
+		NnlsFit engine(x, n, mxGetPr(spectrum), nRows);
+		engine.SetRegularization(lambda);
+		ParallelFor(nVoxels, 4*NnlsFit::blockSize, [&](size_t begin, size_t end, unsigned int) {
+			engine.Fit(y+begin*n, end-begin, p+begin*nRows, pR2+begin, pRes ? pRes+begin*n : 0);
+		});
+	}
+	else {
+		LogLinearFit engine(x, n);
+		engine.SetWeighted(isWeighted);
+		ParallelFor(nVoxels, 4096, [&](size_t begin, size_t end, unsigned int) {
+			engine.Fit(y+begin*n, end-begin, p+begin*nRows, pR2+begin, pRes ? pRes+begin*n : 0);
+			if( !isRate ) {
+				for(size_t v=begin; v<end; v++) {
+					p[v*nRows+1] = 1/p[v*nRows+1];
+				};
+			};
+		});
+	};
+
+	if( nlhs>1 ) {
+		plhs[1] = r2;
+	}
+	else {
+		mxDestroyArray(r2);
+	};
+	if( res ) {
+		plhs[2] = res;
+	};
+};
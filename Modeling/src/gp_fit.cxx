@@ -0,0 +1,208 @@
+/*
+ *	gp_fit.cxx
+ *
+ *	MEX front end of the Gaussian process regression engine (see
+ *	GaussianProcess.h)
+ *
+ *	[F,HYP,LL] = gp_fit(T,Y,TSTAR) performs Gaussian process regression of the
+ *	columns of the n-by-M array Y (or a vector of n values) sampled at the n
+ *	times T. All columns share the hyperparameters [s l sigma] of cov_gp,
+ *	which are estimated by maximizing the log marginal likelihood of the batch
+ *	(the sum of marg_ll over the columns). F is the numel(TSTAR)-by-M array of
+ *	the posterior means at the times TSTAR (empty TSTAR: no prediction), HYP
+ *	is the 1-by-3 array of hyperparameters and LL the log marginal likelihood.
+ *	Columns are processed on all cores.
+ *
+ *	[...] = gp_fit(...,'Option',VALUE,...) specifies the following options:
+ *
+ *		Option String		Description
+ *		===========================================================
+ *		'Kernel'			Covariance function of cov_gp, 'se' (squared
+ *							exponential) or 'ad' (absolute difference).
+ *							Default: 'se'
+ *
+ *		'Hyperparameters'	Initial (or fixed, see 'Optimize') values of
+ *							[s l sigma]. Default: estimated from the data
+ *
+ *		'Optimize'			Logical scalar or 3-element mask of the
+ *							hyperparameters to estimate. Default: true
+ *
+ *		'Inducing'			Number of evenly spaced inducing points or
+ *							vector of inducing times of the DTC sparse
+ *							approximation. Default: [] (exact GP)
+ *
+ *		'MaxIterations'		Maximum number of BFGS iterations. Default: 100
+ */
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+/*	MATLAB headers	*/
+#include "mex.h"
+
+/*	QUATTRO headers	*/
+#include "GaussianProcess.h"
+
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+
+	/*	Validate the inputs	*/
+	if( nrhs<2 ) {
+		mexErrMsgIdAndTxt("QUATTRO:gp_fit:invalidInput",
+						  "T and Y must be specified");
+	};
+	for(int idx=0; idx<std::min(nrhs, 3); idx++) {
+		if( !mxIsDouble(prhs[idx]) || mxIsComplex(prhs[idx]) ) {
+			mexErrMsgIdAndTxt("QUATTRO:gp_fit:invalidInput",
+							  "T, Y and TSTAR must be real double arrays");
+		};
+	};
+	const size_t n	   = mxGetNumberOfElements(prhs[0]);
+	const bool	 isVec = (mxGetNumberOfElements(prhs[1])==n) && (mxGetM(prhs[1])==1 || mxGetN(prhs[1])==1);
+	if( (n<2) || (!isVec && (mxGetM(prhs[1])!=n)) ) {
+		mexErrMsgIdAndTxt("QUATTRO:gp_fit:invalidInput",
+						  "At least two times and one row of Y per time are required");
+	};
+	const size_t  nCurves = mxGetNumberOfElements(prhs[1])/n;
+	const size_t  nStar	  = (nrhs>2) ? mxGetNumberOfElements(prhs[2]) : 0;
+	const double* t		  = mxGetPr(prhs[0]);
+	const double* y		  = mxGetPr(prhs[1]);
+
+	/*	Parse the options	*/
+	GaussianProcess::Kernel kernel = GaussianProcess::SquaredExponential;
+	std::vector<double>	hyp, inducing;
+	bool				isFree[GaussianProcess::nHyperparameters] = {true, true, true};
+	unsigned int		maxIterations = 100;
+	if( (nrhs>3) && !(nrhs%2) ) {
+		mexErrMsgIdAndTxt("QUATTRO:gp_fit:invalidInput",
+						  "Options must be specified as name/value pairs");
+	};
+	for(int idx=3; idx<nrhs; idx+=2) {
+		if( !mxIsChar(prhs[idx]) ) {
+			mexErrMsgIdAndTxt("QUATTRO:gp_fit:invalidInput",
+							  "Option names must be strings");
+		};
+		char* str = mxArrayToString(prhs[idx]);
+		const std::string name(str);
+		mxFree(str);
+		const mxArray* value = prhs[idx+1];
+		if( name=="Kernel" ) {
+			char* kStr = mxIsChar(value) ? mxArrayToString(value) : 0;
+			const std::string kName(kStr ? kStr : "");
+			mxFree(kStr);
+			if( kName=="se" ) {
+				kernel = GaussianProcess::SquaredExponential;
+			}
+			else if( kName=="ad" ) {
+				kernel = GaussianProcess::AbsoluteDifference;
+			}
+			else {
+				mexErrMsgIdAndTxt("QUATTRO:gp_fit:invalidInput",
+								  "Kernel must be 'se' or 'ad'");
+			};
+			continue;
+		};
+		if( !(mxIsNumeric(value) || mxIsLogical(value)) || mxIsComplex(value) ) {
+			mexErrMsgIdAndTxt("QUATTRO:gp_fit:invalidInput",
+							  "%s must be a real numeric or logical value", name.c_str());
+		};
+		const size_t nValue = mxGetNumberOfElements(value);
+		if( name=="Hyperparameters" ) {
+			if( !mxIsDouble(value) || (nValue!=GaussianProcess::nHyperparameters) ) {
+				mexErrMsgIdAndTxt("QUATTRO:gp_fit:invalidInput",
+								  "Hyperparameters must be a 3-element double array");
+			};
+			hyp.assign(mxGetPr(value), mxGetPr(value)+nValue);
+		}
+		else if( name=="Optimize" ) {
+			if( (nValue!=1) && (nValue!=GaussianProcess::nHyperparameters) ) {
+				mexErrMsgIdAndTxt("QUATTRO:gp_fit:invalidInput",
+								  "Optimize must be a logical scalar or 3-element mask");
+			};
+			mxArray* d = 0;
+			mexCallMATLAB(1, &d, 1, const_cast<mxArray**>(&value), "double");
+			for(unsigned int h=0; h<GaussianProcess::nHyperparameters; h++) {
+				isFree[h] = (mxGetPr(d)[(nValue==1) ? 0 : h]!=0);
+			};
+			mxDestroyArray(d);
+		}
+		else if( name=="Inducing" ) {
+			if( !mxIsDouble(value) ) {
+				mexErrMsgIdAndTxt("QUATTRO:gp_fit:invalidInput",
+								  "Inducing must be a double array");
+			};
+			inducing.assign(mxGetPr(value), mxGetPr(value)+nValue);
+		}
+		else if( name=="MaxIterations" ) {
+			maxIterations = static_cast<unsigned int>( std::max(mxGetScalar(value), 0.0) );
+		}
+		else {
+			mexErrMsgIdAndTxt("QUATTRO:gp_fit:invalidInput",
+							  "Unknown option: %s", name.c_str());
+		};
+	};
+
+	/*	A scalar number of inducing points is spread over the times	*/
+	if( inducing.size()==1 ) {
+		const size_t m = static_cast<size_t>( std::max(inducing[0], 0.0) );
+		const double tMin = *std::min_element(t, t+n), tMax = *std::max_element(t, t+n);
+		inducing.resize(m);
+		for(size_t i=0; i<m; i++) {
+			inducing[i] = (m>1) ? tMin+i*(tMax-tMin)/(m-1) : (tMin+tMax)/2;
+		};
+	};
+
+	/*	Default hyperparameters: the pooled standard deviation of the data,
+		a quarter of the time span and a tenth of the deviation as noise	*/
+	if( hyp.empty() ) {
+		double sum = 0, sumSq = 0;
+		size_t count = 0;
+		for(size_t k=0; k<n*nCurves; k++) {
+			if( std::isfinite(y[k]) ) {
+				sum	  += y[k];
+				sumSq += y[k]*y[k];
+				count++;
+			};
+		};
+		const double mean = count ? sum/count : 0;
+		const double sd	  = count ? std::sqrt(std::max(sumSq/count-mean*mean, 0.0)) : 1;
+		const double span = *std::max_element(t, t+n)-*std::min_element(t, t+n);
+		const double l	  = (span>0) ? span/4 : 1;
+		hyp.push_back( (sd>0) ? sd : 1 );
+		hyp.push_back( (kernel==GaussianProcess::SquaredExponential) ? l : 1/std::sqrt(l) );
+		hyp.push_back( hyp[0]/10 );
+	};
+
+	/*	Estimate the hyperparameters of the batch	*/
+	GaussianProcess engine(t, n, kernel);
+	if( !inducing.empty() ) {
+		engine.SetInducingPoints(&inducing[0], inducing.size());
+	};
+	if( !engine.SetHyperparameters(&hyp[0]) ) {
+		mexErrMsgIdAndTxt("QUATTRO:gp_fit:invalidInput",
+						  "The covariance of the initial hyperparameters is not positive definite");
+	};
+	double ll = engine.GetLogLikelihood(y, nCurves, 0);
+	if( (isFree[0] || isFree[1] || isFree[2]) && (maxIterations>0) ) {
+		ll = engine.Optimize(y, nCurves, isFree, maxIterations);
+	};
+
+	/*	Create the outputs	*/
+	plhs[0] = mxCreateDoubleMatrix(nStar, nCurves, mxREAL);
+	if( nStar ) {
+		engine.Predict(y, nCurves, mxGetPr(prhs[2]), nStar, mxGetPr(plhs[0]));
+	};
+	if( nlhs>1 ) {
+		plhs[1] = mxCreateDoubleMatrix(1, GaussianProcess::nHyperparameters, mxREAL);
+		std::copy(engine.GetHyperparameters(), engine.GetHyperparameters()+GaussianProcess::nHyperparameters,
+				  mxGetPr(plhs[1]));
+	};
+	if( nlhs>2 ) {
+		plhs[2] = mxCreateDoubleScalar(ll);
+	};
+};
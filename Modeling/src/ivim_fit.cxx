@@ -0,0 +1,158 @@
+/*
+ *	ivim_fit.cxx
+ *
+ *	MEX front end of the IVIM engine (see Ivim.h)
+ *
+ *	[P,R2] = ivim_fit(B,Y) estimates the parameters of the intravoxel
+ *	incoherent motion model (ivim.m) for each column of the n-by-M array of
+ *	diffusion weighted signals Y acquired with the n b-values B (s/mm^2) by a
+ *	segmented fit: the high b-value signals give S0 and D, and the low
+ *	b-value signals give the perfusion fraction f and the pseudo-diffusion
+ *	coefficient D*. P is the 5-by-M array of S0, D, D*, f and K (the order of
+ *	ivim.m) and R2 is the 1-by-M array of R^2 values of the model, the layout
+ *	used by fitmaps. Voxels with non-finite or non-positive signals, or
+ *	without a valid estimate, are NaN. Voxels are processed on all cores.
+ *
+ *	[P,R2,RES] = ivim_fit(...) also returns the n-by-M array of residuals
+ *	(model minus data).
+ *
+ *	[...] = ivim_fit(...,'Option',VALUE,...) specifies the following options:
+ *
+ *		Option String		Description
+ *		===========================================================
+ *		'Threshold'			Smallest b-value of the diffusion segment.
+ *							Default: 200
+ *
+ *		'Perfusion'			Logical flag; when false, a (kurtosis) mono-
+ *							exponential model is fitted to all b-values and
+ *							D* and f are 0. Default: true
+ *
+ *		'Kurtosis'			Logical flag; when true, the diffusion kurtosis
+ *							K is estimated. Default: false
+ *
+ *		'Range'				Two-element vector of the smallest and largest
+ *							D* of the grid search. Default: [0.003 0.3]
+ *
+ *		'Iterations'		Number of Gauss-Newton iterations of the D* and
+ *							Bayesian refinements. Default: 10
+ *
+ *		'Bayesian'			Logical flag; when true, the segmented estimates
+ *							of all voxels define shared priors of D, D*, f
+ *							and K and every voxel is refined by a maximum a
+ *							posteriori fit of all parameters. Default: false
+ */
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <string>
+
+/*	MATLAB headers	*/
+#include "mex.h"
+
+/*	QUATTRO headers	*/
+#include "Ivim.h"
+#include "ParallelFor.h"
+
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+
+	/*	Validate the inputs	*/
+	if( nrhs<2 ) {
+		mexErrMsgIdAndTxt("QUATTRO:ivim_fit:invalidInput",
+						  "B and Y must be specified");
+	};
+	for(int idx=0; idx<2; idx++) {
+		if( !mxIsDouble(prhs[idx]) || mxIsComplex(prhs[idx]) ) {
+			mexErrMsgIdAndTxt("QUATTRO:ivim_fit:invalidInput",
+							  "B and Y must be real double arrays");
+		};
+	};
+	const size_t n = mxGetNumberOfElements(prhs[0]);
+	if( (n<2) || (mxGetM(prhs[1])!=n) ) {
+		mexErrMsgIdAndTxt("QUATTRO:ivim_fit:invalidInput",
+						  "At least two b-values and one row of Y per b-value are required");
+	};
+	const size_t nVoxels = mxGetNumberOfElements(prhs[1])/n;
+
+	/*	Parse the options	*/
+	IvimFit engine(mxGetPr(prhs[0]), n);
+	bool isBayesian = false;
+	if( nrhs%2 ) {
+		mexErrMsgIdAndTxt("QUATTRO:ivim_fit:invalidInput",
+						  "Options must be specified as name/value pairs");
+	};
+	for(int idx=2; idx<nrhs; idx+=2) {
+		if( !mxIsChar(prhs[idx]) ) {
+			mexErrMsgIdAndTxt("QUATTRO:ivim_fit:invalidInput",
+							  "Option names must be strings");
+		};
+		char* str = mxArrayToString(prhs[idx]);
+		const std::string name(str);
+		mxFree(str);
+		const mxArray* value = prhs[idx+1];
+		if( !(mxIsNumeric(value) || mxIsLogical(value)) || mxIsComplex(value) || mxIsEmpty(value) ) {
+			mexErrMsgIdAndTxt("QUATTRO:ivim_fit:invalidInput",
+							  "%s must be a real numeric or logical value", name.c_str());
+		};
+		if( name=="Threshold" ) {
+			engine.SetThreshold(mxGetScalar(value));
+		}
+		else if( name=="Perfusion" ) {
+			engine.SetPerfusion(mxGetScalar(value)!=0);
+		}
+		else if( name=="Kurtosis" ) {
+			engine.SetKurtosis(mxGetScalar(value)!=0);
+		}
+		else if( name=="Range" ) {
+			if( !mxIsDouble(value) || (mxGetNumberOfElements(value)!=2) ||
+				!(mxGetPr(value)[0]>0) || !(mxGetPr(value)[1]>mxGetPr(value)[0]) ) {
+				mexErrMsgIdAndTxt("QUATTRO:ivim_fit:invalidInput",
+								  "Range must be a positive and increasing two-element vector");
+			};
+			engine.SetPseudoDiffusionRange(mxGetPr(value)[0], mxGetPr(value)[1]);
+		}
+		else if( name=="Iterations" ) {
+			engine.SetIterations(static_cast<unsigned int>( std::max(mxGetScalar(value), 0.0) ));
+		}
+		else if( name=="Bayesian" ) {
+			isBayesian = (mxGetScalar(value)!=0);
+		}
+		else {
+			mexErrMsgIdAndTxt("QUATTRO:ivim_fit:invalidInput",
+							  "Unknown option: %s", name.c_str());
+		};
+	};
+
+	/*	Create the outputs and estimate the maps	*/
+	plhs[0] = mxCreateDoubleMatrix(IvimFit::nParams, nVoxels, mxREAL);
+	mxArray* r2	 = mxCreateDoubleMatrix(1, nVoxels, mxREAL);
+	mxArray* res = (nlhs>2) ? mxCreateDoubleMatrix(n, nVoxels, mxREAL) : 0;
+	double*	 p	  = mxGetPr(plhs[0]);
+	double*	 pR2  = mxGetPr(r2);
+	double*	 pRes = res ? mxGetPr(res) : 0;
+	const double* y = mxGetPr(prhs[1]);
+
+	const size_t chunk = 256;
+	ParallelFor(nVoxels, chunk, [&](size_t begin, size_t end, unsigned int) {
+		engine.Fit(y+begin*n, end-begin, p+begin*IvimFit::nParams, pR2+begin, pRes ? pRes+begin*n : 0);
+	});
+
+	/*	Maximum a posteriori refinement with the shared priors	*/
+	if( isBayesian && engine.SetPriors(p, nVoxels) ) {
+		ParallelFor(nVoxels, chunk, [&](size_t begin, size_t end, unsigned int) {
+			engine.Fit(y+begin*n, end-begin, p+begin*IvimFit::nParams, pR2+begin, pRes ? pRes+begin*n : 0);
+		});
+	};
+
+	if( nlhs>1 ) {
+		plhs[1] = r2;
+	}
+	else {
+		mxDestroyArray(r2);
+	};
+	if( res ) {
+		plhs[2] = res;
+	};
+};
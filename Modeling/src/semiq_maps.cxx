@@ -0,0 +1,294 @@
+/*
+ *	semiq_maps.cxx
+ *
+ *	MEX front end of the semi-quantitative DCE engine (see SemiQuantitative.h)
+ *
+ *	S = semiq_maps(T,Y) computes the semi-quantitative features of each voxel
+ *	of the signal intensities Y acquired at the n times T (s). Y is an n-by-M
+ *	(time-contiguous) array or, with the 'Dim' option, an array whose last
+ *	dimension is time (e.g., a 4D series). Y must be double or single. S is a
+ *	structure with the fields:
+ *
+ *		Field				Description
+ *		===========================================================
+ *		'Arrival'			Bolus arrival time (see detect_bolus_arrival)
+ *
+ *		'TTP'				Time-to-peak of the first-pass frames
+ *
+ *		'Enhancement'		Relative peak enhancement (peak-pre)/pre
+ *
+ *		'SER'				Signal enhancement ratio, peak/pre
+ *
+ *		'UptakeSlope'		Slopes of the least squares lines through the
+ *		'WashoutSlope'		peak before and after the peak
+ *
+ *		'IAUC'				Initial areas under the curve, one row per
+ *							integration time
+ *
+ *	Each field has one value per voxel (1-by-M, or the size of the voxel
+ *	dimensions of Y). Voxels with non-finite data are NaN. Voxels are
+ *	processed on all cores.
+ *
+ *	S = semiq_maps(...,'Option',VALUE,...) specifies the following options:
+ *
+ *		Option String		Description
+ *		===========================================================
+ *		'Pre'				Logical mask of the pre-contrast frames.
+ *							Default: frames up to the bolus arrival of the
+ *							mean curve (the first four frames when the
+ *							arrival is not detected)
+ *
+ *		'FirstPass'			Logical mask of the first-pass (pre-
+ *							recirculation) frames. Default: all frames
+ *
+ *		'Integrals'			Integration times of the IAUC.
+ *							Default: [60 120 180]
+ *
+ *		'Baseline'			Logical mask of the frames averaged for the pre-
+ *							contrast signal of SER and Enhancement.
+ *							Default: the 'Pre' frames
+ *
+ *		'Signal'			Signal intensities (same size and class as Y)
+ *							from which the arrival, TTP, Enhancement and SER
+ *							are computed; Y is then the processed curve
+ *							(e.g., delta S.I.) of the slopes, which are
+ *							anchored at the frame of the signal peak, and
+ *							of the IAUC. Both are read in the same pass.
+ *							Default: Y
+ *
+ *		'Start'				Start time of the integration. Default: the
+ *							time of the first post-contrast frame
+ *
+ *		'Dim'				Time dimension of Y, 1 or ndims(Y). Default: 1
+ */
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/*	MATLAB headers	*/
+#include "mex.h"
+
+/*	QUATTRO headers	*/
+#include "ParallelFor.h"
+#include "SemiQuantitative.h"
+
+
+/*	Reads a logical (or numeric) mask of n frames	*/
+std::vector<bool> GetMask(const mxArray* value, size_t n, const char* name)
+{
+	if( !(mxIsLogical(value) || mxIsNumeric(value)) || (mxGetNumberOfElements(value)!=n) ) {
+		mexErrMsgIdAndTxt("QUATTRO:semiq_maps:invalidInput",
+						  "%s must be a mask with one element per frame", name);
+	};
+	std::vector<bool> mask(n);
+	if( mxIsLogical(value) ) {
+		const mxLogical* m = mxGetLogicals(value);
+		for(size_t k=0; k<n; k++) {
+			mask[k] = m[k];
+		};
+	}
+	else {
+		mxArray* d = 0;
+		mexCallMATLAB(1, &d, 1, const_cast<mxArray**>(&value), "double");
+		for(size_t k=0; k<n; k++) {
+			mask[k] = (mxGetPr(d)[k]!=0);
+		};
+		mxDestroyArray(d);
+	};
+	return mask;
+};
+
+
+template <class T>
+void ComputeMaps(const SemiQuantitative &engine, const T* y, const T* yPeak, size_t voxelStride, size_t timeStride,
+				 size_t nVoxels, const SemiQuantitativeMaps &maps)
+{
+	const size_t nInt = engine.GetNumberOfIntegrals();
+	ParallelFor(nVoxels, 16*SemiQuantitative::blockSize, [&](size_t begin, size_t end, unsigned int) {
+		SemiQuantitativeMaps part = {maps.arrival+begin, maps.ttp+begin, maps.enhancement+begin, maps.ser+begin,
+									 maps.uptake+begin, maps.washout+begin, maps.iauc+begin*nInt};
+		engine.Compute(y+begin*voxelStride, yPeak ? yPeak+begin*voxelStride : 0, voxelStride, timeStride,
+					   end-begin, part);
+	});
+};
+
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+
+	/*	Validate the inputs	*/
+	if( nrhs<2 ) {
+		mexErrMsgIdAndTxt("QUATTRO:semiq_maps:invalidInput",
+						  "T and Y must be specified");
+	};
+	if( !mxIsDouble(prhs[0]) || mxIsComplex(prhs[0]) ) {
+		mexErrMsgIdAndTxt("QUATTRO:semiq_maps:invalidInput",
+						  "T must be a real double array");
+	};
+	if( !(mxIsDouble(prhs[1]) || mxIsSingle(prhs[1])) || mxIsComplex(prhs[1]) ) {
+		mexErrMsgIdAndTxt("QUATTRO:semiq_maps:invalidInput",
+						  "Y must be a real double or single array");
+	};
+	const size_t  n = mxGetNumberOfElements(prhs[0]);
+	const double* t = mxGetPr(prhs[0]);
+	if( (n<2) || (mxGetNumberOfElements(prhs[1])%n) ) {
+		mexErrMsgIdAndTxt("QUATTRO:semiq_maps:invalidInput",
+						  "At least two frames and n samples per voxel are required");
+	};
+	const size_t nVoxels = mxGetNumberOfElements(prhs[1])/n;
+
+	/*	Parse the options	*/
+	std::vector<bool>	isPre, isBaseline, isFirstPass(n, true);
+	const mxArray*		signal = 0;
+	std::vector<double>	tIntegrals;
+	tIntegrals.push_back(60);
+	tIntegrals.push_back(120);
+	tIntegrals.push_back(180);
+	double tStart	 = mxGetNaN();
+	bool   isTimeLast = false;
+	if( nrhs%2 ) {
+		mexErrMsgIdAndTxt("QUATTRO:semiq_maps:invalidInput",
+						  "Options must be specified as name/value pairs");
+	};
+	for(int idx=2; idx<nrhs; idx+=2) {
+		if( !mxIsChar(prhs[idx]) ) {
+			mexErrMsgIdAndTxt("QUATTRO:semiq_maps:invalidInput",
+							  "Option names must be strings");
+		};
+		char* str = mxArrayToString(prhs[idx]);
+		const std::string name(str);
+		mxFree(str);
+		const mxArray* value = prhs[idx+1];
+		if( name=="Pre" ) {
+			isPre = GetMask(value, n, "Pre");
+		}
+		else if( name=="Baseline" ) {
+			isBaseline = GetMask(value, n, "Baseline");
+		}
+		else if( name=="Signal" ) {
+			if( (mxGetClassID(value)!=mxGetClassID(prhs[1])) || mxIsComplex(value) ||
+				(mxGetNumberOfDimensions(value)!=mxGetNumberOfDimensions(prhs[1])) ||
+				!std::equal(mxGetDimensions(value), mxGetDimensions(value)+mxGetNumberOfDimensions(value),
+							mxGetDimensions(prhs[1])) ) {
+				mexErrMsgIdAndTxt("QUATTRO:semiq_maps:invalidInput",
+								  "Signal must be a real array of the size and class of Y");
+			};
+			signal = value;
+		}
+		else if( name=="FirstPass" ) {
+			isFirstPass = GetMask(value, n, "FirstPass");
+		}
+		else if( name=="Integrals" ) {
+			if( !mxIsDouble(value) ) {
+				mexErrMsgIdAndTxt("QUATTRO:semiq_maps:invalidInput",
+								  "Integrals must be a double array");
+			};
+			tIntegrals.assign(mxGetPr(value), mxGetPr(value)+mxGetNumberOfElements(value));
+		}
+		else if( name=="Start" ) {
+			if( !mxIsNumeric(value) || (mxGetNumberOfElements(value)!=1) ) {
+				mexErrMsgIdAndTxt("QUATTRO:semiq_maps:invalidInput",
+								  "Start must be a numeric scalar");
+			};
+			tStart = mxGetScalar(value);
+		}
+		else if( name=="Dim" ) {
+			const mwSize nDims = mxGetNumberOfDimensions(prhs[1]);
+			const double dim   = mxIsNumeric(value) ? mxGetScalar(value) : 0;
+			if( (dim!=1) && (dim!=nDims) ) {
+				mexErrMsgIdAndTxt("QUATTRO:semiq_maps:invalidInput",
+								  "Dim must be 1 or the last dimension of Y");
+			};
+			isTimeLast = (dim!=1);
+			if( mxGetDimensions(prhs[1])[static_cast<size_t>(dim)-1]!=n ) {
+				mexErrMsgIdAndTxt("QUATTRO:semiq_maps:invalidInput",
+								  "The time dimension of Y must have one element per frame");
+			};
+		}
+		else {
+			mexErrMsgIdAndTxt("QUATTRO:semiq_maps:invalidInput",
+							  "Unknown option: %s", name.c_str());
+		};
+	};
+	if( !isTimeLast && (mxGetM(prhs[1])!=n) ) {
+		mexErrMsgIdAndTxt("QUATTRO:semiq_maps:invalidInput",
+						  "Y must have one row per frame");
+	};
+
+	/*	Without a mask, the pre-contrast frames are those up to the bolus
+		arrival of the mean signal curve (the first four frames when the
+		arrival is not detected), keeping at least one post-contrast frame	*/
+	const bool	   isDouble = mxIsDouble(prhs[1]);
+	const mxArray* peakData = signal ? signal : prhs[1];
+	if( isPre.empty() ) {
+		std::vector<double> curve(n, 0.0);
+		for(size_t v=0; v<nVoxels; v++) {
+			for(size_t k=0; k<n; k++) {
+				const size_t ind = isTimeLast ? k*nVoxels+v : v*n+k;
+				curve[k] += (isDouble ? mxGetPr(peakData)[ind] :
+										static_cast<const float*>( mxGetData(peakData) )[ind])/nVoxels;
+			};
+		};
+		double arrival, ttp, enhancement, ser, uptake, washout;
+		SemiQuantitativeMaps maps = {&arrival, &ttp, &enhancement, &ser, &uptake, &washout, 0};
+		SemiQuantitative(t, n, std::vector<bool>(n, false), isFirstPass, 0, 0, 0).Compute(&curve[0], &curve[0], n, 1, 1,
+																						  maps);
+		isPre.assign(n, false);
+		for(size_t k=0; k+1<n; k++) {
+			isPre[k] = mxIsNaN(arrival) ? (k<4) : (t[k]<=arrival);
+		};
+	};
+	if( mxIsNaN(tStart) ) {
+		tStart = t[0];
+		for(size_t k=0; k<n; k++) {
+			if( !isPre[k] ) {
+				tStart = t[k];
+				break;
+			};
+		};
+	};
+
+	/*	Create the outputs	*/
+	const char* fields[] = {"Arrival", "TTP", "Enhancement", "SER", "UptakeSlope", "WashoutSlope", "IAUC"};
+	const size_t nInt = tIntegrals.size();
+	std::vector<mwSize> dims(1, 1);
+	if( isTimeLast ) {
+		const mwSize* yDims = mxGetDimensions(prhs[1]);
+		dims.assign(yDims, yDims+mxGetNumberOfDimensions(prhs[1])-1);
+		if( dims.size()<2 ) {
+			dims.push_back(1);
+		};
+	}
+	else {
+		dims.push_back(nVoxels);
+	};
+	plhs[0] = mxCreateStructMatrix(1, 1, 7, fields);
+	double* ptr[7];
+	for(int idx=0; idx<6; idx++) {
+		mxArray* map = mxCreateNumericArray(dims.size(), &dims[0], mxDOUBLE_CLASS, mxREAL);
+		ptr[idx] = mxGetPr(map);
+		mxSetFieldByNumber(plhs[0], 0, idx, map);
+	};
+	mxArray* iauc = mxCreateDoubleMatrix(nInt, nVoxels, mxREAL);
+	ptr[6] = mxGetPr(iauc);
+	mxSetFieldByNumber(plhs[0], 0, 6, iauc);
+
+	/*	Compute the maps	*/
+	SemiQuantitative engine(t, n, isPre, isFirstPass, tIntegrals.empty() ? 0 : &tIntegrals[0], nInt, tStart);
+	if( !isBaseline.empty() ) {
+		engine.SetBaseline(isBaseline);
+	};
+	SemiQuantitativeMaps maps = {ptr[0], ptr[1], ptr[2], ptr[3], ptr[4], ptr[5], ptr[6]};
+	const size_t voxelStride = isTimeLast ? 1 : n;
+	const size_t timeStride	 = isTimeLast ? nVoxels : 1;
+	if( isDouble ) {
+		ComputeMaps(engine, mxGetPr(prhs[1]), signal ? mxGetPr(signal) : 0, voxelStride, timeStride, nVoxels, maps);
+	}
+	else {
+		ComputeMaps(engine, static_cast<const float*>( mxGetData(prhs[1]) ),
+					signal ? static_cast<const float*>( mxGetData(signal) ) : 0, voxelStride, timeStride, nVoxels, maps);
+	};
+};
@@ -0,0 +1,294 @@
+/*
+ *	sim_fit.cxx
+ *
+ *	MEX front end of the Monte Carlo simulation engine (see Simulation.h)
+ *
+ *	[BIAS,SD] = sim_fit(MODEL,X,P) simulates noisy signals of the model
+ *	specified by the string MODEL (see voxel_fit for the valid models and
+ *	their constants) at the n predictor values X for each column of the
+ *	nParams-by-M array of parameters P, fits every noisy replicate with the
+ *	voxel_fit solver and returns the nParams-by-M arrays of the bias (mean
+ *	fitted minus true value) and of the standard deviation of the fitted
+ *	parameters. Grid points are processed on all cores.
+ *
+ *	[BIAS,SD,Y] = sim_fit(...) also returns the n-by-R-by-M array of the
+ *	simulated (noisy) signals of the R replicates.
+ *
+ *	[...] = sim_fit(...,'Option',VALUE,...) specifies the model constants
+ *	of voxel_fit ('TR', 'TE', 'Flip', 'VIF' and 'Hct') and the following
+ *	options:
+ *
+ *		Option String		Description
+ *		===========================================================
+ *		'Noise'				Standard deviation of the noise. Without noise,
+ *							Y holds the (signed) model values. Default: 0
+ *
+ *		'Distribution'		'rician' (magnitude data) or 'gaussian'.
+ *							Default: 'rician'
+ *
+ *		'Replicates'		Number of noise realizations per grid point.
+ *							Default: 100
+ *
+ *		'Seed'				Non-negative integer seed of the counter-based
+ *							generator. Default: 0
+ *
+ *		'Guess'				nParams-by-1 (or nParams-by-M) initial guesses
+ *							of the fits. Default: P
+ *
+ *		'LB', 'UB'			Lower and upper parameter bounds of the fits.
+ *							Default: [] (unbounded)
+ *
+ *		'MaxIterations'		Maximum number of iterations. Default: 400
+ *
+ *		'Tolerance'			Relative change of the residual sum of squares or
+ *							of the parameters at convergence. Default: 1e-6
+ *
+ *		'Fit'				Logical flag; when false, only the signals are
+ *							simulated and BIAS and SD are empty. Default: true
+ */
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <string>
+#include <vector>
+
+/*	MATLAB headers	*/
+#include "mex.h"
+
+/*	QUATTRO headers	*/
+#include "Simulation.h"
+#include "VoxelModels.h"
+
+
+/*	Inputs of a simulation	*/
+struct SimulationInputs{
+	const double*	x;
+	size_t			n;
+	const double*	p;
+	size_t			nPoints;
+	const double*	p0;
+	bool			isGuessShared;
+	VoxelModelBounds bounds;
+	VoxelModelInputs constants;
+	double			sigma;
+	bool			isRician;
+	size_t			nReplicates;
+	uint64_t		seed;
+	unsigned int	maxIterations;
+	double			tolerance;
+	bool			isFit;
+};
+
+
+/*
+ *	Simulate()
+ *
+ *	Simulates the signals and, unless only the signals are requested, fits
+ *	the replicates of all grid points
+ */
+template <class TModel>
+void Simulate(const SimulationInputs &in, double* bias, double* sd, double* y)
+{
+	const unsigned int nParams = TModel::nParams;
+	double lower[nParams], upper[nParams];
+	if( !in.bounds.Get(nParams, lower, upper) ) {
+		mexErrMsgIdAndTxt("QUATTRO:sim_fit:invalidBounds",
+						  "LB and UB must be empty or double vectors with %u elements", nParams);
+	};
+
+	MonteCarloFit<TModel> engine(TModel(in.x, in.n, in.constants), in.n, in.nReplicates, in.seed);
+	engine.SetNoise(in.sigma, in.isRician);
+	engine.GetSolver().SetBounds(lower, upper);
+	engine.GetSolver().SetMaximumIterations(in.maxIterations);
+	engine.GetSolver().SetTolerance(in.tolerance);
+	if( y ) {
+		engine.Simulate(in.p, in.nPoints, y);
+	};
+	if( in.isFit ) {
+		engine.Fit(in.p, in.p0, in.isGuessShared, in.nPoints, bias, sd);
+	};
+};
+
+
+/*	Simulates the model selected by DispatchVoxelModel	*/
+struct SimulateRunner{
+	const SimulationInputs &in;
+	double*					bias;
+	double*					sd;
+	double*					y;
+	template <class TModel>
+	void Run() const { Simulate<TModel>(in, bias, sd, y); };
+};
+
+
+static void ParseOptions(int nrhs, const mxArray *prhs[], unsigned int nParams, SimulationInputs &in)
+{
+	if( nrhs%2 ) {
+		mexErrMsgIdAndTxt("QUATTRO:sim_fit:invalidInput",
+						  "Options must be specified as name/value pairs");
+	};
+	for(int idx=0; idx<nrhs; idx+=2) {
+		if( !mxIsChar(prhs[idx]) ) {
+			mexErrMsgIdAndTxt("QUATTRO:sim_fit:invalidInput",
+							  "Option names must be strings");
+		};
+		char* str = mxArrayToString(prhs[idx]);
+		const std::string name(str);
+		mxFree(str);
+		const mxArray* value = prhs[idx+1];
+		if( name=="VIF" ) {
+			if( !mxIsDouble(value) || mxIsComplex(value) || (mxGetNumberOfElements(value)!=in.n) ) {
+				mexErrMsgIdAndTxt("QUATTRO:sim_fit:invalidInput",
+								  "VIF must be a real double vector with NUMEL(X) elements");
+			};
+			in.constants.vif = mxGetPr(value);
+			continue;
+		}
+		else if( name=="Distribution" ) {
+			char* dStr = mxIsChar(value) ? mxArrayToString(value) : 0;
+			const std::string dist(dStr ? dStr : "");
+			mxFree(dStr);
+			if( (dist!="rician") && (dist!="gaussian") ) {
+				mexErrMsgIdAndTxt("QUATTRO:sim_fit:invalidInput",
+								  "Distribution must be 'rician' or 'gaussian'");
+			};
+			in.isRician = (dist=="rician");
+			continue;
+		}
+		else if( name=="Guess" ) {
+			const size_t nGuess = mxGetNumberOfElements(value);
+			if( !mxIsDouble(value) || ((nGuess!=nParams) && (nGuess!=nParams*in.nPoints)) ) {
+				mexErrMsgIdAndTxt("QUATTRO:sim_fit:invalidInput",
+								  "Guess must be a %u-by-1 or %u-by-M double array", nParams, nParams);
+			};
+			in.p0			 = mxGetPr(value);
+			in.isGuessShared = (nGuess==nParams);
+			continue;
+		}
+		else if( (name=="LB") || (name=="UB") ) {
+			if( !mxIsEmpty(value) && !mxIsDouble(value) ) {
+				mexErrMsgIdAndTxt("QUATTRO:sim_fit:invalidBounds",
+								  "LB and UB must be empty or double vectors with %u elements", nParams);
+			};
+			const double* bound = mxIsEmpty(value) ? 0 : mxGetPr(value);
+			if( name=="LB" ) {
+				in.bounds.lower	 = bound;
+				in.bounds.nLower = mxGetNumberOfElements(value);
+			}
+			else {
+				in.bounds.upper	 = bound;
+				in.bounds.nUpper = mxGetNumberOfElements(value);
+			};
+			continue;
+		};
+		if( !(mxIsNumeric(value) || mxIsLogical(value)) || (mxGetNumberOfElements(value)!=1) ) {
+			mexErrMsgIdAndTxt("QUATTRO:sim_fit:invalidInput",
+							  "%s must be a numeric scalar", name.c_str());
+		};
+		if( name=="TR" ) {
+			in.constants.tr = mxGetScalar(value);
+		}
+		else if( name=="TE" ) {
+			in.constants.te = mxGetScalar(value);
+		}
+		else if( name=="Flip" ) {
+			in.constants.flip = mxGetScalar(value);
+		}
+		else if( name=="Hct" ) {
+			in.constants.hct = mxGetScalar(value);
+		}
+		else if( name=="Noise" ) {
+			in.sigma = std::max(mxGetScalar(value), 0.0);
+		}
+		else if( name=="Replicates" ) {
+			in.nReplicates = static_cast<size_t>( std::max(mxGetScalar(value), 0.0) );
+		}
+		else if( name=="Seed" ) {
+			in.seed = static_cast<uint64_t>( std::max(mxGetScalar(value), 0.0) );
+		}
+		else if( name=="MaxIterations" ) {
+			in.maxIterations = static_cast<unsigned int>( std::max(mxGetScalar(value), 0.0) );
+		}
+		else if( name=="Tolerance" ) {
+			in.tolerance = mxGetScalar(value);
+		}
+		else if( name=="Fit" ) {
+			in.isFit = (mxGetScalar(value)!=0);
+		}
+		else {
+			mexErrMsgIdAndTxt("QUATTRO:sim_fit:invalidInput",
+							  "Unknown option: %s", name.c_str());
+		};
+	};
+};
+
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+
+	/*	Validate the inputs	*/
+	if( (nrhs<3) || !mxIsChar(prhs[0]) ) {
+		mexErrMsgIdAndTxt("QUATTRO:sim_fit:invalidInput",
+						  "MODEL, X and P must be specified");
+	};
+	char* str = mxArrayToString(prhs[0]);
+	const std::string model(str);
+	mxFree(str);
+	const unsigned int nParams = GetVoxelModelParameters(model);
+	if( !nParams ) {
+		mexErrMsgIdAndTxt("QUATTRO:sim_fit:invalidModel",
+						  "Unknown model: %s", model.c_str());
+	};
+	for(int idx=1; idx<3; idx++) {
+		if( !mxIsDouble(prhs[idx]) || mxIsComplex(prhs[idx]) ) {
+			mexErrMsgIdAndTxt("QUATTRO:sim_fit:invalidInput",
+							  "X and P must be real double arrays");
+		};
+	};
+
+	SimulationInputs in;
+	in.x		= mxGetPr(prhs[1]);
+	in.n		= mxGetNumberOfElements(prhs[1]);
+	in.p		= mxGetPr(prhs[2]);
+	in.nPoints	= mxGetNumberOfElements(prhs[2])/nParams;
+	in.p0		= in.p;
+	in.isGuessShared = false;
+	in.sigma	= 0;
+	in.isRician = true;
+	in.nReplicates	 = 100;
+	in.seed			 = 0;
+	in.maxIterations = 400;
+	in.tolerance	 = 1e-6;
+	in.isFit		 = true;
+	if( (in.n<nParams) || (mxGetM(prhs[2])!=nParams) ) {
+		mexErrMsgIdAndTxt("QUATTRO:sim_fit:invalidInput",
+						  "P must have %u rows and X must have at least %u elements", nParams, nParams);
+	};
+	ParseOptions(nrhs-3, prhs+3, nParams, in);
+	if( (model.compare(0, 3, "gkm")==0) && !in.constants.vif ) {
+		mexErrMsgIdAndTxt("QUATTRO:sim_fit:invalidInput",
+						  "The VIF must be specified for %s", model.c_str());
+	};
+
+	/*	Create the outputs and simulate	*/
+	const size_t nRows = in.isFit ? nParams : 0;
+	const mwSize dims[3] = {in.n, in.nReplicates, in.nPoints};
+	plhs[0] = mxCreateDoubleMatrix(nRows, in.isFit ? in.nPoints : 0, mxREAL);
+	mxArray* sd = mxCreateDoubleMatrix(nRows, in.isFit ? in.nPoints : 0, mxREAL);
+	mxArray* y	= (nlhs>2) ? mxCreateNumericArray(3, dims, mxDOUBLE_CLASS, mxREAL) : 0;
+	double*	 pBias = mxGetPr(plhs[0]);
+	double*	 pSd   = mxGetPr(sd);
+	double*	 pY	   = y ? mxGetPr(y) : 0;
+	const SimulateRunner simulate = {in, pBias, pSd, pY};
+	DispatchVoxelModel(model, simulate);
+	if( nlhs>1 ) {
+		plhs[1] = sd;
+	}
+	else {
+		mxDestroyArray(sd);
+	};
+	if( y ) {
+		plhs[2] = y;
+	};
+};
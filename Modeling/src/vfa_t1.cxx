@@ -0,0 +1,153 @@
+/*
+ *	vfa_t1.cxx
+ *
+ *	MEX front end of the variable flip angle T1 engine (see Despot1.h)
+ *
+ *	[P,R2] = vfa_t1(FA,Y,TR) estimates S0 and T1 for each column of the n-by-M
+ *	array of spoiled gradient echo signals Y acquired with the n flip angles
+ *	FA (degrees) and the repetition time TR using the linearized (DESPOT1)
+ *	model. P is the 2-by-M array of S0 and T1 (in the units of TR) and R2 is
+ *	the 1-by-M array of R^2 values of the model, the layout used by fitmaps.
+ *	Voxels with non-finite or zero signals, or without a valid estimate,
+ *	are NaN. Voxels are processed on all cores.
+ *
+ *	[P,R2,RES] = vfa_t1(...) also returns the n-by-M array of residuals (model
+ *	minus data).
+ *
+ *	[...] = vfa_t1(...,'Option',VALUE,...) specifies the following options:
+ *
+ *		Option String		Description
+ *		===========================================================
+ *		'B1'				Relative B1 (actual/nominal flip angle) of each
+ *							voxel, an array with M elements. Default: 1
+ *
+ *		'Guess'				2-by-M array of S0 and T1 from which voxels
+ *							without a linear estimate are refined. Default:
+ *							T1 = -TR/log(0.99) and the least squares S0
+ *
+ *		'Iterations'		Number of non-linear (damped Gauss-Newton)
+ *							iterations that refine the linear estimate.
+ *							Default: 0
+ *
+ *		'LB', 'UB'			Lower and upper bounds of S0 and T1 (two-element
+ *							arrays). Default: no bounds
+ */
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <string>
+
+/*	MATLAB headers	*/
+#include "mex.h"
+
+/*	QUATTRO headers	*/
+#include "Despot1.h"
+#include "ParallelFor.h"
+
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+
+	/*	Validate the inputs	*/
+	if( nrhs<3 ) {
+		mexErrMsgIdAndTxt("QUATTRO:vfa_t1:invalidInput",
+						  "FA, Y and TR must be specified");
+	};
+	for(int idx=0; idx<3; idx++) {
+		if( !mxIsDouble(prhs[idx]) || mxIsComplex(prhs[idx]) ) {
+			mexErrMsgIdAndTxt("QUATTRO:vfa_t1:invalidInput",
+							  "FA, Y and TR must be real double arrays");
+		};
+	};
+	const size_t n = mxGetNumberOfElements(prhs[0]);
+	if( (n<2) || (mxGetM(prhs[1])!=n) || (mxGetNumberOfElements(prhs[2])!=1) ) {
+		mexErrMsgIdAndTxt("QUATTRO:vfa_t1:invalidInput",
+						  "At least two flip angles, one row of Y per flip angle and a scalar TR are required");
+	};
+	const size_t nVoxels = mxGetNumberOfElements(prhs[1])/n;
+
+	/*	Parse the options	*/
+	const double* b1		  = 0;
+	const double* guess		  = 0;
+	const double* bounds[2]	  = {0, 0};
+	unsigned int  nIterations = 0;
+	if( (nrhs-3)%2 ) {
+		mexErrMsgIdAndTxt("QUATTRO:vfa_t1:invalidInput",
+						  "Options must be specified as name/value pairs");
+	};
+	for(int idx=3; idx<nrhs; idx+=2) {
+		if( !mxIsChar(prhs[idx]) ) {
+			mexErrMsgIdAndTxt("QUATTRO:vfa_t1:invalidInput",
+							  "Option names must be strings");
+		};
+		char* str = mxArrayToString(prhs[idx]);
+		const std::string name(str);
+		mxFree(str);
+		const mxArray* value = prhs[idx+1];
+		if( name=="B1" ) {
+			if( !mxIsDouble(value) || mxIsComplex(value) || (mxGetNumberOfElements(value)!=nVoxels) ) {
+				mexErrMsgIdAndTxt("QUATTRO:vfa_t1:invalidInput",
+								  "B1 must be a real double array with one element per voxel");
+			};
+			b1 = mxGetPr(value);
+		}
+		else if( name=="Guess" ) {
+			if( !mxIsDouble(value) || mxIsComplex(value) || (mxGetM(value)!=2) || (mxGetN(value)!=nVoxels) ) {
+				mexErrMsgIdAndTxt("QUATTRO:vfa_t1:invalidInput",
+								  "Guess must be a real 2-by-M double array");
+			};
+			guess = mxGetPr(value);
+		}
+		else if( (name=="LB") || (name=="UB") ) {
+			if( !mxIsDouble(value) || mxIsComplex(value) || (mxGetNumberOfElements(value)!=2) ) {
+				mexErrMsgIdAndTxt("QUATTRO:vfa_t1:invalidInput",
+								  "%s must be a real double array with two elements", name.c_str());
+			};
+			bounds[name=="UB"] = mxGetPr(value);
+		}
+		else if( name=="Iterations" ) {
+			if( !mxIsNumeric(value) || (mxGetNumberOfElements(value)!=1) ) {
+				mexErrMsgIdAndTxt("QUATTRO:vfa_t1:invalidInput",
+								  "Iterations must be a numeric scalar");
+			};
+			nIterations = static_cast<unsigned int>( std::max(mxGetScalar(value), 0.0) );
+		}
+		else {
+			mexErrMsgIdAndTxt("QUATTRO:vfa_t1:invalidInput",
+							  "Unknown option: %s", name.c_str());
+		};
+	};
+
+	/*	Create the outputs and estimate the maps	*/
+	plhs[0] = mxCreateDoubleMatrix(2, nVoxels, mxREAL);
+	mxArray* r2	 = mxCreateDoubleMatrix(1, nVoxels, mxREAL);
+	mxArray* res = (nlhs>2) ? mxCreateDoubleMatrix(n, nVoxels, mxREAL) : 0;
+	double*	 p	  = mxGetPr(plhs[0]);
+	double*	 pR2  = mxGetPr(r2);
+	double*	 pRes = res ? mxGetPr(res) : 0;
+	const double* y = mxGetPr(prhs[1]);
+
+	Despot1 engine(mxGetPr(prhs[0]), n, mxGetScalar(prhs[2]));
+	engine.SetIterations(nIterations);
+	if( bounds[0] || bounds[1] ) {
+		const double inf	= mxGetInf();
+		const double lb[2]	= {bounds[0] ? bounds[0][0] : -inf, bounds[0] ? bounds[0][1] : 0};
+		const double ub[2]	= {bounds[1] ? bounds[1][0] : inf, bounds[1] ? bounds[1][1] : inf};
+		engine.SetBounds(lb, ub);
+	};
+	ParallelFor(nVoxels, 64*Despot1::blockSize, [&](size_t begin, size_t end, unsigned int) {
+		engine.Fit(y+begin*n, b1 ? b1+begin : 0, guess ? guess+2*begin : 0, end-begin,
+				   p+2*begin, pR2+begin, pRes ? pRes+begin*n : 0);
+	});
+
+	if( nlhs>1 ) {
+		plhs[1] = r2;
+	}
+	else {
+		mxDestroyArray(r2);
+	};
+	if( res ) {
+		plhs[2] = res;
+	};
+};
@@ -0,0 +1,309 @@
+/*
+ *	voxel_fit.cxx
+ *
+ *	MEX front end of the voxel-wise fitting engine (see LevenbergMarquardt.h
+ *	and VoxelModels.h)
+ *
+ *	[P,R2] = voxel_fit(MODEL,X,Y,P0,LB,UB) fits the model specified by the
+ *	string MODEL to each column of the n-by-M array Y, where X is the vector
+ *	of n predictor values. P0 is the nParams-by-M (or nParams-by-1) array of
+ *	initial guesses and LB and UB are vectors of the nParams lower and upper
+ *	parameter bounds (empty for unbounded parameters). P is the nParams-by-M
+ *	array of fitted parameters and R2 is the 1-by-M array of R^2 values, the
+ *	layout used by fitmaps. Voxels with non-finite data or guesses are not
+ *	fitted and are NaN. Voxels are fitted on all cores.
+ *
+ *	[P,R2,RES] = voxel_fit(...) also returns the n-by-M array of residuals
+ *	(model minus data, as returned by lsqcurvefit).
+ *
+ *	Valid models are (see the MATLAB functions of the same name):
+ *
+ *		Model			Parameters		Constants
+ *		===========================================================
+ *		'multi_te'		S0, T			-
+ *
+ *		'multi_tr'		S0, T1			'TE'
+ *
+ *		'fspgr_vfa'		S0, T1			'TR'
+ *
+ *		'fse_vti'		S0, T1			'Flip'
+ *
+ *		'gkm2_ve'		Ktrans, ve		'VIF', 'Hct'
+ *
+ *		'gkm2_kep'		Ktrans, kep		'VIF', 'Hct'
+ *
+ *		'gkm3_ve'		Ktrans, ve, vp	'VIF', 'Hct'
+ *
+ *		'gkm3_kep'		Ktrans, kep, vp	'VIF', 'Hct'
+ *
+ *	For the general kinetic models, X is the vector of acquisition times
+ *	(which need not be uniformly spaced), 'VIF' is the vector of vascular
+ *	input function values at these times and 'Hct' the hematocrit (default:
+ *	0). Curves are computed by recursive convolution (see DceKernels.h).
+ *
+ *	[...] = voxel_fit(...,'Option',VALUE,...) specifies the model constants
+ *	above and the following options:
+ *
+ *		Option String		Description
+ *		===========================================================
+ *		'MaxIterations'		Maximum number of iterations. Default: 400
+ *
+ *		'Tolerance'			Relative change of the residual sum of squares or
+ *							of the parameters at convergence. Default: 1e-6
+ */
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <vector>
+
+/*	MATLAB headers	*/
+#include "mex.h"
+
+/*	QUATTRO headers	*/
+#include "LevenbergMarquardt.h"
+#include "ParallelFor.h"
+#include "VoxelModels.h"
+
+
+/*	Number of voxels fitted in lock step	*/
+static const unsigned int batchSize = 8;
+
+
+/*	Inputs of a fit	*/
+struct FitInputs{
+	const double*	x;
+	size_t			n;
+	const double*	y;
+	size_t			nVoxels;
+	const double*	p0;
+	bool			isGuessShared;
+	VoxelModelBounds bounds;
+	VoxelModelInputs constants;
+	unsigned int	maxIterations;
+	double			tolerance;
+};
+
+
+static bool IsFinite(const double* values, size_t n)
+{
+	for(size_t idx=0; idx<n; idx++) {
+		if( !std::isfinite(values[idx]) ) {
+			return false;
+		};
+	};
+	return true;
+};
+
+
+/*
+ *	FitVoxels()
+ *
+ *	Fits all voxels with finite data and guesses. The voxels to fit are
+ *	gathered into batches that are handed out to the worker threads
+ */
+template <class TModel>
+void FitVoxels(const FitInputs &in, double* p, double* r2, double* res)
+{
+	typedef LevenbergMarquardt<TModel, batchSize> TSolver;
+	const unsigned int nParams = TModel::nParams;
+	const size_t	   n	   = in.n;
+
+	double lower[nParams], upper[nParams];
+	if( !in.bounds.Get(nParams, lower, upper) ) {
+		mexErrMsgIdAndTxt("QUATTRO:voxel_fit:invalidBounds",
+						  "LB and UB must be empty or double vectors with %u elements", nParams);
+	};
+
+	/*	Skipped voxels are NaN	*/
+	const double nan = std::numeric_limits<double>::quiet_NaN();
+	std::fill(p, p+nParams*in.nVoxels, nan);
+	std::fill(r2, r2+in.nVoxels, nan);
+	if( res ) {
+		std::fill(res, res+n*in.nVoxels, nan);
+	};
+	std::vector<size_t> voxels;
+	for(size_t v=0; v<in.nVoxels; v++) {
+		const double* guess = in.p0+(in.isGuessShared ? 0 : v*nParams);
+		if( IsFinite(in.y+v*n, n) && IsFinite(guess, nParams) ) {
+			voxels.push_back(v);
+		};
+	};
+
+	const TModel model(in.x, n, in.constants);
+	TSolver		 solver(model, n);
+	solver.SetBounds(lower, upper);
+	solver.SetMaximumIterations(in.maxIterations);
+	solver.SetTolerance(in.tolerance);
+
+	const size_t	   nBatches = (voxels.size()+batchSize-1)/batchSize;
+	const size_t	   chunk	= 4;
+	const unsigned int nSlots	= GetNumberOfParallelSlots(nBatches, chunk);
+	std::vector<TSolver> solvers(nSlots, solver);
+	ParallelFor(nBatches, chunk, [&](size_t begin, size_t end, unsigned int threadId) {
+		std::vector<double> yBatch(n*batchSize), p0Batch(nParams*batchSize), pBatch(nParams*batchSize);
+		std::vector<double> resBatch(res ? n*batchSize : 0);
+		double r2Batch[batchSize];
+		for(size_t b=begin; b<end; b++) {
+			const size_t first	 = b*batchSize;
+			const size_t nInBatch = std::min<size_t>(batchSize, voxels.size()-first);
+			for(size_t w=0; w<nInBatch; w++) {
+				const size_t  v		= voxels[first+w];
+				const double* guess = in.p0+(in.isGuessShared ? 0 : v*nParams);
+				std::copy(in.y+v*n, in.y+(v+1)*n, yBatch.begin()+w*n);
+				std::copy(guess, guess+nParams, p0Batch.begin()+w*nParams);
+			};
+			solvers[threadId].Fit(&yBatch[0], n, &p0Batch[0], nInBatch, &pBatch[0], r2Batch,
+								  res ? &resBatch[0] : 0);
+			for(size_t w=0; w<nInBatch; w++) {
+				const size_t v = voxels[first+w];
+				std::copy(pBatch.begin()+w*nParams, pBatch.begin()+(w+1)*nParams, p+v*nParams);
+				r2[v] = r2Batch[w];
+				if( res ) {
+					std::copy(resBatch.begin()+w*n, resBatch.begin()+(w+1)*n, res+v*n);
+				};
+			};
+		};
+	});
+};
+
+
+/*	Fits the voxels with the model selected by DispatchVoxelModel	*/
+struct FitVoxelsRunner{
+	const FitInputs &in;
+	double*			p;
+	double*			r2;
+	double*			res;
+	template <class TModel>
+	void Run() const { FitVoxels<TModel>(in, p, r2, res); };
+};
+
+
+static void ParseOptions(int nrhs, const mxArray *prhs[], FitInputs &in)
+{
+	if( nrhs%2 ) {
+		mexErrMsgIdAndTxt("QUATTRO:voxel_fit:invalidInput",
+						  "Options must be specified as name/value pairs");
+	};
+	for(int idx=0; idx<nrhs; idx+=2) {
+		if( !mxIsChar(prhs[idx]) ) {
+			mexErrMsgIdAndTxt("QUATTRO:voxel_fit:invalidInput",
+							  "Option names must be strings");
+		};
+		char* str = mxArrayToString(prhs[idx]);
+		const std::string name(str);
+		mxFree(str);
+		const mxArray* value = prhs[idx+1];
+		if( name=="VIF" ) {
+			if( !mxIsDouble(value) || mxIsComplex(value) || (mxGetNumberOfElements(value)!=in.n) ) {
+				mexErrMsgIdAndTxt("QUATTRO:voxel_fit:invalidInput",
+								  "VIF must be a real double vector with NUMEL(X) elements");
+			};
+			in.constants.vif = mxGetPr(value);
+			continue;
+		};
+		if( !mxIsNumeric(value) || (mxGetNumberOfElements(value)!=1) ) {
+			mexErrMsgIdAndTxt("QUATTRO:voxel_fit:invalidInput",
+							  "%s must be a numeric scalar", name.c_str());
+		};
+		if( name=="TR" ) {
+			in.constants.tr = mxGetScalar(value);
+		}
+		else if( name=="TE" ) {
+			in.constants.te = mxGetScalar(value);
+		}
+		else if( name=="Flip" ) {
+			in.constants.flip = mxGetScalar(value);
+		}
+		else if( name=="Hct" ) {
+			in.constants.hct = mxGetScalar(value);
+		}
+		else if( name=="MaxIterations" ) {
+			in.maxIterations = static_cast<unsigned int>( std::max(mxGetScalar(value), 0.0) );
+		}
+		else if( name=="Tolerance" ) {
+			in.tolerance = mxGetScalar(value);
+		}
+		else {
+			mexErrMsgIdAndTxt("QUATTRO:voxel_fit:invalidInput",
+							  "Unknown option: %s", name.c_str());
+		};
+	};
+};
+
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+
+	/*	Validate the inputs	*/
+	if( (nrhs<6) || !mxIsChar(prhs[0]) ) {
+		mexErrMsgIdAndTxt("QUATTRO:voxel_fit:invalidInput",
+						  "MODEL, X, Y, P0, LB and UB must be specified");
+	};
+	char* str = mxArrayToString(prhs[0]);
+	const std::string model(str);
+	mxFree(str);
+	const unsigned int nParams = GetVoxelModelParameters(model);
+	if( !nParams ) {
+		mexErrMsgIdAndTxt("QUATTRO:voxel_fit:invalidModel",
+						  "Unknown model: %s", model.c_str());
+	};
+	for(int idx=1; idx<4; idx++) {
+		if( !mxIsDouble(prhs[idx]) || mxIsComplex(prhs[idx]) ) {
+			mexErrMsgIdAndTxt("QUATTRO:voxel_fit:invalidInput",
+							  "X, Y and P0 must be real double arrays");
+		};
+	};
+	for(int idx=4; idx<6; idx++) {
+		if( !mxIsEmpty(prhs[idx]) && !mxIsDouble(prhs[idx]) ) {
+			mexErrMsgIdAndTxt("QUATTRO:voxel_fit:invalidBounds",
+							  "LB and UB must be empty or double vectors with %u elements", nParams);
+		};
+	};
+
+	FitInputs in;
+	in.x		= mxGetPr(prhs[1]);
+	in.n		= mxGetNumberOfElements(prhs[1]);
+	in.y		= mxGetPr(prhs[2]);
+	in.nVoxels	= (in.n>0) ? mxGetNumberOfElements(prhs[2])/in.n : 0;
+	in.p0		= mxGetPr(prhs[3]);
+	in.bounds.lower	 = mxIsEmpty(prhs[4]) ? 0 : mxGetPr(prhs[4]);
+	in.bounds.nLower = mxGetNumberOfElements(prhs[4]);
+	in.bounds.upper	 = mxIsEmpty(prhs[5]) ? 0 : mxGetPr(prhs[5]);
+	in.bounds.nUpper = mxGetNumberOfElements(prhs[5]);
+	in.maxIterations = 400;
+	in.tolerance	 = 1e-6;
+	if( (in.n<nParams) || (mxGetM(prhs[2])!=in.n) ) {
+		mexErrMsgIdAndTxt("QUATTRO:voxel_fit:invalidInput",
+						  "Y must have NUMEL(X) rows and X must have at least %u elements", nParams);
+	};
+	in.isGuessShared = (mxGetNumberOfElements(prhs[3])==nParams);
+	if( !in.isGuessShared && (mxGetNumberOfElements(prhs[3])!=nParams*in.nVoxels) ) {
+		mexErrMsgIdAndTxt("QUATTRO:voxel_fit:invalidInput",
+						  "P0 must be a %u-by-1 or %u-by-M array", nParams, nParams);
+	};
+	ParseOptions(nrhs-6, prhs+6, in);
+	if( (model.compare(0, 3, "gkm")==0) && !in.constants.vif ) {
+		mexErrMsgIdAndTxt("QUATTRO:voxel_fit:invalidInput",
+						  "The VIF must be specified for %s", model.c_str());
+	};
+
+	/*	Create the outputs and fit	*/
+	plhs[0] = mxCreateDoubleMatrix(nParams, in.nVoxels, mxREAL);
+	mxArray* r2 = mxCreateDoubleMatrix(1, in.nVoxels, mxREAL);
+	mxArray* res = (nlhs>2) ? mxCreateDoubleMatrix(in.n, in.nVoxels, mxREAL) : 0;
+	const FitVoxelsRunner fit = {in, mxGetPr(plhs[0]), mxGetPr(r2), res ? mxGetPr(res) : 0};
+	DispatchVoxelModel(model, fit);
+	if( nlhs>1 ) {
+		plhs[1] = r2;
+	}
+	else {
+		mxDestroyArray(r2);
+	};
+	if( res ) {
+		plhs[2] = res;
+	};
+};
@@ -0,0 +1,47 @@
+function test_dwi_ivim_maps
+%test_dwi_ivim_maps  Native IVIM map test of the dwi_ivim model
+%
+%   test_dwi_ivim_maps simulates a map of IVIM (with kurtosis) signals, fits it
+%   with the dwi_ivim model (in memory and streamed to a file) through the
+%   ivim_fit MEX file and verifies that the maps of all non-linear parameters
+%   (S0, D, D*, f and K) are stored with the size of the map. An error is
+%   thrown on the first failure.
+%
+%   See also dwi_ivim, ivim_fit, fitmaps
+
+    if (exist('ivim_fit','file')~=3)
+        error(['QUATTRO:' mfilename ':missingMex'],...
+              'The ivim_fit MEX file must be built to run this test.');
+    end
+
+    % Simulate a 8-by-8 map with the same parameters in every voxel
+    b  = [0 10 20 40 80 150 200 400 600 800 1000]';
+    x  = [1000 0.0012 0.03 0.15 0.8];
+    mY = [8 8];
+    y  = repmat(ivim(x(:),b),[1 mY]);
+
+    % Fit the map in memory: the results hold one map per parameter
+    obj    = qt_models.diffusion.dwi.dwi_ivim(b,y);
+    params = obj.nlinParams;
+    assert(numel(params)==5,'dwi_ivim must have five non-linear parameters');
+    obj.fit;
+    for idx = 1:numel(params)
+        assert(isfield(obj.results,params{idx}),...
+               'The %s map was not stored',params{idx});
+        val = obj.results.(params{idx}).value;
+        assert(isequal(size(val),mY),'The %s map has the wrong size',params{idx});
+        assert(any( isfinite(val(:)) ),'The %s map holds no fit',params{idx});
+    end
+
+    % Stream the maps to a file: the file holds the parameter and R^2 maps
+    fName   = tempname;
+    cleanup = onCleanup(@() delete([fName '*']));
+    obj     = qt_models.diffusion.dwi.dwi_ivim(b,y);
+    obj.fit('OutputFile',fName);
+    for idx = 1:numel(params)
+        assert(isfield(obj.results,params{idx}),...
+               'The streamed %s map was not stored',params{idx});
+    end
+    fprintf('%s: %d parameter maps passed\n',mfilename,numel(params));
+
+end %test_dwi_ivim_maps
\ No newline at end of file
@@ -1,4 +1,14 @@
-function register_helper(obj, varargin)
+function fName = register_helper(obj, varargin)
+%register_helper  Writes the INI file (job manifest) read by itkReg
+%
+%   FNAME = register_helper(OBJ,'PROP1',VAL1,...) writes the registration
+%   options of the qt_reg object OBJ and the additional property/value pairs
+%   (e.g., image file names) to the [Properties] section of the INI file FNAME.
+%
+%   FNAME = register_helper(...,'Job',JOBS) also writes one [Job] section per
+%   element of the structure array JOBS. The fields of a job (e.g.,
+%   imMovingFile or iterHistFile) override the [Properties] values, so that a
+%   single manifest describes the registration of all frames of a series.
 
     %Calls function PARSE_OPTS to ensure appropriate property-value pairs are passed
     parse_opts(nargin-1, varargin);
@@ -7,46 +17,50 @@ function register_helper(obj, varargin)
     %values, respectively, from VARARGIN
     optNames = varargin(1:2:length(varargin)).';
     optVals = varargin(2:2:length(varargin)).';
-    
+
+    %Separates the job definitions from the other options
+    isJob = strcmpi(optNames,'Job');
+    jobs  = struct([]);
+    if any(isJob)
+        jobs = optVals{find(isJob,1,'last')};
+    end
+    optNames = optNames(~isJob);
+    optVals  = optVals(~isJob);
+
     %Creates the INI file with the name assigned to FNAME
     fName = fullfile(obj.appDir,[obj.itkFile '.ini']);
-    inifile(fName, 'new');
-    
-    %Creates a list LIST of properties for the object OBJ, and makes an empty
-    %cell array CA of corresponding size
-    list = meta.class.fromName('regopts').PropertyList;
-    CA = cell(length(list) + (nargin-1)/2, 4); %(nargin-1)/2 to account for optional inputs
-    
-    %Fills the first column of CA (section name) with "Properties" and the
-    %second (subsection name) with the empty string
-    [CA{:,1}] = deal('Properties');
-    [CA{:,2}] = deal('');
-    
+
     %Creates a cell array PROPNAMES containing all property names of OBJ
+    list = meta.class.fromName('regopts').PropertyList;
     propNames = cell(length(list),1);
     [propNames{:}] = list(:).Name;
-    
+
     %Creates a cell array PROPVALS containing all property values of OBJ
     propVals = cellfun(@(prop) obj.(prop), propNames, 'UniformOutput', false);
-    
-    %Add the optional property names to PROPNAMES
+
+    %Add the optional property names and values
     propNames = [propNames;optNames];
-   
-    %Add the optional property values to PROPVALS
     propVals = [propVals;optVals];
-    
+
+    %Writes the manifest in a single buffered write using the native writer
+    if (exist('ini_write','file')==3)
+        props = cell2struct(propVals,propNames,1);
+        ini_write(fName,'Properties',props,'Job',jobs);
+        return
+    elseif ~isempty(jobs)
+        error(['qt_reg:' mfilename ':missingMex'],...
+              'Job manifests require the ini_write MEX file.');
+    end
+
     %Converts arrays to strings; required for the INI writer
     mask = cellfun(@(val) isnumeric(val) && numel(val) > 1, propVals);
-    if sum(mask)
-        propVals(mask) = {mat2str(propVals{mask})};
-    end
-    
-    %Fills the third column of CA (property name) from PROPNAMES and the
-    %fourth (property value) from PROPVALS
-    [CA{:,3}] = propNames{:};
-    [CA{:,4}] = propVals{:};
-    
-    %Writes the data from CA to the INI file
+    propVals(mask) = cellfun(@mat2str, propVals(mask), 'UniformOutput', false);
+
+    %Creates a cell array CA with the section name ("Properties"), subsection
+    %name (empty), property names and property values, and writes CA to the INI
+    %file
+    CA = [repmat({'Properties',''},numel(propNames),1) propNames propVals];
+    inifile(fName, 'new');
     inifile(fName, 'write', CA, 'tabbed');
 end
 
@@ -57,7 +71,10 @@ function parse_opts(num, inputs)
         disp('Improper number of inputs. Must be property-value pairs.');
         throw(MException('', 'Improper number of inputs. Must be property-value pairs.'));
     end
-    
-    %Ensure inputs are either strings or numeric
-    cellfun(@(input) validateattributes(input, {'numeric', 'char'}, {'nonempty'}), inputs, 'UniformOutput', false);
-end
\ No newline at end of file
+
+    %Ensure inputs are either strings or numeric (job definitions are
+    %structures)
+    isJob = [false strcmpi(inputs(1:end-1),'Job')];
+    cellfun(@(input) validateattributes(input, {'numeric', 'char'}, {'nonempty'}), inputs(~isJob), 'UniformOutput', false);
+    cellfun(@(input) validateattributes(input, {'struct'}, {}), inputs(isJob), 'UniformOutput', false);
+end
@@ -1,8 +1,16 @@
-function register(obj)
+function varargout = register(obj,frames)
 %register  Performs image registration
 %
 %   register(OBJ) performs image registration using the properties stored in the
 %   qt_reg object OBJ.
+%
+%   [WC,TRAFOFILE] = register(OBJ,FRAMES) registers every frame of the array
+%   FRAMES (one moving image per index of the last dimension) to the target
+%   image in a single call to itkReg. One manifest with a [Job] section per
+%   frame is written (see register_helper). WC contains the final
+%   transformation of each frame (one row per frame) and TRAFOFILE is the ITK
+%   transform file holding the final transform of each frame (see
+%   itkWarpMask). The properties of OBJ are not modified.
 
     % Start the timer - let's see how long this takes
     tic;
@@ -16,6 +24,10 @@ function register(obj)
                           'ElementSpacing',obj.pixdimTarget,...
                           'ElementType','MET_FLOAT');
     mhawrite(obj.imTarget,imFixedFile,hdr);
+    if (nargin>1)
+        [varargout{1:max(nargout,1)}] = register_frames(obj,frames,imFixedFile);
+        return
+    end
     imMovingFile = fullfile(obj.appDir,[obj.itkFile,'_moving.mha']);
     hdr          = struct('NDims',obj.n,...
                           'DimSize',size(obj.imMoving),...
@@ -25,9 +37,10 @@ function register(obj)
     iterHistFile = fullfile(obj.appDir,[obj.itkFile,'_iterHistory.txt']);
 
     % Create the INI file
-    obj.register_helper('imFixedFile',imFixedFile,...
-                        'imMovingFile',imMovingFile,...
-                        'iterHistFile',iterHistFile);
+    iniFile = register_helper(obj,'dimensions',obj.n,...
+                                  'imFixedFile',imFixedFile,...
+                                  'imMovingFile',imMovingFile,...
+                                  'iterHistFile',iterHistFile);
 
 %TODO: this is old code. Remove after testing "register_helper"
 % imFile4 = fullfile(obj.appDir,[obj.itkFile,'_output.mha']);
@@ -58,7 +71,7 @@ function register(obj)
 %                             transform)];
 
     exeFile = which('itkReg.exe');
-    eval(['!"' exeFile '" ' optStr]);
+    eval(['!"' exeFile '" "' iniFile '"']);
 
     % Parse the ITK iteration history file
     fid             = fopen(iterHistFile,'r');
@@ -83,4 +96,50 @@ function register(obj)
     fprintf(['W: ' s],obj.wc);
     fprintf('Time elapsed (s): %f\n',obj.time);
 
-end %qt_reg.register
\ No newline at end of file
+end %qt_reg.register
+
+
+%------------------------------------------------------------------
+function [wc,trafoFile] = register_frames(obj,frames,imFixedFile)
+
+    % Write each frame and define its [Job] section
+    m       = size(frames);
+    nFrames = size(frames,obj.n+1);
+    frames  = reshape(frames,[],nFrames);
+    hdr     = struct('NDims',obj.n,...
+                     'DimSize',m(1:obj.n),...
+                     'ElementSpacing',obj.pixdimMoving,...
+                     'ElementType','MET_FLOAT');
+    jobs    = struct('imMovingFile',cell(1,nFrames),'iterHistFile',[]);
+    for fIdx = 1:nFrames
+        jobs(fIdx).imMovingFile = fullfile(obj.appDir,...
+                                 sprintf('%s_moving%d.mha',obj.itkFile,fIdx));
+        jobs(fIdx).iterHistFile = fullfile(obj.appDir,...
+                            sprintf('%s_iterHistory%d.txt',obj.itkFile,fIdx));
+        mhawrite(reshape(double(frames(:,fIdx)),m(1:obj.n)),...
+                                                 jobs(fIdx).imMovingFile,hdr);
+    end
+    trafoFile = fullfile(obj.appDir,[obj.itkFile,'_transforms.tfm']);
+
+    % Create the manifest and register all frames
+    iniFile = register_helper(obj,'dimensions',obj.n,...
+                                  'imFixedFile',imFixedFile,...
+                                  'imMovingFile',jobs(1).imMovingFile,...
+                                  'iterHistFile',jobs(1).iterHistFile,...
+                                  'transformFile',trafoFile,...
+                                  'Job',jobs);
+    exeFile = which('itkReg.exe');
+    eval(['!"' exeFile '" "' iniFile '"']);
+
+    % Grab the final transformation of each frame from its iteration history
+    wc = cell(nFrames,1);
+    for fIdx = 1:nFrames
+        fid       = fopen(jobs(fIdx).iterHistFile,'r');
+        T         = textscan(fid,'%s','Delimiter','\n');
+        fclose(fid);
+        wcHistory = parse_itk_cmd(sprintf('%s\n',T{1}{:}));
+        wc{fIdx}  = wcHistory{end}(end,:);
+    end
+    wc = cell2mat(wc);
+
+end %register_frames
\ No newline at end of file
@@ -0,0 +1,329 @@
+/*
+ *	CropRegion.h
+ *
+ *	Helpers for registering only a region of interest of large volumes.
+ *	A physical bounding box is computed from an ROI mask (on any grid) or
+ *	from an intensity threshold of the target image. The target and
+ *	moving images are then read through a streaming MetaImage reader and
+ *	a region of interest filter so that only the (padded) bounding box is
+ *	read from disk and held in memory. The cropped images keep their
+ *	physical coordinates (origin), so transforms remain valid for the full
+ *	images.
+ */
+
+
+#ifndef CROPREGION_H
+#define CROPREGION_H
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <string>
+
+/*	ITK headers	*/
+#include "itkImage.h"
+#include "itkImageFileReader.h"
+#include "itkImageRegionConstIteratorWithIndex.h"
+#include "itkMetaImageIO.h"
+#include "itkRegionOfInterestImageFilter.h"
+
+/*	QUATTRO headers	*/
+#include "RegOptionsFilter.h"
+
+
+/*	Number of slices read at a time when thresholding the target image	*/
+static const unsigned int cropSlabThickness = 8;
+
+
+/*
+ *	PhysicalBoundingBox
+ *
+ *	Axis aligned (in physical space) bounding box
+ */
+template <unsigned int VImageDimension>
+struct PhysicalBoundingBox{
+	itk::Point<double,VImageDimension>	lower;
+	itk::Point<double,VImageDimension>	upper;
+	bool								isValid;
+
+	PhysicalBoundingBox() : isValid(false) {};
+
+	/*	Adds a physical point to the bounding box	*/
+	void Add(const itk::Point<double,VImageDimension> &point)
+	{
+		for(unsigned int dim=0; dim<VImageDimension; dim++) {
+			lower[dim] = (!isValid || point[dim]<lower[dim]) ? point[dim] : lower[dim];
+			upper[dim] = (!isValid || point[dim]>upper[dim]) ? point[dim] : upper[dim];
+		};
+		isValid = true;
+	};
+};
+
+
+/*
+ *	AddIndexBox()
+ *
+ *	Adds the physical corners of an index bounding box of an image to a
+ *	physical bounding box. The corners are placed at the voxel edges so
+ *	that partially covered voxels are retained
+ */
+template <class TImage>
+void AddIndexBox(const TImage* image, const typename TImage::IndexType &minIdx,
+				 const typename TImage::IndexType &maxIdx,
+				 PhysicalBoundingBox<TImage::ImageDimension> &box)
+{
+	const unsigned int D = TImage::ImageDimension;
+	for(unsigned int corner=0; corner<(1u<<D); corner++) {
+		itk::ContinuousIndex<double,D>		cIdx;
+		itk::Point<double,D>				point;
+		for(unsigned int dim=0; dim<D; dim++) {
+			cIdx[dim] = (corner & (1u<<dim)) ? maxIdx[dim]+0.5 : minIdx[dim]-0.5;
+		};
+		image->TransformContinuousIndexToPhysicalPoint(cIdx, point);
+		box.Add(point);
+	};
+};
+
+
+/*
+ *	GetMaskBoundingBox()
+ *
+ *	Physical bounding box of the non-zero voxels of an ROI mask
+ */
+template <unsigned int VImageDimension>
+PhysicalBoundingBox<VImageDimension> GetMaskBoundingBox(std::string FName)
+{
+	typedef itk::Image<unsigned char,VImageDimension>	TMask;
+	typedef itk::ImageFileReader<TMask>					TReader;
+	PhysicalBoundingBox<VImageDimension>				box;
+
+	typename TReader::Pointer reader = TReader::New();
+	reader->SetFileName(FName);
+	try {
+		reader->Update();
+	}
+	catch( itk::ExceptionObject & err ) {
+		std::cerr << "Unable to read the ROI mask: " << FName << std::endl;
+		std::cerr << err << std::endl;
+		return box;
+	};
+
+	typename TMask::IndexType	minIdx, maxIdx;
+	bool						isFound = false;
+	itk::ImageRegionConstIteratorWithIndex<TMask> it(reader->GetOutput(),
+													 reader->GetOutput()->GetLargestPossibleRegion());
+	for(it.GoToBegin(); !it.IsAtEnd(); ++it) {
+		if( !it.Get() ) {
+			continue;
+		};
+		const typename TMask::IndexType idx = it.GetIndex();
+		for(unsigned int dim=0; dim<VImageDimension; dim++) {
+			minIdx[dim] = (!isFound || idx[dim]<minIdx[dim]) ? idx[dim] : minIdx[dim];
+			maxIdx[dim] = (!isFound || idx[dim]>maxIdx[dim]) ? idx[dim] : maxIdx[dim];
+		};
+		isFound = true;
+	};
+	if( isFound ) {
+		AddIndexBox<TMask>(reader->GetOutput(), minIdx, maxIdx, box);
+	};
+	return box;
+};
+
+
+/*
+ *	GetThresholdBoundingBox()
+ *
+ *	Physical bounding box of the voxels of an image exceeding a threshold.
+ *	The image is streamed in slabs along the last dimension so that the
+ *	whole volume is never held in memory
+ */
+template <class TPixel, unsigned int VImageDimension>
+PhysicalBoundingBox<VImageDimension> GetThresholdBoundingBox(std::string FName, double threshold)
+{
+	typedef itk::Image<TPixel,VImageDimension>	TImage;
+	typedef itk::ImageFileReader<TImage>		TReader;
+	PhysicalBoundingBox<VImageDimension>		box;
+
+	itk::MetaImageIO::Pointer	imageIO = itk::MetaImageIO::New();
+	typename TReader::Pointer	reader	= TReader::New();
+	imageIO->SetUseStreamedReading(true);
+	reader->SetImageIO(imageIO);
+	reader->SetFileName(FName);
+
+	typename TImage::IndexType	minIdx, maxIdx;
+	bool						isFound = false;
+	try {
+		reader->UpdateOutputInformation();
+		const typename TImage::RegionType	fullRegion	= reader->GetOutput()->GetLargestPossibleRegion();
+		const unsigned int					lastDim		= VImageDimension-1;
+		const long							nSlices		= fullRegion.GetSize()[lastDim];
+		for(long slice=0; slice<nSlices; slice+=cropSlabThickness) {
+			typename TImage::RegionType slab = fullRegion;
+			slab.SetIndex(lastDim, fullRegion.GetIndex()[lastDim]+slice);
+			slab.SetSize(lastDim, std::min<long>(cropSlabThickness, nSlices-slice));
+			reader->GetOutput()->SetRequestedRegion(slab);
+			reader->Update();
+
+			itk::ImageRegionConstIteratorWithIndex<TImage> it(reader->GetOutput(), slab);
+			for(it.GoToBegin(); !it.IsAtEnd(); ++it) {
+				if( !(it.Get()>threshold) ) {
+					continue;
+				};
+				const typename TImage::IndexType idx = it.GetIndex();
+				for(unsigned int dim=0; dim<VImageDimension; dim++) {
+					minIdx[dim] = (!isFound || idx[dim]<minIdx[dim]) ? idx[dim] : minIdx[dim];
+					maxIdx[dim] = (!isFound || idx[dim]>maxIdx[dim]) ? idx[dim] : maxIdx[dim];
+				};
+				isFound = true;
+			};
+		};
+	}
+	catch( itk::ExceptionObject & err ) {
+		std::cerr << "Unable to threshold the image: " << FName << std::endl;
+		std::cerr << err << std::endl;
+		return box;
+	};
+
+	if( isFound ) {
+		AddIndexBox<TImage>(reader->GetOutput(), minIdx, maxIdx, box);
+	};
+	return box;
+};
+
+
+/*
+ *	ReadCroppedImage()
+ *
+ *	Reads the part of an image covered by a physical bounding box padded
+ *	by "padding" mm on all sides. Only the cropped region is read from
+ *	uncompressed files. The full image is returned if the box does not
+ *	intersect the image and a null pointer if the image cannot be read.
+ */
+template <class TPixel, unsigned int VImageDimension>
+typename itk::Image<TPixel,VImageDimension>::Pointer ReadCroppedImage(std::string FName,
+																		const PhysicalBoundingBox<VImageDimension> &box,
+																		double padding)
+{
+	typedef itk::Image<TPixel,VImageDimension>				TImage;
+	typedef itk::ImageFileReader<TImage>					TReader;
+	typedef itk::RegionOfInterestImageFilter<TImage,TImage>	TCropFilter;
+	const unsigned int										D = VImageDimension;
+
+	itk::MetaImageIO::Pointer	imageIO = itk::MetaImageIO::New();
+	typename TReader::Pointer	reader	= TReader::New();
+	imageIO->SetUseStreamedReading(true);
+	reader->SetImageIO(imageIO);
+	reader->SetFileName(FName);
+	try {
+		reader->UpdateOutputInformation();
+	}
+	catch( itk::ExceptionObject & err ) {
+		std::cerr << "Unable to read the image: " << FName << std::endl;
+		std::cerr << err << std::endl;
+		return typename TImage::Pointer();
+	};
+	const TImage*						info		= reader->GetOutput();
+	const typename TImage::RegionType	fullRegion	= info->GetLargestPossibleRegion();
+
+	/*	Convert the padded physical box to an index region of this image	*/
+	typename TImage::IndexType	lower, upper;
+	for(unsigned int corner=0; corner<(1u<<D); corner++) {
+		itk::Point<double,D>			point;
+		itk::ContinuousIndex<double,D>	cIdx;
+		for(unsigned int dim=0; dim<D; dim++) {
+			point[dim] = (corner & (1u<<dim)) ? box.upper[dim]+padding : box.lower[dim]-padding;
+		};
+		info->TransformPhysicalPointToContinuousIndex(point, cIdx);
+		for(unsigned int dim=0; dim<D; dim++) {
+			const long lo = static_cast<long>( std::floor(cIdx[dim]) );
+			const long hi = static_cast<long>( std::ceil(cIdx[dim]) );
+			lower[dim] = (!corner || lo<lower[dim]) ? lo : lower[dim];
+			upper[dim] = (!corner || hi>upper[dim]) ? hi : upper[dim];
+		};
+	};
+
+	typename TImage::RegionType cropRegion;
+	bool						isEmpty = !box.isValid;
+	for(unsigned int dim=0; dim<D; dim++) {
+		const long first = fullRegion.GetIndex()[dim];
+		const long last	 = first + static_cast<long>( fullRegion.GetSize()[dim] ) - 1;
+		const long lo	 = std::max<long>(lower[dim], first);
+		const long hi	 = std::min<long>(upper[dim], last);
+		isEmpty = isEmpty || (hi<lo);
+		cropRegion.SetIndex(dim, lo);
+		cropRegion.SetSize(dim, (hi>=lo) ? hi-lo+1 : 0);
+	};
+	if( isEmpty ) {
+		std::cerr << "Crop region does not intersect " << FName << ". Using the full image" << std::endl;
+		cropRegion = fullRegion;
+	};
+
+	/*	Crop the image. The region of interest filter only requests the
+	 *	cropped region from the reader	*/
+	typename TCropFilter::Pointer cropper = TCropFilter::New();
+	cropper->SetInput( reader->GetOutput() );
+	cropper->SetRegionOfInterest(cropRegion);
+	try {
+		cropper->Update();
+	}
+	catch( itk::ExceptionObject & err ) {
+		std::cerr << "Unable to read the image: " << FName << std::endl;
+		std::cerr << err << std::endl;
+		return typename TImage::Pointer();
+	};
+
+	typename TImage::Pointer image = cropper->GetOutput();
+	image->DisconnectPipeline();
+	std::cout << "Cropped " << FName << " to " << cropRegion.GetSize()
+			  << " of " << fullRegion.GetSize() << " voxels" << std::endl;
+	return image;
+};
+
+
+/*
+ *	ReadRegistrationImages()
+ *
+ *	Reads the target and moving images, cropping them to the region of
+ *	interest specified in the registration options (ROI mask or threshold).
+ *	Returns false if either image cannot be read
+ */
+template <class TPixel, unsigned int VImageDimension>
+bool ReadRegistrationImages(RegOptsFilter &opts,
+							typename itk::Image<TPixel,VImageDimension>::Pointer &fixedImage,
+							typename itk::Image<TPixel,VImageDimension>::Pointer &movingImage)
+{
+	PhysicalBoundingBox<VImageDimension> box;
+	if( !opts.roiFile.empty() ) {
+		box = GetMaskBoundingBox<VImageDimension>(opts.roiFile);
+	}
+	else if( opts.cropThreshold>0 ) {
+		box = GetThresholdBoundingBox<TPixel,VImageDimension>(opts.targetFile, opts.cropThreshold);
+	};
+
+	/*	No cropping	*/
+	if( !box.isValid ) {
+		if( !opts.roiFile.empty() || (opts.cropThreshold>0) ) {
+			std::cerr << "Empty crop region. Registering the full images" << std::endl;
+		};
+		try {
+			fixedImage	= opts.GetImagePointerFromFile<TPixel,VImageDimension>(opts.targetFile);
+			movingImage	= opts.GetImagePointerFromFile<TPixel,VImageDimension>(opts.movingFile);
+		}
+		catch( itk::ExceptionObject & err ) {
+			std::cerr << "Unable to read the registration images" << std::endl;
+			std::cerr << err << std::endl;
+			return false;
+		};
+		return true;
+	};
+
+	/*	The moving image is padded twice as much to allow for motion	*/
+	fixedImage	= ReadCroppedImage<TPixel,VImageDimension>(opts.targetFile, box, opts.cropPadding);
+	movingImage	= ReadCroppedImage<TPixel,VImageDimension>(opts.movingFile, box, 2*opts.cropPadding);
+	return fixedImage && movingImage;
+};
+
+
+#endif
@@ -0,0 +1,350 @@
+/*
+ *	MaskPropagationSpecializations.h
+ *
+ *	Partial specialization templated class implementation for warping
+ *	an ROI mask (label image) through a set of final registration
+ *	transforms. Each transform maps the reference (fixed) grid to a
+ *	frame, so the mask is resampled using the inverse transform onto
+ *	the mask's own grid (all frames of a series share the geometry).
+ */
+
+
+#ifndef MASKPROPAGATIONSPECIALIZATIONS_H
+#define MASKPROPAGATIONSPECIALIZATIONS_H
+
+
+/*	C++ headers	*/
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/*	ITK headers	*/
+#include "itkImage.h"
+#include "itkImageFileReader.h"
+#include "itkImageFileWriter.h"
+#include "itkResampleImageFilter.h"
+#include "itkBinaryThresholdImageFilter.h"
+#include "itkNearestNeighborInterpolateImageFunction.h"
+#include "itkLinearInterpolateImageFunction.h"
+#include "itkImageRegionConstIterator.h"
+#include "itkTransformFileReader.h"
+#include "itkTransformFactoryBase.h"
+#include "itkTransform.h"
+
+
+
+//	Define common types
+enum maskResampleType{		//	Mask resampling scheme
+	NearestNeighbour,		//	labels are preserved (output: label image)
+	PartialVolume			//	fraction of each voxel inside the mask (output: float)
+};
+
+enum maskOutputType{		//	Format of the propagated masks
+	LabelImage,				//	one MHA file per frame
+	SparseIndices			//	one line of (1-based) linear indices per frame
+};
+
+
+/*
+ *	MaskPropagationOpts
+ *
+ *	Options shared by all mask propagation specializations. These are
+ *	parsed from the command prompt by itkWarpMask.
+ */
+struct MaskPropagationOpts{
+
+	unsigned int		dimensions;		/*	Number of image dimensions	*/
+	maskResampleType	resample;		/*	Mask resampling scheme	*/
+	maskOutputType		output;			/*	Output format	*/
+	float				threshold;		/*	Minimum partial volume written to sparse lists	*/
+
+	std::string maskFile;		/*	Label/mask image on the reference grid	*/
+	std::string transformFile;	/*	ITK transform file (one transform per frame)	*/
+	std::string outputPrefix;	/*	Output file prefix	*/
+};
+
+
+/*
+ *	ReadFrameTransforms()
+ *
+ *	Reads all transforms stored in an ITK transform file (as written by
+ *	itkReg in append mode) and returns the inverse of each transform,
+ *	i.e., the mapping from a frame back to the reference grid required
+ *	by the resampler.
+ */
+template <unsigned int VImageDimension>
+bool ReadFrameTransforms(std::string FName,
+						 std::vector< typename itk::Transform<double,VImageDimension,VImageDimension>::ConstPointer > &transforms)
+{
+	typedef itk::Transform<double,VImageDimension,VImageDimension>	TTransform;
+
+	itk::TransformFactoryBase::RegisterDefaultTransforms();
+	itk::TransformFileReader::Pointer reader = itk::TransformFileReader::New();
+	reader->SetFileName(FName);
+	try {
+		reader->Update();
+	}
+	catch( itk::ExceptionObject & err ) {
+		std::cerr << "Unable to read the transform file: " << FName << std::endl;
+		std::cerr << err << std::endl;
+		return false;
+	};
+
+	typedef itk::TransformFileReader::TransformListType TListType;
+	const TListType* list = reader->GetTransformList();
+	for(typename TListType::const_iterator it=list->begin(); it!=list->end(); ++it) {
+		const TTransform* transform = dynamic_cast<const TTransform*>( it->GetPointer() );
+		if( !transform ) {
+			std::cerr << "Transform " << transforms.size()+1 << " does not match the "
+					  << VImageDimension << "D mask" << std::endl;
+			return false;
+		};
+
+		typename TTransform::InverseTransformBasePointer inverse = transform->GetInverseTransform();
+		if( inverse.IsNull() ) {
+			std::cerr << "Transform " << transforms.size()+1 << " is not invertible" << std::endl;
+			return false;
+		};
+		transforms.push_back( dynamic_cast<const TTransform*>( inverse.GetPointer() ) );
+	};
+
+	return !transforms.empty();
+};
+
+
+/*
+ *	FrameFileName()
+ *
+ *	Generates the output file name for a given (zero-based) frame
+ */
+inline std::string FrameFileName(std::string prefix, unsigned int frame)
+{
+	std::ostringstream fName;
+	fName << prefix << "_";
+	fName.width(4);
+	fName.fill('0');
+	fName << frame+1 << ".mha";
+	return fName.str();
+};
+
+
+/*	Default specialization	*/
+template <unsigned int VImageDimension, unsigned int MaskResampleEnum>
+class MaskPropagationWrapper
+{
+
+public:
+
+	/*	Class constructor	*/
+	MaskPropagationWrapper(MaskPropagationOpts &opts)
+	{
+		std::cerr << "Unknown or unsupported mask resampling scheme" << std::endl;
+	};
+};
+
+/*	Nearest neighbour specialization	*/
+template <unsigned int VImageDimension>
+class MaskPropagationWrapper <VImageDimension,NearestNeighbour>
+{
+
+	/*	Common types	*/
+	typedef unsigned short													TLabel;
+	typedef itk::Image<TLabel,VImageDimension>								TMask;
+	typedef itk::Transform<double,VImageDimension,VImageDimension>			TTransform;
+	typedef itk::ResampleImageFilter<TMask,TMask>							TResampler;
+	typedef itk::NearestNeighborInterpolateImageFunction<TMask,double>		TInterpolator;
+
+public:
+
+	bool isSuccess;
+
+	/*	Class constructor	*/
+	MaskPropagationWrapper(MaskPropagationOpts &opts)
+	{
+		isSuccess = false;
+
+		/*	Read the mask and the transforms	*/
+		typedef itk::ImageFileReader<TMask> TReader;
+		typename TReader::Pointer reader = TReader::New();
+		reader->SetFileName(opts.maskFile);
+		std::vector<typename TTransform::ConstPointer> transforms;
+		try {
+			reader->Update();
+		}
+		catch( itk::ExceptionObject & err ) {
+			std::cerr << "ExceptionObject caught !" << std::endl;
+			std::cerr << err << std::endl;
+			return;
+		};
+		if( !ReadFrameTransforms<VImageDimension>(opts.transformFile,transforms) ) {
+			return;
+		};
+		typename TMask::Pointer mask = reader->GetOutput();
+
+		/*	A single resampler is reused for all frames. The output grid
+		 *	is the mask grid and the filter is multi-threaded by ITK	*/
+		typename TResampler::Pointer resampler = TResampler::New();
+		resampler->SetInput(mask);
+		resampler->SetInterpolator( TInterpolator::New() );
+		resampler->SetOutputParametersFromImage(mask);
+		resampler->SetDefaultPixelValue(0);
+
+		std::ofstream indexOut;
+		if( opts.output==SparseIndices ) {
+			indexOut.open(opts.outputPrefix + "_indices.txt", std::ofstream::out | std::ofstream::trunc);
+			if( !indexOut.is_open() ) {
+				std::cerr << "Unable to open the index list file" << std::endl;
+				return;
+			};
+		};
+
+		/*	Warp the mask into each frame	*/
+		for(unsigned int frame=0; frame<transforms.size(); frame++) {
+			resampler->SetTransform(transforms[frame]);
+			try {
+				resampler->Update();
+			}
+			catch( itk::ExceptionObject & err ) {
+				std::cerr << "ExceptionObject caught !" << std::endl;
+				std::cerr << err << std::endl;
+				return;
+			};
+
+			if( opts.output==LabelImage ) {
+				typedef itk::ImageFileWriter<TMask> TWriter;
+				typename TWriter::Pointer writer = TWriter::New();
+				writer->SetInput( resampler->GetOutput() );
+				writer->SetFileName( FrameFileName(opts.outputPrefix,frame) );
+				writer->Update();
+			}
+			else {
+
+				/*	Write only the voxels within the mask. MATLAB's column
+				 *	major ordering matches ITK's buffer ordering, so the
+				 *	index is simply the (1-based) buffer offset	*/
+				itk::ImageRegionConstIterator<TMask> it(resampler->GetOutput(),
+														resampler->GetOutput()->GetLargestPossibleRegion());
+				unsigned long idx = 1;
+				indexOut << frame+1;
+				for(it.GoToBegin(); !it.IsAtEnd(); ++it, idx++) {
+					if( it.Get() ) {
+						indexOut << '\t' << idx << ':' << it.Get();
+					};
+				};
+				indexOut << std::endl;
+			};
+			std::cout << "Propagated mask to frame " << frame+1 << " of " << transforms.size() << std::endl;
+		};
+
+		isSuccess = true;
+	};
+};
+
+/*	Partial volume specialization	*/
+template <unsigned int VImageDimension>
+class MaskPropagationWrapper <VImageDimension,PartialVolume>
+{
+
+	/*	Common types	*/
+	typedef unsigned short													TLabel;
+	typedef float															TFraction;
+	typedef itk::Image<TLabel,VImageDimension>								TMask;
+	typedef itk::Image<TFraction,VImageDimension>							TFractionImage;
+	typedef itk::Transform<double,VImageDimension,VImageDimension>			TTransform;
+	typedef itk::BinaryThresholdImageFilter<TMask,TFractionImage>			TBinarizer;
+	typedef itk::ResampleImageFilter<TFractionImage,TFractionImage>		TResampler;
+	typedef itk::LinearInterpolateImageFunction<TFractionImage,double>		TInterpolator;
+
+public:
+
+	bool isSuccess;
+
+	/*	Class constructor	*/
+	MaskPropagationWrapper(MaskPropagationOpts &opts)
+	{
+		isSuccess = false;
+
+		/*	Read the mask and the transforms	*/
+		typedef itk::ImageFileReader<TMask> TReader;
+		typename TReader::Pointer reader = TReader::New();
+		reader->SetFileName(opts.maskFile);
+		std::vector<typename TTransform::ConstPointer> transforms;
+		if( !ReadFrameTransforms<VImageDimension>(opts.transformFile,transforms) ) {
+			return;
+		};
+
+		/*	Partial volume fractions are computed for the union of all
+		 *	labels by linearly interpolating the binarized mask	*/
+		typename TBinarizer::Pointer binarizer = TBinarizer::New();
+		binarizer->SetInput( reader->GetOutput() );
+		binarizer->SetLowerThreshold(1);
+		binarizer->SetInsideValue(1.0);
+		binarizer->SetOutsideValue(0.0);
+		try {
+			binarizer->Update();
+		}
+		catch( itk::ExceptionObject & err ) {
+			std::cerr << "ExceptionObject caught !" << std::endl;
+			std::cerr << err << std::endl;
+			return;
+		};
+		typename TFractionImage::Pointer mask = binarizer->GetOutput();
+
+		typename TResampler::Pointer resampler = TResampler::New();
+		resampler->SetInput(mask);
+		resampler->SetInterpolator( TInterpolator::New() );
+		resampler->SetOutputParametersFromImage(mask);
+		resampler->SetDefaultPixelValue(0);
+
+		std::ofstream indexOut;
+		if( opts.output==SparseIndices ) {
+			indexOut.open(opts.outputPrefix + "_indices.txt", std::ofstream::out | std::ofstream::trunc);
+			if( !indexOut.is_open() ) {
+				std::cerr << "Unable to open the index list file" << std::endl;
+				return;
+			};
+			indexOut.precision(4);
+		};
+
+		/*	Warp the mask into each frame	*/
+		for(unsigned int frame=0; frame<transforms.size(); frame++) {
+			resampler->SetTransform(transforms[frame]);
+			try {
+				resampler->Update();
+			}
+			catch( itk::ExceptionObject & err ) {
+				std::cerr << "ExceptionObject caught !" << std::endl;
+				std::cerr << err << std::endl;
+				return;
+			};
+
+			if( opts.output==LabelImage ) {
+				typedef itk::ImageFileWriter<TFractionImage> TWriter;
+				typename TWriter::Pointer writer = TWriter::New();
+				writer->SetInput( resampler->GetOutput() );
+				writer->SetFileName( FrameFileName(opts.outputPrefix,frame) );
+				writer->Update();
+			}
+			else {
+				itk::ImageRegionConstIterator<TFractionImage> it(resampler->GetOutput(),
+																 resampler->GetOutput()->GetLargestPossibleRegion());
+				unsigned long idx = 1;
+				indexOut << frame+1;
+				for(it.GoToBegin(); !it.IsAtEnd(); ++it, idx++) {
+					if( it.Get()>opts.threshold ) {
+						indexOut << '\t' << idx << ':' << it.Get();
+					};
+				};
+				indexOut << std::endl;
+			};
+			std::cout << "Propagated mask to frame " << frame+1 << " of " << transforms.size() << std::endl;
+		};
+
+		isSuccess = true;
+	};
+};
+
+
+#endif
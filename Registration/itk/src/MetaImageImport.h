@@ -0,0 +1,109 @@
+/*
+ *	MetaImageImport.h
+ *
+ *	Reads MetaImage files into ITK images using the QUATTRO MetaImage
+ *	reader (see MetaImage.h). When the element type of the file matches
+ *	the pixel type and the data are uncompressed, the image references
+ *	the (copy-on-write) mapped file directly, so large series are paged
+ *	in by the OS as the registration accesses them. Otherwise the data
+ *	are decoded (in parallel) into a buffer owned by the image.
+ */
+
+
+#ifndef METAIMAGEIMPORT_H
+#define METAIMAGEIMPORT_H
+
+
+/*	C++ headers	*/
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*	ITK headers	*/
+#include "itkImage.h"
+
+/*	QUATTRO headers	*/
+#include "MetaImage.h"
+
+
+/*
+ *	ImportMetaImage()
+ *
+ *	Returns the image stored in a MetaImage file or a null pointer if the
+ *	file cannot be imported (e.g., multi-channel data or a dimension
+ *	mismatch), in which case the caller should use itk::ImageFileReader
+ */
+template <class TPixel, unsigned int VImageDimension>
+typename itk::Image<TPixel,VImageDimension>::Pointer ImportMetaImage(std::string FName)
+{
+	typedef itk::Image<TPixel,VImageDimension>	TImage;
+	typedef typename TImage::PixelContainer		TContainer;
+	const unsigned int							D = VImageDimension;
+
+	/*	Mappings referenced by images are retained until the process
+	 *	exits because the images do not own their buffers	*/
+	static std::vector< std::shared_ptr<MetaImage> > mappings;
+
+	std::shared_ptr<MetaImage> file = std::make_shared<MetaImage>();
+	if( !file->Read(FName) ) {
+		return typename TImage::Pointer();
+	};
+	const MetaImageHeader &header = file->GetHeader();
+	if( (header.nChannels!=1) || (header.dimSize.size()<D) ) {
+		return typename TImage::Pointer();
+	};
+
+	/*	Geometry. Trailing singleton dimensions of the file are ignored	*/
+	typename TImage::RegionType		region;
+	typename TImage::SpacingType	spacing;
+	typename TImage::PointType		origin;
+	typename TImage::DirectionType	direction;
+	const size_t					nDims	= header.dimSize.size();
+	size_t							nPixels = 1;
+	direction.SetIdentity();
+	for(unsigned int dim=0; dim<nDims; dim++) {
+		if( (dim>=D) && (header.dimSize[dim]!=1) ) {
+			return typename TImage::Pointer();
+		}
+		else if( dim>=D ) {
+			continue;
+		};
+		region.SetIndex(dim, 0);
+		region.SetSize(dim, header.dimSize[dim]);
+		spacing[dim] = (dim<header.spacing.size()) ? header.spacing[dim] : 1.0;
+		origin[dim]	 = (dim<header.offset.size())  ? header.offset[dim]  : 0.0;
+		nPixels		*= header.dimSize[dim];
+
+		/*	Row "dim" of TransformMatrix is the direction of axis "dim"	*/
+		if( header.transformMatrix.size()==nDims*nDims ) {
+			for(unsigned int r=0; r<D; r++) {
+				direction[r][dim] = header.transformMatrix[dim*nDims+r];
+			};
+		};
+	};
+
+	typename TContainer::Pointer container = TContainer::New();
+	if( file->IsDirect() && (MetaElementTraits<TPixel>::type==header.elementType) ) {
+		container->SetImportPointer( static_cast<TPixel*>( file->GetWritableData() ), nPixels, false );
+		mappings.push_back(file);
+	}
+	else {
+		container->Reserve(nPixels);
+		if( !file->CopyTo( container->GetBufferPointer() ) ) {
+			std::cerr << "Unable to read " << FName << ": " << file->GetError() << std::endl;
+			return typename TImage::Pointer();
+		};
+	};
+
+	typename TImage::Pointer image = TImage::New();
+	image->SetRegions(region);
+	image->SetSpacing(spacing);
+	image->SetOrigin(origin);
+	image->SetDirection(direction);
+	image->SetPixelContainer(container);
+	return image;
+};
+
+
+#endif
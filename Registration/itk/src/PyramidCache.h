@@ -0,0 +1,223 @@
+/*
+ *	PyramidCache.h
+ *
+ *	Cache of pre-processed registration images (multi-resolution pyramid
+ *	levels and normalized images) keyed by a hash of the pixel data,
+ *	image geometry and processing settings. Re-running a registration
+ *	on the same image pair (e.g., after changing the metric settings in
+ *	the GUI) then skips the smoothing/shrinking of every pyramid level.
+ *
+ *	Two levels of caching are provided:
+ *
+ *		1) an in-memory LRU cache (per process) with a fixed capacity
+ *
+ *		2) an optional on-disk cache in which each entry is stored in a
+ *		   single, uncompressed file that later jobs memory-map (copy-on-
+ *		   write) instead of recomputing the levels. A mapping is released
+ *		   with the last image that references it
+ */
+
+
+#ifndef PYRAMIDCACHE_H
+#define PYRAMIDCACHE_H
+
+
+/*	C++ headers	*/
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*	ITK headers	*/
+#include "itkImage.h"
+#include "itkImportImageContainer.h"
+#include "itkMultiResolutionPyramidImageFilter.h"
+
+/*	QUATTRO headers	*/
+#include "ContentHash.h"
+#include "MappedFile.h"
+
+
+/*
+ *	MappedImageContainer
+ *
+ *	Pixel container of an image whose pixels reside in a memory-mapped
+ *	file. The container keeps the mapping open for as long as the image
+ *	(or any image grafted from it) exists.
+ */
+template <class TPixel>
+class MappedImageContainer : public itk::ImportImageContainer<itk::SizeValueType,TPixel>
+{
+
+public:
+
+	typedef MappedImageContainer										Self;
+	typedef itk::ImportImageContainer<itk::SizeValueType,TPixel>		Superclass;
+	typedef itk::SmartPointer<Self>										Pointer;
+	typedef itk::SmartPointer<const Self>								ConstPointer;
+	itkNewMacro(Self);
+	itkTypeMacro(MappedImageContainer, ImportImageContainer);
+
+	/*	Imports nPixels pixels starting at byte offset of the mapped file	*/
+	void SetMappedFile(const std::shared_ptr<MappedFile> &mappedFile, size_t offset, size_t nPixels)
+	{
+		file = mappedFile;
+		this->SetImportPointer( reinterpret_cast<TPixel*>(file->GetWritableData()+offset), nPixels, false );
+	};
+
+protected:
+
+	MappedImageContainer() {};
+
+private:
+
+	MappedImageContainer(const Self&);
+	void operator=(const Self&);
+
+	std::shared_ptr<MappedFile> file;
+};
+
+
+/*
+ *	PyramidCache
+ *
+ *	Process wide cache of image levels. Use GetInstance() to access the
+ *	cache of a given image type.
+ */
+template <class TImage>
+class PyramidCache{
+
+ public:
+
+	typedef typename TImage::Pointer		ImagePointer;
+	typedef typename TImage::PixelType		PixelType;
+	typedef std::vector<ImagePointer>		LevelsType;
+	typedef itk::Array2D<unsigned int>		ScheduleType;
+
+	/*
+	 *	GetInstance()
+	 *
+	 *	Returns the cache of the image type TImage
+	 */
+	static PyramidCache& GetInstance();
+
+	/*
+	 *	SetDirectory()
+	 *
+	 *	Sets the on-disk cache directory. An empty string (default)
+	 *	disables the on-disk cache
+	 */
+	void SetDirectory(const std::string &dir) { directory = dir; };
+
+	/*
+	 *	SetMemoryCapacity()
+	 *
+	 *	Sets the maximum number of bytes of the in-memory cache. Least
+	 *	recently used entries are evicted when the capacity is exceeded
+	 */
+	void SetMemoryCapacity(size_t nBytes);
+
+	/*
+	 *	ComputeKey()
+	 *
+	 *	Computes the cache key of an image for a processing step ("tag")
+	 *	and, for pyramids, the pyramid schedule
+	 */
+	QtHashType ComputeKey(const TImage* image, const std::string &tag,
+						  const ScheduleType* schedule=0) const;
+
+	/*
+	 *	Find()
+	 *
+	 *	Looks up the levels stored with the given key, first in memory and
+	 *	then on disk. The returned images can be used (and modified) by
+	 *	the caller without affecting the cache
+	 */
+	bool Find(QtHashType key, LevelsType &levels);
+
+	/*
+	 *	Store()
+	 *
+	 *	Stores a copy of the levels in memory and, if enabled, on disk
+	 */
+	void Store(QtHashType key, const LevelsType &levels);
+
+
+ private:
+
+	/*	Cache entry of the in-memory cache	*/
+	struct Entry{
+		LevelsType						levels;
+		size_t							nBytes;
+		typename std::list<QtHashType>::iterator order;
+	};
+
+	std::string										directory;
+	size_t											capacity;
+	size_t											nBytes;
+	std::list<QtHashType>							lru;		/*	most recently used first	*/
+	std::map<QtHashType,Entry>						entries;
+
+	PyramidCache() : capacity(512*1024*1024), nBytes(0) {};
+	PyramidCache(const PyramidCache&);
+	PyramidCache& operator=(const PyramidCache&);
+
+	std::string GetFileName(QtHashType key) const;
+	void		Evict();
+	bool		ReadFromDisk(QtHashType key, LevelsType &levels);
+	void		WriteToDisk(QtHashType key, const LevelsType &levels) const;
+	static ImagePointer Duplicate(const TImage* image);
+};
+
+
+/*
+ *	CachedPyramidImageFilter
+ *
+ *	Multi-resolution pyramid filter that retrieves its output levels from
+ *	the PyramidCache whenever the same input and schedule were processed
+ *	before (in this process or by an earlier job sharing the on-disk
+ *	cache). Drop-in replacement for itk::MultiResolutionPyramidImageFilter.
+ */
+template <class TImage>
+class CachedPyramidImageFilter : public itk::MultiResolutionPyramidImageFilter<TImage,TImage>
+{
+
+public:
+
+	typedef CachedPyramidImageFilter									Self;
+	typedef itk::MultiResolutionPyramidImageFilter<TImage,TImage>		Superclass;
+	typedef itk::SmartPointer<Self>										Pointer;
+	typedef itk::SmartPointer<const Self>								ConstPointer;
+	itkNewMacro(Self);
+	itkTypeMacro(CachedPyramidImageFilter, MultiResolutionPyramidImageFilter);
+
+protected:
+
+	CachedPyramidImageFilter() {};
+
+	/*	Generates the levels or grafts the cached levels to the outputs	*/
+	void GenerateData();
+
+private:
+
+	CachedPyramidImageFilter(const Self&);
+	void operator=(const Self&);
+};
+
+
+/*
+ *	GetNormalizedImage()
+ *
+ *	Returns the zero mean, unit variance version of an image (as used by
+ *	the Viola mutual information metric), using the PyramidCache
+ */
+template <class TImage>
+typename TImage::Pointer GetNormalizedImage(TImage* image);
+
+
+#ifndef ITK_MANUAL_INSTANTIATION
+#include "PyramidCache.hxx"
+#endif
+
+#endif // PYRAMIDCACHE_H
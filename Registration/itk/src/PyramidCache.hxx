@@ -0,0 +1,427 @@
+
+#ifndef PYRAMIDCACHE_HXX
+#define PYRAMIDCACHE_HXX
+
+
+/*	C++ headers	*/
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// QUATTRO headers
+#include "PyramidCache.h"
+
+//  Image computation headers
+#include "itkImageDuplicator.h"
+#include "itkNormalizeImageFilter.h"
+
+
+/*	On-disk cache file layout. The header is followed by one level record
+ *	per level and the (64 byte aligned) pixel data of each level	*/
+static const char	pyramidCacheMagic[8]	= {'Q','T','P','Y','R','M','D','1'};
+static const size_t	pyramidCacheAlignment	= 64;
+
+struct PyramidCacheFileHeader{
+	char			magic[8];
+	QtHashType		key;
+	unsigned int	dimension;
+	unsigned int	pixelSize;
+	unsigned int	numberOfLevels;
+	unsigned int	reserved;
+};
+
+struct PyramidCacheFileLevel{
+	QtHashType	size[3];
+	double		spacing[3];
+	double		origin[3];
+	double		direction[9];
+	QtHashType	offset;		/*	byte offset of the pixel data	*/
+};
+
+
+/*
+ *	GetInstance()
+ *
+ */
+template <class TImage>
+PyramidCache<TImage>& PyramidCache<TImage>::GetInstance()
+{
+	static PyramidCache<TImage> instance;
+	return instance;
+};
+
+
+/*
+ *	SetMemoryCapacity()
+ *
+ */
+template <class TImage>
+void PyramidCache<TImage>::SetMemoryCapacity(size_t nBytes)
+{
+	capacity = nBytes;
+	Evict();
+};
+
+
+/*
+ *	ComputeKey()
+ *
+ *	The key covers the processing step, pixel type, image geometry,
+ *	schedule and every pixel of the image
+ */
+template <class TImage>
+QtHashType PyramidCache<TImage>::ComputeKey(const TImage* image, const std::string &tag,
+											const ScheduleType* schedule) const
+{
+	const unsigned int	dim = TImage::ImageDimension;
+	ContentHash			hash;
+
+	hash.AppendString(tag);
+	hash.AppendValue(dim);
+	hash.AppendValue( static_cast<unsigned int>(sizeof(PixelType)) );
+
+	const typename TImage::SizeType			size		= image->GetBufferedRegion().GetSize();
+	const typename TImage::SpacingType		spacing		= image->GetSpacing();
+	const typename TImage::PointType		origin		= image->GetOrigin();
+	const typename TImage::DirectionType	direction	= image->GetDirection();
+	for(unsigned int r=0; r<dim; r++) {
+		hash.AppendValue( static_cast<QtHashType>(size[r]) );
+		hash.AppendValue( static_cast<double>(spacing[r]) );
+		hash.AppendValue( static_cast<double>(origin[r]) );
+		for(unsigned int c=0; c<dim; c++) {
+			hash.AppendValue( static_cast<double>(direction[r][c]) );
+		};
+	};
+
+	if( schedule ) {
+		hash.AppendValue( static_cast<unsigned int>(schedule->rows()) );
+		for(unsigned int r=0; r<schedule->rows(); r++) {
+			for(unsigned int c=0; c<schedule->cols(); c++) {
+				hash.AppendValue( (*schedule)[r][c] );
+			};
+		};
+	};
+
+	hash.Append(image->GetBufferPointer(),
+				image->GetBufferedRegion().GetNumberOfPixels()*sizeof(PixelType));
+	return hash.GetValue();
+};
+
+
+/*
+ *	Find()
+ *
+ */
+template <class TImage>
+bool PyramidCache<TImage>::Find(QtHashType key, LevelsType &levels)
+{
+	levels.clear();
+
+	/*	In-memory cache: move the entry to the front of the LRU list and
+	 *	return copies so that later pipeline updates cannot modify it	*/
+	typename std::map<QtHashType,Entry>::iterator it = entries.find(key);
+	if( it!=entries.end() ) {
+		lru.splice(lru.begin(), lru, it->second.order);
+		for(size_t lvl=0; lvl<it->second.levels.size(); lvl++) {
+			levels.push_back( Duplicate(it->second.levels[lvl]) );
+		};
+		return true;
+	};
+
+	/*	On-disk cache	*/
+	return ReadFromDisk(key, levels);
+};
+
+
+/*
+ *	Store()
+ *
+ */
+template <class TImage>
+void PyramidCache<TImage>::Store(QtHashType key, const LevelsType &levels)
+{
+	if( entries.find(key)!=entries.end() ) {
+		return;
+	};
+
+	Entry entry;
+	entry.nBytes = 0;
+	for(size_t lvl=0; lvl<levels.size(); lvl++) {
+		entry.levels.push_back( Duplicate(levels[lvl]) );
+		entry.nBytes += levels[lvl]->GetBufferedRegion().GetNumberOfPixels()*sizeof(PixelType);
+	};
+
+	/*	Entries larger than the cache are only written to disk	*/
+	if( entry.nBytes<=capacity ) {
+		lru.push_front(key);
+		entry.order	 = lru.begin();
+		nBytes		+= entry.nBytes;
+		entries[key] = entry;
+		Evict();
+	};
+
+	if( !directory.empty() ) {
+		WriteToDisk(key, levels);
+	};
+};
+
+
+/*
+ *	GetFileName()
+ *
+ */
+template <class TImage>
+std::string PyramidCache<TImage>::GetFileName(QtHashType key) const
+{
+	char name[32];
+	std::snprintf(name, sizeof(name), "%08x%08x.qtpyr",
+				  static_cast<unsigned int>(key>>32), static_cast<unsigned int>(key & 0xFFFFFFFF));
+	return directory + "/" + name;
+};
+
+
+/*
+ *	Evict()
+ *
+ *	Removes the least recently used entries until the in-memory cache
+ *	fits within the capacity
+ */
+template <class TImage>
+void PyramidCache<TImage>::Evict()
+{
+	while( (nBytes>capacity) && !lru.empty() ) {
+		typename std::map<QtHashType,Entry>::iterator it = entries.find( lru.back() );
+		nBytes -= it->second.nBytes;
+		entries.erase(it);
+		lru.pop_back();
+	};
+};
+
+
+/*
+ *	ReadFromDisk()
+ *
+ *	Maps an on-disk cache entry and wraps each level in an ITK image
+ *	that references the mapped pages directly. The mapping is copy-on-
+ *	write, so modifying the images never alters the cache file. Each
+ *	lookup maps the file anew (so one caller's modifications are never
+ *	seen by the next) and the pixel containers own the mapping, which is
+ *	released with the last image that references it.
+ */
+template <class TImage>
+bool PyramidCache<TImage>::ReadFromDisk(QtHashType key, LevelsType &levels)
+{
+	if( directory.empty() ) {
+		return false;
+	};
+
+	std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>();
+	if( !file->Open(GetFileName(key), MapCopyOnWrite) ) {
+		return false;
+	};
+
+	/*	Validate the header	*/
+	const unsigned int dim = TImage::ImageDimension;
+	if( file->GetSize()<sizeof(PyramidCacheFileHeader) ) {
+		return false;
+	};
+	const PyramidCacheFileHeader* header = reinterpret_cast<const PyramidCacheFileHeader*>( file->GetData() );
+	if( std::memcmp(header->magic, pyramidCacheMagic, sizeof(pyramidCacheMagic)) ||
+		(header->key!=key) || (header->dimension!=dim) || (header->pixelSize!=sizeof(PixelType)) ||
+		(file->GetSize()<sizeof(PyramidCacheFileHeader) + header->numberOfLevels*sizeof(PyramidCacheFileLevel)) ) {
+		std::cerr << "Ignoring invalid pyramid cache file: " << GetFileName(key) << std::endl;
+		return false;
+	};
+
+	/*	Wrap each level	*/
+	const PyramidCacheFileLevel* records = reinterpret_cast<const PyramidCacheFileLevel*>( header+1 );
+	for(unsigned int lvl=0; lvl<header->numberOfLevels; lvl++) {
+		const PyramidCacheFileLevel &record = records[lvl];
+
+		typename TImage::RegionType		region;
+		typename TImage::SpacingType	spacing;
+		typename TImage::PointType		origin;
+		typename TImage::DirectionType	direction;
+		size_t							nPixels = 1;
+		for(unsigned int r=0; r<dim; r++) {
+			region.SetSize(r, record.size[r]);
+			region.SetIndex(r, 0);
+			spacing[r]	= record.spacing[r];
+			origin[r]	= record.origin[r];
+			nPixels	   *= record.size[r];
+			for(unsigned int c=0; c<dim; c++) {
+				direction[r][c] = record.direction[r*3+c];
+			};
+		};
+		if( record.offset + nPixels*sizeof(PixelType)>file->GetSize() ) {
+			std::cerr << "Ignoring truncated pyramid cache file: " << GetFileName(key) << std::endl;
+			levels.clear();
+			return false;
+		};
+
+		typedef MappedImageContainer<PixelType> TContainer;
+		typename TContainer::Pointer container = TContainer::New();
+		container->SetMappedFile(file, record.offset, nPixels);
+
+		ImagePointer image = TImage::New();
+		image->SetRegions(region);
+		image->SetSpacing(spacing);
+		image->SetOrigin(origin);
+		image->SetDirection(direction);
+		image->SetPixelContainer(container);
+		levels.push_back(image);
+	};
+
+	return true;
+};
+
+
+/*
+ *	WriteToDisk()
+ *
+ *	Writes the levels to a temporary file that is renamed once complete
+ *	so that concurrent jobs never map a partially written entry
+ */
+template <class TImage>
+void PyramidCache<TImage>::WriteToDisk(QtHashType key, const LevelsType &levels) const
+{
+	const unsigned int dim		= TImage::ImageDimension;
+	const std::string  fName	= GetFileName(key);
+	const std::string  tmpName	= fName + ".tmp";
+
+	/*	Create the header and level records	*/
+	PyramidCacheFileHeader header;
+	std::memset(&header, 0, sizeof(header));
+	std::memcpy(header.magic, pyramidCacheMagic, sizeof(pyramidCacheMagic));
+	header.key				= key;
+	header.dimension		= dim;
+	header.pixelSize		= sizeof(PixelType);
+	header.numberOfLevels	= static_cast<unsigned int>( levels.size() );
+
+	std::vector<PyramidCacheFileLevel> records(levels.size());
+	size_t offset = sizeof(header) + levels.size()*sizeof(PyramidCacheFileLevel);
+	for(size_t lvl=0; lvl<levels.size(); lvl++) {
+		PyramidCacheFileLevel &record = records[lvl];
+		std::memset(&record, 0, sizeof(record));
+
+		const TImage* image = levels[lvl];
+		for(unsigned int r=0; r<dim; r++) {
+			record.size[r]		= image->GetBufferedRegion().GetSize()[r];
+			record.spacing[r]	= image->GetSpacing()[r];
+			record.origin[r]	= image->GetOrigin()[r];
+			for(unsigned int c=0; c<dim; c++) {
+				record.direction[r*3+c] = image->GetDirection()[r][c];
+			};
+		};
+		offset			= (offset + pyramidCacheAlignment-1)/pyramidCacheAlignment*pyramidCacheAlignment;
+		record.offset	= offset;
+		offset		   += image->GetBufferedRegion().GetNumberOfPixels()*sizeof(PixelType);
+	};
+
+	/*	Write the file	*/
+	std::ofstream outFile(tmpName.c_str(), std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+	if( !outFile.is_open() ) {
+		std::cerr << "Unable to write the pyramid cache file: " << tmpName << std::endl;
+		return;
+	};
+	outFile.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	outFile.write(reinterpret_cast<const char*>(&records[0]), records.size()*sizeof(PyramidCacheFileLevel));
+	size_t position = sizeof(header) + records.size()*sizeof(PyramidCacheFileLevel);
+	const char padding[pyramidCacheAlignment] = {0};
+	for(size_t lvl=0; lvl<levels.size(); lvl++) {
+		outFile.write(padding, records[lvl].offset-position);
+		const size_t nBytes = levels[lvl]->GetBufferedRegion().GetNumberOfPixels()*sizeof(PixelType);
+		outFile.write(reinterpret_cast<const char*>( levels[lvl]->GetBufferPointer() ), nBytes);
+		position = records[lvl].offset + nBytes;
+	};
+	outFile.close();
+	if( outFile.fail() ) {
+		std::cerr << "Unable to write the pyramid cache file: " << tmpName << std::endl;
+		std::remove(tmpName.c_str());
+		return;
+	};
+
+	/*	Another job may have written the same entry in the meantime	*/
+	if( std::rename(tmpName.c_str(), fName.c_str())!=0 ) {
+		std::remove(tmpName.c_str());
+	};
+};
+
+
+/*
+ *	Duplicate()
+ *
+ */
+template <class TImage>
+typename PyramidCache<TImage>::ImagePointer PyramidCache<TImage>::Duplicate(const TImage* image)
+{
+	typedef itk::ImageDuplicator<TImage> TDuplicator;
+	typename TDuplicator::Pointer duplicator = TDuplicator::New();
+	duplicator->SetInputImage(image);
+	duplicator->Update();
+	return duplicator->GetOutput();
+};
+
+
+/*
+ *	CachedPyramidImageFilter::GenerateData()
+ *
+ */
+template <class TImage>
+void CachedPyramidImageFilter<TImage>::GenerateData()
+{
+	PyramidCache<TImage>&						cache	= PyramidCache<TImage>::GetInstance();
+	typename PyramidCache<TImage>::LevelsType	levels;
+	const typename Superclass::ScheduleType		schedule = this->GetSchedule();
+	const QtHashType							key		= cache.ComputeKey(this->GetInput(), "pyramid", &schedule);
+
+	/*	Graft the cached levels	*/
+	if( cache.Find(key,levels) && (levels.size()==this->GetNumberOfLevels()) ) {
+		for(unsigned int lvl=0; lvl<levels.size(); lvl++) {
+			this->GraftNthOutput(lvl, levels[lvl]);
+		};
+		std::cout << "Using cached multi-resolution pyramid" << std::endl;
+		return;
+	};
+
+	/*	Otherwise compute and store the levels	*/
+	Superclass::GenerateData();
+	levels.clear();
+	for(unsigned int lvl=0; lvl<this->GetNumberOfLevels(); lvl++) {
+		levels.push_back( this->GetOutput(lvl) );
+	};
+	cache.Store(key, levels);
+};
+
+
+/*
+ *	GetNormalizedImage()
+ *
+ */
+template <class TImage>
+typename TImage::Pointer GetNormalizedImage(TImage* image)
+{
+	PyramidCache<TImage>&						cache	= PyramidCache<TImage>::GetInstance();
+	typename PyramidCache<TImage>::LevelsType	levels;
+	const QtHashType							key		= cache.ComputeKey(image, "normalize");
+
+	if( cache.Find(key,levels) && (levels.size()==1) ) {
+		std::cout << "Using cached normalized image" << std::endl;
+		return levels[0];
+	};
+
+	typedef itk::NormalizeImageFilter<TImage,TImage> TNormalizeFilter;
+	typename TNormalizeFilter::Pointer normalizer = TNormalizeFilter::New();
+	normalizer->SetInput(image);
+	normalizer->Update();
+
+	typename TImage::Pointer normalized = normalizer->GetOutput();
+	normalized->DisconnectPipeline();
+	levels.push_back(normalized);
+	cache.Store(key, levels);
+	return normalized;
+};
+
+
+#endif	/*PYRAMIDCACHE_HXX*/
@@ -0,0 +1,150 @@
+/*
+ *	PyramidScheduleGenerator.h
+ *
+ *	Generates multi-resolution pyramid schedules from the physical voxel
+ *	size and extent of an image. Starting from the full resolution image,
+ *	each coarser level doubles the shrink factor of only those axes whose
+ *	effective voxel size (spacing*factor) is close to the smallest one,
+ *	so anisotropic acquisitions (e.g., thick slices) become approximately
+ *	isotropic before the in-plane resolution is reduced further. Levels
+ *	are added until the coarsest level reaches the target number of
+ *	voxels, the maximum number of levels, or no axis can be shrunk.
+ *
+ *	MultiResolutionPyramidImageFilter smooths each axis with a Gaussian of
+ *	variance (0.5*factor)^2 voxels, so the smoothing of every level follows
+ *	from the per-axis shrink factors; GetSigma() reports the resulting
+ *	physical standard deviations.
+ */
+
+
+#ifndef PYRAMIDSCHEDULEGENERATOR_H
+#define PYRAMIDSCHEDULEGENERATOR_H
+
+
+/*	C++ headers	*/
+#include <cmath>
+#include <vector>
+
+/*	ITK headers	*/
+#include "itkArray2D.h"
+#include "itkSize.h"
+#include "itkVector.h"
+
+
+template <unsigned int VImageDimension>
+class PyramidScheduleGenerator{
+
+ public:
+
+	typedef itk::Array2D<unsigned int>				ScheduleType;
+	typedef itk::Size<VImageDimension>				SizeType;
+	typedef itk::Vector<double,VImageDimension>		SpacingType;
+
+	PyramidScheduleGenerator() :
+		maxLevels(4),
+		minSize(16),
+		targetVoxels(0),
+		anisotropy(std::sqrt(2.0))
+	{
+		size.Fill(1);
+		spacing.Fill(1.0);
+	};
+
+	void SetSize(const SizeType &value)				{ size			= value; };
+	void SetSpacing(const SpacingType &value)		{ spacing		= value; };
+	void SetMaximumNumberOfLevels(unsigned int n)	{ maxLevels		= (n>0) ? n : 1; };
+	void SetMinimumSize(unsigned int n)				{ minSize		= (n>0) ? n : 1; };
+
+	/*
+	 *	SetTargetNumberOfVoxels()
+	 *
+	 *	Sets the number of voxels at which the coarsest level is reached.
+	 *	A value of zero uses 64 voxels per image dimension (64^D)
+	 */
+	void SetTargetNumberOfVoxels(double n)			{ targetVoxels	= n; };
+
+	/*
+	 *	Generate()
+	 *
+	 *	Returns the schedule (one row per level, coarsest level first)
+	 */
+	ScheduleType Generate()
+	{
+		const double target = (targetVoxels>0) ? targetVoxels : std::pow(64.0,static_cast<double>(VImageDimension));
+
+		/*	Build the levels from the finest (all factors 1) to the coarsest	*/
+		std::vector< std::vector<unsigned int> > levels;
+		std::vector<unsigned int> factors(VImageDimension, 1);
+		levels.push_back(factors);
+		while( (levels.size()<maxLevels) && (GetNumberOfVoxels(factors)>target) ) {
+
+			/*	Smallest effective voxel size of the axes that can still
+			 *	be shrunk	*/
+			double minSpacing = 0;
+			for(unsigned int dim=0; dim<VImageDimension; dim++) {
+				if( IsShrinkable(factors,dim) ) {
+					const double s = spacing[dim]*factors[dim];
+					minSpacing = ( (minSpacing==0) || (s<minSpacing) ) ? s : minSpacing;
+				};
+			};
+			if( minSpacing==0 ) {
+				break;
+			};
+
+			/*	Shrink all axes with a comparable effective voxel size	*/
+			for(unsigned int dim=0; dim<VImageDimension; dim++) {
+				if( IsShrinkable(factors,dim) && (spacing[dim]*factors[dim]<=anisotropy*minSpacing) ) {
+					factors[dim] *= 2;
+				};
+			};
+			levels.push_back(factors);
+		};
+
+		/*	Store the levels in the ITK order (coarsest first)	*/
+		ScheduleType schedule(static_cast<unsigned int>(levels.size()), VImageDimension);
+		for(unsigned int lvl=0; lvl<levels.size(); lvl++) {
+			for(unsigned int dim=0; dim<VImageDimension; dim++) {
+				schedule[lvl][dim] = levels[levels.size()-1-lvl][dim];
+			};
+		};
+		return schedule;
+	};
+
+	/*
+	 *	GetSigma()
+	 *
+	 *	Physical standard deviation of the Gaussian smoothing applied to an
+	 *	axis by MultiResolutionPyramidImageFilter for a given shrink factor
+	 */
+	double GetSigma(unsigned int dim, unsigned int factor) const
+	{
+		return 0.5*factor*spacing[dim];
+	};
+
+
+ private:
+
+	SizeType		size;
+	SpacingType		spacing;
+	unsigned int	maxLevels;
+	unsigned int	minSize;
+	double			targetVoxels;
+	double			anisotropy;		/*	maximum ratio of effective voxel sizes shrunk together	*/
+
+	bool IsShrinkable(const std::vector<unsigned int> &factors, unsigned int dim) const
+	{
+		return size[dim]/(2*factors[dim])>=minSize;
+	};
+
+	double GetNumberOfVoxels(const std::vector<unsigned int> &factors) const
+	{
+		double n = 1;
+		for(unsigned int dim=0; dim<VImageDimension; dim++) {
+			n *= std::ceil( static_cast<double>(size[dim])/factors[dim] );
+		};
+		return n;
+	};
+};
+
+
+#endif
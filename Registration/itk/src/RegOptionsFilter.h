@@ -24,7 +24,7 @@
 #include "itkMultiResolutionImageRegistrationMethod.h"
 
 /*	QUATTRO headers	*/
-
+#include "IniConfig.h"
 
 
 //	Define common types
@@ -69,10 +69,13 @@ class RegOptsFilter{
      float	numberOfIter;		//	Maximum number of iterations to use
      float	numberOfSamples;	//	Number of spatial samples to use when calculating
 								//	the similarity metric
-     float	numberOfPyramids;	//	Number of pyramids to use in multi-resolution scheme
+     float	numberOfPyramids;	//	Maximum number of pyramids to use in multi-resolution scheme
+     float	pyramidTargetVoxels;//	Target number of voxels of the coarsest pyramid level
      float	intensityThreshold;	//	Minimum threshold of pixel for selection by metric
 	 float	learningRate;		//	Gradient descent optimizer learning rate
 	 float	dimensions;			//	Number of image dimension
+	 float	cropThreshold;		//	Intensity threshold defining the registration region
+	 float	cropPadding;		//	Padding (mm) of the registration region
 
 	 similarityType		similarity;		/*	Similarity metric to be used	*/
 	 transformType		transform;		/*	Type of transformation	*/
@@ -82,6 +85,11 @@ class RegOptsFilter{
 	 std::string targetFile;
 	 std::string movingFile;
 	 std::string historyFile;
+	 std::string transformFile;		/*	Optional output file for the final transform	*/
+	 std::string cacheDirectory;	/*	Optional on-disk pyramid cache directory	*/
+	 std::string roiFile;			/*	Optional mask defining the registration region	*/
+
+	 long	job;	/*	Index of the manifest [Job] (-1 when not a batch)	*/
 
 	 std::ofstream historyOut;
 
@@ -96,6 +104,18 @@ class RegOptsFilter{
 	  *	Class constructor
 	  */
      RegOptsFilter(int argc, char *argv[]);
+     RegOptsFilter(const IniConfig &config, long job);
+
+	 /*
+	  *	ReadConfigFile()
+	  *
+	  *	Reads the options from the [Properties] section of an INI file
+	  *	(see register_helper). When a job index is given, the keys of
+	  *	that [Job] section (zero-based) override the [Properties] keys.
+	  *	Batches parse the manifest once and read each job from it
+	  */
+	 bool ReadConfigFile(const std::string &fName, long job=-1);
+	 bool ReadConfigFile(const IniConfig &config, long job=-1);
 
 	 /*
 	  *	GetImagePointerFromFile()
@@ -115,6 +135,16 @@ class RegOptsFilter{
 	 void WriteImagePointerToFile(std::string FName,
 								  typename itk::Image<TPixel,VImageDimension>::Pointer image);
 
+	 /*
+	  *	WriteTransformToFile()
+	  *
+	  *	Function to write the final transform to an ITK transform file
+	  *	so that ROIs can later be propagated (see itkWarpMask). Jobs
+	  *	after the first of a batch append their transform
+	  */
+	 template <class TTransform>
+	 void WriteTransformToFile(std::string FName, TTransform* transform);
+
 	 /*
 	  *	isReady()
 	  *
@@ -153,6 +183,12 @@ class RegOptsFilter{
 	 template <class TPixel, unsigned int VImageDimension, class TImage>
 	 void parseSimilarityToTemplate(itk::MultiResolutionImageRegistrationMethod<TImage,TImage>* registration);
 
+ private:
+
+	 void SetDefaults();
+	 void ValidateOptions();
+	 static float GetImageDimensions(const std::string &fName);
+
 };
 
 
@@ -5,11 +5,13 @@
 
 // QUATTRO headers
 #include "RegOptionsFilter.h"
+#include "MetaImageImport.h"
 
 //  Image IO and computation headers
 #include "itkImageFileReader.h"
 #include "itkImageFileWriter.h"
 #include "itkCastImageFilter.h"
+#include "itkTransformFileWriter.h"
 
 
 /*
@@ -21,16 +23,108 @@
  */
 RegOptsFilter::RegOptsFilter(int argc, char *argv[]){
 
-    /*	Define the default registration options	*/
+	this->SetDefaults();
+
+	/*	Options are either read from an INI file (itkReg CONFIGFILE [JOB])
+	 *	or passed directly via the command prompt	*/
+	if( (argc > 1) && (argc < 4) ) {
+		this->ReadConfigFile( argv[1], (argc > 2) ? atol( argv[2] ) : -1 );
+	}
+	else {
+
+		/*	Handle the necessary inputs	*/
+		if( argc > 4) {
+			this->dimensions	= atoi( argv[1] );
+			this->targetFile	= argv[2];
+			this->movingFile	= argv[3];
+			this->historyFile	= argv[4];
+		};
+		if( argc > 5 ) {	//	maximum step size
+			this->stepSizeMax = atof( argv[5] );
+		};
+		if( argc > 6 ) {	//	minimum step size
+			this->stepSizeMin = atof( argv[6] );
+		};
+		if( argc > 7 ) {	//	number of spatial samples
+			this->numberOfSamples = atof(argv[7]);
+		};
+		if( argc > 8 ) {	//  number of pyramids to use
+			this->numberOfPyramids = atoi( argv[8] );
+		};
+		if( argc > 9 ) {	//	minimum pixel value to use
+			this->intensityThreshold = atof( argv[9] );
+		};
+		if( argc > 10 ) {	//  similarity metric to use
+			this->similarity = static_cast<similarityType>(atoi( argv[10] ));
+		};
+		if( argc > 11 ) {	//	number of iterations
+			this->numberOfIter = atoi( argv[11] );
+		};
+		if( argc > 12 ) {	//	transformation type
+			this->transform = static_cast<transformType>(atoi( argv[12] ));
+		};
+		if( argc > 13 ) {	//	final transform output file
+			this->transformFile = argv[13];
+		};
+		if( argc > 14 ) {	//	pyramid cache directory
+			this->cacheDirectory = argv[14];
+		};
+		if( argc > 15 ) {	//	target number of voxels of the coarsest pyramid level
+			this->pyramidTargetVoxels = atof( argv[15] );
+		};
+		if( argc > 16 ) {	//	mask defining the registration region
+			this->roiFile = argv[16];
+		};
+		if( argc > 17 ) {	//	threshold defining the registration region
+			this->cropThreshold = atof( argv[17] );
+		};
+		if( argc > 18 ) {	//	padding of the registration region
+			this->cropPadding = atof( argv[18] );
+		};
+	};
+
+	this->ValidateOptions();
+
+};
+
+
+/*
+ *	RegOptsFilter()
+ *
+ *	Class constructor that reads the options of a job of a manifest that
+ *	was already parsed (see ReadConfigFile), e.g., by the batch loop of
+ *	itkReg
+ *
+ */
+RegOptsFilter::RegOptsFilter(const IniConfig &config, long job){
+
+	this->SetDefaults();
+	this->ReadConfigFile(config, job);
+	this->ValidateOptions();
+
+};
+
+
+/*
+ *	SetDefaults()
+ *
+ *	Defines the default registration options
+ *
+ */
+void RegOptsFilter::SetDefaults()
+{
 	this->stepSizeMax			= 5.0;
 	this->stepSizeMin			= 1.0e-5;
 	this->numberOfBins			= 128;
 	this->numberOfIter			= 500;
 	this->numberOfSamples		= 0;
 	this->numberOfPyramids		= 3;
+	this->pyramidTargetVoxels	= 0;
 	this->intensityThreshold	= 0;
 	this->learningRate			= 0.9;
 	this->dimensions			= 0;
+	this->cropThreshold			= 0;
+	this->cropPadding			= 10;
 	this->similarity			= NormalizedCrossCorrelation;
 	this->transform				= Euler;
 	this->interpolator			= Linear;
@@ -38,77 +132,59 @@ RegOptsFilter::RegOptsFilter(int argc, char *argv[]){
 	this->targetFile			= "";
 	this->movingFile			= "";
 	this->historyFile			= "";
-
-	/*	Handle the necessary inputs	*/
-	if( argc > 4) {
-		this->dimensions	= atoi( argv[1] );
-		this->targetFile	= argv[2];
-		this->movingFile	= argv[3];
-		this->historyFile	= argv[4];
-	};
+	this->transformFile			= "";
+	this->cacheDirectory		= "";
+	this->roiFile				= "";
+	this->job					= -1;
+};
 
 
-	/*	Currently, all options (image files, registration options, etc.)
-	 *	are passed directly to the registration executable via the 
-	 *	command prompt. In the future, an INI file will handle these
-	 *	options. For now they are parsed here,...	*/
-	if( argc > 5 ) {	//	maximum step size
-		this->stepSizeMax = atof( argv[5] );
-	};
+/*
+ *	ValidateOptions()
+ *
+ *	Replaces invalid options by their defaults, notifying the user
+ *
+ */
+void RegOptsFilter::ValidateOptions()
+{
 	std::cout << "Setting maximun step size to: " << this->stepSizeMax << std::endl;
-	if( argc > 6 ) {	//	minimum step size
-		this->stepSizeMin = atof( argv[6] );
-	};
 	std::cout << "Setting minimun step size to: " << this->stepSizeMin << std::endl;
-	if( argc > 7 ) {	//	number of spatial samples
-		this->numberOfSamples = atof(argv[7]);
-		if( (numberOfSamples>1) || (numberOfSamples<=0) ) {
-			std::cerr << "The number of spatial samples should be provided as" << std::endl
-					  << "a fraction (i.e., value between 0 and 1) of voxels" << std::endl
-					  << "to use in computing the image similarity" << std::endl;
-			this->numberOfSamples = 0.1;
-		};
+	if( (numberOfSamples>1) || (numberOfSamples<=0) ) {
+		std::cerr << "The number of spatial samples should be provided as" << std::endl
+				  << "a fraction (i.e., value between 0 and 1) of voxels" << std::endl
+				  << "to use in computing the image similarity" << std::endl;
+		this->numberOfSamples = 0.1;
 	};
 	std::cout << "Setting # of spatial samples to: " << numberOfSamples*100 << "%" << std::endl;
-	if( argc > 8 ) {	//  number of pyramids to use
-		this->numberOfPyramids = atoi( argv[8] );
+	if( (this->similarity<0) | (this->similarity>6) ) {
+		std::cerr << "Invalid similarity specifier: " << this->similarity << std::endl;
+		std::cerr << "0 - Mean squares" << std::endl;
+		std::cerr << "1 - Gradient difference" << std::endl;
+		std::cerr << "2 - Mutual information" << std::endl;
+		std::cerr << "3 - Normalized cross correlation" << std::endl;
+		std::cerr << "4 - Mattes mutual information" << std::endl;
+		std::cerr << "5 - Mutual information histogram" << std::endl;
+		std::cerr << "6 - Normalized mutual information histogram" << std::endl << std::endl;
+		std::cerr << "Setting the metric to normalized cross correlation" << std::endl;
+		this->similarity = NormalizedCrossCorrelation;
 	};
-	if( argc > 9 ) {	//	minimum pixel value to use
-		this->intensityThreshold = atof( argv[9] );
+	if( this->numberOfIter<1 ) {
+		std::cerr << "Invalid maximum number of iterations: " << this->numberOfIter << std::endl;
+		std::cerr << "# of iterations must be greater than 1" << std::endl << std::endl;
+		std::cerr << "Setting the # of iterations to the default: 500" << std::endl;
+		this->numberOfIter = 500;
 	};
-	if( argc > 10 ) {	//  similarity metric to use
-		this->similarity = static_cast<similarityType>(atoi( argv[10] ));
-		if( (this->similarity<0) | (this->similarity>6) ) {
-			std::cerr << "Invalid similarity specifier: " << this->similarity << std::endl;
-			std::cerr << "0 - Mean squares" << std::endl;
-			std::cerr << "1 - Gradient difference" << std::endl;
-			std::cerr << "2 - Mutual information" << std::endl;
-			std::cerr << "3 - Normalized cross correlation" << std::endl;
-			std::cerr << "4 - Mattes mutual information" << std::endl;
-			std::cerr << "5 - Mutual information histogram" << std::endl;
-			std::cerr << "6 - Normalized mutual information histogram" << std::endl << std::endl;
-			std::cerr << "Setting the metric to normalized cross correlation" << std::endl;
-			this->similarity = NormalizedCrossCorrelation;
-		};
+	if( (this->transform<0) | (this->transform>1) ) {
+		std::cerr << "Invalid transform specifier: " << this->transform << std::endl;
+		std::cerr << "0 - 3D Euler transformation"   << std::endl;
+		std::cerr << "1 - 3D affine transformation"  << std::endl <<std::endl;
+		std::cerr << "Setting the transformation to the default: Euler" << std::endl;
+		this->transform = Euler;
 	};
-	if( argc > 11 ) {	//	number of iterations
-		this->numberOfIter = atoi( argv[11] );
-		if( this->numberOfIter<1 ) {
-			std::cerr << "Invalid maximum number of iterations: " << this->numberOfIter << std::endl;
-			std::cerr << "# of iterations must be greater than 1" << std::endl << std::endl;
-			std::cerr << "Setting the # of iterations to the default: 500" << std::endl;
-			this->numberOfIter = 500;
-		};
-	};
-	if( argc > 12 ) {	//	transformation type
-		this->transform = static_cast<transformType>(atoi( argv[12] ));
-		if( (this->transform<0) | (this->transform>1) ) {
-			std::cerr << "Invalid transform specifier: " << this->transform << std::endl;
-			std::cerr << "0 - 3D Euler transformation"   << std::endl;
-			std::cerr << "1 - 3D affine transformation"  << std::endl <<std::endl;
-			std::cerr << "Setting the transformation to the default: Euler" << std::endl;
-			this->transform = Euler;
-		};
+	if( this->cropPadding<0 ) {
+		std::cerr << "Invalid crop padding: " << this->cropPadding << std::endl;
+		std::cerr << "Setting the crop padding to the default: 10 mm" << std::endl;
+		this->cropPadding = 10;
 	};
 
 };
@@ -117,28 +193,30 @@ RegOptsFilter::RegOptsFilter(int argc, char *argv[]){
 /*
  *	GetImagePointerFromFile()
  *
- *	Function for getting an ITK image pointer from an MHA file.
+ *	Function for getting an ITK image pointer from an MHA file. MetaImage
+ *	files are imported directly (memory-mapped when possible); other files
+ *	are read by the ITK reader, which already casts to TPixel.
  *
  */
 template <class TPixel, unsigned int VImageDimension>
 typename itk::Image<TPixel,VImageDimension>::Pointer RegOptsFilter::GetImagePointerFromFile(std::string FName)
 {
-	/*	Instantiate the image reader and apply the file name	*/
 	typedef itk::Image<TPixel,VImageDimension> TImage;
+	typename TImage::Pointer image = ImportMetaImage<TPixel,VImageDimension>(FName);
+	if( image ) {
+		return image;
+	};
+
+	/*	Instantiate the image reader and apply the file name	*/
 	typedef itk::ImageFileReader<TImage> TImageReader;
-	TImageReader::Pointer imageReader = TImageReader::New();
+	typename TImageReader::Pointer imageReader = TImageReader::New();
 	imageReader->SetFileName( FName );
 
-	/*	Instantitate an image caster and apply the output of 
-	 *	the image reader	*/
-	typedef itk::CastImageFilter<TImage,TImage> TCastFilter;
-	TCastFilter::Pointer imageCaster = TCastFilter::New();
-	imageCaster->SetInput( imageReader->GetOutput() );
-
-	/*	Update the image caster to fire the image read operation
-	 *	and send the output	*/
-	imageCaster->Update();
-	return imageCaster->GetOutput();
+	/*	Fire the image read operation and send the output	*/
+	imageReader->Update();
+	image = imageReader->GetOutput();
+	image->DisconnectPipeline();
+	return image;
 
 };
 
@@ -170,6 +248,190 @@ void RegOptsFilter::WriteImagePointerToFile(std::string FName,
 };
 
 
+/*
+ *	WriteTransformToFile()
+ *
+ *	Function for writing a transform to an ITK transform file. Batch
+ *	registrations (one job per frame) produce a single file with one
+ *	transform per frame: the first job replaces the file of a previous
+ *	run and the following jobs append their transform.
+ */
+template <class TTransform>
+void RegOptsFilter::WriteTransformToFile(std::string FName, TTransform* transform) {
+
+	itk::TransformFileWriter::Pointer writer = itk::TransformFileWriter::New();
+	writer->SetInput( transform );
+	writer->SetFileName( FName );
+	if( this->job>0 ) {
+		writer->SetAppendOn();
+	}
+	else {
+		writer->SetAppendOff();
+	};
+	try {
+		writer->Update();
+	}
+	catch( itk::ExceptionObject & err ) {
+		std::cerr << "Unable to write the transform file: " << FName << std::endl;
+		std::cerr << err << std::endl;
+	};
+
+};
+
+
+/*
+ *	ReadConfigFile()
+ *
+ *	Reads the registration options from an INI file. Keys use the names of
+ *	the regopts properties written by register_helper (e.g., "metric",
+ *	"nIterations", "imFixedFile") or of the class members (e.g.,
+ *	"numberOfIter", "targetFile"). Similarity metrics and transforms are
+ *	given by name or by number. The image dimensions default to NDims of
+ *	the target image
+ *
+ */
+bool RegOptsFilter::ReadConfigFile(const std::string &fName, long job)
+{
+	IniConfig config;
+	if( !config.Read(fName) ) {
+		if( config.GetParseError()<0 ) {
+			std::cerr << "Unable to open the configuration file: " << fName << std::endl;
+			return false;
+		};
+		std::cerr << "Error parsing line " << config.GetParseError() << " of " << fName << std::endl;
+	};
+	return this->ReadConfigFile(config, job);
+};
+
+
+/*
+ *	ReadConfigFile()
+ *
+ *	Reads the registration options of a job from a parsed INI file
+ *
+ */
+bool RegOptsFilter::ReadConfigFile(const IniConfig &config, long job)
+{
+
+	/*	Sections searched for the keys, last one first	*/
+	std::vector<size_t> sections;
+	if( config.FindSection("Properties")!=IniConfig::npos ) {
+		sections.push_back( config.FindSection("Properties") );
+	};
+	if( job>=0 ) {
+		const std::vector<size_t> jobs = config.FindSections("Job");
+		if( static_cast<size_t>(job)>=jobs.size() ) {
+			std::cerr << "Invalid job index " << job << " (" << jobs.size() << " [Job] sections)" << std::endl;
+			return false;
+		};
+		sections.push_back( jobs[job] );
+	};
+	this->job = job;
+
+	/*	Find the section defining a key (or its alias)	*/
+	auto find = [&](const char* key, const char* alias, std::string &name) -> size_t {
+		for(size_t idx=sections.size(); idx-->0; ) {
+			if( config.HasKey(sections[idx], key) ) {
+				name = key;
+				return sections[idx];
+			};
+			if( alias && config.HasKey(sections[idx], alias) ) {
+				name = alias;
+				return sections[idx];
+			};
+		};
+		return IniConfig::npos;
+	};
+	auto getReal = [&](const char* key, const char* alias, float value) -> float {
+		std::string name;
+		const size_t section = find(key, alias, name);
+		return (section==IniConfig::npos) ? value : static_cast<float>( config.GetReal(section, name, value) );
+	};
+	auto getString = [&](const char* key, const char* alias, const std::string &value) -> std::string {
+		std::string name;
+		const size_t section = find(key, alias, name);
+		return (section==IniConfig::npos) ? value : config.GetString(section, name, value);
+	};
+
+	/*	Files	*/
+	this->targetFile		= getString("imFixedFile",	"targetFile",		this->targetFile);
+	this->movingFile		= getString("imMovingFile",	"movingFile",		this->movingFile);
+	this->historyFile		= getString("iterHistFile",	"historyFile",		this->historyFile);
+	this->transformFile		= getString("transformFile",	0,				this->transformFile);
+	this->cacheDirectory	= getString("cacheDirectory",	0,				this->cacheDirectory);
+	this->roiFile			= getString("roiFile",			0,				this->roiFile);
+
+	/*	Numeric options	*/
+	this->dimensions			= getReal("dimensions",			"n",					this->dimensions);
+	this->stepSizeMax			= getReal("stepSizeMax",		0,						this->stepSizeMax);
+	this->stepSizeMin			= getReal("stepSizeMin",		0,						this->stepSizeMin);
+	this->numberOfSamples		= getReal("nSpatialSamples",	"numberOfSamples",		this->numberOfSamples);
+	this->numberOfPyramids		= getReal("multiLevel",			"numberOfPyramids",		this->numberOfPyramids);
+	this->intensityThreshold	= getReal("signalThresh",		"intensityThreshold",	this->intensityThreshold);
+	this->numberOfIter			= getReal("nIterations",		"numberOfIter",			this->numberOfIter);
+	this->numberOfBins			= getReal("numberOfBins",		0,						this->numberOfBins);
+	this->learningRate			= getReal("learningRate",		0,						this->learningRate);
+	this->pyramidTargetVoxels	= getReal("pyramidTargetVoxels",0,						this->pyramidTargetVoxels);
+	this->cropThreshold			= getReal("cropThreshold",		0,						this->cropThreshold);
+	this->cropPadding			= getReal("cropPadding",		0,						this->cropPadding);
+
+	/*	Named options	*/
+	const char* metricNames[] = {"MeanSquares", "GradientDifference", "MutualInformation",
+								 "NormalizedCrossCorrelation", "MattesMutualInformation",
+								 "MutualInformationHistogram", "NormalizedMutualInformationHistogram"};
+	const std::string metric = getString("metric", "similarity", "");
+	if( !metric.empty() ) {
+		this->similarity = static_cast<similarityType>( atoi( metric.c_str() ) );
+		for(int idx=0; idx<7; idx++) {
+			if( IniStringView(metric.data(), metric.size()).IsEqualNoCase(metricNames[idx], strlen(metricNames[idx])) ) {
+				this->similarity = static_cast<similarityType>(idx);
+			};
+		};
+	};
+	const std::string trafo = getString("transformation", "transform", "");
+	if( !trafo.empty() ) {
+		const IniStringView name(trafo.data(), trafo.size());
+		if( name.IsEqualNoCase("Euler", 5) || name.IsEqualNoCase("rigid", 5) ) {
+			this->transform = Euler;
+		}
+		else if( name.IsEqualNoCase("Affine", 6) ) {
+			this->transform = Affine;
+		}
+		else {
+			this->transform = static_cast<transformType>( atoi( trafo.c_str() ) );
+		};
+	};
+
+	/*	Image dimensions from the target image header	*/
+	if( (this->dimensions==0) && !this->targetFile.empty() ) {
+		this->dimensions = GetImageDimensions(this->targetFile);
+	};
+
+	return true;
+};
+
+
+/*
+ *	GetImageDimensions()
+ *
+ *	Reads the number of dimensions of a MetaImage file (0 if the header
+ *	cannot be read). The frames of a batch share the target image, so the
+ *	header of the last file is remembered
+ *
+ */
+float RegOptsFilter::GetImageDimensions(const std::string &fName)
+{
+	static std::string	lastFile;
+	static float		lastDimensions = 0;
+	if( fName!=lastFile ) {
+		MetaImage image;
+		lastDimensions	= image.Read(fName) ? static_cast<float>( image.GetHeader().dimSize.size() ) : 0;
+		lastFile		= fName;
+	};
+	return lastDimensions;
+};
+
+
 /*
  *	isReady()
  *
@@ -182,12 +444,15 @@ bool RegOptsFilter::isReady(int nArgs)
 	 *	the target image file, moving image file and output iteration 
 	 *	history file. Any fewer and the user should be notified of 
 	 *	the appropriate syntax and the program should exit.	*/
-	if( nArgs < 4 ) { /*check for minimum # of inputs*/
+	if( (nArgs < 2) || targetFile.empty() || movingFile.empty() || historyFile.empty() ) {
 		std::cerr << "Missing Parameters " << std::endl;
-		std::cerr << "Usage: itkReg";
+		std::cerr << "Usage: itkReg CONFIGFILE [JOB]" << std::endl;
+		std::cerr << "       itkReg";
 		std::cerr << " DIMENSIONS   TARGETFILE   MOVINGFILE   ITERATIONFILE";
 		std::cerr << "[OUTPUTIMAGE] [STEPSIZEMAX] [STEPSIZEMIN] ";
-		std::cerr << "[PIXELTHRESH] [METRIC] [#ITERATIONS]" << std::endl;
+		std::cerr << "[PIXELTHRESH] [METRIC] [#ITERATIONS] [TRANSFORM] ";
+		std::cerr << "[TRANSFORMFILE] [CACHEDIR] [PYRAMIDVOXELS] ";
+		std::cerr << "[ROIFILE] [CROPTHRESH] [CROPPAD]" << std::endl;
 		return false;
 	};
 
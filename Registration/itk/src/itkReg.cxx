@@ -28,6 +28,25 @@
  *				between the target and moving images.
  *
  *		ITER: maximum number of optimizer iterations
+ *
+ *		TRANSFORMFILE: full file name to an ITK transform file
+ *				to which the final transform is appended
+ *
+ *		CACHEDIR: directory of the on-disk cache of pyramid levels
+ *				and normalized images (no on-disk caching if omitted)
+ *
+ *		PYRAMIDVOXELS: target number of voxels of the coarsest
+ *				pyramid level (default: 64^DIMENSIONS)
+ *
+ *		ROIFILE: full file name to an MHA mask. Registration is
+ *				restricted to the mask's bounding box
+ *
+ *		CROPTHRESH: when no ROI is given and CROPTHRESH>0, the
+ *				registration is restricted to the bounding box of
+ *				target voxels exceeding CROPTHRESH
+ *
+ *		CROPPAD: padding (mm) added to the bounding box. The moving
+ *				image is padded twice as much (default: 10)
  */
 
 
@@ -55,6 +74,9 @@
 #include "InterpolatorSpecializations.h"
 #include "OptimizerSpecializations.h"
 #include "SimilaritySpecializations.h"
+#include "PyramidCache.h"
+#include "PyramidScheduleGenerator.h"
+#include "CropRegion.h"
 
 //  Command observer for monitoring registration evolution
 #include "itkCommand.h"
@@ -127,7 +149,6 @@ protected:
   RegistrationInterfaceCommand() {};
 
 public:
-  typedef   TRegistration								TRegistration;
   typedef   TRegistration *								RegistrationPointer;
   typedef   itk::RegularStepGradientDescentOptimizer	TOptimizer;
   typedef   TOptimizer *								OptimizerPointer;
@@ -149,12 +170,18 @@ public:
 	OptimizerScalesType optimizerScales = optimizer->GetScales();
 
 	// Create the image size
-    typedef itk::Image<double,3>	ImageType;
-	const unsigned int numPixels = registration->GetFixedImageRegion().GetNumberOfPixels();
-
-	// Get the scales
-	typedef itk::MultiResolutionPyramidImageFilter<ImageType,ImageType>   ImagePyramidType;
-    ImagePyramidType::ScheduleType  pyramidSchedule = registration->GetMovingImagePyramidSchedule();
+	typedef typename TRegistration::FixedImageType	ImageType;
+	const unsigned int	dims	  = ImageType::ImageDimension;
+	const unsigned int	numPixels = registration->GetFixedImageRegion().GetNumberOfPixels();
+
+	// Get the scales. The schedule has one column per image dimension
+	typedef typename TRegistration::ScheduleType	ScheduleType;
+	ScheduleType		pyramidSchedule = registration->GetMovingImagePyramidSchedule();
+	const unsigned int	lvl				= registration->GetCurrentLevel();
+	unsigned int		shrinkFactor	= 1;
+	for(unsigned int dim=0; dim<dims; dim++) {
+		shrinkFactor *= pyramidSchedule[lvl][dim];
+	};
 
 	// Open file for writing
 	std::ofstream outFile;
@@ -165,12 +192,11 @@ public:
 	if( (registration->GetMetric()->GetNameOfClass()=="MattesMutualInformationImageToImageMetric") |
 		(registration->GetMetric()->GetNameOfClass()=="MutualInformationImageToImageMetric") )
 	{
-		const unsigned int	lvl      = registration->GetCurrentLevel();
-		const unsigned int	nSamples = pixelPct * numPixels / (pyramidSchedule[lvl][0] * pyramidSchedule[lvl][1]);
+		const unsigned int	nSamples = pixelPct * numPixels / shrinkFactor;
 		registration->GetMetric()->SetNumberOfSpatialSamples( nSamples );
 		outFile << "Number of spatial samples: "
 				<< registration->GetMetric()->GetNumberOfSpatialSamples()
-				<< " of " << numPixels / (pyramidSchedule[lvl][0] * pyramidSchedule[lvl][1])
+				<< " of " << numPixels / shrinkFactor
 				<< std::endl;
 
 		//	Reduce the number of spatial samples
@@ -185,9 +211,11 @@ public:
 		outFile << "Minimum Step Length: "
 				<< optimizer->GetMinimumStepLength() << std::endl;
 		outFile << "-------------------------------------" << std::endl;
-		outFile << "Pyramid Schedule: [" << pyramidSchedule[registration->GetCurrentLevel()][0] 
-				<< " " << pyramidSchedule[registration->GetCurrentLevel()][1]
-				<< " " << pyramidSchedule[registration->GetCurrentLevel()][2] << "]" << std::endl;
+		outFile << "Pyramid Schedule: [";
+		for(unsigned int dim=0; dim<dims; dim++) {
+			outFile << pyramidSchedule[lvl][dim] << ((dim<dims-1) ? " " : "]");
+		};
+		outFile << std::endl;
 		outFile << "MultiResolution Level: "
 				<< registration->GetCurrentLevel()  << std::endl << std::endl;
 		outFile.close();
@@ -296,7 +324,7 @@ class RegWrapper<TPixel,2,Euler>{
 	typedef itk::Euler2DTransform<double>								TTransform;
 	typedef itk::RegularStepGradientDescentOptimizer					TOptimizer;
 	typedef itk::MultiResolutionImageRegistrationMethod<TImage,TImage>	TRegistration;
-	typedef itk::MultiResolutionPyramidImageFilter<TImage,TImage>		TImagePyramid;
+	typedef CachedPyramidImageFilter<TImage>							TImagePyramid;
 
  public:
 
@@ -321,13 +349,19 @@ class RegWrapper<TPixel,2,Euler>{
 		 registration->SetFixedImagePyramid(  fixedImagePyramid );
 		 registration->SetMovingImagePyramid( movingImagePyramid );
 
+		 /*	Pre-processed images are cached by content (see PyramidCache.h)	*/
+		 PyramidCache<TImage>::GetInstance().SetDirectory(opts.cacheDirectory);
+
 
 		 /*==============*
 		  *	Image setup
 		  *==============*/
 
-		 TImage::Pointer fixedImage = opts.GetImagePointerFromFile<TPixel,2>(opts.targetFile);
-		 TImage::Pointer movingImage = opts.GetImagePointerFromFile<TPixel,2>(opts.movingFile);
+		 /*	Read the images, cropping to the region of interest if requested	*/
+		 typename TImage::Pointer fixedImage, movingImage;
+		 if( !ReadRegistrationImages<TPixel,2>(opts, fixedImage, movingImage) ) {
+			 return;
+		 };
 
 		 if( opts.similarity!=MutualInformation ) {
 			 registration->SetFixedImage(fixedImage);
@@ -335,18 +369,9 @@ class RegWrapper<TPixel,2,Euler>{
 		 }
 		 else {	//	Special case for Viola mutual information
 
-			 /*	Create a normalizing filter	*/
-			 typedef itk::NormalizeImageFilter<TImage,TImage> TNormalizeFilter;
-			 TNormalizeFilter::Pointer	fixedNormalizer		= TNormalizeFilter::New();
-			 TNormalizeFilter::Pointer	movingNormalizer	= TNormalizeFilter::New();
-			 fixedNormalizer->SetInput(fixedImage);
-			 movingNormalizer->SetInput(movingImage);
-			 
-			 /*	Set fixed/moving images	*/
-			 registration->SetFixedImage( fixedNormalizer->GetOutput() );
-			 registration->SetMovingImage( movingNormalizer->GetOutput() );
-			 fixedNormalizer->Update();
-			 movingNormalizer->Update();
+			 /*	Normalize the images (cached between runs on the same pair)	*/
+			 registration->SetFixedImage( GetNormalizedImage<TImage>(fixedImage) );
+			 registration->SetMovingImage( GetNormalizedImage<TImage>(movingImage) );
 		 };
 		 registration->SetFixedImageRegion(fixedImage->GetLargestPossibleRegion());
 
@@ -391,17 +416,21 @@ class RegWrapper<TPixel,2,Euler>{
 		  *	Registration initialization
 		  *=============================*/
 
-		 // Set up the pyramid schedule
-		 typedef TImage::SizeType	TSize;
-		 const TSize				fixedSize = fixedImage->GetLargestPossibleRegion().GetSize();
-		 TImagePyramid::Pointer		fauxImagePyramid = TImagePyramid::New();
-		 fauxImagePyramid->SetNumberOfLevels(opts.numberOfPyramids);
-		 TImagePyramid::ScheduleType  pyramidSchedule = fauxImagePyramid->GetSchedule();
-		 if( (fixedSize[0]/pyramidSchedule[0][1] < 64) & (opts.numberOfPyramids > 1) )
-		 {
-			 opts.numberOfPyramids = opts.numberOfPyramids-1;
-			 fauxImagePyramid->SetNumberOfLevels(opts.numberOfPyramids);
-			 pyramidSchedule = fauxImagePyramid->GetSchedule();
+		 // Set up the pyramid schedule from the physical voxel size. The
+		 // number of pyramids is the maximum number of levels
+		 PyramidScheduleGenerator<2>	scheduler;
+		 scheduler.SetSize( fixedImage->GetLargestPossibleRegion().GetSize() );
+		 scheduler.SetSpacing( fixedImage->GetSpacing() );
+		 scheduler.SetMaximumNumberOfLevels( opts.numberOfPyramids );
+		 scheduler.SetTargetNumberOfVoxels( opts.pyramidTargetVoxels );
+		 typename TImagePyramid::ScheduleType  pyramidSchedule = scheduler.Generate();
+		 opts.numberOfPyramids = pyramidSchedule.rows();
+		 for(unsigned int i=0; i<pyramidSchedule.rows(); i++) {
+			 opts.historyOut << "Pyramid level " << i << " smoothing sigma (mm): [";
+			 for(unsigned int dim=0; dim<2; dim++) {
+				 opts.historyOut << scheduler.GetSigma(dim,pyramidSchedule[i][dim]) << ((dim<1) ? " " : "]");
+			 };
+			 opts.historyOut << std::endl;
 		 };
 		 registration->SetSchedules(pyramidSchedule,pyramidSchedule);
 		 
@@ -447,6 +476,11 @@ class RegWrapper<TPixel,2,Euler>{
 		 std::cout << "Offset = " << std::endl << offset << std::endl;
 		 std::cout << "Final matrix = " << std::endl << finalMatrix << std::endl;
 
+		 /*	Store the final transform for ROI propagation	*/
+		 if( !opts.transformFile.empty() ) {
+			 opts.WriteTransformToFile<TTransform>(opts.transformFile, transform);
+		 };
+
 	 };
 };
 
@@ -460,7 +494,7 @@ class RegWrapper<TPixel,3,Euler>{
 	typedef itk::Euler3DTransform<double>								TTransform;
 	typedef itk::RegularStepGradientDescentOptimizer					TOptimizer;
 	typedef itk::MultiResolutionImageRegistrationMethod<TImage,TImage>	TRegistration;
-	typedef itk::MultiResolutionPyramidImageFilter<TImage,TImage>		TImagePyramid;
+	typedef CachedPyramidImageFilter<TImage>							TImagePyramid;
 
 
  public:
@@ -486,13 +520,19 @@ class RegWrapper<TPixel,3,Euler>{
 		 registration->SetFixedImagePyramid(  fixedImagePyramid );
 		 registration->SetMovingImagePyramid( movingImagePyramid );
 
+		 /*	Pre-processed images are cached by content (see PyramidCache.h)	*/
+		 PyramidCache<TImage>::GetInstance().SetDirectory(opts.cacheDirectory);
+
 
 		 /*==============*
 		  *	Image setup
 		  *==============*/
 
-		 TImage::Pointer fixedImage = opts.GetImagePointerFromFile<TPixel,3>(opts.targetFile);
-		 TImage::Pointer movingImage = opts.GetImagePointerFromFile<TPixel,3>(opts.movingFile);
+		 /*	Read the images, cropping to the region of interest if requested	*/
+		 typename TImage::Pointer fixedImage, movingImage;
+		 if( !ReadRegistrationImages<TPixel,3>(opts, fixedImage, movingImage) ) {
+			 return;
+		 };
 
 		 if( opts.similarity!=MutualInformation ) {
 			 registration->SetFixedImage(fixedImage);
@@ -500,18 +540,9 @@ class RegWrapper<TPixel,3,Euler>{
 		 }
 		 else {	//	Special case for Viola mutual information
 
-			 /*	Create a normalizing filter	*/
-			 typedef itk::NormalizeImageFilter<TImage,TImage> TNormalizeFilter;
-			 TNormalizeFilter::Pointer	fixedNormalizer		= TNormalizeFilter::New();
-			 TNormalizeFilter::Pointer	movingNormalizer	= TNormalizeFilter::New();
-			 fixedNormalizer->SetInput(fixedImage);
-			 movingNormalizer->SetInput(movingImage);
-			 
-			 /*	Set fixed/moving images	*/
-			 registration->SetFixedImage( fixedNormalizer->GetOutput() );
-			 registration->SetMovingImage( movingNormalizer->GetOutput() );
-			 fixedNormalizer->Update();
-			 movingNormalizer->Update();
+			 /*	Normalize the images (cached between runs on the same pair)	*/
+			 registration->SetFixedImage( GetNormalizedImage<TImage>(fixedImage) );
+			 registration->SetMovingImage( GetNormalizedImage<TImage>(movingImage) );
 		 };
 		 registration->SetFixedImageRegion(fixedImage->GetLargestPossibleRegion());
 
@@ -556,21 +587,21 @@ class RegWrapper<TPixel,3,Euler>{
 		  *	Registration initialization
 		  *=============================*/
 
-		 // Set up the pyramid schedule
-		 typedef TImage::SizeType	TSize;
-		 const TSize				fixedSize = fixedImage->GetLargestPossibleRegion().GetSize();
-		 TImagePyramid::Pointer		fauxImagePyramid = TImagePyramid::New();
-		 fauxImagePyramid->SetNumberOfLevels(opts.numberOfPyramids);
-		 TImagePyramid::ScheduleType  pyramidSchedule = fauxImagePyramid->GetSchedule();
-		 if( (fixedSize[0]/pyramidSchedule[0][1] < 64) & (opts.numberOfPyramids > 1) )
-		 {
-			 opts.numberOfPyramids = opts.numberOfPyramids-1;
-			 fauxImagePyramid->SetNumberOfLevels(opts.numberOfPyramids);
-			 pyramidSchedule = fauxImagePyramid->GetSchedule();
-		 };
-		 for(unsigned int i=0; i<opts.numberOfPyramids; i++ )
-		 {
-			 pyramidSchedule[i][2] = 1; // don't undersample in the z direction
+		 // Set up the pyramid schedule from the physical voxel size. The
+		 // number of pyramids is the maximum number of levels
+		 PyramidScheduleGenerator<3>	scheduler;
+		 scheduler.SetSize( fixedImage->GetLargestPossibleRegion().GetSize() );
+		 scheduler.SetSpacing( fixedImage->GetSpacing() );
+		 scheduler.SetMaximumNumberOfLevels( opts.numberOfPyramids );
+		 scheduler.SetTargetNumberOfVoxels( opts.pyramidTargetVoxels );
+		 typename TImagePyramid::ScheduleType  pyramidSchedule = scheduler.Generate();
+		 opts.numberOfPyramids = pyramidSchedule.rows();
+		 for(unsigned int i=0; i<pyramidSchedule.rows(); i++) {
+			 opts.historyOut << "Pyramid level " << i << " smoothing sigma (mm): [";
+			 for(unsigned int dim=0; dim<3; dim++) {
+				 opts.historyOut << scheduler.GetSigma(dim,pyramidSchedule[i][dim]) << ((dim<2) ? " " : "]");
+			 };
+			 opts.historyOut << std::endl;
 		 };
 		 registration->SetSchedules(pyramidSchedule,pyramidSchedule);
 
@@ -616,23 +647,30 @@ class RegWrapper<TPixel,3,Euler>{
 		 std::cout << "Offset = " << std::endl << offset << std::endl;
 		 std::cout << "Final matrix = " << std::endl << finalMatrix << std::endl;
 
+		 /*	Store the final transform for ROI propagation	*/
+		 if( !opts.transformFile.empty() ) {
+			 opts.WriteTransformToFile<TTransform>(opts.transformFile, transform);
+		 };
+
 	 };	/*	RegWrapper<> RegWrapper()	*/
 
 }; /*	RegWrapper<TPixel,3,Euler>	*/
 
 
-int main( int argc, char *argv[] ){
-
-	/*	Before performing any computations, the registration options
-	 *	should be generated. The MatlabRegHeader class member "isReady"
-	 *	is then called to ensure that certain necessary other members
-	 *	have been appropriately imported. Appropriate error messages
-	 *	are printed to the command prompt, but the caller is ultimately
-	 *	responsible for terminating execution	*/
-
-	/*	Create the options object	*/
-	RegOptsFilter	opts(argc, argv);
-	if (!opts.isReady(argc)) {
+/*
+ *	RunRegistration()
+ *
+ *	Validates the options and performs the registration they describe
+ *
+ */
+static int RunRegistration(RegOptsFilter &opts, int nArgs){
+
+	/*	The RegOptsFilter member "isReady" is called to ensure that
+	 *	certain necessary other members have been appropriately
+	 *	imported. Appropriate error messages are printed to the command
+	 *	prompt, but the caller is ultimately responsible for terminating
+	 *	execution	*/
+	if (!opts.isReady(nArgs)) {
 		return	EXIT_FAILURE;
 	};
 
@@ -655,6 +693,36 @@ int main( int argc, char *argv[] ){
 	};
 
 	return EXIT_SUCCESS;
+};
+
+
+int main( int argc, char *argv[] ){
+
+	/*	Manifests with [Job] sections (see register_helper) describe a
+	 *	batch of registrations (e.g., one per frame). Unless a single job
+	 *	is requested, all jobs are registered in turn from the manifest
+	 *	parsed here	*/
+	if( argc==2 ) {
+		IniConfig manifest;
+		manifest.Read(argv[1]);
+		const long nJobs = static_cast<long>( manifest.FindSections("Job").size() );
+		if( nJobs>0 ) {
+			int status = EXIT_SUCCESS;
+			for(long job=0; job<nJobs; job++) {
+				std::cout << "Registering job " << job+1 << " of " << nJobs << std::endl;
+				RegOptsFilter opts(manifest, job);
+				if( RunRegistration(opts, argc)!=EXIT_SUCCESS ) {
+					status = EXIT_FAILURE;
+				};
+			};
+			return status;
+		};
+	};
+
+	/*	Create the options object	*/
+	RegOptsFilter	opts(argc, argv);
+	return RunRegistration(opts, argc);
+
 
 //	/*	Determine the number of voxels in the moving image	*/
 //	unsigned int numberOfVoxels = mImage->GetLargestPossibleRegion().GetNumberOfPixels();
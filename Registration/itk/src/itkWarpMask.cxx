@@ -0,0 +1,115 @@
+/*
+ *	itkWarpMask.cxx
+ *
+ *	Propagates an ROI mask through the final transforms of a registration
+ *	(e.g., a motion corrected DCE series) without resampling the images.
+ *
+ *
+ *	Inputs:
+ *	=======
+ *
+ *		DIMENSIONS: number of image dimensions (2 or 3)
+ *
+ *		MASK: full file name to an MHA label/mask image defined
+ *				on the reference (target) image grid
+ *
+ *		TRANSFORMS: full file name to an ITK transform file
+ *				containing the final transform of each frame
+ *				(written by itkReg in append mode)
+ *
+ *		OUTPUT: output file prefix. Label images are written to
+ *				OUTPUT_####.mha and sparse index lists are written
+ *				to OUTPUT_indices.txt
+ *
+ *		RESAMPLE: 0 - nearest neighbour (default), 1 - partial volume
+ *
+ *		FORMAT: 0 - label images (default), 1 - sparse index lists
+ *
+ *		THRESH: minimum partial volume fraction written to sparse
+ *				index lists (default: 0)
+ */
+
+
+#ifndef ITKWARPMASK_CXX
+#define ITKWARPMASK_CXX
+
+
+/*	C++ headers	*/
+#include <cstdlib>
+#include <iostream>
+
+/*	QUATTRO headers	*/
+#include "MaskPropagationSpecializations.h"
+
+
+int main( int argc, char *argv[] ){
+
+	/*	Validate the inputs	*/
+	if( argc < 5 ) {
+		std::cerr << "Missing Parameters " << std::endl;
+		std::cerr << "Usage: itkWarpMask";
+		std::cerr << " DIMENSIONS   MASKFILE   TRANSFORMFILE   OUTPUTPREFIX ";
+		std::cerr << "[RESAMPLE] [FORMAT] [THRESH]" << std::endl;
+		return EXIT_FAILURE;
+	};
+
+	/*	Create the options	*/
+	MaskPropagationOpts opts;
+	opts.dimensions		= atoi( argv[1] );
+	opts.maskFile		= argv[2];
+	opts.transformFile	= argv[3];
+	opts.outputPrefix	= argv[4];
+	opts.resample		= NearestNeighbour;
+	opts.output			= LabelImage;
+	opts.threshold		= 0;
+	if( argc > 5 ) {	//	resampling scheme
+		opts.resample = static_cast<maskResampleType>(atoi( argv[5] ));
+		if( (opts.resample<0) | (opts.resample>1) ) {
+			std::cerr << "Invalid resampling specifier: " << opts.resample << std::endl;
+			std::cerr << "0 - Nearest neighbour" << std::endl;
+			std::cerr << "1 - Partial volume"    << std::endl << std::endl;
+			std::cerr << "Setting the resampling to the default: nearest neighbour" << std::endl;
+			opts.resample = NearestNeighbour;
+		};
+	};
+	if( argc > 6 ) {	//	output format
+		opts.output = static_cast<maskOutputType>(atoi( argv[6] ));
+		if( (opts.output<0) | (opts.output>1) ) {
+			std::cerr << "Invalid output specifier: " << opts.output << std::endl;
+			std::cerr << "0 - Label images"       << std::endl;
+			std::cerr << "1 - Sparse index lists" << std::endl << std::endl;
+			std::cerr << "Setting the output to the default: label images" << std::endl;
+			opts.output = LabelImage;
+		};
+	};
+	if( argc > 7 ) {	//	partial volume threshold
+		opts.threshold = atof( argv[7] );
+	};
+
+	/*	Specialize the propagation task	*/
+	bool isSuccess = false;
+	if( (opts.dimensions==2) && (opts.resample==NearestNeighbour) ) {
+		MaskPropagationWrapper<2,NearestNeighbour> wrapper(opts);
+		isSuccess = wrapper.isSuccess;
+	}
+	else if( (opts.dimensions==2) && (opts.resample==PartialVolume) ) {
+		MaskPropagationWrapper<2,PartialVolume> wrapper(opts);
+		isSuccess = wrapper.isSuccess;
+	}
+	else if( (opts.dimensions==3) && (opts.resample==NearestNeighbour) ) {
+		MaskPropagationWrapper<3,NearestNeighbour> wrapper(opts);
+		isSuccess = wrapper.isSuccess;
+	}
+	else if( (opts.dimensions==3) && (opts.resample==PartialVolume) ) {
+		MaskPropagationWrapper<3,PartialVolume> wrapper(opts);
+		isSuccess = wrapper.isSuccess;
+	}
+	else {
+		std::cerr << "Invalid or missing image dimensions input" << std::endl;
+	};
+
+	return (isSuccess) ? EXIT_SUCCESS : EXIT_FAILURE;
+};
+
+
+#endif
@@ -0,0 +1,595 @@
+/*
+ *	RegMetrics.h
+ *
+ *	Native implementation of the image similarity measures found in
+ *	Registration/metrics (ssd.m, msd.m, ncc.m, mi.m, nmi.m and smi.m).
+ *	All requested measures are computed together for an image pair or
+ *	for every frame of a series against a common reference.
+ *
+ *	The MATLAB "ignore" semantics are preserved: voxel pairs in which
+ *	either value is negative or NaN are excluded (smi.m does not mask
+ *	and neither does the spatial MI here). When no usable, non-zero
+ *	voxels remain, the measure is Inf, as in the MATLAB code.
+ *
+ *	Instead of deleting the ignored voxels and rescaling whole copies of
+ *	the images, the moments (SSD, MSD, NCC and the intensity maxima) are
+ *	accumulated in one read of each frame. MI/NMI need the maxima of the
+ *	usable voxels to bin the intensities, so the joint histograms are
+ *	filled in a second read of the same frame (while it is still hot in
+ *	the cache when frames are processed one per thread).
+ */
+
+
+#ifndef REGMETRICS_H
+#define REGMETRICS_H
+
+
+/*	C++ headers	*/
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+
+/*	QUATTRO headers	*/
+#include "ParallelFor.h"
+
+
+
+//	Define common types
+enum regMetricFlag{		//	Metric selection flags (bitwise OR)
+	MetricSSD	= 1,	//	sum of squared differences (ssd.m)
+	MetricMSD	= 2,	//	mean sum of squared differences (msd.m)
+	MetricNCC	= 4,	//	normalized cross correlation (ncc.m)
+	MetricMI	= 8,	//	mutual information (mi.m)
+	MetricNMI	= 16,	//	normalized mutual information (nmi.m)
+	MetricSMI	= 32,	//	spatial mutual information (smi.m)
+	MetricAll	= 63
+};
+
+/*	Names of the metrics as used by the MATLAB functions. The order
+ *	matches the bit order of regMetricFlag	*/
+static const char* regMetricNames[] = {"ssd", "msd", "ncc", "mi", "nmi", "smi"};
+static const unsigned int regMetricCount = 6;
+
+
+/*
+ *	RegMetricValues
+ *
+ *	Similarity measures of a single image pair
+ */
+struct RegMetricValues{
+	double	value[6];	/*	indexed in the order of regMetricNames	*/
+};
+
+
+/*
+ *	RegMetricMoments
+ *
+ *	Partial sums over the usable voxels of an image pair
+ */
+struct RegMetricMoments{
+
+	double	n;		/*	number of usable voxels	*/
+	double	ssd;	/*	sum of (a-b)^2	*/
+	double	ab;		/*	sum of a*b	*/
+	double	aa;		/*	sum of a^2	*/
+	double	bb;		/*	sum of b^2	*/
+	double	maxA;	/*	maximum of a	*/
+	double	maxB;	/*	maximum of b	*/
+
+	RegMetricMoments() : n(0), ssd(0), ab(0), aa(0), bb(0), maxA(0), maxB(0) {};
+
+	void Merge(const RegMetricMoments &other)
+	{
+		n	+= other.n;
+		ssd	+= other.ssd;
+		ab	+= other.ab;
+		aa	+= other.aa;
+		bb	+= other.bb;
+		maxA = (other.maxA>maxA) ? other.maxA : maxA;
+		maxB = (other.maxB>maxB) ? other.maxB : maxB;
+	};
+};
+
+
+/*	Size of the spatial MI neighbourhood vector (2*(2*r+1)^2, r=1)	*/
+static const unsigned int smiDim = 18;
+
+
+/*
+ *	RegMetricWorkspace
+ *
+ *	Thread local accumulation buffers
+ */
+struct RegMetricWorkspace{
+
+	RegMetricMoments		moments;
+	std::vector<unsigned int> miHist;		/*	(nBins+1)^2 joint histogram (mi.m)	*/
+	std::vector<unsigned int> nmiHist;	/*	(nBins+1)^2 joint histogram (nmi.m)	*/
+	double					smiSum[smiDim];
+	double					smiOuter[smiDim*smiDim];
+	double					smiCount;
+
+	void Reset()
+	{
+		moments = RegMetricMoments();
+		std::fill(miHist.begin(), miHist.end(), 0u);
+		std::fill(nmiHist.begin(), nmiHist.end(), 0u);
+		std::memset(smiSum, 0, sizeof(smiSum));
+		std::memset(smiOuter, 0, sizeof(smiOuter));
+		smiCount = 0;
+	};
+};
+
+
+/*
+ *	RegMetricEngine
+ *
+ *	Computes the requested similarity measures for one or more frames
+ *	against the reference image. Frames are stored contiguously, each
+ *	frame having the same number of voxels (and ordering) as the reference.
+ */
+template <class TPixel>
+class RegMetricEngine{
+
+ public:
+
+	/*
+	 *	RegMetricEngine()
+	 *
+	 *	Class constructor. The reference data must remain valid for the
+	 *	lifetime of the engine. "dims" are the (MATLAB) image dimensions
+	 *	and are only used by the spatial MI
+	 */
+	RegMetricEngine(const TPixel* reference, const std::vector<size_t> &dims) :
+		reference(reference),
+		dims(dims),
+		metrics(MetricAll),
+		miBins(256),	/*	mi.m default	*/
+		nmiBins(255),	/*	nmi.m default	*/
+		nThreads(0)
+	{
+		nVoxels = 1;
+		for(size_t idx=0; idx<dims.size(); idx++) {
+			nVoxels *= dims[idx];
+		};
+	};
+
+	void SetMetrics(unsigned int flags)				{ metrics  = flags & MetricAll; };
+	void SetNumberOfThreads(unsigned int n)			{ nThreads = n; };
+	void SetNumberOfBins(unsigned int mi, unsigned int nmi)
+	{
+		miBins	= (mi>0)  ? mi  : 1;
+		nmiBins	= (nmi>0) ? nmi : 1;
+	};
+
+	/*
+	 *	Evaluate()
+	 *
+	 *	Computes the similarity measures of nFrames frames. When there are
+	 *	at least as many frames as threads, each thread processes whole
+	 *	frames. Otherwise, each frame is split into voxel blocks that are
+	 *	reduced after all threads have finished.
+	 */
+	void Evaluate(const TPixel* frames, size_t nFrames, RegMetricValues* values)
+	{
+		const unsigned int nWorkers = (nThreads>0) ? nThreads : GetNumberOfWorkerThreads();
+
+		if( nFrames>=nWorkers ) {
+			std::vector<RegMetricWorkspace> workspaces( GetNumberOfParallelSlots(nFrames,1,nWorkers) );
+			for(size_t idx=0; idx<workspaces.size(); idx++) {
+				AllocateWorkspace(workspaces[idx]);
+			};
+			ParallelFor(nFrames, 1, [&](size_t begin, size_t end, unsigned int threadId) {
+				for(size_t frame=begin; frame<end; frame++) {
+					EvaluateFrameSerial(frames+frame*nVoxels, workspaces[threadId], values[frame]);
+				};
+			}, nWorkers);
+		}
+		else {
+			for(size_t frame=0; frame<nFrames; frame++) {
+				EvaluateFrameParallel(frames+frame*nVoxels, values[frame], nWorkers);
+			};
+		};
+	};
+
+
+ private:
+
+	const TPixel*			reference;
+	std::vector<size_t>		dims;
+	size_t					nVoxels;
+	unsigned int			metrics;
+	unsigned int			miBins;
+	unsigned int			nmiBins;
+	unsigned int			nThreads;
+
+	/*	Number of voxels per block when splitting a single frame	*/
+	static const size_t blockSize = 65536;
+
+
+	/*
+	 *	IsIgnored()
+	 *
+	 *	Voxel pairs with negative or NaN values are excluded
+	 */
+	static inline bool IsIgnored(double a, double b)
+	{
+		return (a<0) || (b<0) || (a!=a) || (b!=b);
+	};
+
+	void AllocateWorkspace(RegMetricWorkspace &ws) const
+	{
+		if( metrics & MetricMI ) {
+			ws.miHist.resize( (miBins+1)*(miBins+1) );
+		};
+		if( metrics & MetricNMI ) {
+			ws.nmiHist.resize( (nmiBins+1)*(nmiBins+1) );
+		};
+		ws.Reset();
+	};
+
+	/*
+	 *	AccumulateMoments()
+	 *
+	 *	First read of a frame: sums and maxima of the usable voxels
+	 */
+	void AccumulateMoments(const TPixel* frame, size_t begin, size_t end, RegMetricMoments &m) const
+	{
+		for(size_t idx=begin; idx<end; idx++) {
+			const double a = static_cast<double>(reference[idx]);
+			const double b = static_cast<double>(frame[idx]);
+			if( IsIgnored(a,b) ) {
+				continue;
+			};
+			const double d = a-b;
+			m.n		+= 1;
+			m.ssd	+= d*d;
+			m.ab	+= a*b;
+			m.aa	+= a*a;
+			m.bb	+= b*b;
+			m.maxA	 = (a>m.maxA) ? a : m.maxA;
+			m.maxB	 = (b>m.maxB) ? b : m.maxB;
+		};
+	};
+
+	/*
+	 *	AccumulateHistograms()
+	 *
+	 *	Second read of a frame: joint histograms of the rescaled
+	 *	intensities, floor(x/max(x)*nBins), as in mi.m and nmi.m
+	 */
+	void AccumulateHistograms(const TPixel* frame, size_t begin, size_t end,
+							  double maxA, double maxB, RegMetricWorkspace &ws) const
+	{
+		const bool	 isMi	= (metrics & MetricMI)!=0;
+		const bool	 isNmi	= (metrics & MetricNMI)!=0;
+		for(size_t idx=begin; idx<end; idx++) {
+			const double a = static_cast<double>(reference[idx]);
+			const double b = static_cast<double>(frame[idx]);
+			if( IsIgnored(a,b) ) {
+				continue;
+			};
+			if( isMi ) {
+				const size_t i = static_cast<size_t>(a/maxA*miBins);
+				const size_t j = static_cast<size_t>(b/maxB*miBins);
+				ws.miHist[i + j*(miBins+1)]++;
+			};
+			if( isNmi ) {
+				const size_t i = static_cast<size_t>(a/maxA*nmiBins);
+				const size_t j = static_cast<size_t>(b/maxB*nmiBins);
+				ws.nmiHist[i + j*(nmiBins+1)]++;
+			};
+		};
+	};
+
+	/*
+	 *	GetSpatialColumns()
+	 *
+	 *	Number of "columns" (sets of neighbourhoods sharing the outer
+	 *	indices) used by the spatial MI. In 2D a column is the set of
+	 *	interior pixels of image column j. In 3D, smi.m uses the (i,k)
+	 *	plane for every j, so a column is indexed by (j,k)
+	 */
+	size_t GetSpatialColumns() const
+	{
+		if( (dims.size()<2) || (dims[0]<3) || (dims[1]<3) ) {
+			return 0;
+		};
+		if( (dims.size()==2) || (dims.size()==3 && dims[2]==1) ) {
+			return dims[1]-2;
+		};
+		if( (dims.size()==3) && (dims[2]>=3) ) {
+			return dims[1]*(dims[2]-2);
+		};
+		return 0;
+	};
+
+	/*
+	 *	AccumulateSpatial()
+	 *
+	 *	Sums and outer products of the 18 element neighbourhood vectors
+	 *	of smi.m for the spatial columns [begin,end)
+	 */
+	void AccumulateSpatial(const TPixel* frame, size_t begin, size_t end, RegMetricWorkspace &ws) const
+	{
+		const size_t m0		= dims[0];
+		const size_t m1		= dims[1];
+		const bool	 is3D	= (dims.size()==3) && (dims[2]>1);
+		double		 p[smiDim];
+
+		for(size_t col=begin; col<end; col++) {
+			for(size_t i=1; i+1<m0; i++) {
+
+				/*	Gather the neighbourhoods of both images	*/
+				unsigned int n = 0;
+				for(int u=-1; u<=1; u++) {
+					for(int v=-1; v<=1; v++, n++) {
+						size_t idx;
+						if( is3D ) {
+							const size_t j = col % m1;
+							const size_t k = col / m1 + 1;
+							idx = (i+u) + m0*(j + m1*(k+v));
+						}
+						else {
+							idx = (i+u) + m0*(col+1+v);
+						};
+						p[n]		= static_cast<double>(reference[idx]);
+						p[n+9]		= static_cast<double>(frame[idx]);
+					};
+				};
+
+				/*	Accumulate (upper triangle only)	*/
+				for(unsigned int r=0; r<smiDim; r++) {
+					ws.smiSum[r] += p[r];
+					double* row = ws.smiOuter + r*smiDim;
+					for(unsigned int c=r; c<smiDim; c++) {
+						row[c] += p[r]*p[c];
+					};
+				};
+				ws.smiCount += 1;
+			};
+		};
+	};
+
+	/*
+	 *	EvaluateFrameSerial()
+	 *
+	 *	Computes all requested measures of a single frame on the calling
+	 *	thread using the provided workspace
+	 */
+	void EvaluateFrameSerial(const TPixel* frame, RegMetricWorkspace &ws, RegMetricValues &out) const
+	{
+		ws.Reset();
+		AccumulateMoments(frame, 0, nVoxels, ws.moments);
+		if( (metrics & (MetricMI|MetricNMI)) && IsValid(ws.moments) ) {
+			AccumulateHistograms(frame, 0, nVoxels, ws.moments.maxA, ws.moments.maxB, ws);
+		};
+		if( metrics & MetricSMI ) {
+			AccumulateSpatial(frame, 0, GetSpatialColumns(), ws);
+		};
+		Finalize(ws, out);
+	};
+
+	/*
+	 *	EvaluateFrameParallel()
+	 *
+	 *	Computes all requested measures of a single frame by splitting the
+	 *	voxels into blocks shared by all threads
+	 */
+	void EvaluateFrameParallel(const TPixel* frame, RegMetricValues &out, unsigned int nWorkers) const
+	{
+		std::vector<RegMetricWorkspace> ws( GetNumberOfParallelSlots(nVoxels,blockSize,nWorkers) );
+		for(size_t idx=0; idx<ws.size(); idx++) {
+			AllocateWorkspace(ws[idx]);
+		};
+
+		/*	Moments	*/
+		ParallelFor(nVoxels, blockSize, [&](size_t begin, size_t end, unsigned int threadId) {
+			AccumulateMoments(frame, begin, end, ws[threadId].moments);
+		}, nWorkers);
+		for(size_t idx=1; idx<ws.size(); idx++) {
+			ws[0].moments.Merge(ws[idx].moments);
+		};
+		const RegMetricMoments &m = ws[0].moments;
+
+		/*	Joint histograms	*/
+		if( (metrics & (MetricMI|MetricNMI)) && IsValid(m) ) {
+			ParallelFor(nVoxels, blockSize, [&](size_t begin, size_t end, unsigned int threadId) {
+				AccumulateHistograms(frame, begin, end, m.maxA, m.maxB, ws[threadId]);
+			}, nWorkers);
+			for(size_t idx=1; idx<ws.size(); idx++) {
+				for(size_t bin=0; bin<ws[0].miHist.size(); bin++) {
+					ws[0].miHist[bin] += ws[idx].miHist[bin];
+				};
+				for(size_t bin=0; bin<ws[0].nmiHist.size(); bin++) {
+					ws[0].nmiHist[bin] += ws[idx].nmiHist[bin];
+				};
+			};
+		};
+
+		/*	Spatial MI	*/
+		if( metrics & MetricSMI ) {
+			const size_t nCols	= GetSpatialColumns();
+			const size_t chunk	= (dims[0]>0) ? std::max<size_t>(1, blockSize/dims[0]) : 1;
+			ParallelFor(nCols, chunk, [&](size_t begin, size_t end, unsigned int threadId) {
+				AccumulateSpatial(frame, begin, end, ws[threadId]);
+			}, nWorkers);
+			for(size_t idx=1; idx<ws.size(); idx++) {
+				for(unsigned int r=0; r<smiDim; r++) {
+					ws[0].smiSum[r] += ws[idx].smiSum[r];
+				};
+				for(unsigned int r=0; r<smiDim*smiDim; r++) {
+					ws[0].smiOuter[r] += ws[idx].smiOuter[r];
+				};
+				ws[0].smiCount += ws[idx].smiCount;
+			};
+		};
+
+		Finalize(ws[0], out);
+	};
+
+	/*
+	 *	IsValid()
+	 *
+	 *	Equivalent to the "~any(im1(:)) || ~any(im2(:))" test of the
+	 *	MATLAB code (all usable values are non-negative)
+	 */
+	static bool IsValid(const RegMetricMoments &m)
+	{
+		return (m.n>0) && (m.maxA>0) && (m.maxB>0);
+	};
+
+	/*
+	 *	Entropy()
+	 *
+	 *	Joint and marginal (base 2) entropies of a joint histogram
+	 */
+	static void Entropy(const std::vector<unsigned int> &hist, unsigned int nBins, double n,
+						double &h1, double &h2, double &h12)
+	{
+		const size_t		dim = nBins+1;
+		std::vector<double>	p1(dim, 0.0), p2(dim, 0.0);
+		h12 = 0;
+		for(size_t j=0; j<dim; j++) {
+			for(size_t i=0; i<dim; i++) {
+				const unsigned int c = hist[i+j*dim];
+				if( c ) {
+					const double p = c/n;
+					h12	  -= p*std::log2(p);
+					p1[i] += p;
+					p2[j] += p;
+				};
+			};
+		};
+		h1 = 0;
+		h2 = 0;
+		for(size_t i=0; i<dim; i++) {
+			h1 -= (p1[i]>0) ? p1[i]*std::log2(p1[i]) : 0;
+			h2 -= (p2[i]>0) ? p2[i]*std::log2(p2[i]) : 0;
+		};
+	};
+
+	/*
+	 *	LogDeterminant()
+	 *
+	 *	Natural logarithm of the determinant of the n-by-n leading block
+	 *	(starting at "offset") of a symmetric matrix using an LU
+	 *	decomposition with partial pivoting. NaN is returned for singular
+	 *	or non-positive determinants
+	 */
+	static double LogDeterminant(const double* C, unsigned int offset, unsigned int n)
+	{
+		double A[smiDim*smiDim];
+		for(unsigned int r=0; r<n; r++) {
+			for(unsigned int c=0; c<n; c++) {
+				A[r*n+c] = C[(r+offset)*smiDim + (c+offset)];
+			};
+		};
+
+		double logDet = 0;
+		int	   sign	  = 1;
+		for(unsigned int k=0; k<n; k++) {
+			unsigned int pivot = k;
+			for(unsigned int r=k+1; r<n; r++) {
+				if( std::fabs(A[r*n+k])>std::fabs(A[pivot*n+k]) ) {
+					pivot = r;
+				};
+			};
+			if( A[pivot*n+k]==0 ) {
+				return std::numeric_limits<double>::quiet_NaN();
+			};
+			if( pivot!=k ) {
+				for(unsigned int c=0; c<n; c++) {
+					std::swap(A[k*n+c], A[pivot*n+c]);
+				};
+				sign = -sign;
+			};
+			const double diag = A[k*n+k];
+			sign	= (diag<0) ? -sign : sign;
+			logDet += std::log(std::fabs(diag));
+			for(unsigned int r=k+1; r<n; r++) {
+				const double f = A[r*n+k]/diag;
+				for(unsigned int c=k+1; c<n; c++) {
+					A[r*n+c] -= f*A[k*n+c];
+				};
+			};
+		};
+
+		return (sign>0) ? logDet : std::numeric_limits<double>::quiet_NaN();
+	};
+
+	/*
+	 *	Finalize()
+	 *
+	 *	Converts the accumulated sums to the similarity measures
+	 */
+	void Finalize(const RegMetricWorkspace &ws, RegMetricValues &out) const
+	{
+		const double			 inf	= std::numeric_limits<double>::infinity();
+		const double			 nan	= std::numeric_limits<double>::quiet_NaN();
+		const RegMetricMoments	&m		= ws.moments;
+		const bool				 valid	= IsValid(m);
+
+		for(unsigned int idx=0; idx<regMetricCount; idx++) {
+			out.value[idx] = nan;
+		};
+
+		if( metrics & MetricSSD ) {
+			out.value[0] = valid ? m.ssd : inf;
+		};
+		if( metrics & MetricMSD ) {
+			out.value[1] = valid ? m.ssd/m.n : inf;
+		};
+		if( metrics & MetricNCC ) {
+			out.value[2] = valid ? 1 - (m.ab*m.ab/m.bb)/m.aa : inf;
+		};
+		if( metrics & MetricMI ) {
+			double h1, h2, h12;
+			if( valid ) {
+				Entropy(ws.miHist, miBins, m.n, h1, h2, h12);
+				out.value[3] = -(h1 + h2 - h12);
+			}
+			else {
+				out.value[3] = inf;
+			};
+		};
+		if( metrics & MetricNMI ) {
+			double h1, h2, h12;
+			if( valid ) {
+				Entropy(ws.nmiHist, nmiBins, m.n, h1, h2, h12);
+				out.value[4] = -(h1 + h2)/h12;
+			}
+			else {
+				out.value[4] = inf;
+			};
+		};
+		if( (metrics & MetricSMI) && (ws.smiCount>0) ) {
+
+			/*	Covariance of the mean subtracted neighbourhood vectors. As
+			 *	in smi.m, the normalization uses the number of voxels	*/
+			double C[smiDim*smiDim];
+			for(unsigned int r=0; r<smiDim; r++) {
+				for(unsigned int c=r; c<smiDim; c++) {
+					const double v = ( ws.smiOuter[r*smiDim+c] - ws.smiSum[r]*ws.smiSum[c]/ws.smiCount ) / nVoxels;
+					C[r*smiDim+c] = v;
+					C[c*smiDim+r] = v;
+				};
+			};
+
+			/*	Gaussian entropies. Note that smi.m uses the full dimension
+			 *	(d=18) in the constant term of all three entropies	*/
+			const double d		= smiDim;
+			const double konst	= 0.5*d*std::log(2*3.14159265358979323846*std::exp(1.0));
+			const double hg		= konst + 0.5*LogDeterminant(C, 0, smiDim);
+			const double hg1	= konst + 0.5*LogDeterminant(C, 0, smiDim/2);
+			const double hg2	= konst + 0.5*LogDeterminant(C, smiDim/2, smiDim/2);
+			out.value[5] = -(hg1 + hg2 - hg);
+		};
+	};
+};
+
+
+#endif
@@ -0,0 +1,206 @@
+/*
+ *	reg_metrics.cxx
+ *
+ *	MEX front end of the registration quality metric engine (see
+ *	RegMetrics.h)
+ *
+ *	S = reg_metrics(REF,IMGS) computes the similarity measures of the
+ *	images IMGS against the reference image REF. IMGS is either the same
+ *	size as REF (image pair) or has one additional trailing dimension
+ *	indexing the frames of a series. S is a structure with the fields
+ *	"ssd", "msd", "ncc", "mi", "nmi" and "smi", each a 1-by-N array of
+ *	values for the N frames, computed as in Registration/metrics.
+ *
+ *	S = reg_metrics(...,'PropertyName1',PropertyValue1,...) uses the
+ *	options specified by the property/value pairs:
+ *
+ *		Option String		Description
+ *		-------------------------------
+ *
+ *		Metrics				Cell array of metric names (or a single
+ *							name) to compute. Default: all metrics
+ *
+ *		NumberOfBins		Number of bins for the joint density of mi
+ *							and nmi (default: 256 and 255 respectively,
+ *							as in mi.m and nmi.m)
+ *
+ *		NumberOfThreads		Number of worker threads (default: all cores)
+ *
+ *	REF and IMGS must be of the same class (double, single, int16 or
+ *	uint16).
+ */
+
+
+/*	C++ headers	*/
+#include <cstring>
+#include <string>
+#include <vector>
+
+/*	MATLAB headers	*/
+#include "mex.h"
+
+/*	QUATTRO headers	*/
+#include "RegMetrics.h"
+
+
+/*
+ *	ParseMetricName()
+ *
+ *	Converts a metric name to the corresponding regMetricFlag
+ */
+static unsigned int ParseMetricName(const mxArray* name)
+{
+	char* str = mxArrayToString(name);
+	if( !str ) {
+		mexErrMsgIdAndTxt("QUATTRO:reg_metrics:invalidMetric",
+						  "Metric names must be strings");
+	};
+	unsigned int flag = 0;
+	for(unsigned int idx=0; idx<regMetricCount; idx++) {
+		if( !strcmp(str, regMetricNames[idx]) ) {
+			flag = 1u << idx;
+		};
+	};
+	mxFree(str);
+	if( !flag ) {
+		mexErrMsgIdAndTxt("QUATTRO:reg_metrics:invalidMetric",
+						  "Unknown metric. Valid metrics are: ssd, msd, ncc, mi, nmi, smi");
+	};
+	return flag;
+};
+
+
+/*
+ *	EvaluateMetrics()
+ *
+ *	Runs the engine for a specific pixel type
+ */
+template <class TPixel>
+void EvaluateMetrics(const mxArray* ref, const mxArray* imgs, const std::vector<size_t> &dims,
+					 size_t nFrames, unsigned int metrics, unsigned int nBins,
+					 unsigned int nThreads, std::vector<RegMetricValues> &values)
+{
+	RegMetricEngine<TPixel> engine(static_cast<const TPixel*>( mxGetData(ref) ), dims);
+	engine.SetMetrics(metrics);
+	engine.SetNumberOfThreads(nThreads);
+	if( nBins>0 ) {
+		engine.SetNumberOfBins(nBins, nBins);
+	};
+	engine.Evaluate(static_cast<const TPixel*>( mxGetData(imgs) ), nFrames, &values[0]);
+};
+
+
+void mexFunction(int nlhs, mxArray *plhs[], int nrhs, const mxArray *prhs[])
+{
+
+	/*	Validate the inputs	*/
+	if( nrhs<2 ) {
+		mexErrMsgIdAndTxt("QUATTRO:reg_metrics:tooFewInputs",
+						  "Two images are required");
+	};
+	if( (nrhs-2)%2 ) {
+		mexErrMsgIdAndTxt("QUATTRO:reg_metrics:invalidOptions",
+						  "Options must be property/value pairs");
+	};
+	const mxArray* ref	= prhs[0];
+	const mxArray* imgs	= prhs[1];
+	if( mxGetClassID(ref)!=mxGetClassID(imgs) || mxIsComplex(ref) || mxIsComplex(imgs) ) {
+		mexErrMsgIdAndTxt("QUATTRO:reg_metrics:invalidImageClass",
+						  "REF and IMGS must be real arrays of the same class");
+	};
+
+	/*	Parse the options	*/
+	unsigned int metrics	= MetricAll;
+	unsigned int nBins		= 0;
+	unsigned int nThreads	= 0;
+	for(int idx=2; idx<nrhs; idx+=2) {
+		char* prop = mxArrayToString(prhs[idx]);
+		if( !prop ) {
+			mexErrMsgIdAndTxt("QUATTRO:reg_metrics:invalidOptions",
+							  "Property names must be strings");
+		};
+		std::string name(prop);
+		mxFree(prop);
+		if( name=="Metrics" ) {
+			metrics = 0;
+			if( mxIsCell(prhs[idx+1]) ) {
+				for(size_t cIdx=0; cIdx<mxGetNumberOfElements(prhs[idx+1]); cIdx++) {
+					metrics |= ParseMetricName( mxGetCell(prhs[idx+1],cIdx) );
+				};
+			}
+			else {
+				metrics = ParseMetricName(prhs[idx+1]);
+			};
+		}
+		else if( name=="NumberOfBins" ) {
+			nBins = static_cast<unsigned int>( mxGetScalar(prhs[idx+1]) );
+		}
+		else if( name=="NumberOfThreads" ) {
+			nThreads = static_cast<unsigned int>( mxGetScalar(prhs[idx+1]) );
+		}
+		else {
+			mexErrMsgIdAndTxt("QUATTRO:reg_metrics:invalidOptions",
+							  "Unknown property: %s", name.c_str());
+		};
+	};
+
+	/*	Determine the number of frames. IMGS must match REF in all
+	 *	dimensions, optionally with an additional frame dimension	*/
+	const mwSize	nRefDims = mxGetNumberOfDimensions(ref);
+	const mwSize*	refDims	 = mxGetDimensions(ref);
+	std::vector<size_t> dims(refDims, refDims+nRefDims);
+	while( (dims.size()>2) && (dims.back()==1) ) {
+		dims.pop_back();
+	};
+	const size_t nVoxels = mxGetNumberOfElements(ref);
+	const size_t nTotal	 = mxGetNumberOfElements(imgs);
+	if( (nVoxels==0) || (nTotal%nVoxels) ) {
+		mexErrMsgIdAndTxt("QUATTRO:reg_metrics:invalidImageSize",
+						  "IMGS must contain an integer number of frames the size of REF");
+	};
+	const size_t nFrames = nTotal/nVoxels;
+
+	/*	Compute the metrics	*/
+	std::vector<RegMetricValues> values(nFrames);
+	try {
+		switch( mxGetClassID(ref) ) {
+		case mxDOUBLE_CLASS:
+			EvaluateMetrics<double>(ref, imgs, dims, nFrames, metrics, nBins, nThreads, values);
+			break;
+		case mxSINGLE_CLASS:
+			EvaluateMetrics<float>(ref, imgs, dims, nFrames, metrics, nBins, nThreads, values);
+			break;
+		case mxINT16_CLASS:
+			EvaluateMetrics<short>(ref, imgs, dims, nFrames, metrics, nBins, nThreads, values);
+			break;
+		case mxUINT16_CLASS:
+			EvaluateMetrics<unsigned short>(ref, imgs, dims, nFrames, metrics, nBins, nThreads, values);
+			break;
+		default:
+			mexErrMsgIdAndTxt("QUATTRO:reg_metrics:invalidImageClass",
+							  "Unsupported image class. Use double, single, int16 or uint16");
+		};
+	}
+	catch( std::exception &err ) {
+		mexErrMsgIdAndTxt("QUATTRO:reg_metrics:engineFailure", "%s", err.what());
+	};
+
+	/*	Create the output structure (only the requested fields)	*/
+	std::vector<const char*> fieldNames;
+	std::vector<unsigned int> fieldIdx;
+	for(unsigned int idx=0; idx<regMetricCount; idx++) {
+		if( metrics & (1u << idx) ) {
+			fieldNames.push_back(regMetricNames[idx]);
+			fieldIdx.push_back(idx);
+		};
+	};
+	plhs[0] = mxCreateStructMatrix(1, 1, static_cast<int>(fieldNames.size()), &fieldNames[0]);
+	for(size_t fIdx=0; fIdx<fieldIdx.size(); fIdx++) {
+		mxArray* field	= mxCreateDoubleMatrix(1, nFrames, mxREAL);
+		double*	 data	= mxGetPr(field);
+		for(size_t frame=0; frame<nFrames; frame++) {
+			data[frame] = values[frame].value[ fieldIdx[fIdx] ];
+		};
+		mxSetField(plhs[0], 0, fieldNames[fIdx], field);
+	};
+};